@@ -0,0 +1,217 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "md3_parse.h"
+#include "world.h"
+#include "anim_sched.h"
+
+static void anim_sched_sift_up(struct anim_sched_t* s, int place);
+static void anim_sched_sift_down(struct anim_sched_t* s, int place);
+
+/*
+ *	Free the heap; the instances in it are left alone.
+ */
+void
+anim_sched_free(struct anim_sched_t* s)
+{
+  int i = 0;
+
+  for (; i < s->num; ++i)
+    s->insts[i]->sched = NULL;
+
+  free(s->heap);
+  free(s->insts);
+  free(s->places);
+  memset(s, 0, sizeof(struct anim_sched_t));
+}
+
+/*
+ *	Add an instance to a scheduler, due at once.
+ */
+void
+anim_sched_add(struct anim_sched_t* s, md3_instance_t* inst)
+{
+  int id;
+
+  if (inst->sched)
+    anim_sched_remove(inst);
+
+  if (s->num == s->size)
+  {
+    s->size = (s->size ? (s->size * 2) : 64);
+    s->heap = (struct anim_sched_entry_t*)realloc(s->heap, (sizeof(struct anim_sched_entry_t) * s->size));
+    s->insts = (md3_instance_t**)realloc(s->insts, (sizeof(md3_instance_t*) * s->size));
+    s->places = (int*)realloc(s->places, (sizeof(int) * s->size));
+  }
+
+  id = s->num++;
+  inst->sched = s;
+  inst->sched_id = id;
+  inst->anim_due = 0.0;
+  s->insts[id] = inst;
+
+  s->heap[id].due = inst->anim_due;
+  s->heap[id].id = id;
+  s->places[id] = id;
+  anim_sched_sift_up(s, id);
+}
+
+/*
+ *	Take an instance out of its scheduler, if it is in one.
+ */
+void
+anim_sched_remove(md3_instance_t* inst)
+{
+  struct anim_sched_t* s = inst->sched;
+  int id = inst->sched_id;
+  int place, last;
+
+  if (!s)
+    return;
+
+  inst->sched = NULL;
+  place = s->places[id];
+  last = --s->num;
+
+  /* the last entry of the heap fills the hole, and moves whichever way it must */
+  if (place != last)
+  {
+    s->heap[place] = s->heap[last];
+    s->places[s->heap[place].id] = place;
+    anim_sched_sift_up(s, place);
+    anim_sched_sift_down(s, s->places[s->heap[place].id]);
+  }
+
+  /* and the last id takes over the freed one */
+  if (id != last)
+  {
+    s->insts[id] = s->insts[last];
+    s->insts[id]->sched_id = id;
+    s->places[id] = s->places[last];
+    s->heap[s->places[id]].id = id;
+  }
+}
+
+/*
+ *	Put an instance back in order after its anim_due changed.
+ */
+void
+anim_sched_update(md3_instance_t* inst)
+{
+  struct anim_sched_t* s = inst->sched;
+  int place;
+
+  if (!s)
+    return;
+
+  place = s->places[inst->sched_id];
+  s->heap[place].due = inst->anim_due;
+  anim_sched_sift_up(s, place);
+  anim_sched_sift_down(s, s->places[inst->sched_id]);
+}
+
+/*
+ *	Advance every instance due by now, in clock time.
+ *
+ *	Each is advanced at most once, so an instance that stays due
+ *	cannot hold up the frame.  Returns the number advanced.
+ */
+int
+anim_sched_tick(struct anim_sched_t* s, struct world_t* wptr, double now)
+{
+  md3_instance_t* inst = NULL;
+  int left = s->num;
+
+  s->advanced = 0;
+  while (s->num && (s->heap[0].due <= now) && left--)
+  {
+    inst = s->insts[s->heap[0].id];
+    if (inst->anim_state.animated)
+    {
+      world_tick_model(wptr, inst, now);
+      ++s->advanced;
+    }
+    else
+    {
+      /* stopped; due again when an animation is set */
+      inst->anim_due = s->heap[0].due = HUGE_VAL;
+      anim_sched_sift_down(s, 0);
+    }
+  }
+
+  return s->advanced;
+}
+
+/*
+ *	Move the entry at place up to where it is due no earlier than
+ *	its parent.
+ */
+static void
+anim_sched_sift_up(struct anim_sched_t* s, int place)
+{
+  struct anim_sched_entry_t entry = s->heap[place];
+  int parent;
+
+  while (place > 0)
+  {
+    parent = ((place - 1) / ANIM_SCHED_ARITY);
+    if (s->heap[parent].due <= entry.due)
+      break;
+
+    s->heap[place] = s->heap[parent];
+    s->places[s->heap[place].id] = place;
+    place = parent;
+  }
+  s->heap[place] = entry;
+  s->places[entry.id] = place;
+}
+
+/*
+ *	Move the entry at place down to where it is due no later than
+ *	its children.
+ */
+static void
+anim_sched_sift_down(struct anim_sched_t* s, int place)
+{
+  struct anim_sched_entry_t entry = s->heap[place];
+  int child, first, last;
+
+  for (;;)
+  {
+    first = ((place * ANIM_SCHED_ARITY) + 1);
+    if (first >= s->num)
+      break;
+
+    /* the earliest child */
+    last = (((first + ANIM_SCHED_ARITY) < s->num) ? (first + ANIM_SCHED_ARITY) : s->num);
+    for (child = first++; first < last; ++first)
+      if (s->heap[first].due < s->heap[child].due)
+        child = first;
+    if (entry.due <= s->heap[child].due)
+      break;
+
+    s->heap[place] = s->heap[child];
+    s->places[s->heap[place].id] = place;
+    place = child;
+  }
+  s->heap[place] = entry;
+  s->places[entry.id] = place;
+}
@@ -0,0 +1,88 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _ANIM_SCHED_H
+#define _ANIM_SCHED_H
+
+#include "md3_parse.h"
+
+/*
+ *	Animation scheduler.
+ *
+ *	A min-heap of instances by md3_instance_t::anim_due, the time
+ *	each next needs more than its blend moved: its next key frame,
+ *	at its animation's fps, or the next update its animation level
+ *	of detail allows.  anim_sched_tick() advances only the instances
+ *	that are due, so thousands of animated instances cost nothing
+ *	between their key frames unless they are drawn.
+ *
+ *	world_tick_model() keeps the heap in order when it advances an
+ *	instance itself, and before anim_due only sets the blend from
+ *	the time of the frame.
+ *
+ *	The world's instances are in the world's scheduler, ticked with
+ *	the animations, on the simulation thread while there is one; the
+ *	crowd's copies are in the crowd's, ticked on the GUI thread.  An
+ *	instance is in at most one.  A zeroed scheduler is empty.
+ */
+
+/*
+ *	Children of each entry of the heap; four keeps it half as deep
+ *	as two, for a few more comparisons on the way down.
+ */
+#define ANIM_SCHED_ARITY 4
+
+/*
+ *	An instance in the heap, by its id in the scheduler, with a copy
+ *	of its anim_due so the heap is kept in order without touching
+ *	the instances.
+ */
+struct anim_sched_entry_t
+{
+  double due;
+  int id;
+};
+
+struct anim_sched_t
+{
+  struct anim_sched_entry_t* heap; /* the earliest due first				*/
+  md3_instance_t** insts;          /* by id								*/
+  int* places;                     /* where each id is in the heap			*/
+  int num;                         /* ids are 0 to num - 1					*/
+  int size;
+  int advanced;                    /* by the last anim_sched_tick()			*/
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  void anim_sched_free(struct anim_sched_t* s);
+
+  void anim_sched_add(struct anim_sched_t* s, md3_instance_t* inst);
+  void anim_sched_remove(md3_instance_t* inst);
+  void anim_sched_update(md3_instance_t* inst);
+
+  int anim_sched_tick(struct anim_sched_t* s, struct world_t* wptr, double now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ANIM_SCHED_H */
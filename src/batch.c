@@ -0,0 +1,400 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+#include "definitions.h"
+#include "util.h"
+#include "md3_parse.h"
+#include "world.h"
+#include "render.h"
+#include "thread.h"
+#include "headless.h"
+#include "batch.h"
+
+/*
+ *	Shared by the workers of a run.
+ */
+struct batch_shared_t
+{
+  int next;   /* next file to draw			*/
+  int images; /* images written so far		*/
+};
+
+static md3_instance_t* batch_load(struct batch_t* b, char* file);
+static void batch_pin(struct batch_t* b, md3_instance_t* inst);
+static void batch_pose(struct batch_t* b, int anim);
+static int batch_draw(struct batch_t* b, struct headless_t* h, char* file);
+static int batch_turntable(struct batch_t* b, struct headless_t* h, char* name);
+static int batch_contact_sheet(struct batch_t* b, struct headless_t* h, char* name);
+
+/*
+ *	Read the list of files to draw, one per line.
+ *	Empty lines and lines starting with '#' are skipped.
+ *
+ *	Returns NULL if the list could not be read.
+ */
+struct batch_t*
+batch_new(char* list)
+{
+  struct batch_t* b = NULL;
+  FILE* fptr = NULL;
+  char buf[1024];
+
+  fptr = fopen(list, "r");
+  if (!fptr)
+  {
+    printf("Error: Could not open %s.\n", list);
+    return NULL;
+  }
+
+  b = (struct batch_t*)malloc(sizeof(struct batch_t));
+  memset(b, 0, sizeof(struct batch_t));
+  b->world = world_init(NULL);
+  b->out_dir = (char*)".";
+  b->width = 256;
+  b->height = 256;
+
+  while (fgets(buf, sizeof(buf), fptr))
+  {
+    strip_lf(buf);
+    if (!buf[0] || (buf[0] == '#'))
+      continue;
+
+    b->files = (char**)realloc(b->files, (sizeof(char*) * (b->num_files + 1)));
+    b->files[b->num_files++] = strdup(buf);
+  }
+
+  fclose(fptr);
+  return b;
+}
+
+/*
+ *	Free a batch.
+ */
+void
+batch_free(struct batch_t* b)
+{
+  int i = 0;
+
+  for (; i < b->num_files; ++i)
+    free(b->files[i]);
+  free(b->files);
+  world_free(b->world);
+  free(b);
+}
+
+/*
+ *	Load every file once and keep the model data in the world's
+ *	cache, for the workers to find.  Needs no GL context.
+ *	Files that do not load are taken off the list.
+ *
+ *	Returns the number of files that loaded.
+ */
+int
+batch_preload(struct batch_t* b)
+{
+  md3_instance_t* root = NULL;
+  int loaded = 0;
+  int i = 0;
+
+  for (; i < b->num_files; ++i)
+  {
+    root = batch_load(b, b->files[i]);
+    if (!root)
+    {
+      printf("Error: Could not load %s.\n", b->files[i]);
+      free(b->files[i]);
+      continue;
+    }
+
+    batch_pin(b, root);
+    unload_model(b->world, root, 1);
+    b->files[loaded++] = b->files[i];
+  }
+
+  b->num_files = loaded;
+  return loaded;
+}
+
+/*
+ *	Draw the batch with the given number of worker processes.
+ *	msec is set to the time it took.
+ *
+ *	Returns the number of images written.
+ */
+int
+batch_run(struct batch_t* b, int workers, double* msec)
+{
+#ifdef _WIN32
+  printf("Error: Batch rendering needs fork() and EGL.\n");
+  *msec = 0;
+  return 0;
+#else
+  struct batch_shared_t* shared = NULL;
+  struct headless_t* h = NULL;
+  double start = get_time_in_ms();
+  int images = 0;
+  int started = 0;
+  int i = 0;
+  pid_t pid;
+
+  shared = (struct batch_shared_t*)mmap(NULL, sizeof(struct batch_shared_t), (PROT_READ | PROT_WRITE), (MAP_SHARED | MAP_ANONYMOUS), -1, 0);
+  if (shared == MAP_FAILED)
+  {
+    printf("Error: Could not share memory with the workers.\n");
+    *msec = 0;
+    return 0;
+  }
+  memset(shared, 0, sizeof(struct batch_shared_t));
+
+  /* or the workers print what is buffered again */
+  fflush(stdout);
+
+  for (; started < workers; ++started)
+  {
+    pid = fork();
+    if (pid < 0)
+    {
+      printf("Error: Could only start %i workers.\n", started);
+      break;
+    }
+    if (pid)
+      continue;
+
+    /*
+     *	A worker; GL is only touched after the fork, so each
+     *	process has a driver and context of its own.
+     */
+    h = headless_new(b->width, b->height);
+    if (h)
+    {
+      render_setup(b->world);
+      while ((i = (ATOMIC_ADD(&shared->next, 1) - 1)) < b->num_files)
+        ATOMIC_ADD(&shared->images, batch_draw(b, h, b->files[i]));
+      headless_free(h);
+    }
+
+    fflush(stdout);
+    _exit(0);
+  }
+
+  for (; started > 0; --started)
+    wait(NULL);
+
+  *msec = (get_time_in_ms() - start);
+  images = shared->images;
+  munmap(shared, sizeof(struct batch_shared_t));
+  return images;
+#endif
+}
+
+/*
+ *	Load a model file and make it the root of the world.
+ *	A lone md3 file is loaded like a weapon, with nothing to hold it.
+ */
+static md3_instance_t*
+batch_load(struct batch_t* b, char* file)
+{
+  md3_instance_t* inst = NULL;
+  size_t len = strlen(file);
+  char* prefix = NULL;
+
+  if ((len > 4) && !strcmp(&file[len - 4], ".mod"))
+    return load_model(b->world, file);
+
+  prefix = get_models_root(file);
+  inst = load_weapon(b->world, file, prefix);
+  free(prefix);
+
+  if (inst)
+    b->world->root_instance = inst;
+  return inst;
+}
+
+/*
+ *	Keep the model data of an instance tree in the cache
+ *	after the instances are gone.
+ */
+static void
+batch_pin(struct batch_t* b, md3_instance_t* inst)
+{
+  int i = 0;
+
+  world_using_model(b->world, inst->model);
+
+  for (; i < inst->num_links; ++i)
+  {
+    if (inst->links[i])
+      batch_pin(b, inst->links[i]);
+  }
+}
+
+/*
+ *	Play an animation with the other body part idle and hold
+ *	every part halfway through what it plays; -1 for the idle
+ *	animations at their first frame.
+ */
+static void
+batch_pose(struct batch_t* b, int anim)
+{
+  struct world_link_instances_t* li = NULL;
+  md3_instance_t* m = NULL;
+
+  set_model_animation(b->world, LEGS_IDLE);
+  set_model_animation(b->world, TORSO_STAND);
+  if (anim >= 0)
+    set_model_animation(b->world, (md3_animations_e)anim);
+
+  for (li = b->world->instances; li; li = li->next)
+  {
+    m = li->instance;
+    if (m->anim_state.animated)
+      world_hold_instance_animation(b->world, m, ((anim >= 0) ? (m->model->anims[m->anim_state.id].frames / 2.0f) : 0.0f));
+  }
+}
+
+/*
+ *	Draw the images of one file.
+ *
+ *	Returns the number of images written.
+ */
+static int
+batch_draw(struct batch_t* b, struct headless_t* h, char* file)
+{
+  md3_instance_t* root = batch_load(b, file);
+  char name[256];
+  char* s = NULL;
+  int images = 0;
+
+  if (!root)
+  {
+    printf("Error: Could not load %s.\n", file);
+    return 0;
+  }
+
+  /* images are named after the file */
+  s = (strrchr(file, '/') ? strrchr(file, '/') : strrchr(file, '\\'));
+  snprintf(name, sizeof(name), "%s", (s ? (s + 1) : file));
+  s = strrchr(name, '.');
+  if (s)
+    *s = '\0';
+
+  if (b->turntable)
+    images += batch_turntable(b, h, name);
+  if (b->contact_sheet)
+    images += batch_contact_sheet(b, h, name);
+
+  unload_model(b->world, root, 1);
+  return images;
+}
+
+/*
+ *	Draw views from all around the model, standing idle.
+ */
+static int
+batch_turntable(struct batch_t* b, struct headless_t* h, char* name)
+{
+  char file[1024];
+  int images = 0;
+  int i = 0;
+
+  if (!headless_resize(h, b->width, b->height))
+    return 0;
+  render_viewport(b->world, b->width, b->height);
+
+  batch_pose(b, -1);
+
+  for (; i < b->turntable; ++i)
+  {
+    b->world->camera.trot = (DEFAULT_CAMERA_TROT + ((360.0 * i) / b->turntable));
+    render_view(b->world);
+    render_c(b->world);
+
+    snprintf(file, sizeof(file), "%s%c%s_turn%02i.tga", b->out_dir, OS_PATH_DELIM, name, i);
+    images += headless_save(h, file);
+  }
+
+  init_camera(&b->world->camera);
+  return images;
+}
+
+/*
+ *	Draw every animation the model has on one image, in a grid
+ *	of cells read left to right and top to bottom in the order
+ *	of animation.cfg.
+ */
+static int
+batch_contact_sheet(struct batch_t* b, struct headless_t* h, char* name)
+{
+  md3_instance_t* torso = world_get_instance_by_type(b->world, MD3_TORSO);
+  md3_instance_t* legs = world_get_instance_by_type(b->world, MD3_LEGS);
+  md3_anim_names_t* inf = NULL;
+  int anims[MD3_MAX_ANIMS];
+  int num_anims = 0;
+  int cols, rows;
+  char file[1024];
+  int id = 0;
+  int i = 0;
+
+  for (; id < MD3_MAX_ANIMS; ++id)
+  {
+    inf = get_animation_by_id((md3_animations_e)id);
+    if ((inf->flags & ANIM_BODY) && torso && torso->model->anims && torso->model->anims[id].frames)
+      anims[num_anims++] = id;
+    else if ((inf->flags & ANIM_LEGS) && legs && legs->model->anims && legs->model->anims[id].frames)
+      anims[num_anims++] = id;
+  }
+
+  /* a model without animations gets one cell */
+  if (!num_anims)
+    anims[num_anims++] = -1;
+
+  cols = (int)ceil(sqrt((double)num_anims));
+  rows = ((num_anims + cols - 1) / cols);
+
+  if (!headless_resize(h, (cols * b->width), (rows * b->height)))
+    return 0;
+  render_viewport(b->world, b->width, b->height);
+
+  glDisable(GL_SCISSOR_TEST);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  /* render_view() clears; keep it to the cell */
+  glEnable(GL_SCISSOR_TEST);
+  for (; i < num_anims; ++i)
+  {
+    glViewport(((i % cols) * b->width), ((rows - 1 - (i / cols)) * b->height), b->width, b->height);
+    glScissor(((i % cols) * b->width), ((rows - 1 - (i / cols)) * b->height), b->width, b->height);
+
+    batch_pose(b, anims[i]);
+    render_view(b->world);
+    render_c(b->world);
+  }
+  glDisable(GL_SCISSOR_TEST);
+
+  snprintf(file, sizeof(file), "%s%c%s_anims.tga", b->out_dir, OS_PATH_DELIM, name);
+  return headless_save(h, file);
+}
@@ -0,0 +1,64 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+/*
+ *	Batch rendering of preview images.
+ *
+ *	Every file on a list of *.mod and *.md3 files gets a turntable of
+ *	views around it, a contact sheet with a cell for each of its
+ *	animations, or both, written to an output directory as tga files.
+ *
+ *	The images are drawn by worker processes, each with its own world
+ *	and its own headless context (see headless.h).  batch_preload()
+ *	decodes the models and textures once before the workers start;
+ *	they share them copy-on-write and only read them.
+ */
+
+struct batch_t
+{
+  struct world_t* world; /* the models are loaded into		*/
+
+  char** files;
+  int num_files;
+
+  char* out_dir;
+  int width; /* of one view or cell				*/
+  int height;
+  int turntable;     /* views around the model, 0 for none	*/
+  int contact_sheet; /* a sheet of every animation			*/
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct batch_t* batch_new(char* list);
+  void batch_free(struct batch_t* b);
+
+  int batch_preload(struct batch_t* b);
+  int batch_run(struct batch_t* b, int workers, double* msec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BATCH_H */
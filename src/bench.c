@@ -0,0 +1,458 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "definitions.h"
+#include "util.h"
+#include "thread.h"
+#include "prof.h"
+#include "world.h"
+#include "render.h"
+#include "headless.h"
+#include "bench.h"
+
+/* every option a run turns on or off */
+#define BENCH_OPTIONS (RENDER_TEXTURES | RENDER_WIREFRAME | ENGINE_LIGHTING | ENGINE_INTERPOLATE | RENDER_MIRRORS)
+
+/* the runs, in order */
+static const struct bench_result_t bench_runs[] = {
+  {"plain", 0, 0, 0, 0, 0, 0},
+  {"textures", RENDER_TEXTURES, 0, 0, 0, 0, 0},
+  {"wireframe", RENDER_WIREFRAME, 0, 0, 0, 0, 0},
+  {"lighting", (RENDER_TEXTURES | ENGINE_LIGHTING), 0, 0, 0, 0, 0},
+  {"interpolation", (RENDER_TEXTURES | ENGINE_INTERPOLATE), 0, 0, 0, 0, 0},
+  {"mirrors", (RENDER_TEXTURES | RENDER_MIRRORS), 0, 0, 0, 0, 0},
+  {"all", (RENDER_TEXTURES | ENGINE_LIGHTING | ENGINE_INTERPOLATE | RENDER_MIRRORS), 0, 0, 0, 0, 0}};
+
+static void bench_camera(struct bench_t* b, int frame);
+static void bench_crowd_camera(struct bench_t* b, int size);
+static double bench_frame(struct bench_t* b);
+static int bench_triangles(struct bench_t* b);
+static int bench_cmp(const void* a, const void* b);
+
+/*
+ *	Create a headless context of the given size and a world to
+ *	load the model into, with the animations on a fixed step clock.
+ *
+ *	Returns NULL on failure.
+ */
+struct bench_t*
+bench_new(int width, int height, int frames)
+{
+  struct bench_t* b = NULL;
+  struct headless_t* h = headless_new(width, height);
+
+  if (!h)
+    return NULL;
+
+  b = (struct bench_t*)malloc(sizeof(struct bench_t));
+  memset(b, 0, sizeof(struct bench_t));
+  b->headless = h;
+  b->width = width;
+  b->height = height;
+  b->frames = ((frames > 0) ? frames : 1);
+
+  b->world = world_init(NULL);
+  world_clock_fixed(b->world, 0.0, BENCH_FRAME_MS);
+  render_setup(b->world);
+  render_viewport(b->world, width, height);
+
+  b->num_results = (sizeof(bench_runs) / sizeof(bench_runs[0]));
+  b->results = (struct bench_result_t*)malloc(sizeof(bench_runs));
+  memcpy(b->results, bench_runs, sizeof(bench_runs));
+
+  return b;
+}
+
+/*
+ *	Free a benchmark, its world and its context.
+ */
+void
+bench_free(struct bench_t* b)
+{
+  world_free(b->world);
+  headless_free(b->headless);
+  free(b->results);
+  free(b);
+}
+
+/*
+ *	Fly the camera path once for every set of render options
+ *	and print the frame times.
+ */
+void
+bench_run(struct bench_t* b)
+{
+  struct world_t* w = b->world;
+  struct bench_result_t* r = NULL;
+  float* ms = (float*)malloc(sizeof(float) * b->frames);
+  double start, total, triangles;
+  int parts, culled;
+  int issued, filtered;
+  int i, f;
+
+  printf("Render benchmark: %i frames per run, %ix%i, %i triangles\n", b->frames, b->width, b->height, w->model_triangles);
+
+  for (i = 0; i < b->num_results; ++i)
+  {
+    r = &b->results[i];
+    world_set_options(w, r->flags, (BENCH_OPTIONS & ~r->flags));
+
+    for (f = 0; f < BENCH_WARMUP; ++f)
+    {
+      bench_camera(b, f);
+      render_view(w);
+      render_c(w);
+    }
+    glFinish();
+
+    total = 0;
+    triangles = 0;
+    parts = 0;
+    culled = 0;
+    issued = 0;
+    filtered = 0;
+    for (f = 0; f < b->frames; ++f)
+    {
+      bench_camera(b, f);
+
+      start = get_time_in_ms();
+      render_view(w);
+      render_c(w);
+      glFinish();
+      ms[f] = (float)(get_time_in_ms() - start);
+
+      total += (double)ms[f];
+      triangles += bench_triangles(b);
+      parts += w->cull.parts;
+      culled += w->cull.parts_culled;
+      issued += w->gl.issued;
+      filtered += w->gl.filtered;
+    }
+
+    qsort(ms, b->frames, sizeof(float), bench_cmp);
+    r->min_ms = ms[0];
+    r->mean_ms = (float)(total / b->frames);
+    r->p95_ms = ms[(int)((b->frames - 1) * 0.95f + 0.5f)];
+    r->p99_ms = ms[(int)((b->frames - 1) * 0.99f + 0.5f)];
+    r->triangles_per_sec = ((total > 0) ? ((triangles * 1000.0) / total) : 0.0);
+
+    printf("  %-14s min %8.3f  mean %8.3f  p95 %8.3f  p99 %8.3f ms  %12.0f triangles/s  %5.1f%% parts culled  %5.1f%% GL calls dropped\n",
+           r->name, (double)r->min_ms, (double)r->mean_ms, (double)r->p95_ms, (double)r->p99_ms, r->triangles_per_sec,
+           (parts ? ((culled * 100.0) / parts) : 0.0), ((issued + filtered) ? ((filtered * 100.0) / (issued + filtered)) : 0.0));
+  }
+
+  init_camera(&w->camera);
+  free(ms);
+}
+
+/*
+ *	Draw crowds of 1, 8, 64 and on up to size models and print
+ *	the frame times, with the camera pulled back so each crowd is
+ *	in view.
+ */
+void
+bench_crowd(struct bench_t* b, int size)
+{
+  struct world_t* w = b->world;
+  struct crowd_t* c = &w->crowd;
+  int old_size = c->size;
+  GLfloat old_far = w->env.vfar;
+  double total;
+  int n, f;
+
+  printf("Crowd benchmark: %i frames per size, %ix%i\n", b->frames, b->width, b->height);
+  world_set_options(w, (RENDER_TEXTURES | ENGINE_INTERPOLATE), (BENCH_OPTIONS & ~(RENDER_TEXTURES | ENGINE_INTERPOLATE)));
+
+  for (n = 1;; n *= BENCH_CROWD_STEP)
+  {
+    /* always finish on the size asked for */
+    if (n > size)
+      n = size;
+
+    crowd_set_size(c, n);
+    bench_crowd_camera(b, n);
+
+    for (f = 0; f < BENCH_WARMUP; ++f)
+      bench_frame(b);
+
+    total = 0;
+    for (f = 0; f < b->frames; ++f)
+      total += bench_frame(b);
+    total /= b->frames;
+
+    /* a crowd of 1 is the root drawn as usual, a surface at a time */
+    printf("  %4i models: %8.3f ms/frame %8.1f fps %8i triangles %6i draw calls\n",
+           n, total, (1000.0 / total), bench_triangles(b),
+           ((w->cull.surfaces - w->cull.surfaces_culled) + ((n > 1) ? c->draw_calls : 0)));
+
+    if (n == size)
+      break;
+  }
+
+  crowd_set_size(c, old_size);
+
+  /* put the camera back */
+  init_camera(&w->camera);
+  w->env.vfar = old_far;
+  render_viewport(w, b->width, b->height);
+}
+
+/*
+ *	Blend the key frames of a crowd of size models on the CPU with
+ *	1, 2, 4 and on up to a thread per processor, and print how many
+ *	it blends a second.  Only the time spent in the thread pool is
+ *	counted.
+ */
+void
+bench_interp(struct bench_t* b, int size)
+{
+  struct world_t* w = b->world;
+  struct crowd_t* c = &w->crowd;
+  int old_size = c->size;
+  int old_cpu = c->cpu_interpolate;
+  int old_threads = c->threads;
+  GLfloat old_far = w->env.vfar;
+  int cpus = thread_cpu_count();
+  double interp_ms, per_sec, base = 0;
+  int threads;
+  int f;
+
+  if (size < 2)
+    return;
+
+  printf("Interpolation benchmark: %i models, %i frames per thread count, %i processors\n", size, b->frames, cpus);
+  world_set_options(w, (RENDER_TEXTURES | ENGINE_INTERPOLATE), (BENCH_OPTIONS & ~(RENDER_TEXTURES | ENGINE_INTERPOLATE)));
+  crowd_set_size(c, size);
+  bench_crowd_camera(b, size);
+
+  for (threads = 1;; threads *= 2)
+  {
+    /* always finish on the number of processors */
+    if (threads > cpus)
+      threads = cpus;
+
+    crowd_set_cpu_interpolation(c, 1, threads);
+
+    for (f = 0; f < BENCH_WARMUP; ++f)
+      bench_frame(b);
+
+    interp_ms = 0;
+    for (f = 0; f < b->frames; ++f)
+    {
+      bench_frame(b);
+      interp_ms += c->interp_ms;
+    }
+    interp_ms /= b->frames;
+
+    /* the root is drawn as usual, the other members are blended */
+    per_sec = ((size - 1) * (1000.0 / interp_ms));
+    if (!base)
+      base = per_sec;
+
+    printf("  %3i threads: %8.3f ms %10.0f models/s %8.2fx %8.1f MB/s written\n",
+           threads, interp_ms, per_sec, (per_sec / base),
+           ((c->vertices * sizeof(float) * CROWD_VERTEX_FLOATS) / (interp_ms * 1000.0)));
+
+    if (threads == cpus)
+      break;
+  }
+
+  crowd_set_cpu_interpolation(c, old_cpu, old_threads);
+  crowd_set_size(c, old_size);
+
+  /* put the camera back */
+  init_camera(&w->camera);
+  w->env.vfar = old_far;
+  render_viewport(w, b->width, b->height);
+}
+
+/*
+ *	Write the results of the last run to a file as JSON,
+ *	one set of render options per line.
+ *
+ *	Returns 0 if the file could not be written.
+ */
+int
+bench_write(struct bench_t* b, char* file)
+{
+  struct bench_result_t* r = NULL;
+  FILE* fptr = fopen(file, "w");
+  int i = 0;
+
+  if (!fptr)
+  {
+    printf("Error: Could not open %s for the benchmark results.\n", file);
+    return 0;
+  }
+
+  fprintf(fptr, "{\"frames\": %i, \"width\": %i, \"height\": %i, \"triangles\": %i,\n\"runs\": [",
+          b->frames, b->width, b->height, b->world->model_triangles);
+  for (; i < b->num_results; ++i)
+  {
+    r = &b->results[i];
+    fprintf(fptr, "%s\n{\"name\": \"%s\", \"min_ms\": %.4f, \"mean_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"triangles_per_sec\": %.0f}",
+            (i ? "," : ""), r->name, (double)r->min_ms, (double)r->mean_ms, (double)r->p95_ms, (double)r->p99_ms, r->triangles_per_sec);
+  }
+  fprintf(fptr, "\n]}\n");
+
+  fclose(fptr);
+  return 1;
+}
+
+/*
+ *	Compare the results of the last run with a file written by
+ *	bench_write() and print every run whose mean or 95th percentile
+ *	frame time grew by more than tolerance percent.
+ *
+ *	Returns the number of regressions, or -1 if the file could not be read.
+ */
+int
+bench_compare(struct bench_t* b, char* file, float tolerance)
+{
+  struct bench_result_t* r = NULL;
+  FILE* fptr = fopen(file, "r");
+  char buf[512];
+  char name[64];
+  float min_ms, mean_ms, p95_ms, p99_ms;
+  float limit = (1.0f + (tolerance / 100.0f));
+  int regressions = 0;
+  int i;
+
+  if (!fptr)
+  {
+    printf("Error: Could not open the baseline %s.\n", file);
+    return -1;
+  }
+
+  while (fgets(buf, sizeof(buf), fptr))
+  {
+    if (sscanf(buf, "{\"name\": \"%63[^\"]\", \"min_ms\": %f, \"mean_ms\": %f, \"p95_ms\": %f, \"p99_ms\": %f",
+               name, &min_ms, &mean_ms, &p95_ms, &p99_ms) != 5)
+      continue;
+
+    for (i = 0; i < b->num_results; ++i)
+    {
+      r = &b->results[i];
+      if (strcmp(r->name, name))
+        continue;
+
+      if (r->mean_ms > (mean_ms * limit))
+      {
+        printf("Regression: %s mean %.3f ms, baseline %.3f ms\n", name, (double)r->mean_ms, (double)mean_ms);
+        ++regressions;
+      }
+      else if (r->p95_ms > (p95_ms * limit))
+      {
+        printf("Regression: %s p95 %.3f ms, baseline %.3f ms\n", name, (double)r->p95_ms, (double)p95_ms);
+        ++regressions;
+      }
+    }
+  }
+
+  fclose(fptr);
+
+  if (!regressions)
+    printf("No regressions against %s (%.0f%% tolerance).\n", file, (double)tolerance);
+  return regressions;
+}
+
+/*
+ *	Place the camera for a frame of the path: once around the model
+ *	while rising and dipping, zooming in and out twice on the way.
+ */
+static void
+bench_camera(struct bench_t* b, int frame)
+{
+  double s = ((double)(frame % b->frames) / b->frames);
+
+  b->world->camera.trot = (DEFAULT_CAMERA_TROT + (360.0 * s));
+  b->world->camera.prot = (DEFAULT_CAMERA_PROT + (30.0 * sin(2.0 * PI * s)));
+  b->world->camera.r = (GLfloat)((double)DEFAULT_CAMERA_DISTANCE * (1.0 - (0.4 * sin(4.0 * PI * s))));
+}
+
+/*
+ *	Pull the camera back so a crowd of size models is in view, the
+ *	far plane with it.
+ */
+static void
+bench_crowd_camera(struct bench_t* b, int size)
+{
+  struct world_t* w = b->world;
+
+  init_camera(&w->camera);
+  w->camera.r = (GLfloat)((double)DEFAULT_CAMERA_DISTANCE + ((double)CROWD_SPACING * sqrt((double)size) * 1.5));
+  w->env.vfar = (w->camera.r * 2.0f);
+  render_viewport(w, b->width, b->height);
+}
+
+/*
+ *	Draw a frame from the camera where it is, from its start until
+ *	glFinish() returns, as a frame of the profiler too.
+ *
+ *	Returns its time in milliseconds.
+ */
+static double
+bench_frame(struct bench_t* b)
+{
+  double start = get_time_in_ms();
+
+  prof_frame_begin();
+  render_view(b->world);
+  render_c(b->world);
+  glFinish();
+  prof_frame_end();
+
+  return (get_time_in_ms() - start);
+}
+
+/*
+ *	Count the triangles of the frame just drawn; the mirrors
+ *	draw the model once more each.
+ */
+static int
+bench_triangles(struct bench_t* b)
+{
+  struct mirror_t* m = NULL;
+  int triangles = ((b->world->crowd.size > 1) ? b->world->crowd.triangles : b->world->model_triangles);
+  int views = 1;
+
+  if (WORLD_IS_SET(b->world, RENDER_MIRRORS))
+  {
+    for (m = b->world->mirrors; m; m = m->next)
+      ++views;
+  }
+
+  /* less those culled, and those the levels of detail left out */
+  return ((triangles * views) - b->world->cull.triangles_culled - b->world->cull.triangles_lod);
+}
+
+/*
+ *	qsort() callback for floats.
+ */
+static int
+bench_cmp(const void* a, const void* b)
+{
+  float fa = *(const float*)a;
+  float fb = *(const float*)b;
+
+  return ((fa > fb) - (fa < fb));
+}
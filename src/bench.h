@@ -0,0 +1,99 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+/*
+ *	Render benchmark along a scripted camera path.
+ *
+ *	The model in the world is drawn without a window (see headless.h)
+ *	once for each of a fixed set of render options.  Each run flies
+ *	the camera once around the model while zooming in and out, over
+ *	the same number of frames and with the animations on a fixed
+ *	step clock, so two runs draw the same images.
+ *
+ *	The frame time is taken from the start of a frame until glFinish()
+ *	returns.  The results are written as JSON and may be compared
+ *	with those of an earlier run to catch regressions.
+ *
+ *	With --crowd the frame time of growing crowds, and the rate the
+ *	thread pool blends a crowd at with more and more threads, are
+ *	printed as well.
+ */
+
+/*
+ *	Frames drawn before the timed ones of each run, and the
+ *	animation time between frames.
+ */
+#define BENCH_WARMUP 30
+#define BENCH_FRAME_MS (1000.0 / 60.0)
+
+/*
+ *	Each crowd of the --crowd scaling run is this many times the
+ *	size of the last, from 1 up to the size asked for.
+ */
+#define BENCH_CROWD_STEP 8
+
+/*
+ *	One set of render options.
+ */
+struct bench_result_t
+{
+  const char* name;
+  int flags; /* world options it is drawn with		*/
+
+  float min_ms;
+  float mean_ms;
+  float p95_ms;
+  float p99_ms;
+  double triangles_per_sec;
+};
+
+struct bench_t
+{
+  struct world_t* world;
+  struct headless_t* headless;
+
+  int width;
+  int height;
+  int frames; /* timed frames per run					*/
+
+  struct bench_result_t* results;
+  int num_results;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct bench_t* bench_new(int width, int height, int frames);
+  void bench_free(struct bench_t* b);
+
+  void bench_run(struct bench_t* b);
+  void bench_crowd(struct bench_t* b, int size);
+  void bench_interp(struct bench_t* b, int size);
+  int bench_write(struct bench_t* b, char* file);
+  int bench_compare(struct bench_t* b, char* file, float tolerance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BENCH_H */
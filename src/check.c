@@ -0,0 +1,711 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "definitions.h"
+#include "md3_parse.h"
+#include "world.h"
+#include "render.h"
+#include "headless.h"
+#include "util.h"
+#include "sim.h"
+#include "lod.h"
+#include "vcache.h"
+#include "anim_sched.h"
+#include "load_bench.h"
+#include "check.h"
+
+#define CHECK_SAVED(full, tris) ((full) ? (100.0 - (((tris) * 100.0) / (full))) : 0.0)
+
+static int check_order_case(struct world_t* wptr, char* name, const int* textures, int num, const int* expect);
+static int check_order_inst(struct world_t* wptr, md3_instance_t* inst, int* parts, int* reordered);
+static void check_vcache_inst(md3_instance_t* inst, struct vcache_stats_t* stats);
+static void check_lod_count(md3_instance_t* inst, int lod, int* triangles);
+static void check_lod_compare(unsigned char* ref, unsigned char* img, int pixels, double* rms, double* changed);
+static void check_sched_steps(struct world_t* wptr, md3_instance_t** members, int num);
+static void check_sched_animate(struct world_t* wptr, md3_instance_t* inst, float phase);
+static void check_sched_add_tree(struct anim_sched_t* s, md3_instance_t* inst);
+static int check_sched_count(md3_instance_t* inst);
+static void check_sched_tick(struct world_t* wptr, md3_instance_t* inst, double now, int poll);
+
+/*
+ *	Find the files in a models directory, if one is given, and make
+ *	a world to load them into with the animations held at their
+ *	first frame.  With a size the world is drawn without a window,
+ *	in a square view of that many pixels a side.
+ *
+ *	Returns NULL on failure.
+ */
+struct check_t*
+check_new(char* dir, int size)
+{
+  struct check_t* c = (struct check_t*)malloc(sizeof(struct check_t));
+
+  memset(c, 0, sizeof(struct check_t));
+
+  if (dir)
+  {
+    c->lb = load_bench_new(dir);
+    if (!c->lb)
+    {
+      free(c);
+      return NULL;
+    }
+  }
+
+  if (size)
+  {
+    c->headless = headless_new(size, size);
+    if (!c->headless)
+    {
+      check_free(c);
+      return NULL;
+    }
+  }
+
+  c->world = world_init(NULL);
+  world_clock_fixed(c->world, 0.0, 0.0);
+  if (c->headless)
+  {
+    render_setup(c->world);
+    render_viewport(c->world, size, size);
+  }
+
+  return c;
+}
+
+/*
+ *	Free a check, its world and its context.
+ *
+ *	Returns the files that did not load and what was wrong.
+ */
+int
+check_free(struct check_t* c)
+{
+  int failed = c->failed;
+
+  /* the world's GL objects go first, while the context is current */
+  if (c->world)
+    world_free(c->world);
+  if (c->headless)
+    headless_free(c->headless);
+  if (c->lb)
+    load_bench_free(c->lb);
+  free(c);
+
+  return failed;
+}
+
+/*
+ *	Load a file into the world; a *.mod model or a lone md3 file.
+ *
+ *	Returns NULL, counted as failed, if it did not load.
+ */
+md3_instance_t*
+check_load(struct check_t* c, char* file)
+{
+  md3_instance_t* inst = load_bench_load(c->world, file);
+
+  if (!inst)
+  {
+    printf("Error: Could not load %s.\n", file);
+    ++c->failed;
+    return NULL;
+  }
+
+  /* a lone md3 has nothing to hold it; draw it as the root */
+  if (!c->world->root_instance)
+    c->world->root_instance = inst;
+
+  return inst;
+}
+
+/*
+ *	Unload what check_load() loaded.
+ */
+void
+check_unload(struct check_t* c, md3_instance_t* inst)
+{
+  unload_model(c->world, inst, 1);
+  c->world->root_instance = NULL;
+}
+
+/*
+ *	Check md3_surface_order() on made up parts, and on every part
+ *	of the models in dir, against the order of a stable sort of the
+ *	surfaces by where their texture first appears; 0 is right when
+ *	that sort keeps the file's order.
+ *
+ *	Returns the number of parts in the wrong order, or files that
+ *	failed to load.
+ */
+int
+check_order(char* dir)
+{
+  struct check_t* c = check_new(dir, 0);
+  md3_instance_t* inst = NULL;
+  int parts, reordered;
+  int i;
+
+  /* textures by index, -1 for none; the order expected, or NULL for the file's */
+  static const int all_different[] = {0, 1, 2};
+  static const int together[] = {0, 0, 1, 1};
+  static const int apart[] = {0, 1, 0, 2, 1};
+  static const int apart_order[] = {0, 2, 1, 4, 3};
+  static const int untextured[] = {-1, 0, -1, 0};
+  static const int untextured_order[] = {0, 1, 3, 2};
+
+  if (!c)
+    return 1;
+
+  world_set_options(c->world, RENDER_TEXTURES, 0);
+
+  printf("Surface order check: parts drawn in the file's order unless a texture's surfaces are apart\n");
+  c->failed += check_order_case(c->world, "all textures different", all_different, 3, NULL);
+  c->failed += check_order_case(c->world, "each texture's surfaces together", together, 4, NULL);
+  c->failed += check_order_case(c->world, "textures apart", apart, 5, apart_order);
+  c->failed += check_order_case(c->world, "surfaces without a texture", untextured, 4, untextured_order);
+
+  printf("  %-48s %8s %10s\n", "file", "parts", "reordered");
+  for (i = 0; i < c->lb->num_files; ++i)
+  {
+    inst = check_load(c, c->lb->files[i].file);
+    if (!inst)
+      continue;
+
+    parts = 0;
+    reordered = 0;
+    c->failed += check_order_inst(c->world, inst, &parts, &reordered);
+    check_unload(c, inst);
+
+    printf("  %-48s %8i %10i\n", c->lb->files[i].file, parts, reordered);
+  }
+
+  printf("%i failed\n", c->failed);
+  return check_free(c);
+}
+
+/*
+ *	Check the order of a made up part with a surface for each of
+ *	num textures, by index.  Returns 1 if it is wrong.
+ */
+static int
+check_order_case(struct world_t* wptr, char* name, const int* textures, int num, const int* expect)
+{
+  md3_surface_t surfaces[MD3_MAX_SURFACES];
+  md3_shader_t shaders[MD3_MAX_SURFACES];
+  struct tga_t images[MD3_MAX_SURFACES];
+  md3_surface_t* order[MD3_MAX_SURFACES];
+  md3_model_t model;
+  int ordered;
+  int wrong = 0;
+  int i;
+
+  memset(&model, 0, sizeof(model));
+  memset(surfaces, 0, sizeof(surfaces));
+  memset(shaders, 0, sizeof(shaders));
+  for (i = 0; i < num; ++i)
+  {
+    shaders[i].texture = ((textures[i] < 0) ? NULL : &images[textures[i]]);
+    surfaces[i].shader = &shaders[i];
+    surfaces[i].next = (((i + 1) < num) ? &surfaces[i + 1] : NULL);
+  }
+  model.surface_ptr = surfaces;
+  model.num_surfaces = num;
+
+  ordered = md3_surface_order(wptr, &model, order);
+  if (!expect)
+    wrong = (ordered != 0);
+  else if (ordered != num)
+    wrong = 1;
+  else
+  {
+    for (i = 0; i < num; ++i)
+      wrong |= (order[i] != &surfaces[expect[i]]);
+  }
+
+  printf("  %-48s %s\n", name, (wrong ? "FAIL" : "ok"));
+  return wrong;
+}
+
+/*
+ *	Check the order of a part and everything linked to it.
+ *	Returns the number of parts in the wrong order.
+ */
+static int
+check_order_inst(struct world_t* wptr, md3_instance_t* inst, int* parts, int* reordered)
+{
+  md3_model_t* model = inst->model;
+  md3_surface_t* surfaces[MD3_MAX_SURFACES];
+  md3_surface_t* order[MD3_MAX_SURFACES];
+  md3_surface_t* sptr;
+  int first[MD3_MAX_SURFACES];
+  int expect[MD3_MAX_SURFACES];
+  int num = 0;
+  int moved = 0;
+  int wrong = 0;
+  int ordered, i, j;
+
+  for (i = 0; i < inst->num_links; ++i)
+  {
+    if (inst->links[i])
+      wrong += check_order_inst(wptr, inst->links[i], parts, reordered);
+  }
+
+  if (!model || (model->num_surfaces > MD3_MAX_SURFACES))
+    return wrong;
+  ++*parts;
+
+  /* where each surface's texture first appears */
+  for (sptr = model->surface_ptr; sptr && (num < MD3_MAX_SURFACES); sptr = sptr->next)
+  {
+    surfaces[num] = sptr;
+    first[num] = num;
+    for (j = 0; sptr->shader[0].texture && (j < num); ++j)
+    {
+      if (surfaces[j]->shader[0].texture == sptr->shader[0].texture)
+      {
+        first[num] = j;
+        break;
+      }
+    }
+    ++num;
+  }
+
+  /* a stable insertion sort by it */
+  for (i = 0; i < num; ++i)
+  {
+    for (j = i; (j > 0) && (first[expect[j - 1]] > first[i]); --j)
+      expect[j] = expect[j - 1];
+    expect[j] = i;
+    moved |= (j != i);
+  }
+
+  ordered = md3_surface_order(wptr, model, order);
+  if (!moved)
+    wrong += (ordered != 0);
+  else if (ordered != num)
+    ++wrong;
+  else
+  {
+    for (i = 0; i < num; ++i)
+    {
+      if (order[i] != surfaces[expect[i]])
+      {
+        ++wrong;
+        break;
+      }
+    }
+  }
+
+  if (ordered)
+    ++*reordered;
+  return wrong;
+}
+
+/*
+ *	Print the ACMR and ATVR of every model in dir as the files have
+ *	them, after vcache_optimize(), and after it with the overdraw
+ *	order too.
+ *
+ *	Returns the number of files that did not load.
+ */
+int
+check_vcache(char* dir)
+{
+  struct check_t* c = check_new(dir, 0);
+  struct vcache_stats_t total[3], file[3];
+  md3_instance_t* inst = NULL;
+  int i = 0;
+  int j = 0;
+
+  if (!c)
+    return 1;
+
+  memset(total, 0, sizeof(total));
+
+  printf("Vertex cache: %i files, FIFO of %i vertices; as loaded, optimized, optimized for overdraw\n", c->lb->num_files, VCACHE_FIFO_SIZE);
+  printf("  %-48s %6s %6s %20s %20s\n", "file", "tris", "verts", "ACMR", "ATVR");
+
+  for (; i < c->lb->num_files; ++i)
+  {
+    inst = check_load(c, c->lb->files[i].file);
+    if (!inst)
+      continue;
+
+    memset(file, 0, sizeof(file));
+    check_vcache_inst(inst, file);
+    check_unload(c, inst);
+
+    printf("  %-48s %6i %6i %6.3f %6.3f %6.3f %6.3f %6.3f %6.3f\n", c->lb->files[i].file, file[0].triangles, file[0].vertices,
+           (double)VCACHE_ACMR(&file[0]), (double)VCACHE_ACMR(&file[1]), (double)VCACHE_ACMR(&file[2]),
+           (double)VCACHE_ATVR(&file[0]), (double)VCACHE_ATVR(&file[1]), (double)VCACHE_ATVR(&file[2]));
+
+    for (j = 0; j < 3; ++j)
+    {
+      total[j].triangles += file[j].triangles;
+      total[j].vertices += file[j].vertices;
+      total[j].transforms += file[j].transforms;
+    }
+  }
+
+  printf("  %-48s %6i %6i %6.3f %6.3f %6.3f %6.3f %6.3f %6.3f\n", "all", total[0].triangles, total[0].vertices,
+         (double)VCACHE_ACMR(&total[0]), (double)VCACHE_ACMR(&total[1]), (double)VCACHE_ACMR(&total[2]),
+         (double)VCACHE_ATVR(&total[0]), (double)VCACHE_ATVR(&total[1]), (double)VCACHE_ATVR(&total[2]));
+
+  return check_free(c);
+}
+
+/*
+ *	Measure the surfaces of a part and everything linked to it
+ *	three times over, optimizing them in between.
+ */
+static void
+check_vcache_inst(md3_instance_t* inst, struct vcache_stats_t* stats)
+{
+  md3_surface_t* sptr = NULL;
+  int i = 0;
+
+  for (; i < inst->num_links; ++i)
+  {
+    if (inst->links[i])
+      check_vcache_inst(inst->links[i], stats);
+  }
+
+  if (!inst->model)
+    return;
+
+  for (sptr = inst->model->surface_ptr; sptr; sptr = sptr->next)
+  {
+    vcache_measure(sptr, &stats[0]);
+    vcache_optimize(sptr, 0);
+    vcache_measure(sptr, &stats[1]);
+    vcache_optimize(sptr, 1);
+    vcache_measure(sptr, &stats[2]);
+  }
+}
+
+/*
+ *	Print the triangles of every level of the models in dir, and
+ *	how far a view of the model at each level is from one at full
+ *	detail.  The views are close up, much larger than a level is
+ *	ever drawn, so the error is the most it can be.
+ *
+ *	Returns the number of files that did not load.
+ */
+int
+check_lod(char* dir)
+{
+  struct check_t* c = check_new(dir, CHECK_LOD_SIZE);
+  struct world_t* w = NULL;
+  md3_instance_t* inst = NULL;
+  unsigned char* ref = NULL;
+  unsigned char* img = NULL;
+  int triangles[MD3_MAX_LODS + 1];
+  int total[MD3_MAX_LODS + 1];
+  double rms[MD3_MAX_LODS + 1];
+  double changed[MD3_MAX_LODS + 1];
+  double worst[MD3_MAX_LODS + 1];
+  int i, lod;
+
+  if (!c)
+    return 1;
+
+  w = c->world;
+  world_set_options(w, ENGINE_LOD, 0);
+
+  ref = (unsigned char*)malloc(CHECK_LOD_SIZE * CHECK_LOD_SIZE * 4);
+  img = (unsigned char*)malloc(CHECK_LOD_SIZE * CHECK_LOD_SIZE * 4);
+  memset(total, 0, sizeof(total));
+  memset(worst, 0, sizeof(worst));
+
+  printf("LOD report: %i files, %ix%i views; triangles, and RMS error and pixels changed against full detail close up\n", c->lb->num_files, CHECK_LOD_SIZE, CHECK_LOD_SIZE);
+  printf("  %-48s %6s", "file", "full");
+  for (lod = 1; lod <= MD3_MAX_LODS; ++lod)
+    printf("  %6s %5s %6s %6s", "tris", "saved", "rms", "pixels");
+  printf("\n");
+  printf("  %-48s %6s", "drawn once the radius is under, in pixels", "");
+  for (lod = 1; lod <= MD3_MAX_LODS; ++lod)
+    printf("  %6.0f %5s %6s %6s", (double)lod_pixels[lod], "", "", "");
+  printf("\n");
+
+  for (i = 0; i < c->lb->num_files; ++i)
+  {
+    inst = check_load(c, c->lb->files[i].file);
+    if (!inst)
+      continue;
+
+    for (lod = 0; lod <= MD3_MAX_LODS; ++lod)
+    {
+      triangles[lod] = 0;
+      check_lod_count(inst, lod, &triangles[lod]);
+      total[lod] += triangles[lod];
+
+      /* every part at this level */
+      w->lod_level = lod;
+      render_view(w);
+      render_c(w);
+      glFinish();
+      glPixelStorei(GL_PACK_ALIGNMENT, 1);
+      glReadPixels(0, 0, CHECK_LOD_SIZE, CHECK_LOD_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, (lod ? img : ref));
+
+      if (lod)
+      {
+        check_lod_compare(ref, img, (CHECK_LOD_SIZE * CHECK_LOD_SIZE), &rms[lod], &changed[lod]);
+        if (rms[lod] > worst[lod])
+          worst[lod] = rms[lod];
+      }
+    }
+    w->lod_level = -1;
+
+    printf("  %-48s %6i", c->lb->files[i].file, triangles[0]);
+    for (lod = 1; lod <= MD3_MAX_LODS; ++lod)
+      printf("  %6i %4.0f%% %6.2f %5.1f%%", triangles[lod], CHECK_SAVED(triangles[0], triangles[lod]), rms[lod], changed[lod]);
+    printf("\n");
+
+    check_unload(c, inst);
+  }
+
+  printf("  %-48s %6i", "all; worst RMS error", total[0]);
+  for (lod = 1; lod <= MD3_MAX_LODS; ++lod)
+    printf("  %6i %4.0f%% %6.2f %6s", total[lod], CHECK_SAVED(total[0], total[lod]), worst[lod], "");
+  printf("\n");
+
+  free(ref);
+  free(img);
+  return check_free(c);
+}
+
+/*
+ *	Add up the triangles of a part and everything linked to it at a
+ *	level of detail.
+ */
+static void
+check_lod_count(md3_instance_t* inst, int lod, int* triangles)
+{
+  md3_surface_t* sptr = NULL;
+  int num = 0;
+  int i = 0;
+
+  for (; i < inst->num_links; ++i)
+  {
+    if (inst->links[i])
+      check_lod_count(inst->links[i], lod, triangles);
+  }
+
+  if (!inst->model)
+    return;
+
+  for (sptr = inst->model->surface_ptr; sptr; sptr = sptr->next)
+  {
+    lod_triangles(sptr, lod, &num);
+    *triangles += num;
+  }
+}
+
+/*
+ *	The RMS difference of two RGBA images over their colour, out of
+ *	255, and the percentage of pixels off by more than 8 in any of it.
+ */
+static void
+check_lod_compare(unsigned char* ref, unsigned char* img, int pixels, double* rms, double* changed)
+{
+  double sum = 0;
+  int off = 0;
+  int d, i, j, c;
+
+  for (i = 0; i < pixels; ++i)
+  {
+    for (j = 0, c = 0; j < 3; ++j)
+    {
+      d = (img[(i * 4) + j] - ref[(i * 4) + j]);
+      sum += (d * d);
+      if ((d > 8) || (d < -8))
+        c = 1;
+    }
+    off += c;
+  }
+
+  *rms = sqrt(sum / (pixels * 3.0));
+  *changed = ((off * 100.0) / pixels);
+}
+
+/*
+ *	Time ticking crowds of copies of a model with the animations
+ *	running but nothing drawn, a simulation step at a time, as a
+ *	server would: advancing only the parts due, against ticking
+ *	every part every step, as drawing them does, and against
+ *	checking every part's key frame every step, as before the
+ *	scheduler.
+ *
+ *	Returns 1 if the model could not be loaded.
+ */
+int
+check_sched(char* model)
+{
+  struct check_t* c = check_new(NULL, 0);
+  md3_instance_t** members = NULL;
+  md3_instance_t* inst = NULL;
+  int sizes[] = {64, 512, CHECK_SCHED_MAX};
+  int i = 0;
+
+  inst = check_load(c, model);
+  if (!inst)
+    return check_free(c);
+
+  members = (md3_instance_t**)malloc(sizeof(md3_instance_t*) * CHECK_SCHED_MAX);
+  for (; i < CHECK_SCHED_MAX; ++i)
+    members[i] = md3_clone_instance(c->world, inst);
+
+  printf("Animation scheduler: %s, %i steps of %i ms, nothing drawn\n", model, CHECK_SCHED_STEPS, SIM_STEP_MS);
+  printf("  %8s %8s %14s %14s %14s %14s\n", "models", "parts", "due per step", "us due only", "us blended", "us polled");
+  for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); ++i)
+    check_sched_steps(c->world, members, sizes[i]);
+
+  for (i = 0; i < CHECK_SCHED_MAX; ++i)
+    unload_model(c->world, members[i], 1);
+  free(members);
+
+  return check_free(c);
+}
+
+/*
+ *	Tick the first num members each way and print a line.
+ */
+static void
+check_sched_steps(struct world_t* wptr, md3_instance_t** members, int num)
+{
+  struct anim_sched_t s;
+  double start, due_ms, blend_ms, poll_ms;
+  double now;
+  long advanced = 0;
+  int parts = 0;
+  int i, step, poll;
+
+  memset(&s, 0, sizeof(s));
+  for (i = 0; i < num; ++i)
+  {
+    check_sched_animate(wptr, members[i], FLOAT_MOD((i * 0.618034f), 1.0f));
+    check_sched_add_tree(&s, members[i]);
+    parts += check_sched_count(members[i]);
+  }
+
+  /* only the parts at a key frame */
+  start = get_time_in_ms();
+  for (step = 0; step < CHECK_SCHED_STEPS; ++step)
+    advanced += anim_sched_tick(&s, wptr, (step * (double)SIM_STEP_MS));
+  due_ms = (get_time_in_ms() - start);
+  anim_sched_free(&s);
+
+  /* every part, from the same start; blending, then advancing every time */
+  for (poll = 0; poll < 2; ++poll)
+  {
+    for (i = 0; i < num; ++i)
+      check_sched_animate(wptr, members[i], FLOAT_MOD((i * 0.618034f), 1.0f));
+    start = get_time_in_ms();
+    for (step = 0; step < CHECK_SCHED_STEPS; ++step)
+    {
+      now = (step * (double)SIM_STEP_MS);
+      for (i = 0; i < num; ++i)
+        check_sched_tick(wptr, members[i], now, poll);
+    }
+    if (poll)
+      poll_ms = (get_time_in_ms() - start);
+    else
+      blend_ms = (get_time_in_ms() - start);
+  }
+
+  printf("  %8i %8i %14.1f %14.2f %14.2f %14.2f\n", num, parts, ((double)advanced / CHECK_SCHED_STEPS),
+         ((due_ms * 1000.0) / CHECK_SCHED_STEPS), ((blend_ms * 1000.0) / CHECK_SCHED_STEPS),
+         ((poll_ms * 1000.0) / CHECK_SCHED_STEPS));
+}
+
+/*
+ *	Start a copy running, phase of the way into its animations.
+ */
+static void
+check_sched_animate(struct world_t* wptr, md3_instance_t* inst, float phase)
+{
+  int link = 0;
+
+  if (!inst)
+    return;
+
+  if (inst->body_part == MD3_LEGS)
+    world_set_instance_animation(wptr, inst, LEGS_RUN, phase);
+  else if (inst->body_part == MD3_TORSO)
+    world_set_instance_animation(wptr, inst, TORSO_ATTACK, phase);
+
+  for (; link < inst->num_links; ++link)
+    check_sched_animate(wptr, inst->links[link], phase);
+}
+
+/*
+ *	Add an instance and everything linked to it.
+ */
+static void
+check_sched_add_tree(struct anim_sched_t* s, md3_instance_t* inst)
+{
+  int link = 0;
+
+  if (!inst)
+    return;
+
+  anim_sched_add(s, inst);
+  for (; link < inst->num_links; ++link)
+    check_sched_add_tree(s, inst->links[link]);
+}
+
+/*
+ *	Count an instance and everything linked to it.
+ */
+static int
+check_sched_count(md3_instance_t* inst)
+{
+  int n = 1;
+  int link = 0;
+
+  if (!inst)
+    return 0;
+
+  for (; link < inst->num_links; ++link)
+    n += check_sched_count(inst->links[link]);
+  return n;
+}
+
+/*
+ *	Tick an instance and everything linked to it, as posing it does;
+ *	poll makes it always due.
+ */
+static void
+check_sched_tick(struct world_t* wptr, md3_instance_t* inst, double now, int poll)
+{
+  int link = 0;
+
+  if (!inst)
+    return;
+
+  if (poll)
+    inst->anim_due = 0.0;
+  world_tick_model(wptr, inst, now);
+  for (; link < inst->num_links; ++link)
+    check_sched_tick(wptr, inst->links[link], now, poll);
+}
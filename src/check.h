@@ -0,0 +1,74 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _CHECK_H
+#define _CHECK_H
+
+#include "md3_parse.h"
+
+/*
+ *	Checks and reports run from the command line over models.
+ *
+ *	Each loads every file load_bench_new() finds in a models
+ *	directory into one world, one at a time, prints a line for it
+ *	and unloads it again, then prints what it found in all.  A
+ *	check_t is what they share: the files, the world, a headless
+ *	context for those that draw, and the count of files that did
+ *	not load.  Each returns that count, with whatever it checks
+ *	that was wrong, as the exit code.
+ */
+
+/*
+ *	Size of the views check_lod() compares.
+ */
+#define CHECK_LOD_SIZE 256
+
+/*
+ *	Copies and steps of the simulation check_sched() ticks.
+ */
+#define CHECK_SCHED_MAX 4096
+#define CHECK_SCHED_STEPS 2500
+
+struct check_t
+{
+  struct load_bench_t* lb;     /* the files; NULL for a model named alone	*/
+  struct headless_t* headless; /* drawn in, for those that draw				*/
+  struct world_t* world;       /* the files are loaded into					*/
+  int failed;                  /* files that did not load, and what was wrong	*/
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct check_t* check_new(char* dir, int size);
+  int check_free(struct check_t* c);
+  md3_instance_t* check_load(struct check_t* c, char* file);
+  void check_unload(struct check_t* c, md3_instance_t* inst);
+
+  int check_order(char* dir);
+  int check_vcache(char* dir);
+  int check_lod(char* dir);
+  int check_sched(char* model);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHECK_H */
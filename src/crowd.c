@@ -0,0 +1,1076 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ *	Crowd rendering.
+ *
+ *	The root model is copied onto a grid and every copy gets its own
+ *	animation and starting phase.  Each frame the copies are posed on
+ *	the CPU, then parts showing the same model at the same key frame
+ *	pair are drawn together with one instanced draw per surface.
+ *	The per-instance data is the part transform and the interpolation
+ *	factor; the key frame blend is done in the vertex shader.
+ *
+ *	If the context can not do instancing (OpenGL 3.3) the copies
+ *	are drawn one by one through md3_render_single().
+ *
+ *	With CPU interpolation on, the blend is done by a thread pool
+ *	instead: every surface of every posed part is a task writing its
+ *	own slice of a vertex buffer, and the GL only issues the draws.
+ *	On OpenGL 4.4 the buffer is mapped once and cycled through
+ *	CROWD_REGIONS regions guarded by fences, otherwise the frame is
+ *	built in client memory and uploaded with glBufferData().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+#include "gl_ext.h"
+#include "md3_parse.h"
+#include "quaternion.h"
+#include "world.h"
+#include "util.h"
+#include "render.h"
+#include "pool.h"
+#include "sim.h"
+#include "prof.h"
+#include "lod.h"
+#include "thread.h"
+#include "anim_sched.h"
+#include "crowd.h"
+
+/* vertex attribute locations */
+#define ATTR_POS0 0
+#define ATTR_POS1 1
+#define ATTR_NORMAL0 2
+#define ATTR_NORMAL1 3
+#define ATTR_TEXCOORD 4
+#define ATTR_MATRIX 5 /* 4 columns: 5 - 8 */
+#define ATTR_T 9
+#define ATTR_COUNT 10
+
+/* floats of per-instance data: matrix and interpolation factor */
+#define INSTANCE_FLOATS 17
+
+/*
+ *	The vertex shader blends the two key frames, places the part
+ *	and does the diffuse part of the fixed function lighting for light 0.
+ */
+static const char* crowd_vertex_shader =
+  "#version 120\n"
+  "attribute vec3 pos0;\n"
+  "attribute vec3 pos1;\n"
+  "attribute vec3 normal0;\n"
+  "attribute vec3 normal1;\n"
+  "attribute vec2 texcoord;\n"
+  "attribute vec4 m0;\n"
+  "attribute vec4 m1;\n"
+  "attribute vec4 m2;\n"
+  "attribute vec4 m3;\n"
+  "attribute float t;\n"
+  "uniform vec2 flip;\n"
+  "uniform int lighting;\n"
+  "varying vec2 st;\n"
+  "varying vec4 color;\n"
+  "void main()\n"
+  "{\n"
+  "  mat4 m = mat4(m0, m1, m2, m3);\n"
+  "  vec4 pos = m * vec4(mix(pos0, pos1, t) * (1.0 / 64.0), 1.0);\n"
+  "  gl_Position = gl_ModelViewProjectionMatrix * pos;\n"
+  "  st = mix(texcoord, vec2(1.0) - texcoord, flip);\n"
+  "  color = vec4(1.0);\n"
+  "  if (lighting != 0)\n"
+  "  {\n"
+  "    vec3 n = normalize(gl_NormalMatrix * (mat3(m) * mix(normal0, normal1, t)));\n"
+  "    vec3 eye = vec3(gl_ModelViewMatrix * pos);\n"
+  "    vec4 lp = gl_LightSource[0].position;\n"
+  "    vec3 l = normalize(lp.xyz - (eye * lp.w));\n"
+  "    color = gl_LightModel.ambient + gl_LightSource[0].ambient + (gl_LightSource[0].diffuse * max(dot(n, l), 0.0));\n"
+  "    color.a = 1.0;\n"
+  "  }\n"
+  "}\n";
+
+static const char* crowd_fragment_shader =
+  "#version 120\n"
+  "uniform sampler2D skin;\n"
+  "uniform int use_texture;\n"
+  "varying vec2 st;\n"
+  "varying vec4 color;\n"
+  "void main()\n"
+  "{\n"
+  "  gl_FragColor = color;\n"
+  "  if (use_texture != 0)\n"
+  "    gl_FragColor *= texture2D(skin, st);\n"
+  "}\n";
+
+/*
+ *	Animations handed out to the crowd members; legs and torso.
+ */
+static md3_animations_e crowd_anims[][2] = {
+  {LEGS_IDLE, TORSO_STAND},
+  {LEGS_WALK, TORSO_STAND2},
+  {LEGS_RUN, TORSO_STAND},
+  {LEGS_BACK, TORSO_STAND2},
+  {LEGS_WALKCR, TORSO_STAND},
+  {LEGS_IDLECR, TORSO_STAND2},
+  {LEGS_SWIM, TORSO_STAND},
+  {LEGS_TURN, TORSO_STAND2}};
+#define CROWD_NUM_ANIMS ((int)(sizeof(crowd_anims) / sizeof(crowd_anims[0])))
+
+static void crowd_build(struct crowd_t* c);
+static void crowd_release(struct crowd_t* c);
+static void crowd_animate(struct crowd_t* c, md3_instance_t* inst, int member);
+static void crowd_schedule(struct crowd_t* c, md3_instance_t* inst);
+static void crowd_member_origin(struct crowd_t* c, int member, float* xy);
+static void crowd_add_item(void* data, md3_instance_t* inst, float* m);
+static void crowd_pick_lods(struct crowd_t* c);
+static int crowd_gl_init(struct crowd_t* c);
+static void crowd_draw_instanced(struct crowd_t* c);
+static void crowd_draw_single(struct crowd_t* c);
+static void crowd_draw_interpolated(struct crowd_t* c);
+static float* crowd_map_vertices(struct crowd_t* c, size_t vertices, size_t* base);
+static void crowd_interpolate(void* data, int task);
+static void crowd_free_vertices(struct crowd_t* c);
+static unsigned int* crowd_surface_buffers(struct crowd_t* c, md3_surface_t* sptr);
+static int crowd_count_triangles(md3_instance_t* inst);
+static int crowd_item_cmp(const void* a, const void* b);
+
+/*
+ *	Set the number of crowd members.
+ *
+ *	The members are built on the next render.
+ */
+void
+crowd_set_size(struct crowd_t* c, int size)
+{
+  if (size < 0)
+    size = 0;
+  if (size > CROWD_MAX_SIZE)
+    size = CROWD_MAX_SIZE;
+
+  c->size = size;
+  c->stale = 1;
+}
+
+/*
+ *	Blend the key frames on the CPU with the given number
+ *	of threads (0 is one per processor) instead of instancing.
+ */
+void
+crowd_set_cpu_interpolation(struct crowd_t* c, int enable, int threads)
+{
+  if (threads < 0)
+    threads = 0;
+
+  /* the pool is made on the next render */
+  if (c->pool && (!enable || (threads != c->threads)))
+  {
+    pool_free(c->pool);
+    c->pool = NULL;
+  }
+
+  c->cpu_interpolate = enable;
+  c->threads = threads;
+}
+
+/*
+ *	Check if any clone is animating; member 0 is the world root
+ *	and is left to the caller.
+ */
+int
+crowd_is_animating(struct crowd_t* c)
+{
+  int i = 1;
+
+  for (; i < c->num_members; ++i)
+  {
+    if (world_is_animating(c->members[i]))
+      return 1;
+  }
+
+  return 0;
+}
+
+/*
+ *	Free the crowd members and the GL objects.
+ */
+void
+crowd_free(struct crowd_t* c)
+{
+  struct world_t* world = c->world;
+
+  crowd_release(c);
+  anim_sched_free(&c->sched);
+  free(c->members);
+  free(c->items);
+  free(c->instance_data);
+  free(c->tasks);
+
+  if (c->pool)
+    pool_free(c->pool);
+
+  if (c->gl_state == 1)
+  {
+    glDeleteProgram(c->program);
+    glDeleteBuffers(1, &c->instance_buffer);
+    crowd_free_vertices(c);
+  }
+
+  memset(c, 0, sizeof(struct crowd_t));
+  c->world = world;
+}
+
+/*
+ *	Free the world's GL buffers of a surface if it was ever drawn instanced.
+ */
+void
+crowd_free_surface(struct world_t* wptr, md3_surface_t* sptr)
+{
+  unsigned int* buffers;
+
+  if ((sptr->gl_slot < 0) || (sptr->gl_slot >= wptr->objects.num_buffers))
+    return;
+
+  buffers = world_surface_buffers(wptr, sptr);
+  if (!buffers[0])
+    return;
+
+  glDeleteBuffers(3, buffers);
+  memset(buffers, 0, (sizeof(unsigned int) * 3));
+}
+
+/*
+ *	Render the crowd.
+ *
+ *	Member 0 is the world root and goes through render_model()
+ *	so picking and bounding boxes keep working for it.
+ */
+void
+crowd_render(struct crowd_t* c, int apply_names)
+{
+  float m[16];
+  float xy[2];
+  GLint render_mode = GL_RENDER;
+  double timer;
+  int i = 0;
+
+  if (c->stale)
+    crowd_build(c);
+
+  c->draw_calls = 0;
+  c->triangles = 0;
+  c->vertices = 0;
+  c->interp_ms = 0;
+
+  if (!c->num_members)
+  {
+    /* nothing to copy; draw the root as usual */
+    render_model(c->world, apply_names);
+    return;
+  }
+
+  /* the root */
+  crowd_member_origin(c, 0, xy);
+  glPushMatrix();
+  glTranslatef(xy[0], xy[1], 0.0f);
+  render_model(c->world, apply_names);
+  glPopMatrix();
+  c->triangles += crowd_count_triangles(c->members[0]);
+
+  /* only the root can be picked */
+  glGetIntegerv(GL_RENDER_MODE, &render_mode);
+  if (render_mode != GL_RENDER)
+    return;
+
+  /* advance the copies at a key frame, then pose them all */
+  timer = prof_begin();
+  anim_sched_tick(&c->sched, c->world, c->world->time);
+  c->num_items = 0;
+  for (i = 1; i < c->num_members; ++i)
+  {
+    crowd_member_origin(c, i, xy);
+    memset(m, 0, sizeof(m));
+    m[0] = m[5] = m[10] = m[15] = 1.0f;
+    m[12] = xy[0];
+    m[13] = xy[1];
+    md3_pose(c->world, c->members[i], c->world->time, NULL, m, crowd_add_item, c);
+  }
+  if (WORLD_IS_SET(c->world, ENGINE_LOD) || WORLD_IS_SET(c->world, ENGINE_ANIM_LOD))
+    crowd_pick_lods(c);
+  prof_end(PROF_POSE, timer);
+
+  if (!c->gl_state)
+    c->gl_state = (crowd_gl_init(c) ? 1 : -1);
+
+  if ((c->gl_state == 1) && c->cpu_interpolate)
+    crowd_draw_interpolated(c);
+  else if (c->gl_state == 1)
+    crowd_draw_instanced(c);
+  else
+    crowd_draw_single(c);
+}
+
+/*
+ *	Rebuild the members from the world root.
+ */
+static void
+crowd_build(struct crowd_t* c)
+{
+  md3_instance_t* root = c->world->root_instance;
+  int i = 0;
+
+  crowd_release(c);
+  c->stale = 0;
+
+  if (!root || (c->size < 2))
+    return;
+
+  c->members = (md3_instance_t**)realloc(c->members, (sizeof(md3_instance_t*) * c->size));
+  c->members[0] = root;
+
+  /* the simulation may be changing the root */
+  sim_lock(c->world->sim);
+  for (i = 1; i < c->size; ++i)
+  {
+    c->members[i] = md3_clone_instance(c->world, root);
+    crowd_animate(c, c->members[i], i);
+    crowd_schedule(c, c->members[i]);
+  }
+  sim_unlock(c->world->sim);
+
+  c->num_members = c->size;
+}
+
+/*
+ *	Free the copies; member 0 belongs to the world.
+ */
+static void
+crowd_release(struct crowd_t* c)
+{
+  int i = 1;
+
+  for (; i < c->num_members; ++i)
+    unload_model(c->world, c->members[i], 1);
+
+  c->num_members = 0;
+}
+
+/*
+ *	Give a member its animations and a starting phase.
+ */
+static void
+crowd_animate(struct crowd_t* c, md3_instance_t* inst, int member)
+{
+  int pick = (member % CROWD_NUM_ANIMS);
+  float phase = (member * 0.618034f);
+  int link = 0;
+
+  if (!inst)
+    return;
+
+  /* spread the phases evenly over [0, 1) */
+  phase = FLOAT_MOD(phase, 1.0f);
+
+  if (inst->body_part == MD3_LEGS)
+    world_set_instance_animation(c->world, inst, crowd_anims[pick][0], phase);
+  else if (inst->body_part == MD3_TORSO)
+    world_set_instance_animation(c->world, inst, crowd_anims[pick][1], phase);
+
+  for (; link < inst->num_links; ++link)
+    crowd_animate(c, inst->links[link], member);
+}
+
+/*
+ *	Put a member's parts in the crowd's animation scheduler.
+ */
+static void
+crowd_schedule(struct crowd_t* c, md3_instance_t* inst)
+{
+  int link = 0;
+
+  if (!inst)
+    return;
+
+  anim_sched_add(&c->sched, inst);
+  for (; link < inst->num_links; ++link)
+    crowd_schedule(c, inst->links[link]);
+}
+
+/*
+ *	Get the grid position of a member; the grid is centered on the origin.
+ */
+static void
+crowd_member_origin(struct crowd_t* c, int member, float* xy)
+{
+  int cols = (int)ceil(sqrt((double)c->num_members));
+  int rows = ((c->num_members + cols - 1) / cols);
+
+  xy[0] = (((member % cols) - ((cols - 1) / 2.0f)) * CROWD_SPACING);
+  xy[1] = (((member / cols) - ((rows - 1) / 2.0f)) * CROWD_SPACING);
+}
+
+/*
+ *	md3_pose() callback: add a posed part to the items to draw.
+ */
+static void
+crowd_add_item(void* data, md3_instance_t* inst, float* m)
+{
+  struct crowd_t* c = (struct crowd_t*)data;
+  struct crowd_item_t* item = NULL;
+
+  /* grow the item list if needed */
+  if (c->num_items == c->max_items)
+  {
+    c->max_items = (c->max_items ? (c->max_items * 2) : 64);
+    c->items = (struct crowd_item_t*)realloc(c->items, (sizeof(struct crowd_item_t) * c->max_items));
+  }
+
+  item = &c->items[c->num_items++];
+  item->inst = inst;
+  memcpy(item->matrix, m, sizeof(item->matrix));
+  item->lod = 0;
+}
+
+/*
+ *	Measure every posed part on the screen and pick its level of
+ *	detail, as md3_render_frame() does for the parts it draws.
+ */
+static void
+crowd_pick_lods(struct crowd_t* c)
+{
+  struct world_t* w = c->world;
+  struct crowd_item_t* item = NULL;
+  float modelview[16];
+  float projection[16];
+  float view[16];
+  float clip[16];
+  float pixels;
+  int i = 0;
+
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  matrix_mult_4x4(projection, modelview, view);
+
+  for (; i < c->num_items; ++i)
+  {
+    item = &c->items[i];
+    if (w->mirror_pass)
+    {
+      item->lod = ((w->lod_level >= 0) ? w->lod_level : item->inst->lod);
+      continue;
+    }
+
+    matrix_mult_4x4(view, item->matrix, clip);
+    pixels = lod_screen_radius(item->inst->model, &item->inst->anim_state, clip, w->viewport_height);
+    ATOMIC_STORE(&item->inst->screen_pixels, ((pixels < 1.0f) ? 1 : (int)ceilf(pixels)));
+
+    if (!WORLD_IS_SET(w, ENGINE_LOD))
+      item->lod = 0;
+    else if (w->lod_level >= 0)
+      item->lod = w->lod_level;
+    else
+      item->lod = item->inst->lod = lod_pick(pixels, item->inst->lod);
+  }
+}
+
+/*
+ *	Build the shader program and instance buffer.
+ *
+ *	Returns 0 if instancing is not available.
+ */
+static int
+crowd_gl_init(struct crowd_t* c)
+{
+  const char* names[ATTR_COUNT] = {"pos0", "pos1", "normal0", "normal1", "texcoord", "m0", "m1", "m2", "m3", "t"};
+  const char* sources[2] = {crowd_vertex_shader, crowd_fragment_shader};
+  GLenum types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+  GLuint shader = 0;
+  GLint status = 0;
+  char log[1024];
+  int i = 0;
+
+  gl_ext_init();
+
+  if (!gl_ext_version(3, 3))
+  {
+    printf("Crowd: OpenGL 3.3 is not available, drawing members one at a time.\n");
+    return 0;
+  }
+
+  c->program = glCreateProgram();
+
+  for (i = 0; i < 2; ++i)
+  {
+    shader = glCreateShader(types[i]);
+    glShaderSource(shader, 1, &sources[i], NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status)
+    {
+      glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+      printf("Error: Crowd shader failed to compile:\n%s\n", log);
+      glDeleteShader(shader);
+      glDeleteProgram(c->program);
+      return 0;
+    }
+    glAttachShader(c->program, shader);
+
+    /* flagged for deletion when the program goes */
+    glDeleteShader(shader);
+  }
+
+  for (i = 0; i < ATTR_COUNT; ++i)
+    glBindAttribLocation(c->program, i, names[i]);
+
+  glLinkProgram(c->program);
+  glGetProgramiv(c->program, GL_LINK_STATUS, &status);
+  if (!status)
+  {
+    glGetProgramInfoLog(c->program, sizeof(log), NULL, log);
+    printf("Error: Crowd shader failed to link:\n%s\n", log);
+    glDeleteProgram(c->program);
+    return 0;
+  }
+
+  c->u_flip = glGetUniformLocation(c->program, "flip");
+  c->u_use_texture = glGetUniformLocation(c->program, "use_texture");
+  c->u_lighting = glGetUniformLocation(c->program, "lighting");
+
+  glGenBuffers(1, &c->instance_buffer);
+  glGenBuffers(1, &c->vertex_buffer);
+
+  /* map the interpolated vertices once and keep them mapped */
+  c->persistent = gl_ext_version(4, 4);
+
+  return 1;
+}
+
+/*
+ *	Draw the posed parts with one instanced draw per surface for every
+ *	run of parts at the same model, level of detail and key frame pair.
+ */
+static void
+crowd_draw_instanced(struct crowd_t* c)
+{
+  struct crowd_item_t* item = NULL;
+  md3_model_t* model = NULL;
+  md3_surface_t* sptr = NULL;
+  md3_shader_t* shader = NULL;
+  unsigned int* buffers = NULL;
+  size_t stride = (sizeof(float) * INSTANCE_FLOATS);
+  size_t base = 0;
+  size_t frame_offset = 0;
+  size_t next_frame_offset = 0;
+  float* data = NULL;
+  double timer;
+  int num_tris = 0;
+  int start = 0;
+  int end = 0;
+  int i = 0;
+
+  if (!c->num_items)
+    return;
+
+  /* group parts with the same model, level of detail and key frames */
+  qsort(c->items, c->num_items, sizeof(struct crowd_item_t), crowd_item_cmp);
+
+  /* fill and upload the instance data */
+  if (c->max_instance_data < (c->num_items * INSTANCE_FLOATS))
+  {
+    c->max_instance_data = (c->num_items * INSTANCE_FLOATS);
+    c->instance_data = (float*)realloc(c->instance_data, (sizeof(float) * c->max_instance_data));
+  }
+
+  data = c->instance_data;
+  for (i = 0; i < c->num_items; ++i)
+  {
+    memcpy(data, c->items[i].matrix, (sizeof(float) * 16));
+    data[16] = c->items[i].inst->anim_state.t;
+    data += INSTANCE_FLOATS;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, c->instance_buffer);
+  glBufferData(GL_ARRAY_BUFFER, (stride * c->num_items), c->instance_data, GL_STREAM_DRAW);
+
+  glUseProgram(c->program);
+  glUniform1i(c->u_lighting, WORLD_IS_SET(c->world, ENGINE_LIGHTING));
+
+  if (WORLD_IS_SET(c->world, RENDER_WIREFRAME))
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+  for (i = 0; i < ATTR_COUNT; ++i)
+    glEnableVertexAttribArray(i);
+  for (i = ATTR_MATRIX; i <= ATTR_T; ++i)
+    glVertexAttribDivisor(i, 1);
+
+  for (start = 0; start < c->num_items; start = end)
+  {
+    /* find the end of this run */
+    for (end = (start + 1); end < c->num_items; ++end)
+    {
+      if (crowd_item_cmp(&c->items[start], &c->items[end]))
+        break;
+    }
+
+    item = &c->items[start];
+    model = item->inst->model;
+    base = (stride * start);
+
+    for (sptr = model->surface_ptr; sptr; sptr = sptr->next)
+    {
+      buffers = crowd_surface_buffers(c, sptr);
+      if (!buffers)
+        continue;
+
+      /* texture */
+      shader = &sptr->shader[0];
+      if (WORLD_IS_SET(c->world, RENDER_TEXTURES) && shader->texture)
+      {
+        timer = prof_begin();
+        apply_texture(c->world, shader);
+        prof_end(PROF_TEXTURE, timer);
+        glUniform1i(c->u_use_texture, (world_texture_name(c->world, shader) != 0));
+        glUniform2f(c->u_flip, (float)shader->texture->hflip, (float)shader->texture->vflip);
+      }
+      else
+        glUniform1i(c->u_use_texture, 0);
+
+      /* key frames */
+      frame_offset = (sizeof(md3_vertex_t) * (item->inst->anim_state.frame % sptr->num_frames) * sptr->num_verts);
+      next_frame_offset = (sizeof(md3_vertex_t) * (item->inst->anim_state.next_frame % sptr->num_frames) * sptr->num_verts);
+
+      glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+      glVertexAttribPointer(ATTR_POS0, 3, GL_SHORT, GL_FALSE, sizeof(md3_vertex_t), (void*)frame_offset);
+      glVertexAttribPointer(ATTR_POS1, 3, GL_SHORT, GL_FALSE, sizeof(md3_vertex_t), (void*)next_frame_offset);
+      glVertexAttribPointer(ATTR_NORMAL0, 3, GL_FLOAT, GL_FALSE, sizeof(md3_vertex_t), (void*)(frame_offset + offsetof(md3_vertex_t, normalxyz)));
+      glVertexAttribPointer(ATTR_NORMAL1, 3, GL_FLOAT, GL_FALSE, sizeof(md3_vertex_t), (void*)(next_frame_offset + offsetof(md3_vertex_t, normalxyz)));
+
+      glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+      glVertexAttribPointer(ATTR_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(md3_texcoord_t), NULL);
+
+      /* per instance */
+      glBindBuffer(GL_ARRAY_BUFFER, c->instance_buffer);
+      for (i = 0; i < 4; ++i)
+        glVertexAttribPointer((ATTR_MATRIX + i), 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + (sizeof(float) * 4 * i)));
+      glVertexAttribPointer(ATTR_T, 1, GL_FLOAT, GL_FALSE, stride, (void*)(base + (sizeof(float) * 16)));
+
+      /* the run's level of detail */
+      lod_triangles(sptr, item->lod, &num_tris);
+
+      timer = prof_begin();
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+      glDrawElementsInstanced(GL_TRIANGLES, (num_tris * 3), GL_UNSIGNED_INT,
+                              (void*)(sizeof(md3_triangle_t) * lod_first_triangle(sptr, item->lod)), (end - start));
+      prof_end(PROF_DRAW, timer);
+
+      c->draw_calls++;
+      c->triangles += (num_tris * (end - start));
+    }
+  }
+
+  /* put everything back for the fixed function path */
+  for (i = ATTR_MATRIX; i <= ATTR_T; ++i)
+    glVertexAttribDivisor(i, 0);
+  for (i = 0; i < ATTR_COUNT; ++i)
+    glDisableVertexAttribArray(i);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glUseProgram(0);
+
+  if (WORLD_IS_SET(c->world, RENDER_WIREFRAME))
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+/*
+ *	Draw the posed parts one at a time.
+ */
+static void
+crowd_draw_single(struct crowd_t* c)
+{
+  int i = 0;
+
+  for (; i < c->num_items; ++i)
+  {
+    glPushMatrix();
+    glMultMatrixf(c->items[i].matrix);
+    md3_render_single(c->world, c->items[i].inst, c->world->time, 0);
+    glPopMatrix();
+
+    c->triangles += c->items[i].inst->model->total_triangles;
+  }
+  c->draw_calls += c->num_items;
+}
+
+/*
+ *	Interpolate the posed parts on the thread pool, then draw them.
+ */
+static void
+crowd_draw_interpolated(struct crowd_t* c)
+{
+  struct crowd_item_t* item = NULL;
+  struct crowd_task_t* task = NULL;
+  md3_surface_t* sptr = NULL;
+  md3_shader_t* shader = NULL;
+  unsigned int* buffers = NULL;
+  size_t stride = (sizeof(float) * CROWD_VERTEX_FLOATS);
+  size_t vertices = 0;
+  size_t base = 0;
+  double start = 0;
+  int textured = 0;
+  int num_tris = 0;
+  int i = 0;
+
+  if (!c->num_items)
+    return;
+
+  if (!c->pool)
+    c->pool = pool_new(c->threads);
+
+  /* one task per surface of every part, each with its own output slice */
+  c->num_tasks = 0;
+  for (i = 0; i < c->num_items; ++i)
+  {
+    for (sptr = c->items[i].inst->model->surface_ptr; sptr; sptr = sptr->next)
+    {
+      if (c->num_tasks == c->max_tasks)
+      {
+        c->max_tasks = (c->max_tasks ? (c->max_tasks * 2) : 256);
+        c->tasks = (struct crowd_task_t*)realloc(c->tasks, (sizeof(struct crowd_task_t) * c->max_tasks));
+      }
+
+      task = &c->tasks[c->num_tasks++];
+      task->item = i;
+      task->sptr = sptr;
+      task->first_vertex = vertices;
+      vertices += sptr->num_verts;
+    }
+  }
+
+  c->vertex_out = crowd_map_vertices(c, vertices, &base);
+
+  start = prof_begin();
+  pool_run(c->pool, crowd_interpolate, c, c->num_tasks);
+  c->interp_ms = (prof_begin() - start);
+  prof_end(PROF_INTERP, start);
+  c->vertices = (int)vertices;
+
+  glBindBuffer(GL_ARRAY_BUFFER, c->vertex_buffer);
+  if (!c->persistent)
+    glBufferData(GL_ARRAY_BUFFER, (stride * vertices), c->vertex_data, GL_STREAM_DRAW);
+
+  /* draw with the fixed function pipeline like md3_render_single() */
+  gl_state_material(&c->world->gl, &white_material);
+  gl_state_color(&c->world->gl, 1.0f, 1.0f, 1.0f, 1.0f);
+
+  if (WORLD_IS_SET(c->world, RENDER_WIREFRAME))
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+
+  for (i = 0; i < c->num_tasks; ++i)
+  {
+    task = &c->tasks[i];
+    sptr = task->sptr;
+    item = &c->items[task->item];
+
+    /* a new part */
+    if (!i || (task->item != c->tasks[i - 1].item))
+    {
+      if (i)
+        glPopMatrix();
+      glPushMatrix();
+      glMultMatrixf(item->matrix);
+    }
+
+    buffers = crowd_surface_buffers(c, sptr);
+    if (!buffers)
+      continue;
+
+    /* texture; flips go through the texture matrix */
+    shader = &sptr->shader[0];
+    textured = (WORLD_IS_SET(c->world, RENDER_TEXTURES) && shader->texture && (shader->gl_slot >= 0));
+    if (textured)
+    {
+      start = prof_begin();
+      apply_texture(c->world, shader);
+      prof_end(PROF_TEXTURE, start);
+
+      glMatrixMode(GL_TEXTURE);
+      glLoadIdentity();
+      glTranslatef((float)shader->texture->hflip, (float)shader->texture->vflip, 0.0f);
+      glScalef((shader->texture->hflip ? -1.0f : 1.0f), (shader->texture->vflip ? -1.0f : 1.0f), 1.0f);
+      glMatrixMode(GL_MODELVIEW);
+
+      glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+      glTexCoordPointer(2, GL_FLOAT, sizeof(md3_texcoord_t), NULL);
+      glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
+    else
+      glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    glBindBuffer(GL_ARRAY_BUFFER, c->vertex_buffer);
+    glVertexPointer(3, GL_FLOAT, stride, (void*)(base + (stride * task->first_vertex)));
+    glNormalPointer(GL_FLOAT, stride, (void*)(base + (stride * task->first_vertex) + (sizeof(float) * 3)));
+
+    lod_triangles(sptr, item->lod, &num_tris);
+
+    start = prof_begin();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+    glDrawElements(GL_TRIANGLES, (num_tris * 3), GL_UNSIGNED_INT, (void*)(sizeof(md3_triangle_t) * lod_first_triangle(sptr, item->lod)));
+    prof_end(PROF_DRAW, start);
+
+    c->draw_calls++;
+    c->triangles += num_tris;
+  }
+  glPopMatrix();
+
+  /* the GPU is done with this region once it passes here */
+  if (c->persistent)
+    c->fences[c->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  /* put everything back */
+  glMatrixMode(GL_TEXTURE);
+  glLoadIdentity();
+  glMatrixMode(GL_MODELVIEW);
+
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  if (WORLD_IS_SET(c->world, RENDER_WIREFRAME))
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+}
+
+/*
+ *	Get room for the interpolated vertices of this frame.
+ *
+ *	With a persistent map this is the next region of the buffer, once
+ *	the GPU is done with it; base is set to its offset in the buffer.
+ *	Otherwise it is client memory uploaded after the interpolation.
+ */
+static float*
+crowd_map_vertices(struct crowd_t* c, size_t vertices, size_t* base)
+{
+  size_t stride = (sizeof(float) * CROWD_VERTEX_FLOATS);
+  GLsync fence = NULL;
+  int i = 0;
+
+  *base = 0;
+
+  if (!c->persistent)
+  {
+    if (c->max_vertex_data < vertices)
+    {
+      c->max_vertex_data = vertices;
+      c->vertex_data = (float*)realloc(c->vertex_data, (stride * vertices));
+    }
+    return c->vertex_data;
+  }
+
+  /* too small; make a new buffer with some room to grow */
+  if (c->region_vertices < vertices)
+  {
+    crowd_free_vertices(c);
+
+    c->region_vertices = (vertices + (vertices / 2));
+    glGenBuffers(1, &c->vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, c->vertex_buffer);
+    glBufferStorage(GL_ARRAY_BUFFER, (stride * c->region_vertices * CROWD_REGIONS), NULL,
+                    (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT));
+    c->vertex_map = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, (stride * c->region_vertices * CROWD_REGIONS),
+                                                     (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (!c->vertex_map)
+    {
+      printf("Error: Crowd could not map its vertex buffer, uploading every frame instead.\n");
+      crowd_free_vertices(c);
+      glGenBuffers(1, &c->vertex_buffer);
+      c->persistent = 0;
+      return crowd_map_vertices(c, vertices, base);
+    }
+
+    for (i = 0; i < CROWD_REGIONS; ++i)
+      c->fences[i] = NULL;
+  }
+
+  /* wait until the GPU has drawn the frame that last used the region */
+  c->region = ((c->region + 1) % CROWD_REGIONS);
+  fence = (GLsync)c->fences[c->region];
+  if (fence)
+  {
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+      ;
+    glDeleteSync(fence);
+    c->fences[c->region] = NULL;
+  }
+
+  *base = (stride * c->region_vertices * c->region);
+  return (float*)(c->vertex_map + *base);
+}
+
+/*
+ *	Pool task: blend the key frames of one surface of one posed part.
+ *
+ *	Only reads the models and animation states, which stay put
+ *	while the pool runs, and writes its own slice of the output.
+ */
+static void
+crowd_interpolate(void* data, int task)
+{
+  struct crowd_t* c = (struct crowd_t*)data;
+  struct crowd_task_t* tptr = &c->tasks[task];
+  md3_instance_t* inst = c->items[tptr->item].inst;
+  md3_surface_t* sptr = tptr->sptr;
+  md3_vertex_t* vptr1 = NULL;
+  md3_vertex_t* vptr2 = NULL;
+  float* out = (c->vertex_out + (tptr->first_vertex * CROWD_VERTEX_FLOATS));
+  float t = inst->anim_state.t;
+  int i = 0;
+
+  vptr1 = &sptr->vertex[(inst->anim_state.frame % sptr->num_frames) * sptr->num_verts];
+  vptr2 = &sptr->vertex[(inst->anim_state.next_frame % sptr->num_frames) * sptr->num_verts];
+
+  for (; i < sptr->num_verts; ++i, ++vptr1, ++vptr2, out += CROWD_VERTEX_FLOATS)
+  {
+    out[0] = ((vptr1->x + (t * (vptr2->x - vptr1->x))) * MD3_XYZ_SCALE);
+    out[1] = ((vptr1->y + (t * (vptr2->y - vptr1->y))) * MD3_XYZ_SCALE);
+    out[2] = ((vptr1->z + (t * (vptr2->z - vptr1->z))) * MD3_XYZ_SCALE);
+    out[3] = (vptr1->normalxyz[0] + (t * (vptr2->normalxyz[0] - vptr1->normalxyz[0])));
+    out[4] = (vptr1->normalxyz[1] + (t * (vptr2->normalxyz[1] - vptr1->normalxyz[1])));
+    out[5] = (vptr1->normalxyz[2] + (t * (vptr2->normalxyz[2] - vptr1->normalxyz[2])));
+  }
+}
+
+/*
+ *	Free the interpolated vertex buffer and its fences.
+ */
+static void
+crowd_free_vertices(struct crowd_t* c)
+{
+  int i = 0;
+
+  for (; i < CROWD_REGIONS; ++i)
+  {
+    if (c->fences[i])
+      glDeleteSync((GLsync)c->fences[i]);
+    c->fences[i] = NULL;
+  }
+
+  if (c->vertex_map)
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, c->vertex_buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    c->vertex_map = NULL;
+  }
+
+  glDeleteBuffers(1, &c->vertex_buffer);
+  c->vertex_buffer = 0;
+  c->region_vertices = 0;
+
+  free(c->vertex_data);
+  c->vertex_data = NULL;
+  c->max_vertex_data = 0;
+}
+
+/*
+ *	The world's GL buffers of a surface, copying the surface
+ *	into them the first time; NULL if the surface is not cached.
+ *
+ *	The vertex buffer holds every frame; draws pick the frames by offset.
+ *	The index buffer holds every level of detail one after the other,
+ *	as lod_first_triangle() has them.
+ */
+static unsigned int*
+crowd_surface_buffers(struct crowd_t* c, md3_surface_t* sptr)
+{
+  unsigned int* buffers = world_surface_buffers(c->world, sptr);
+  int triangles = sptr->num_triangles;
+  int i = 0;
+
+  if (!buffers || buffers[0])
+    return buffers;
+
+  for (; i < sptr->num_lods; ++i)
+    triangles += sptr->lod_num_triangles[i];
+
+  glGenBuffers(3, buffers);
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+  glBufferData(GL_ARRAY_BUFFER, (sizeof(md3_vertex_t) * sptr->num_verts * sptr->num_frames), sptr->vertex, GL_STATIC_DRAW);
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+  glBufferData(GL_ARRAY_BUFFER, (sizeof(md3_texcoord_t) * sptr->num_verts), sptr->st, GL_STATIC_DRAW);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, (sizeof(md3_triangle_t) * triangles), NULL, GL_STATIC_DRAW);
+  glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, (sizeof(md3_triangle_t) * sptr->num_triangles), sptr->triangle);
+  for (i = 0; i < sptr->num_lods; ++i)
+  {
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (sizeof(md3_triangle_t) * lod_first_triangle(sptr, (i + 1))),
+                    (sizeof(md3_triangle_t) * sptr->lod_num_triangles[i]), sptr->lod_triangle[i]);
+  }
+
+  return buffers;
+}
+
+/*
+ *	Count the triangles of a part and everything linked to it.
+ */
+static int
+crowd_count_triangles(md3_instance_t* inst)
+{
+  int triangles = 0;
+  int i = 0;
+
+  if (!inst)
+    return 0;
+
+  triangles = inst->model->total_triangles;
+  for (; i < inst->num_links; ++i)
+    triangles += crowd_count_triangles(inst->links[i]);
+
+  return triangles;
+}
+
+/*
+ *	Order posed parts by model, level of detail, then key frame pair.
+ */
+static int
+crowd_item_cmp(const void* a, const void* b)
+{
+  const md3_instance_t* ia = ((const struct crowd_item_t*)a)->inst;
+  const md3_instance_t* ib = ((const struct crowd_item_t*)b)->inst;
+  int nf = ia->model->num_frames;
+
+  if (ia->model != ib->model)
+    return (((size_t)ia->model < (size_t)ib->model) ? -1 : 1);
+  if (((const struct crowd_item_t*)a)->lod != ((const struct crowd_item_t*)b)->lod)
+    return (((const struct crowd_item_t*)a)->lod - ((const struct crowd_item_t*)b)->lod);
+  if ((ia->anim_state.frame % nf) != (ib->anim_state.frame % nf))
+    return ((ia->anim_state.frame % nf) - (ib->anim_state.frame % nf));
+  return ((ia->anim_state.next_frame % nf) - (ib->anim_state.next_frame % nf));
+}
@@ -0,0 +1,141 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _CROWD_H
+#define _CROWD_H
+
+#include "md3_parse.h"
+#include "anim_sched.h"
+
+/*
+ *	Distance between crowd members on the grid.
+ */
+#define CROWD_SPACING 60.0f
+
+/*
+ *	Largest crowd that can be requested.
+ */
+#define CROWD_MAX_SIZE 4096
+
+/*
+ *	Slices of the interpolated vertex buffer in flight; the CPU
+ *	fills one while the GPU may still be reading the others.
+ */
+#define CROWD_REGIONS 3
+
+/*
+ *	Floats per interpolated vertex: position and normal.
+ */
+#define CROWD_VERTEX_FLOATS 6
+
+/*
+ *	A body part of a crowd member, posed and ready to draw.
+ */
+struct crowd_item_t
+{
+  md3_instance_t* inst;
+  float matrix[16]; /* part to crowd space, custom scale included	*/
+  int lod;          /* level of detail to draw it at				*/
+};
+
+/*
+ *	One surface of one posed part to interpolate on the CPU.
+ */
+struct crowd_task_t
+{
+  int item;            /* the posed part							*/
+  md3_surface_t* sptr; /* the surface of its model					*/
+  size_t first_vertex; /* where its vertices go in the output		*/
+};
+
+/*
+ *	A crowd of copies of the root model standing on a grid.
+ *
+ *	Member 0 is the root model itself so the GUI still controls it,
+ *	the others are clones with their own animation and phase.
+ */
+struct crowd_t
+{
+  struct world_t* world; /* the world the crowd stands in				*/
+
+  int size;                  /* requested number of members; 0 or 1 is off		*/
+  int stale;                 /* the root changed; members must be rebuilt		*/
+  int num_members;           /* number of members built						*/
+  md3_instance_t** members;  /* member roots; members[0] is the world root		*/
+  struct anim_sched_t sched; /* animation scheduler of the copies				*/
+
+  struct crowd_item_t* items; /* posed parts of members 1..n for this frame	*/
+  int num_items;
+  int max_items;
+
+  float* instance_data; /* per-instance attributes, uploaded each frame	*/
+  int max_instance_data;
+
+  /* GL objects; gl_state is 0 untried, 1 instanced, -1 fallback */
+  int gl_state;
+  unsigned int program;
+  unsigned int instance_buffer;
+  int u_flip;
+  int u_use_texture;
+  int u_lighting;
+
+  /*
+   *	CPU interpolation; the key frames are blended by the thread
+   *	pool into a streamed vertex buffer, the GL only draws.
+   */
+  int cpu_interpolate; /* use it instead of instancing			*/
+  int threads;         /* pool size; 0 is one per processor	*/
+  struct pool_t* pool;
+  struct crowd_task_t* tasks;
+  int num_tasks;
+  int max_tasks;
+  float* vertex_out;      /* where the pool writes this frame		*/
+  float* vertex_data;     /* client copy without persistent maps	*/
+  size_t max_vertex_data; /* vertices vertex_data can hold		*/
+  unsigned int vertex_buffer;
+  int persistent; /* vertex_buffer is mapped for good		*/
+  unsigned char* vertex_map;
+  size_t region_vertices;      /* vertices in each region of the map	*/
+  int region;                  /* region used by the last frame		*/
+  void* fences[CROWD_REGIONS]; /* GPU done with a region				*/
+
+  /* statistics for the last frame */
+  int draw_calls;
+  int triangles;
+  int vertices;     /* interpolated on the CPU	*/
+  double interp_ms; /* time spent doing it		*/
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  void crowd_set_size(struct crowd_t* c, int size);
+  void crowd_set_cpu_interpolation(struct crowd_t* c, int enable, int threads);
+  void crowd_free(struct crowd_t* c);
+  void crowd_render(struct crowd_t* c, int apply_names);
+  int crowd_is_animating(struct crowd_t* c);
+
+  void crowd_free_surface(struct world_t* wptr, md3_surface_t* sptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CROWD_H */
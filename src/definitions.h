@@ -19,18 +19,6 @@
 #ifndef _DEFINITIONS_H
 #define _DEFINITIONS_H
 
-/*
- *	Global world structure.
- */
-#ifdef __cplusplus
-extern "C"
-{
-#endif
-  extern struct world_t* g_world;
-#ifdef __cplusplus
-}
-#endif
-
 /*
  *	Version.
  */
@@ -83,6 +71,8 @@ extern "C"
 #include <gl\glu.h>
 #include <gl\glaux.h>
 #else
+/* newer entry points are exported directly, see gl_ext.h */
+#define GL_GLEXT_PROTOTYPES
 #include <GL/gl.h>
 #endif
 
@@ -0,0 +1,57 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include "gl_ext.h"
+
+#ifdef _WIN32
+#define GL_EXT_DEFINE(type, name) type p_##name = NULL;
+GL_EXT_FUNCTIONS(GL_EXT_DEFINE)
+
+#define GL_EXT_LOAD(type, name) p_##name = (type)wglGetProcAddress(#name);
+#endif
+
+/*
+ *	Fetch the entry points of the OpenGL functions newer than 1.1.
+ *
+ *	A GL context must be current.  Functions the context does
+ *	not have are left NULL.
+ */
+void
+gl_ext_init()
+{
+#ifdef _WIN32
+  GL_EXT_FUNCTIONS(GL_EXT_LOAD)
+#endif
+}
+
+/*
+ *	Check if the current context is at least the given OpenGL version.
+ */
+int
+gl_ext_version(int major, int minor)
+{
+  const char* version = (const char*)glGetString(GL_VERSION);
+  int cmajor = 0;
+  int cminor = 0;
+
+  if (!version || (sscanf(version, "%d.%d", &cmajor, &cminor) != 2))
+    return 0;
+
+  return ((cmajor > major) || ((cmajor == major) && (cminor >= minor)));
+}
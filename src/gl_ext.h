@@ -0,0 +1,143 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GL_EXT_H
+#define _GL_EXT_H
+
+/*
+ *	OpenGL functions newer than 1.1.
+ *
+ *	On Linux libGL exports everything and definitions.h asks
+ *	for the prototypes, so they are called directly.
+ *
+ *	Windows only ships OpenGL 1.1 headers and libraries, so the
+ *	entry points are fetched with wglGetProcAddress() in gl_ext_init().
+ *	Qt carries a copy of glext.h that provides the types.
+ *
+ *	Either way check gl_ext_version() before using a function.
+ */
+
+#include "definitions.h"
+
+#ifdef _WIN32
+#include <qopenglext.h>
+
+#define GL_EXT_FUNCTIONS(X)                                           \
+  X(PFNGLGENBUFFERSPROC, glGenBuffers)                                \
+  X(PFNGLBINDBUFFERPROC, glBindBuffer)                                \
+  X(PFNGLBUFFERDATAPROC, glBufferData)                                \
+  X(PFNGLBUFFERSUBDATAPROC, glBufferSubData)                          \
+  X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers)                          \
+  X(PFNGLCREATESHADERPROC, glCreateShader)                            \
+  X(PFNGLSHADERSOURCEPROC, glShaderSource)                            \
+  X(PFNGLCOMPILESHADERPROC, glCompileShader)                          \
+  X(PFNGLGETSHADERIVPROC, glGetShaderiv)                              \
+  X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog)                    \
+  X(PFNGLDELETESHADERPROC, glDeleteShader)                            \
+  X(PFNGLCREATEPROGRAMPROC, glCreateProgram)                          \
+  X(PFNGLATTACHSHADERPROC, glAttachShader)                            \
+  X(PFNGLBINDATTRIBLOCATIONPROC, glBindAttribLocation)                \
+  X(PFNGLLINKPROGRAMPROC, glLinkProgram)                              \
+  X(PFNGLGETPROGRAMIVPROC, glGetProgramiv)                            \
+  X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog)                  \
+  X(PFNGLDELETEPROGRAMPROC, glDeleteProgram)                          \
+  X(PFNGLUSEPROGRAMPROC, glUseProgram)                                \
+  X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation)                \
+  X(PFNGLUNIFORM1IPROC, glUniform1i)                                  \
+  X(PFNGLUNIFORM2FPROC, glUniform2f)                                  \
+  X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer)              \
+  X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray)      \
+  X(PFNGLDISABLEVERTEXATTRIBARRAYPROC, glDisableVertexAttribArray)    \
+  X(PFNGLVERTEXATTRIBDIVISORPROC, glVertexAttribDivisor)              \
+  X(PFNGLDRAWELEMENTSINSTANCEDPROC, glDrawElementsInstanced)          \
+  X(PFNGLBUFFERSTORAGEPROC, glBufferStorage)                          \
+  X(PFNGLMAPBUFFERRANGEPROC, glMapBufferRange)                        \
+  X(PFNGLUNMAPBUFFERPROC, glUnmapBuffer)                              \
+  X(PFNGLFENCESYNCPROC, glFenceSync)                                  \
+  X(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync)                        \
+  X(PFNGLDELETESYNCPROC, glDeleteSync)                                \
+  X(PFNGLGENQUERIESPROC, glGenQueries)                                \
+  X(PFNGLDELETEQUERIESPROC, glDeleteQueries)                          \
+  X(PFNGLQUERYCOUNTERPROC, glQueryCounter)                            \
+  X(PFNGLGETQUERYOBJECTIVPROC, glGetQueryObjectiv)                    \
+  X(PFNGLGETQUERYOBJECTUI64VPROC, glGetQueryObjectui64v)
+
+#define GL_EXT_DECLARE(type, name) extern type p_##name;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+  GL_EXT_FUNCTIONS(GL_EXT_DECLARE)
+#ifdef __cplusplus
+}
+#endif
+
+#define glGenBuffers p_glGenBuffers
+#define glBindBuffer p_glBindBuffer
+#define glBufferData p_glBufferData
+#define glBufferSubData p_glBufferSubData
+#define glDeleteBuffers p_glDeleteBuffers
+#define glCreateShader p_glCreateShader
+#define glShaderSource p_glShaderSource
+#define glCompileShader p_glCompileShader
+#define glGetShaderiv p_glGetShaderiv
+#define glGetShaderInfoLog p_glGetShaderInfoLog
+#define glDeleteShader p_glDeleteShader
+#define glCreateProgram p_glCreateProgram
+#define glAttachShader p_glAttachShader
+#define glBindAttribLocation p_glBindAttribLocation
+#define glLinkProgram p_glLinkProgram
+#define glGetProgramiv p_glGetProgramiv
+#define glGetProgramInfoLog p_glGetProgramInfoLog
+#define glDeleteProgram p_glDeleteProgram
+#define glUseProgram p_glUseProgram
+#define glGetUniformLocation p_glGetUniformLocation
+#define glUniform1i p_glUniform1i
+#define glUniform2f p_glUniform2f
+#define glVertexAttribPointer p_glVertexAttribPointer
+#define glEnableVertexAttribArray p_glEnableVertexAttribArray
+#define glDisableVertexAttribArray p_glDisableVertexAttribArray
+#define glVertexAttribDivisor p_glVertexAttribDivisor
+#define glDrawElementsInstanced p_glDrawElementsInstanced
+#define glBufferStorage p_glBufferStorage
+#define glMapBufferRange p_glMapBufferRange
+#define glUnmapBuffer p_glUnmapBuffer
+#define glFenceSync p_glFenceSync
+#define glClientWaitSync p_glClientWaitSync
+#define glDeleteSync p_glDeleteSync
+#define glGenQueries p_glGenQueries
+#define glDeleteQueries p_glDeleteQueries
+#define glQueryCounter p_glQueryCounter
+#define glGetQueryObjectiv p_glGetQueryObjectiv
+#define glGetQueryObjectui64v p_glGetQueryObjectui64v
+#endif /* _WIN32 */
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  void gl_ext_init();
+  int gl_ext_version(int major, int minor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GL_EXT_H */
@@ -0,0 +1,145 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include "definitions.h"
+#include "world.h"
+#include "gl_state.h"
+
+static GLenum gl_state_cap(int what);
+
+/*
+ *	Forget everything GL is known to have and zero the counts;
+ *	the next call of each kind goes to GL.
+ */
+void
+gl_state_reset(struct gl_state_t* gs)
+{
+  memset(gs, 0, sizeof(struct gl_state_t));
+}
+
+/*
+ *	Forget the given GL_STATE_ bits, after something set them
+ *	around the cache.
+ */
+void
+gl_state_forget(struct gl_state_t* gs, int what)
+{
+  gs->known &= ~what;
+}
+
+/*
+ *	Enable or disable GL_STATE_LIGHTING, GL_STATE_TEXTURE_2D or both.
+ */
+void
+gl_state_enable(struct gl_state_t* gs, int what, int on)
+{
+  int bit;
+
+  for (bit = GL_STATE_LIGHTING; bit <= GL_STATE_TEXTURE_2D; bit <<= 1)
+  {
+    if (!(what & bit))
+      continue;
+
+    if ((gs->known & bit) && (((gs->enabled & bit) != 0) == (on != 0)))
+    {
+      ++gs->filtered;
+      continue;
+    }
+
+    if (on)
+    {
+      glEnable(gl_state_cap(bit));
+      gs->enabled |= bit;
+    }
+    else
+    {
+      glDisable(gl_state_cap(bit));
+      gs->enabled &= ~bit;
+    }
+    gs->known |= bit;
+    ++gs->issued;
+  }
+}
+
+/*
+ *	Bind a texture to GL_TEXTURE_2D.
+ */
+void
+gl_state_bind_texture(struct gl_state_t* gs, unsigned int texture)
+{
+  if ((gs->known & GL_STATE_TEXTURE) && (gs->texture == texture))
+  {
+    ++gs->filtered;
+    return;
+  }
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  gs->texture = texture;
+  gs->known |= GL_STATE_TEXTURE;
+  ++gs->issued;
+}
+
+/*
+ *	Apply a material, unless it is the one applied last.
+ */
+void
+gl_state_material(struct gl_state_t* gs, struct material_t* material)
+{
+  if ((gs->known & GL_STATE_MATERIAL) && (gs->material == material))
+  {
+    gs->filtered += GL_STATE_MATERIAL_CALLS;
+    return;
+  }
+
+  apply_material(material);
+  gs->material = material;
+  gs->known |= GL_STATE_MATERIAL;
+  gs->issued += GL_STATE_MATERIAL_CALLS;
+}
+
+/*
+ *	Set the current colour.
+ */
+void
+gl_state_color(struct gl_state_t* gs, float r, float g, float b, float a)
+{
+  if ((gs->known & GL_STATE_COLOR) && (gs->color[0] == r) && (gs->color[1] == g) && (gs->color[2] == b) &&
+      (gs->color[3] == a))
+  {
+    ++gs->filtered;
+    return;
+  }
+
+  glColor4f(r, g, b, a);
+  gs->color[0] = r;
+  gs->color[1] = g;
+  gs->color[2] = b;
+  gs->color[3] = a;
+  gs->known |= GL_STATE_COLOR;
+  ++gs->issued;
+}
+
+/*
+ *	The GL capability of a GL_STATE_ bit.
+ */
+static GLenum
+gl_state_cap(int what)
+{
+  return ((what == GL_STATE_LIGHTING) ? GL_LIGHTING : GL_TEXTURE_2D);
+}
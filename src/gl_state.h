@@ -0,0 +1,79 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _GL_STATE_H
+#define _GL_STATE_H
+
+/*
+ *	GL state cache.
+ *
+ *	Drawing a part sets the same material, colour and capabilities
+ *	for every surface, and most parts bind a texture the one before
+ *	left bound.  The gl_state_ calls remember what they last set and
+ *	only call GL when it changes, counting the calls made and those
+ *	dropped.
+ *
+ *	The cache only knows what went through it.  gl_state_reset()
+ *	forgets everything at the start of a frame, and whatever sets
+ *	the same state around it, as the display lists do, must
+ *	gl_state_forget() that state after.
+ */
+
+/* state the cache tracks, for gl_state_enable() and gl_state_forget() */
+#define GL_STATE_LIGHTING 0x01
+#define GL_STATE_TEXTURE_2D 0x02
+#define GL_STATE_TEXTURE 0x04  /* the texture bound				*/
+#define GL_STATE_MATERIAL 0x08
+#define GL_STATE_COLOR 0x10
+#define GL_STATE_ALL 0x1f
+
+/* GL calls apply_material() makes */
+#define GL_STATE_MATERIAL_CALLS 5
+
+struct material_t;
+
+struct gl_state_t
+{
+  int known;                   /* GL_STATE_ bits of what GL is known to have	*/
+  int enabled;                 /* the GL_STATE_LIGHTING and _TEXTURE_2D on		*/
+  unsigned int texture;        /* bound to GL_TEXTURE_2D						*/
+  struct material_t* material; /* compared by pointer; materials never change	*/
+  float color[4];
+
+  int issued;   /* GL calls made since the reset			*/
+  int filtered; /* and dropped as they changed nothing	*/
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  void gl_state_reset(struct gl_state_t* gs);
+  void gl_state_forget(struct gl_state_t* gs, int what);
+
+  void gl_state_enable(struct gl_state_t* gs, int what, int on);
+  void gl_state_bind_texture(struct gl_state_t* gs, unsigned int texture);
+  void gl_state_material(struct gl_state_t* gs, struct material_t* material);
+  void gl_state_color(struct gl_state_t* gs, float r, float g, float b, float a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GL_STATE_H */
@@ -21,6 +21,7 @@
 #include <QSurfaceFormat>
 #include <QEvent>
 #include <math.h>
+#include <stdio.h>
 #include <GL/glu.h>
 #include "quaternion.h"
 #include "render.h"
@@ -29,6 +30,17 @@
 #include "gui.h"
 #include "gl_widget.h"
 #include "md3_parse.h"
+#include "sim.h"
+#include "prof.h"
+
+/*
+ *	world_t redraw callback; may be called from the simulation thread.
+ */
+static void
+gl_widget_redraw(void* data)
+{
+  QMetaObject::invokeMethod((gl_widget*)data, "update", Qt::QueuedConnection);
+}
 
 gl_widget::gl_widget(int argc, char** argv, const QSurfaceFormat& format, QWidget* parent, const char* name, const QOpenGLWidget* shareWidget, Qt::WindowFlags f)
   : QOpenGLWidget(parent, f)
@@ -44,32 +56,44 @@ gl_widget::gl_widget(int argc, char** argv, const QSurfaceFormat& format, QWidge
   this->mouse.sensitivity = 2.0f;
 
   /* initialize frame rate stuff */
-  this->next_frame_msec = 0;
-  this->last_msec = 0;
+  this->frame_msec = 0;
+  this->fps_msec = 0;
+  this->swap_start = 0;
   this->frames = 0;
-  this->frame_skip = 0;
+  this->animating = 0;
   this->max_frame_rate = MAX_FRAMERATE;
 
   /* set selected object to nothing */
   this->selected_object = NULL;
 
   /*
-   *	Setup the event timer - this will give us render calls on idle cycles
-   *
    *	Optimization.
    *
-   *	A one millisecond delay always occurs between rendering frames.
-   *	This is to minimize CPU usage by constantly executing the process.
-   *	This also means that a maximum of 1000 frames can be rendered per second,
-   *	which is fine since the monitor probably can not handle over 100.
+   *	Frames are only drawn when asked for.  Changes to the world ask
+   *	through world_redraw(), the mouse handlers call update().  While
+   *	something is animating frame_swapped() asks for the next frame,
+   *	no sooner than 1 / max_frame_rate after the last one started.
+   *
+   *	A static or hidden view draws nothing and the process sleeps.
    */
-  this->timer = new QTimer(this);
-  this->timer->start(1);
-  QObject::connect(this->timer, SIGNAL(timeout()), this, SLOT(idle_cycle()));
+  g_world->redraw = gl_widget_redraw;
+  g_world->redraw_data = this;
+
+  this->frame_timer = new QTimer(this);
+  this->frame_timer->setSingleShot(true);
+  this->frame_timer->setTimerType(Qt::PreciseTimer);
+  QObject::connect(this->frame_timer, SIGNAL(timeout()), this, SLOT(update()));
+  QObject::connect(this, SIGNAL(frameSwapped()), this, SLOT(frame_swapped()));
+
+  /* started by the first frame, stops itself when none are drawn */
+  this->fps_timer = new QTimer(this);
+  QObject::connect(this->fps_timer, SIGNAL(timeout()), this, SLOT(show_fps()));
 }
 
 gl_widget::~gl_widget()
 {
+  g_world->redraw = NULL;
+
   /*
    *	Delete the bounding box list from GL.
    */
@@ -78,56 +102,69 @@ gl_widget::~gl_widget()
 }
 
 /*
- *	Called by the timer constantly.
+ *	Called when a frame has been handed to the window system.
+ *
+ *	With vsync the swap has already waited for the display, so the
+ *	next frame is usually asked for right away.
  */
 void
-gl_widget::idle_cycle()
+gl_widget::frame_swapped()
 {
-  char buf[64] = {0};
-  double now = get_time_in_ms();
+  double wait;
 
-  if (now >= this->next_frame_msec)
-  {
-    /* one second has elapsed */
+  prof_end(PROF_SWAP, this->swap_start);
+  prof_frame_end();
 
-    /* update GUI widget with frame rate */
-    sprintf(buf, "%i Frames Per Second     %i Skip", this->frames, this->frame_skip);
-    g_gui->fps->setText(buf);
+  if (!this->animating)
+    return;
 
-    this->next_frame_msec = (now + 1000.0);
-    this->frames = 1;
-    this->frame_skip = 0;
-  }
-  else
-  {
-    if ((now - this->last_msec) <= ((1000.0 / this->max_frame_rate) - 1))
-    {
-      /*
-       *	Optimization.
-       *
-       *	If the last frame was rendered less than
-       *		1 millisecond / maximum FPS
-       *	milliseconds ago then skip the rendering of
-       *	this frame.
-       *	This allows the FPS to be capped at
-       *	max_frame_rate so extra CPU is not wasted
-       *	on rerendering virtually the same scene.
-       *
-       *	On my AMD64 machine this reduces the
-       *	FPS from 2800 to max_frame_rate.
-       *
-       *	Note the -1 in the equation is for the timer delay of 1ms.
-       */
-      this->frame_skip++;
-      return;
-    }
+  wait = ((this->frame_msec + (1000.0 / this->max_frame_rate)) - get_time_in_ms());
+  this->frame_timer->start((wait > 0) ? (int)wait : 0);
+}
 
-    this->last_msec = now;
-    this->frames++;
+/*
+ *	Called once a second while frames are drawn to show the frame rate.
+ *
+ *	The frame time percentiles are shown next to it, the tool tip
+ *	breaks them down by stage.
+ */
+void
+gl_widget::show_fps()
+{
+  char buf[128] = {0};
+  char tip[2048] = {0};
+  double now = get_time_in_ms();
+  float p50, p95, p99;
+  int len = 0;
+  int i;
+
+  prof_percentiles(PROF_FRAME, &p50, &p95, &p99);
+  sprintf(buf, "%i Frames Per Second     %.1f / %.1f / %.1f ms",
+          (int)((this->frames * 1000.0 / (now - this->fps_msec)) + 0.5), (double)p50, (double)p95, (double)p99);
+  g_gui->fps->setText(buf);
+
+  len = sprintf(tip, "Milliseconds per frame over the last %i frames\n%-21s %7s %7s %7s",
+                prof_percentiles(PROF_FRAME, &p50, &p95, &p99), "stage", "p50", "p95", "p99");
+  for (i = 0; i < PROF_STAGES; ++i)
+  {
+    prof_percentiles((prof_stage_e)i, &p50, &p95, &p99);
+    len += sprintf(&tip[len], "\n%-21s %7.2f %7.2f %7.2f", prof_stage_name((prof_stage_e)i), (double)p50, (double)p95, (double)p99);
   }
-
-  /* rerender */
-  this->update();
+  if (WORLD_IS_SET(g_world, ENGINE_FRUSTUM_CULL))
+    len += sprintf(&tip[len], "\n\nCulled in the last frame: %i of %i parts, %i of %i surfaces",
+                   g_world->cull.parts_culled, g_world->cull.parts, g_world->cull.surfaces_culled, g_world->cull.surfaces);
+  if (WORLD_IS_SET(g_world, ENGINE_LOD))
+    len += sprintf(&tip[len], "\n\nLeft out by the levels of detail in the last frame: %i triangles", g_world->cull.triangles_lod);
+  len += sprintf(&tip[len], "\n\nGL state calls in the last frame: %i made, %i dropped as they changed nothing",
+                 g_world->gl.issued, g_world->gl.filtered);
+  g_gui->fps->setToolTip(QString("<pre>%1</pre>").arg(tip));
+
+  /* nothing drawn for a second; wait for the next frame */
+  if (!this->frames)
+    this->fps_timer->stop();
+
+  this->fps_msec = now;
+  this->frames = 0;
 }
 
 /*
@@ -136,76 +173,7 @@ gl_widget::idle_cycle()
 void
 gl_widget::initializeGL()
 {
-  /* enable gl options */
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_NORMALIZE);
-  glEnable(GL_TEXTURE_2D);
-  glEnable(GL_BLEND);
-  glEnable(GL_CULL_FACE);
-
-  /* clear the stencil buffer */
-  glClearStencil(0);
-
-  if (WORLD_IS_SET(ENGINE_LIGHTING))
-    glEnable(GL_LIGHTING);
-
-  /*
-   *	Optimization.
-   *	We want every optimization possible,
-   *	so we don't draw the back faces.
-   */
-  glCullFace(GL_FRONT);
-
-  glShadeModel(GL_SMOOTH);
-
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-/* set texture options */
-#if 0
-	this is done when a texture is bound
-	
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-#endif
-
-  /* set background color */
-  glClearColor(g_world->env.bg_rgba[0], g_world->env.bg_rgba[1], g_world->env.bg_rgba[2], g_world->env.bg_rgba[3]);
-
-  /* make the bounding box */
-  g_world->gl_box_id = make_bounding_box();
-  g_world->gl_plane_id = make_tes_plane();
-
-  /* register the mirror walls */
-  {
-    /* floor */
-    double clip[] = {0.0, -1.0, 0.0, 0.0};
-    float origin[] = {-50.0f, -25.0f, -50.0f};
-    float axis[] = {0.0f, 0.0f, 0.0f};
-    float normal[] = {0.0f, -1.0f, 0.0f};
-    float angle = 0.0f;
-    world_register_mirror(g_world, clip, origin, normal, axis, angle);
-  }
-  {
-    /* right wall */
-    double clip[] = {0.0, -1.0, 0.0, 0.0};
-    float origin[] = {-50.0f, -50.0f, -75.0f};
-    float axis[] = {1.0f, 0.0f, 0.0f};
-    float normal[] = {0.0f, 0.0f, -1.0f};
-    float angle = 90.0f;
-    world_register_mirror(g_world, clip, origin, normal, axis, angle);
-  }
-  {
-    /* back wall */
-    double clip[] = {0.0, -1.0, 0.0, 0.0};
-    float origin[] = {-75.0f, -50.0f, -50.0f};
-    float axis[] = {0.0f, 0.0f, 1.0f};
-    float normal[] = {-1.0f, 0.0f, 0.0f};
-    float angle = -90.0f;
-    world_register_mirror(g_world, clip, origin, normal, axis, angle);
-  }
+  render_setup(g_world);
 }
 
 #include "accum.h"
@@ -215,20 +183,10 @@ gl_widget::initializeGL()
 void
 gl_widget::resizeGL(int w, int h)
 {
-  /* setup viewport */
-  glViewport(0, 0, w, h);
-
-  /* setup the projection matrix */
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  gluPerspective(g_world->env.fov, ((float)w / (float)h), g_world->env.vnear, g_world->env.vfar);
+  render_viewport(g_world, w, h);
 
   this->width = w;
   this->height = h;
-
-  /* switch back and initialize the model view matrix */
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
 }
 
 /*
@@ -237,46 +195,30 @@ gl_widget::resizeGL(int w, int h)
 void
 gl_widget::paintGL()
 {
-  /* clear color and depth buffers */
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+  struct sim_snapshot_t* snap = NULL;
 
-  /* set matrix mode to model view */
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
+  prof_frame_begin();
 
-  /* initialize names buffer */
-  glInitNames();
-  glPushName(0);
-  glLoadName(ETHER);
-
-  /* setup camera */
-  gluLookAt(g_world->camera.r * cos(g_world->camera.prot * deg) * cos(g_world->camera.trot * deg),
-            g_world->camera.r * sin(g_world->camera.prot * deg),
-            g_world->camera.r * cos(g_world->camera.prot * deg) * sin(g_world->camera.trot * deg),
-            g_world->camera.center_xyz[0],
-            g_world->camera.center_xyz[1],
-            g_world->camera.center_xyz[2],
-            0,
-            1,
-            0);
-
-  /* apply the light sources */
-  if (WORLD_IS_SET(ENGINE_LIGHTING))
+  this->frame_msec = get_time_in_ms();
+  this->frames++;
+  if (!this->fps_timer->isActive())
   {
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
-    apply_light(GL_LIGHT0, &g_world->light[0]);
+    this->fps_msec = this->frame_msec;
+    this->fps_timer->start(1000);
   }
-  else
-    glDisable(GL_LIGHTING);
 
-  /* apply textures */
-  if (WORLD_IS_SET(RENDER_TEXTURES))
-    glEnable(GL_TEXTURE_2D);
-  else
-    glDisable(GL_TEXTURE_2D);
+  /* the newest pose from the simulation; used for every pass of this frame */
+  snap = sim_acquire(g_world->sim);
+
+  render_view(g_world);
+  render_c(g_world);
+
+  /* keep drawing while something moves */
+  this->animating = (snap ? snap->animating : world_is_animating(g_world->root_instance));
+  this->animating |= crowd_is_animating(&g_world->crowd);
 
-  render_c();
+  /* Qt swaps after this returns; frame_swapped() ends the frame */
+  this->swap_start = prof_begin();
 }
 
 /*
@@ -421,13 +363,14 @@ gl_widget::select_object(int x, int y)
 
   /*
    *	We do not need multipass rendering when doing selection.
-   *	Turn off AA and Depth of Field.
+   *	Turn off AA and Depth of Field; straight in the flags, as
+   *	world_set_options() would ask for a frame for each.
    */
-  if (WORLD_IS_SET(ENGINE_AA))
+  if (WORLD_IS_SET(g_world, ENGINE_AA))
     reenable_flags |= ENGINE_AA;
-  if (WORLD_IS_SET(ENGINE_DEPTH_OF_FIELD))
+  if (WORLD_IS_SET(g_world, ENGINE_DEPTH_OF_FIELD))
     reenable_flags |= ENGINE_DEPTH_OF_FIELD;
-  world_set_options(g_world, 0, reenable_flags);
+  g_world->flags &= ~reenable_flags;
 
   glSelectBuffer(128, buf);             /* set buffer to local */
   glGetIntegerv(GL_VIEWPORT, viewport); /* get current viewport configuration */
@@ -475,7 +418,7 @@ gl_widget::select_object(int x, int y)
     this->selected_object = NULL;
   else
   {
-    this->selected_object = world_get_model_by_type((md3_body_parts_e)target);
+    this->selected_object = world_get_instance_by_type(g_world, (md3_body_parts_e)target);
 
     /* turn on rendering this objects bounding box */
     if (this->selected_object)
@@ -486,5 +429,5 @@ gl_widget::select_object(int x, int y)
   g_gui->srot->object_selected(this->selected_object);
 
   /* Reenable the flags we turned off */
-  world_set_options(g_world, reenable_flags, 0);
+  g_world->flags |= reenable_flags;
 }
@@ -27,8 +27,8 @@
 #include "world.h"
 
 /*
- *	The maximum number of frames to be rendered.
- *	This is just an estimation and it may go slightly over.
+ *	The maximum number of frames rendered per second while animating.
+ *	Vsync, when the driver does it, may hold it lower.
  */
 #define MAX_FRAMERATE 100
 
@@ -39,17 +39,19 @@ class gl_widget : public QOpenGLWidget
 public:
   gl_widget(int argc, char** argv, const QSurfaceFormat& format, QWidget* parent = 0, const char* name = 0, const QOpenGLWidget* shareWidget = 0, Qt::WindowFlags f = 0);
   ~gl_widget();
-  md3_model_t* selected_object; /* currently selected object	*/
+  md3_instance_t* selected_object; /* currently selected object	*/
 
 public slots:
-  void idle_cycle();
+  void frame_swapped();
+  void show_fps();
 
 private:
   /* functions */
   void gl_widget::select_object(int x, int y);
 
   /* data */
-  QTimer* timer;
+  QTimer* frame_timer; /* paces frames while animating			*/
+  QTimer* fps_timer;   /* updates the frame rate once a second	*/
 
   int argc;
   char** argv;
@@ -59,10 +61,11 @@ private:
   int height;
 
   /* frame rate information */
-  double next_frame_msec;
-  double last_msec;
+  double frame_msec; /* when the last frame was started		*/
+  double fps_msec;   /* when frames was last reset			*/
+  double swap_start; /* when paintGL() returned				*/
   int frames;
-  int frame_skip;
+  int animating; /* something moved in the last frame	*/
 
   int max_frame_rate; /* maximum possible FPS */
 
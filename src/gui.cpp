@@ -22,9 +22,12 @@
 #include "gl_widget.h"
 #include "gui.h"
 #include "world.h"
+#include "sim.h"
+#include "trace.h"
 
 /* global to GUI widget - singleton */
 class gui_widget* g_gui = NULL;
+struct world_t* g_world = NULL;
 
 /*
  *	Entry point for the Qt portion.
@@ -36,10 +39,15 @@ gui_start(int argc, char** argv)
 
   gui_widget* gptr = new gui_widget(argc, argv);
 
+  /* the default models are loaded; hand them to the simulation */
+  sim_start(g_world->sim);
+
   gptr->show();
 
   int ret = app.exec();
 
+  sim_stop(g_world->sim);
+
   delete gptr;
   return ret;
 }
@@ -163,7 +171,7 @@ gui_widget::gui_widget(int argc, char** argv)
 
   /* set model info */
   char buf[64];
-  sprintf(buf, "Trianges: %i     Frames: %i", g_world->model_triangles, g_world->root_model ? g_world->root_model->num_frames : 0);
+  sprintf(buf, "Trianges: %i     Frames: %i", g_world->model_triangles, g_world->root_instance ? g_world->root_instance->model->num_frames : 0);
   this->model_inf->setText(buf);
 
   /*
@@ -212,21 +220,21 @@ model_widget::model_widget(enum loadable_types mtype, int strips, Qt::Orientatio
  */
 #ifdef DEFAULT_LOAD_MODEL
   if (mtype == MODEL_TYPE)
-    this->model = load_model(DEFAULT_LOAD_MODEL);
+    this->model = load_model(g_world, DEFAULT_LOAD_MODEL);
 
 #ifdef DEFAULT_LOAD_WEAPON
   if (mtype == WEAPON_TYPE)
-    this->model = load_weapon(DEFAULT_LOAD_WEAPON, "../");
+    this->model = load_weapon(g_world, DEFAULT_LOAD_WEAPON, "../");
 #endif
 
   /*
    *	Set the default animations.
    */
-  SET_DEFAULT_ANIMATIONS();
+  SET_DEFAULT_ANIMATIONS(g_world);
 
 #endif
 #ifdef DEFAULT_LOAD_LIGHT0
-  load_light_model(DEFAULT_LOAD_LIGHT0, 0);
+  load_light_model(g_world, DEFAULT_LOAD_LIGHT0, 0);
 #endif
 }
 
@@ -256,22 +264,26 @@ model_widget::load()
      *	For this reason after the model has been loaded we must relink
      *	the weapon back into the new tree.
      */
-    md3_model_t* weapon = world_get_model_by_type(MD3_WEAPON);
+    sim_lock(g_world->sim);
+
+    md3_instance_t* weapon = world_get_instance_by_type(g_world, MD3_WEAPON);
     if (this->model)
-      unload_model(this->model, 0);
+      unload_model(g_world, this->model, 0);
 
     /* load the full model */
-    this->model = load_model((char*)s.toLatin1().data());
+    this->model = load_model(g_world, (char*)s.toLatin1().data());
 
     /* relink the weapon */
     if (weapon)
-      world_link_model(g_world, weapon);
+      world_link_instance(g_world, weapon);
+
+    sim_unlock(g_world->sim);
 
     /* now that the model has been loaded the GUI animation stuff must be reset */
     g_gui->animate->reset_animation();
 
     char buf[64];
-    sprintf(buf, "Trianges: %i     Frames: %i", g_world->model_triangles, g_world->root_model ? g_world->root_model->num_frames : 0);
+    sprintf(buf, "Trianges: %i     Frames: %i", g_world->model_triangles, g_world->root_instance ? g_world->root_instance->model->num_frames : 0);
     g_gui->model_inf->setText(buf);
   }
   else
@@ -284,13 +296,19 @@ model_widget::load()
     if (s.isEmpty())
       return;
 
+    sim_lock(g_world->sim);
+
     /* if there was previously a model loaded unload it */
     if (this->model)
-      unload_weapon(this->model);
+      unload_weapon(g_world, this->model);
 
     /* load the weapon model */
-    this->model = load_weapon((char*)s.toLatin1().data(), "../");
+    this->model = load_weapon(g_world, (char*)s.toLatin1().data(), "../");
+
+    sim_unlock(g_world->sim);
   }
+
+  world_redraw(g_world);
 }
 
 /***********************************************************************************
@@ -419,7 +437,7 @@ animate_widget::reset_animation()
   /*
    *	Set animation to default.
    */
-  SET_DEFAULT_ANIMATIONS();
+  SET_DEFAULT_ANIMATIONS(g_world);
 
   /*
    *	Set drop-down boxes to first elements.
@@ -451,7 +469,7 @@ animate_widget::tl_clicked()
   if (!selected)
     return;
 
-  set_model_animation((md3_animations_e)anims[selected - 1]);
+  set_model_animation(g_world, (md3_animations_e)anims[selected - 1]);
 }
 
 /*
@@ -477,7 +495,7 @@ animate_widget::t_clicked()
   if (!selected)
     return;
 
-  set_model_animation((md3_animations_e)anims[selected - 1]);
+  set_model_animation(g_world, (md3_animations_e)anims[selected - 1]);
 }
 
 /*
@@ -508,7 +526,7 @@ animate_widget::l_clicked()
   if (!selected)
     return;
 
-  set_model_animation((md3_animations_e)anims[selected - 1]);
+  set_model_animation(g_world, (md3_animations_e)anims[selected - 1]);
 }
 
 /*
@@ -519,7 +537,7 @@ animate_widget::l_clicked()
 void
 animate_widget::tls_clicked()
 {
-  world_stop_model_animation(MD3_LEGS | MD3_TORSO);
+  world_stop_model_animation(g_world, MD3_LEGS | MD3_TORSO);
 }
 
 /*
@@ -530,7 +548,7 @@ animate_widget::tls_clicked()
 void
 animate_widget::ts_clicked()
 {
-  world_stop_model_animation(MD3_TORSO);
+  world_stop_model_animation(g_world, MD3_TORSO);
 }
 
 /*
@@ -541,7 +559,7 @@ animate_widget::ts_clicked()
 void
 animate_widget::ls_clicked()
 {
-  world_stop_model_animation(MD3_LEGS);
+  world_stop_model_animation(g_world, MD3_LEGS);
 }
 
 /*
@@ -552,7 +570,7 @@ animate_widget::ls_clicked()
 void
 animate_widget::stopall_clicked()
 {
-  world_stop_model_animation(MD3_LEGS | MD3_TORSO);
+  world_stop_model_animation(g_world, MD3_LEGS | MD3_TORSO);
 }
 
 /*
@@ -632,6 +650,16 @@ opt_widget::opt_widget(int strips, Qt::Orientation orientation, const QString& t
   this->opt_grid->addWidget(this->reset_lights, 4, 0, 1, 2);
   connect(reset_lights, SIGNAL(clicked()), this, SLOT(resetLights_pushed()));
 
+  this->traceCB = new QCheckBox("Record Trace", this->base);
+  this->traceCB->setChecked(trace_enabled());
+  this->opt_grid->addWidget(this->traceCB, 5, 0, 1, 2);
+  connect(traceCB, SIGNAL(clicked()), this, SLOT(trace_checked()));
+
+  this->fast_slerpCB = new QCheckBox("Fast Slerp", this->base);
+  this->fast_slerpCB->setChecked(WORLD_IS_SET(g_world, ENGINE_FAST_SLERP));
+  this->opt_grid->addWidget(this->fast_slerpCB, 6, 0, 1, 2);
+  connect(fast_slerpCB, SIGNAL(clicked()), this, SLOT(fast_slerp_checked()));
+
   /*
    *	second column
    */
@@ -786,6 +814,41 @@ opt_widget::resetLights_pushed()
   g_world->light[0].r = DEFAULT_LIGHT_DISTANCE;
   g_world->light[0].dir_trot = DEFAULT_LIGHT_DIR_TROT;
   g_world->light[0].dir_prot = DEFAULT_LIGHT_DIR_PROT;
+
+  world_redraw(g_world);
+}
+
+/*
+ *	opt_widget::trace_checked()
+ *
+ *	Start recording a trace, or stop and write it.
+ */
+void
+opt_widget::trace_checked()
+{
+  if (this->traceCB->isChecked() == true)
+  {
+    QString s = QFileDialog::getSaveFileName(this, "Save Trace", "trace.json", "Chrome Trace (*.json)");
+
+    if (s.isEmpty() || !trace_start((char*)s.toLatin1().data()))
+      this->traceCB->setChecked(false);
+  }
+  else
+    trace_stop();
+}
+
+/*
+ *	opt_widget::fast_slerp_checked()
+ *
+ *	Toggle approximating the slerp of the tags.
+ */
+void
+opt_widget::fast_slerp_checked()
+{
+  if (this->fast_slerpCB->isChecked() == true)
+    world_set_options(g_world, ENGINE_FAST_SLERP, 0);
+  else
+    world_set_options(g_world, 0, ENGINE_FAST_SLERP);
 }
 
 /***********************************************************************************
@@ -875,7 +938,7 @@ srot_widget::srot_widget(int strips, Qt::Orientation orientation, const QString&
  *	A new object was selected.
  */
 void
-srot_widget::object_selected(md3_model_t* model)
+srot_widget::object_selected(md3_instance_t* model)
 {
 
   char* title = "";
@@ -927,17 +990,23 @@ srot_widget::object_selected(md3_model_t* model)
   }
   this->setTitle(title);
 
+  /* the simulation may be changing these */
+  sim_lock(g_world->sim);
+  float scale = model->scale_factor;
+  float rot[3] = {model->rot[0], model->rot[1], model->rot[2]};
+  sim_unlock(g_world->sim);
+
   /*
    *	Set the scale slider to what this model scale factor is.
    */
-  this->scale_S->setValue((int)(model->scale_factor * 100.0f));
+  this->scale_S->setValue((int)(scale * 100.0f));
 
   /*
           Sets all the rotation sliders to what the model's rotation factors are
   */
-  this->xrot_S->setValue((int)(model->rot[0]));
-  this->yrot_S->setValue((int)(model->rot[1]));
-  this->zrot_S->setValue((int)(model->rot[2]));
+  this->xrot_S->setValue((int)(rot[0]));
+  this->yrot_S->setValue((int)(rot[1]));
+  this->zrot_S->setValue((int)(rot[2]));
 }
 
 /*
@@ -961,7 +1030,7 @@ srot_widget::scale_changed(int s_factor)
     /* no model selected */
     return;
 
-  this->selected_model->scale_factor = factor;
+  scale_model(g_world, this->selected_model->body_part, factor);
 }
 
 /*
@@ -976,7 +1045,7 @@ srot_widget::xrot_changed(int x_factor)
     /* no model selected */
     return;
 
-  rotate_model_absolute(this->selected_model->body_part, X_AXIS, x_factor);
+  rotate_model_absolute(g_world, this->selected_model->body_part, X_AXIS, x_factor);
 }
 
 /*
@@ -991,7 +1060,7 @@ srot_widget::yrot_changed(int y_factor)
     /* no model selected */
     return;
 
-  rotate_model_absolute(this->selected_model->body_part, Y_AXIS, y_factor);
+  rotate_model_absolute(g_world, this->selected_model->body_part, Y_AXIS, y_factor);
 }
 
 /*
@@ -1006,7 +1075,7 @@ srot_widget::zrot_changed(int z_factor)
     /* no model selected */
     return;
 
-  rotate_model_absolute(this->selected_model->body_part, Z_AXIS, z_factor);
+  rotate_model_absolute(g_world, this->selected_model->body_part, Z_AXIS, z_factor);
 }
 
 /*
@@ -1024,24 +1093,25 @@ srot_widget::resets_clicked()
      *
      *	In this case the reset is for all body parts.
      */
-    rotate_all_models_absolute(X_AXIS, 0, MD3_LIGHT);
-    rotate_all_models_absolute(Y_AXIS, 0, MD3_LIGHT);
-    rotate_all_models_absolute(Z_AXIS, 0, MD3_LIGHT);
-    scale_all_models(1.0f, MD3_LIGHT);
+    rotate_all_models_absolute(g_world, X_AXIS, 0, MD3_LIGHT);
+    rotate_all_models_absolute(g_world, Y_AXIS, 0, MD3_LIGHT);
+    rotate_all_models_absolute(g_world, Z_AXIS, 0, MD3_LIGHT);
+    scale_all_models(g_world, 1.0f, MD3_LIGHT);
     return;
   }
 
   /* model is selected */
 
+  /* the changes may still be queued for the simulation; set the sliders directly */
   scale_changed(100);
-  this->scale_S->setValue((int)(this->selected_model->scale_factor * 100.0f));
+  this->scale_S->setValue(100);
 
   xrot_changed(0);
-  this->xrot_S->setValue((int)(this->selected_model->rot[0]));
+  this->xrot_S->setValue(0);
 
   yrot_changed(0);
-  this->yrot_S->setValue((int)(this->selected_model->rot[1]));
+  this->yrot_S->setValue(0);
 
   zrot_changed(0);
-  this->zrot_S->setValue((int)(this->selected_model->rot[2]));
+  this->zrot_S->setValue(0);
 }
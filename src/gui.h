@@ -58,6 +58,9 @@
 /* global to GUI widget */
 extern class gui_widget* g_gui;
 
+/* the world the viewer shows */
+extern struct world_t* g_world;
+
 /*
  *	The kinds of loadable models to distinguish
  *	between model_widget instances.
@@ -86,7 +89,7 @@ public slots:
 private:
   enum loadable_types type;
   QPushButton* open;
-  md3_model_t* model;
+  md3_instance_t* model;
 };
 
 class animate_widget : public QGroupBox
@@ -146,6 +149,8 @@ public slots:
   void zoom_changed(int zfactor);
   void vlights_checked();
   void resetLights_pushed();
+  void trace_checked();
+  void fast_slerp_checked();
 
 private:
   QGridLayout* opt_grid;
@@ -158,6 +163,8 @@ private:
   QCheckBox* lightCB;
   QCheckBox* view_lightsCB;
   QCheckBox* no_interpCB;
+  QCheckBox* traceCB;
+  QCheckBox* fast_slerpCB;
 
   QPushButton* reset_lights;
 
@@ -173,7 +180,7 @@ class srot_widget : public QGroupBox
 public:
   srot_widget(int strips, Qt::Orientation orientation, const QString& title, QWidget* parent = 0, const char* name = 0);
 
-  void object_selected(md3_model_t* model);
+  void object_selected(md3_instance_t* model);
 
 public slots:
   void scale_changed(int s_factor);
@@ -183,7 +190,7 @@ public slots:
   void resets_clicked();
 
 private:
-  md3_model_t* selected_model;
+  md3_instance_t* selected_model;
 
   QGridLayout* move_grid;
 
@@ -0,0 +1,215 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#include "gl_ext.h"
+#include "tga.h"
+#include "headless.h"
+
+struct headless_t
+{
+  int width;
+  int height;
+
+#ifndef _WIN32
+  EGLDisplay display;
+  EGLContext context;
+#endif
+
+  GLuint fbo;
+  GLuint rbo[2]; /* color, depth and stencil		*/
+};
+
+#ifndef _WIN32
+static EGLDisplay headless_display();
+#endif
+
+/*
+ *	Create a context drawing into a width x height framebuffer
+ *	and make it current on the calling thread.
+ *
+ *	Returns NULL on failure.
+ */
+struct headless_t*
+headless_new(int width, int height)
+{
+#ifdef _WIN32
+  printf("Error: Headless rendering needs EGL.\n");
+  return NULL;
+#else
+  EGLint attribs[] = {
+    EGL_SURFACE_TYPE, 0,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE};
+  struct headless_t* h = NULL;
+  EGLConfig config;
+  EGLint n = 0;
+
+  h = (struct headless_t*)malloc(sizeof(struct headless_t));
+  memset(h, 0, sizeof(struct headless_t));
+
+  h->display = headless_display();
+  if ((h->display == EGL_NO_DISPLAY) || !eglInitialize(h->display, NULL, NULL))
+  {
+    printf("Error: Could not open an EGL display.\n");
+    free(h);
+    return NULL;
+  }
+
+  /* the fixed function pipeline is needed, so desktop GL */
+  if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(h->display, attribs, &config, 1, &n) || !n)
+  {
+    printf("Error: EGL has no OpenGL config.\n");
+    eglTerminate(h->display);
+    free(h);
+    return NULL;
+  }
+
+  h->context = eglCreateContext(h->display, config, EGL_NO_CONTEXT, NULL);
+  if ((h->context == EGL_NO_CONTEXT) || !eglMakeCurrent(h->display, EGL_NO_SURFACE, EGL_NO_SURFACE, h->context))
+  {
+    printf("Error: Could not make an OpenGL context without a surface.\n");
+    if (h->context != EGL_NO_CONTEXT)
+      eglDestroyContext(h->display, h->context);
+    eglTerminate(h->display);
+    free(h);
+    return NULL;
+  }
+
+  /* there is no default framebuffer, draw into one of our own */
+  glGenFramebuffers(1, &h->fbo);
+  glGenRenderbuffers(2, h->rbo);
+  if (!headless_resize(h, width, height))
+  {
+    headless_free(h);
+    return NULL;
+  }
+
+  return h;
+#endif
+}
+
+/*
+ *	Change the size of the framebuffer; what was drawn is lost.
+ *
+ *	Returns 0 on failure.
+ */
+int
+headless_resize(struct headless_t* h, int width, int height)
+{
+  h->width = width;
+  h->height = height;
+
+#ifdef _WIN32
+  return 0;
+#else
+  glBindFramebuffer(GL_FRAMEBUFFER, h->fbo);
+
+  glBindRenderbuffer(GL_RENDERBUFFER, h->rbo[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, h->rbo[0]);
+
+  /* the mirrors need a stencil buffer */
+  glBindRenderbuffer(GL_RENDERBUFFER, h->rbo[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, h->rbo[1]);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+  {
+    printf("Error: Could not make a %ix%i framebuffer.\n", width, height);
+    return 0;
+  }
+
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  return 1;
+#endif
+}
+
+/*
+ *	Destroy the context.
+ */
+void
+headless_free(struct headless_t* h)
+{
+  if (!h)
+    return;
+
+#ifndef _WIN32
+  glDeleteRenderbuffers(2, h->rbo);
+  glDeleteFramebuffers(1, &h->fbo);
+
+  eglMakeCurrent(h->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(h->display, h->context);
+  eglTerminate(h->display);
+#endif
+
+  free(h);
+}
+
+/*
+ *	Write the framebuffer to a tga file.
+ *
+ *	Returns 0 on failure.
+ */
+int
+headless_save(struct headless_t* h, char* file)
+{
+  unsigned char* pixels = (unsigned char*)malloc(h->width * h->height * 4);
+  int ok = 0;
+
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, h->width, h->height, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+
+  ok = save_tga(file, h->width, h->height, pixels);
+  if (!ok)
+    printf("Error: Could not write %s.\n", file);
+
+  free(pixels);
+  return ok;
+}
+
+#ifndef _WIN32
+/*
+ *	Get a display that needs no window system.
+ *
+ *	Mesa has a surfaceless platform for this; other drivers may
+ *	give one for the default display.
+ */
+static EGLDisplay
+headless_display()
+{
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = NULL;
+  const char* exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+  if (exts && strstr(exts, "EGL_MESA_platform_surfaceless"))
+  {
+    get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display)
+      return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  }
+
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+#endif
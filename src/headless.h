@@ -0,0 +1,52 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _HEADLESS_H
+#define _HEADLESS_H
+
+/*
+ *	Offscreen rendering without a window or a window system.
+ *
+ *	headless_new() makes a GL context current on the calling thread
+ *	with a framebuffer object of the given size to draw into, so
+ *	render_setup(), render_viewport(), render_view() and render_c()
+ *	work as they do in the viewer.  headless_save() writes what was
+ *	drawn to a tga file.
+ *
+ *	The context comes from EGL without a surface, so it works on a
+ *	machine without an X server, and without a GPU with Mesa's
+ *	software renderer.  Not available on Windows.
+ */
+
+struct headless_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct headless_t* headless_new(int width, int height);
+  void headless_free(struct headless_t* h);
+  int headless_resize(struct headless_t* h, int width, int height);
+  int headless_save(struct headless_t* h, char* file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HEADLESS_H */
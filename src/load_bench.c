@@ -0,0 +1,463 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#endif
+#include "definitions.h"
+#include "util.h"
+#include "md3_parse.h"
+#include "world.h"
+#include "thread.h"
+#include "load_bench.h"
+
+/*
+ *	A thread of load_bench_scale().
+ */
+struct load_bench_thread_t
+{
+  struct load_bench_t* lb;
+  struct world_cache_t* cache; /* shared with the other threads; NULL for its own	*/
+  thread_t thread;
+  int loads; /* that worked				*/
+};
+
+static void load_bench_scan(struct load_bench_t* lb, char* dir, int depth, int in_weapons);
+static int load_bench_ends_with(char* file, const char* ext);
+static int load_bench_pass(struct load_bench_t* lb, struct world_t* w, struct md3_load_stats_t* total);
+static void load_bench_evict(struct load_bench_t* lb);
+static int load_bench_threads(struct load_bench_thread_t* t, int n, double* ms);
+static void load_bench_thread(void* arg);
+static long load_bench_peak_rss();
+static int load_bench_cmp(const void* a, const void* b);
+
+/*
+ *	Find the files to load in a models directory.
+ *
+ *	Returns NULL if there are none.
+ */
+struct load_bench_t*
+load_bench_new(char* dir)
+{
+  struct load_bench_t* lb = (struct load_bench_t*)malloc(sizeof(struct load_bench_t));
+
+  memset(lb, 0, sizeof(struct load_bench_t));
+  lb->iterations = 5;
+
+#ifdef _WIN32
+  printf("Error: The load benchmark needs POSIX directories.\n");
+#else
+  load_bench_scan(lb, dir, 0, 0);
+  qsort(lb->files, lb->num_files, sizeof(struct load_bench_file_t), load_bench_cmp);
+#endif
+
+  if (!lb->num_files)
+  {
+    printf("Error: No *.mod or weapons2/*.md3 files in %s.\n", dir);
+    load_bench_free(lb);
+    return NULL;
+  }
+
+  return lb;
+}
+
+/*
+ *	Free a benchmark.
+ */
+void
+load_bench_free(struct load_bench_t* lb)
+{
+  int i = 0;
+
+  for (; i < lb->num_files; ++i)
+    free(lb->files[i].file);
+  for (i = 0; i < lb->num_cache_files; ++i)
+    free(lb->cache_files[i]);
+
+  free(lb->files);
+  free(lb->cache_files);
+  free(lb);
+}
+
+/*
+ *	Load every file lb->iterations times, from the disk if cold
+ *	and from the page cache if not, and print the throughput per
+ *	file, in all and for each stage of loading.
+ *
+ *	Returns the number of loads that worked.
+ */
+int
+load_bench_run(struct load_bench_t* lb, int cold)
+{
+  struct world_t* w = world_init(NULL);
+  struct load_bench_file_t* f = NULL;
+  struct md3_load_stats_t stats;
+  double ms = 0, stage_ms = 0;
+  long bytes = 0;
+  int allocs = 0;
+  int loads = 0;
+  int i;
+
+#ifdef _WIN32
+  if (cold)
+  {
+    printf("Error: Cold loads need posix_fadvise(); loading warm.\n");
+    cold = 0;
+  }
+#endif
+
+  printf("Load benchmark, %s page cache: %i files, %i passes\n", (cold ? "cold" : "warm"), lb->num_files, lb->iterations);
+
+  for (i = 0; i < lb->num_files; ++i)
+  {
+    lb->files[i].failed = 0;
+    lb->files[i].ms = 0;
+  }
+
+  /* read everything in first */
+  if (!cold)
+    load_bench_pass(lb, w, NULL);
+
+  /* start from nothing */
+  md3_load_stats_enable(1);
+  md3_load_stats_take(&stats);
+  memset(&stats, 0, sizeof(stats));
+
+  for (i = 0; i < lb->iterations; ++i)
+  {
+    if (cold)
+      load_bench_evict(lb);
+    loads += load_bench_pass(lb, w, &stats);
+  }
+
+  md3_load_stats_enable(0);
+
+  for (i = 0; i < lb->num_files; ++i)
+  {
+    f = &lb->files[i];
+    if (f->failed == lb->iterations)
+    {
+      printf("  %-48s failed\n", f->file);
+      continue;
+    }
+
+    printf("  %-48s %8.3f MB %9.3f ms %9.2f MB/s %6i allocs\n",
+           f->file, (f->stats.bytes / 1048576.0), (f->ms / (lb->iterations - f->failed)),
+           ((f->ms > 0) ? ((f->stats.bytes * (lb->iterations - f->failed) * 1000.0) / (f->ms * 1048576.0)) : 0.0),
+           f->stats.allocs);
+
+    ms += f->ms;
+    bytes += (f->stats.bytes * (lb->iterations - f->failed));
+    allocs += (f->stats.allocs * (lb->iterations - f->failed));
+  }
+
+  if (ms > 0)
+  {
+    printf("  all: %i loads, %.2f MB in %.1f ms, %.2f MB/s, %.1f models/s, %i allocs per pass, %ld KB peak RSS\n",
+           loads, (bytes / 1048576.0), ms, ((bytes * 1000.0) / (ms * 1048576.0)), ((loads * 1000.0) / ms),
+           (allocs / lb->iterations), load_bench_peak_rss());
+
+    for (i = 0; i < MD3_LOAD_STAGES; ++i)
+    {
+      printf("    %-10s %9.1f ms %5.1f%%\n", md3_load_stage_name(i), (double)stats.ms[i], (((double)stats.ms[i] * 100.0) / ms));
+      stage_ms += (double)stats.ms[i];
+    }
+    printf("    %-10s %9.1f ms %5.1f%%\n", "other", (ms - stage_ms), (((ms - stage_ms) * 100.0) / ms));
+  }
+
+  world_free(w);
+  return loads;
+}
+
+/*
+ *	Load the files on 1, 2, 4, ... threads up to the number asked
+ *	for, each thread making lb->iterations passes into a world of
+ *	its own, and print the throughput of each.  Each number of
+ *	threads is run twice: with a cache for each world, and with one
+ *	cache for all of them, as worlds drawing side by side would
+ *	have, along with how often its lock was waited for.
+ *
+ *	The files are read from the page cache.
+ */
+void
+load_bench_scale(struct load_bench_t* lb, int threads)
+{
+  struct load_bench_thread_t* t = (struct load_bench_thread_t*)malloc(sizeof(struct load_bench_thread_t) * threads);
+  struct world_t* host = NULL;
+  double ms, shared_ms, per_sec, shared_per_sec, base = 0;
+  int loads, shared_loads;
+  int n = 1;
+  int i;
+
+  printf("Load scaling: %i files, %i passes per thread, %i processors\n", lb->num_files, lb->iterations, thread_cpu_count());
+
+  for (;;)
+  {
+    for (i = 0; i < n; ++i)
+    {
+      t[i].lb = lb;
+      t[i].cache = NULL;
+    }
+    loads = load_bench_threads(t, n, &ms);
+
+    /* the cache goes with the last world using it */
+    host = world_init(NULL);
+    for (i = 0; i < n; ++i)
+      t[i].cache = host->cache;
+    shared_loads = load_bench_threads(t, n, &shared_ms);
+
+    per_sec = ((loads * 1000.0) / ms);
+    shared_per_sec = ((shared_loads * 1000.0) / shared_ms);
+    if (!base)
+      base = per_sec;
+    printf("  %3i threads: %6i loads in %9.1f ms, %9.1f models/s, %5.2fx; one cache %9.1f models/s, %5.2fx, %6i lock waits %8.2f ms\n",
+           n, loads, ms, per_sec, (per_sec / base), shared_per_sec, (shared_per_sec / base),
+           host->cache->lock_waits, host->cache->lock_wait_ms);
+    world_free(host);
+
+    if (n >= threads)
+      break;
+    n = (((n * 2) < threads) ? (n * 2) : threads);
+  }
+
+  free(t);
+}
+
+#ifndef _WIN32
+/*
+ *	Find the *.mod files at the top of a models directory and the
+ *	*.md3 files anywhere under its weapons2 directory, and every file
+ *	under it for the cold loads.
+ */
+static void
+load_bench_scan(struct load_bench_t* lb, char* dir, int depth, int in_weapons)
+{
+  DIR* d = opendir(dir);
+  struct dirent* e = NULL;
+  struct stat st;
+  char path[1024];
+
+  if (!d)
+    return;
+
+  while ((e = readdir(d)))
+  {
+    if (e->d_name[0] == '.')
+      continue;
+
+    snprintf(path, sizeof(path), "%s%c%s", dir, OS_PATH_DELIM, e->d_name);
+    if (stat(path, &st))
+      continue;
+
+    if (S_ISDIR(st.st_mode))
+    {
+      load_bench_scan(lb, path, (depth + 1), (in_weapons || (!depth && !strcmp(e->d_name, "weapons2"))));
+      continue;
+    }
+
+    lb->cache_files = (char**)realloc(lb->cache_files, (sizeof(char*) * (lb->num_cache_files + 1)));
+    lb->cache_files[lb->num_cache_files++] = strdup(path);
+
+    if ((!depth && load_bench_ends_with(e->d_name, ".mod")) || (in_weapons && load_bench_ends_with(e->d_name, ".md3")))
+    {
+      lb->files = (struct load_bench_file_t*)realloc(lb->files, (sizeof(struct load_bench_file_t) * (lb->num_files + 1)));
+      memset(&lb->files[lb->num_files], 0, sizeof(struct load_bench_file_t));
+      lb->files[lb->num_files++].file = strdup(path);
+    }
+  }
+
+  closedir(d);
+}
+#endif
+
+/*
+ *	Does a file name end in ext?
+ */
+static int
+load_bench_ends_with(char* file, const char* ext)
+{
+  size_t len = strlen(file);
+  size_t ext_len = strlen(ext);
+
+  return ((len > ext_len) && !strcmp(&file[len - ext_len], ext));
+}
+
+/*
+ *	Load a file into the world; a *.mod model, or a lone
+ *	md3 file like a weapon.  unload_model() unloads either.
+ */
+md3_instance_t*
+load_bench_load(struct world_t* w, char* file)
+{
+  md3_instance_t* inst = NULL;
+  char* prefix = NULL;
+
+  if (load_bench_ends_with(file, ".mod"))
+    return load_model(w, file);
+
+  prefix = get_models_root(file);
+  inst = load_weapon(w, file, prefix);
+  free(prefix);
+  return inst;
+}
+
+/*
+ *	Load and unload every file once.  With a total the loads are
+ *	timed: the time and load statistics go to the file, and the
+ *	time of each stage is added to the total.
+ *
+ *	Returns the number of loads that worked.
+ */
+static int
+load_bench_pass(struct load_bench_t* lb, struct world_t* w, struct md3_load_stats_t* total)
+{
+  struct load_bench_file_t* f = NULL;
+  md3_instance_t* inst = NULL;
+  double start;
+  int loads = 0;
+  int i = 0;
+  int s;
+
+  for (; i < lb->num_files; ++i)
+  {
+    f = &lb->files[i];
+
+    start = get_time_in_ms();
+    inst = load_bench_load(w, f->file);
+
+    if (total)
+    {
+      f->ms += (get_time_in_ms() - start);
+      md3_load_stats_take(&f->stats);
+      for (s = 0; s < MD3_LOAD_STAGES; ++s)
+        total->ms[s] += f->stats.ms[s];
+
+      if (!inst)
+        ++f->failed;
+    }
+
+    if (!inst)
+      continue;
+
+    unload_model(w, inst, 1);
+    ++loads;
+  }
+
+  return loads;
+}
+
+/*
+ *	Drop every file under the models directory from the page cache.
+ */
+static void
+load_bench_evict(struct load_bench_t* lb)
+{
+#ifndef _WIN32
+  int fd;
+  int i = 0;
+
+  for (; i < lb->num_cache_files; ++i)
+  {
+    fd = open(lb->cache_files[i], O_RDONLY);
+    if (fd < 0)
+      continue;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#endif
+}
+
+/*
+ *	Run n threads of load_bench_scale() until all are done; fewer if
+ *	they could not all be started.  ms is set to how long they took.
+ *
+ *	Returns the number of loads that worked.
+ */
+static int
+load_bench_threads(struct load_bench_thread_t* t, int n, double* ms)
+{
+  double start = get_time_in_ms();
+  int loads = 0;
+  int i = 0;
+
+  for (; i < n; ++i)
+  {
+    t[i].loads = 0;
+    if (!thread_create(&t[i].thread, load_bench_thread, &t[i]))
+      break;
+  }
+  n = i;
+
+  for (i = 0; i < n; ++i)
+  {
+    thread_join(t[i].thread);
+    loads += t[i].loads;
+  }
+
+  *ms = (get_time_in_ms() - start);
+  return loads;
+}
+
+/*
+ *	A thread of load_bench_scale().
+ */
+static void
+load_bench_thread(void* arg)
+{
+  struct load_bench_thread_t* t = (struct load_bench_thread_t*)arg;
+  struct world_t* w = world_init(t->cache);
+  int i = 0;
+
+  for (; i < t->lb->iterations; ++i)
+    t->loads += load_bench_pass(t->lb, w, NULL);
+
+  world_free(w);
+}
+
+/*
+ *	Get the most memory the process has had resident, in KB.
+ */
+static long
+load_bench_peak_rss()
+{
+#ifdef _WIN32
+  return 0;
+#else
+  struct rusage r;
+
+  getrusage(RUSAGE_SELF, &r);
+  return r.ru_maxrss;
+#endif
+}
+
+/*
+ *	qsort() callback for files, by name.
+ */
+static int
+load_bench_cmp(const void* a, const void* b)
+{
+  return strcmp(((const struct load_bench_file_t*)a)->file, ((const struct load_bench_file_t*)b)->file);
+}
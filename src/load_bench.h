@@ -0,0 +1,80 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _LOAD_BENCH_H
+#define _LOAD_BENCH_H
+
+#include "md3_parse.h"
+
+/*
+ *	Model loading benchmark.
+ *
+ *	Every *.mod file in a models directory and every *.md3 file
+ *	under its weapons2 directory is loaded and unloaded again, a
+ *	number of times over, into a world of its own.  Loading needs
+ *	no GL context; textures are only uploaded when first drawn.
+ *
+ *	A cold run drops every file under the models directory from
+ *	the page cache before each pass, so the files come from the
+ *	disk; a warm run reads them once first and never drops them.
+ *	The loaders count files, bytes and allocations and time their
+ *	stages while it runs (see md3_load_stats_take()).
+ *
+ *	load_bench_scale() loads the files on 1, 2, 4, ... threads at
+ *	once, each thread with a world of its own, to show how loading
+ *	scales with the processors; once with a cache for each world,
+ *	and once with the worlds sharing one.
+ */
+
+struct load_bench_file_t
+{
+  char* file;
+  int failed; /* loads that did not					*/
+  double ms;  /* over the timed loads				*/
+  struct md3_load_stats_t stats; /* of one load		*/
+};
+
+struct load_bench_t
+{
+  struct load_bench_file_t* files; /* to load			*/
+  int num_files;
+
+  char** cache_files; /* every file under the models directory	*/
+  int num_cache_files;
+
+  int iterations; /* timed passes over the files			*/
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct load_bench_t* load_bench_new(char* dir);
+  void load_bench_free(struct load_bench_t* lb);
+
+  int load_bench_run(struct load_bench_t* lb, int cold);
+  void load_bench_scale(struct load_bench_t* lb, int threads);
+
+  md3_instance_t* load_bench_load(struct world_t* w, char* file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LOAD_BENCH_H */
@@ -0,0 +1,742 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ *	References used for the research of this code include:
+ *
+ *	"Surface Simplification Using Quadric Error Metrics"
+ *	by Michael Garland and Paul S. Heckbert
+ */
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "md3_parse.h"
+#include "world.h"
+#include "lod.h"
+
+/*
+ *	Surfaces with fewer triangles are left as they are.
+ */
+#define LOD_MIN_TRIANGLES 16
+
+/*
+ *	A level is kept only if it has at most this share of the
+ *	triangles of the level before.
+ */
+#define LOD_MIN_SAVING 0.9f
+
+/*
+ *	No collapse may turn a triangle further than this from where it
+ *	faced, as the cosine of the angle, in any sample frame.
+ */
+#define LOD_MAX_TURN 0.2f
+
+/*
+ *	Radius on the screen, in pixels, under which each level is drawn.
+ */
+const float lod_pixels[MD3_MAX_LODS + 1] = {0.0f, 32.0f, 16.0f, 8.0f};
+
+/*
+ *	A vertex while a surface is simplified.  The vertices at the same
+ *	place in every frame, as on either side of a texture seam, are
+ *	simplified as one: the first of them.
+ */
+struct lod_vertex_t
+{
+  double q[LOD_SAMPLE_FRAMES][10]; /* error quadric in each sample frame	*/
+  int* tris;                       /* triangles using it; some may be gone	*/
+  int num_tris;
+  int max_tris;
+  int locked; /* on an open edge				*/
+  int gone;   /* collapsed onto another		*/
+  int target; /* cheapest to collapse onto	*/
+  double cost;
+};
+
+/*
+ *	A surface while it is simplified.
+ */
+struct lod_mesh_t
+{
+  md3_surface_t* sptr;
+  int frames;                 /* sample frames							*/
+  float (*pos)[3];            /* of the vertices in them				*/
+  struct lod_vertex_t* verts; /* sptr->num_verts of them				*/
+  int* weld;                  /* the first vertex at the same place	*/
+  int* next_weld;             /* the next one there, or -1			*/
+  int* partner;               /* where each moves in a collapse		*/
+  md3_triangle_t* tris;       /* as they are collapsed					*/
+  char* tri_gone;
+  int live; /* triangles not gone						*/
+};
+
+static void lod_weld(struct lod_mesh_t* mesh);
+static void lod_quadrics(struct lod_mesh_t* mesh);
+static void lod_lock_edges(struct lod_mesh_t* mesh);
+static void lod_add_tri(struct lod_vertex_t* v, int t);
+static void lod_update(struct lod_mesh_t* mesh, int u);
+static int lod_partners(struct lod_mesh_t* mesh, int u, int v);
+static int lod_turns(struct lod_mesh_t* mesh, int u, int v);
+static void lod_collapse(struct lod_mesh_t* mesh, int u, int v);
+static int lod_has(struct lod_mesh_t* mesh, md3_triangle_t* tri, int v);
+static double lod_error(double* q1, double* q2, float* p);
+static void lod_normal(float* a, float* b, float* c, float* n);
+
+/*
+ *	Build the levels of detail of a surface.
+ *	Returns the number of levels built.
+ */
+int
+lod_build(md3_surface_t* sptr)
+{
+  struct lod_mesh_t mesh;
+  struct lod_vertex_t* v = NULL;
+  md3_triangle_t* tri = NULL;
+  int target, best, i, j, f;
+
+  lod_free(sptr);
+
+  if ((sptr->num_triangles < LOD_MIN_TRIANGLES) || (sptr->num_frames < 1))
+    return 0;
+
+  for (i = 0; i < sptr->num_triangles; ++i)
+  {
+    for (j = 0; j < 3; ++j)
+    {
+      if ((sptr->triangle[i].index[j] < 0) || (sptr->triangle[i].index[j] >= sptr->num_verts))
+        return 0;
+    }
+  }
+
+  memset(&mesh, 0, sizeof(mesh));
+  mesh.sptr = sptr;
+  mesh.frames = ((sptr->num_frames < LOD_SAMPLE_FRAMES) ? sptr->num_frames : LOD_SAMPLE_FRAMES);
+  mesh.live = sptr->num_triangles;
+
+  mesh.tris = (md3_triangle_t*)malloc(sizeof(md3_triangle_t) * sptr->num_triangles);
+  memcpy(mesh.tris, sptr->triangle, (sizeof(md3_triangle_t) * sptr->num_triangles));
+  mesh.tri_gone = (char*)malloc(sizeof(char) * sptr->num_triangles);
+  memset(mesh.tri_gone, 0, (sizeof(char) * sptr->num_triangles));
+
+  /* the sample frames spread over the animation */
+  mesh.pos = (float (*)[3])malloc(sizeof(float) * 3 * mesh.frames * sptr->num_verts);
+  for (f = 0; f < mesh.frames; ++f)
+  {
+    for (i = 0; i < sptr->num_verts; ++i)
+    {
+      md3_vertex_t* vptr = &sptr->vertex[(((f * sptr->num_frames) / mesh.frames) * sptr->num_verts) + i];
+      mesh.pos[(f * sptr->num_verts) + i][0] = (vptr->x * MD3_XYZ_SCALE);
+      mesh.pos[(f * sptr->num_verts) + i][1] = (vptr->y * MD3_XYZ_SCALE);
+      mesh.pos[(f * sptr->num_verts) + i][2] = (vptr->z * MD3_XYZ_SCALE);
+    }
+  }
+
+  mesh.weld = (int*)malloc(sizeof(int) * sptr->num_verts);
+  mesh.next_weld = (int*)malloc(sizeof(int) * sptr->num_verts);
+  mesh.partner = (int*)malloc(sizeof(int) * sptr->num_verts);
+  lod_weld(&mesh);
+
+  /* triangles with two corners at one place are never seen */
+  mesh.verts = (struct lod_vertex_t*)malloc(sizeof(struct lod_vertex_t) * sptr->num_verts);
+  memset(mesh.verts, 0, (sizeof(struct lod_vertex_t) * sptr->num_verts));
+  for (i = 0; i < sptr->num_triangles; ++i)
+  {
+    tri = &mesh.tris[i];
+    if ((mesh.weld[tri->index[0]] == mesh.weld[tri->index[1]]) ||
+        (mesh.weld[tri->index[1]] == mesh.weld[tri->index[2]]) ||
+        (mesh.weld[tri->index[2]] == mesh.weld[tri->index[0]]))
+    {
+      mesh.tri_gone[i] = 1;
+      --mesh.live;
+      continue;
+    }
+
+    for (j = 0; j < 3; ++j)
+      lod_add_tri(&mesh.verts[mesh.weld[tri->index[j]]], i);
+  }
+
+  lod_quadrics(&mesh);
+  lod_lock_edges(&mesh);
+  for (i = 0; i < sptr->num_verts; ++i)
+    lod_update(&mesh, i);
+
+  /* collapse the cheapest edge until each level is half the last */
+  for (; sptr->num_lods < MD3_MAX_LODS; ++sptr->num_lods)
+  {
+    target = (sptr->num_triangles >> (sptr->num_lods + 1));
+
+    while (mesh.live > target)
+    {
+      best = -1;
+      for (i = 0; i < sptr->num_verts; ++i)
+      {
+        v = &mesh.verts[i];
+        if ((v->target >= 0) && ((best < 0) || (v->cost < mesh.verts[best].cost)))
+          best = i;
+      }
+      if (best < 0)
+        break;
+
+      lod_collapse(&mesh, best, mesh.verts[best].target);
+    }
+
+    /* no better than the level before */
+    if (mesh.live > (LOD_MIN_SAVING * (sptr->num_lods ? sptr->lod_num_triangles[sptr->num_lods - 1] : sptr->num_triangles)))
+      break;
+
+    sptr->lod_num_triangles[sptr->num_lods] = mesh.live;
+    sptr->lod_triangle[sptr->num_lods] = (md3_triangle_t*)malloc(sizeof(md3_triangle_t) * mesh.live);
+    for (i = 0, j = 0; i < sptr->num_triangles; ++i)
+    {
+      if (!mesh.tri_gone[i])
+        sptr->lod_triangle[sptr->num_lods][j++] = mesh.tris[i];
+    }
+  }
+
+  for (i = 0; i < sptr->num_verts; ++i)
+    free(mesh.verts[i].tris);
+  free(mesh.verts);
+  free(mesh.weld);
+  free(mesh.next_weld);
+  free(mesh.partner);
+  free(mesh.pos);
+  free(mesh.tris);
+  free(mesh.tri_gone);
+
+  return sptr->num_lods;
+}
+
+/*
+ *	Free the levels of detail of a surface.
+ */
+void
+lod_free(md3_surface_t* sptr)
+{
+  int i = 0;
+
+  for (; i < sptr->num_lods; ++i)
+  {
+    free(sptr->lod_triangle[i]);
+    sptr->lod_triangle[i] = NULL;
+    sptr->lod_num_triangles[i] = 0;
+  }
+  sptr->num_lods = 0;
+}
+
+/*
+ *	The triangles of a level of the surface, or of the coarsest
+ *	it has if it has fewer levels; num is set to how many.
+ */
+md3_triangle_t*
+lod_triangles(md3_surface_t* sptr, int lod, int* num)
+{
+  if (lod > sptr->num_lods)
+    lod = sptr->num_lods;
+
+  if (lod <= 0)
+  {
+    *num = sptr->num_triangles;
+    return sptr->triangle;
+  }
+
+  *num = sptr->lod_num_triangles[lod - 1];
+  return sptr->lod_triangle[lod - 1];
+}
+
+/*
+ *	Where the triangles of a level start with every level of the
+ *	surface one after the other, the surface's own first.
+ */
+int
+lod_first_triangle(md3_surface_t* sptr, int lod)
+{
+  int first = sptr->num_triangles;
+  int i = 1;
+
+  if (lod > sptr->num_lods)
+    lod = sptr->num_lods;
+  if (lod <= 0)
+    return 0;
+
+  for (; i < lod; ++i)
+    first += sptr->lod_num_triangles[i - 1];
+
+  return first;
+}
+
+/*
+ *	How far the radius of a part's bounds reaches up the screen, in
+ *	pixels; clip is the projection and modelview it is drawn with.
+ *	A part around the eye is the height of the screen.
+ */
+float
+lod_screen_radius(md3_model_t* model, md3_anim_state_t* state, float* clip, int viewport_height)
+{
+  md3_frame_t* f1 = &model->frames[state->frame % model->num_frames];
+  md3_frame_t* f2 = &model->frames[state->next_frame % model->num_frames];
+  float min[3], max[3], centre[3];
+  float radius = 0;
+  float scale, w;
+  int i = 0;
+
+  min[0] = (f1->min_bounds.x + (state->t * (f2->min_bounds.x - f1->min_bounds.x)));
+  min[1] = (f1->min_bounds.y + (state->t * (f2->min_bounds.y - f1->min_bounds.y)));
+  min[2] = (f1->min_bounds.z + (state->t * (f2->min_bounds.z - f1->min_bounds.z)));
+  max[0] = (f1->max_bounds.x + (state->t * (f2->max_bounds.x - f1->max_bounds.x)));
+  max[1] = (f1->max_bounds.y + (state->t * (f2->max_bounds.y - f1->max_bounds.y)));
+  max[2] = (f1->max_bounds.z + (state->t * (f2->max_bounds.z - f1->max_bounds.z)));
+
+  for (; i < 3; ++i)
+  {
+    centre[i] = ((min[i] + max[i]) / 2.0f);
+    radius += ((max[i] - centre[i]) * (max[i] - centre[i]));
+  }
+  radius = sqrtf(radius);
+
+  /* the distance in front of the eye */
+  w = ((clip[3] * centre[0]) + (clip[7] * centre[1]) + (clip[11] * centre[2]) + clip[15]);
+  scale = sqrtf((clip[3] * clip[3]) + (clip[7] * clip[7]) + (clip[11] * clip[11]));
+  if (w <= (radius * scale))
+    return (float)viewport_height;
+
+  scale = sqrtf((clip[1] * clip[1]) + (clip[5] * clip[5]) + (clip[9] * clip[9]));
+  return (((radius * scale) / w) * (viewport_height / 2.0f));
+}
+
+/*
+ *	Pick the level of detail to draw a part with from its
+ *	lod_screen_radius(), and the level it was drawn with last.
+ */
+int
+lod_pick(float pixels, int current)
+{
+  int lod = current;
+
+  if ((lod < 0) || (lod > MD3_MAX_LODS))
+    lod = 0;
+  while ((lod > 0) && (pixels > (lod_pixels[lod] * (1.0f + LOD_HYSTERESIS))))
+    --lod;
+  while ((lod < MD3_MAX_LODS) && (pixels < (lod_pixels[lod + 1] * (1.0f - LOD_HYSTERESIS))))
+    ++lod;
+
+  return lod;
+}
+
+/*
+ *	Find the vertices at the same place as another in every frame,
+ *	not only the sample frames, and chain them to the first.
+ */
+static void
+lod_weld(struct lod_mesh_t* mesh)
+{
+  md3_surface_t* sptr = mesh->sptr;
+  md3_vertex_t* a = NULL;
+  md3_vertex_t* b = NULL;
+  int i, j, k, f;
+
+  for (i = 0; i < sptr->num_verts; ++i)
+  {
+    mesh->weld[i] = i;
+    mesh->next_weld[i] = -1;
+
+    for (j = 0; j < i; ++j)
+    {
+      if (mesh->weld[j] != j)
+        continue;
+
+      for (f = 0; f < sptr->num_frames; ++f)
+      {
+        a = &sptr->vertex[(f * sptr->num_verts) + i];
+        b = &sptr->vertex[(f * sptr->num_verts) + j];
+        if ((a->x != b->x) || (a->y != b->y) || (a->z != b->z))
+          break;
+      }
+      if (f < sptr->num_frames)
+        continue;
+
+      /* the end of j's chain */
+      mesh->weld[i] = j;
+      for (k = j; mesh->next_weld[k] >= 0; k = mesh->next_weld[k])
+        ;
+      mesh->next_weld[k] = i;
+      break;
+    }
+  }
+}
+
+/*
+ *	Add up the error quadrics of the planes of every triangle
+ *	around each vertex, weighted by the triangle's area.
+ */
+static void
+lod_quadrics(struct lod_mesh_t* mesh)
+{
+  int num_verts = mesh->sptr->num_verts;
+  float* p[3];
+  float n[3];
+  double nd[3];
+  double area, d;
+  double* q = NULL;
+  int i, j, f;
+
+  for (i = 0; i < mesh->sptr->num_triangles; ++i)
+  {
+    if (mesh->tri_gone[i])
+      continue;
+
+    for (f = 0; f < mesh->frames; ++f)
+    {
+      for (j = 0; j < 3; ++j)
+        p[j] = mesh->pos[(f * num_verts) + mesh->tris[i].index[j]];
+
+      lod_normal(p[0], p[1], p[2], n);
+      for (j = 0; j < 3; ++j)
+        nd[j] = n[j];
+      area = sqrt((nd[0] * nd[0]) + (nd[1] * nd[1]) + (nd[2] * nd[2]));
+      if (area <= 0.0)
+        continue;
+      d = -(((nd[0] * (double)p[0][0]) + (nd[1] * (double)p[0][1]) + (nd[2] * (double)p[0][2])) / area);
+
+      for (j = 0; j < 3; ++j)
+      {
+        /* the plane is n / area, weighted by area, so divide by area once */
+        q = mesh->verts[mesh->weld[mesh->tris[i].index[j]]].q[f];
+        q[0] += ((nd[0] * nd[0]) / area);
+        q[1] += ((nd[0] * nd[1]) / area);
+        q[2] += ((nd[0] * nd[2]) / area);
+        q[3] += (nd[0] * d);
+        q[4] += ((nd[1] * nd[1]) / area);
+        q[5] += ((nd[1] * nd[2]) / area);
+        q[6] += (nd[1] * d);
+        q[7] += ((nd[2] * nd[2]) / area);
+        q[8] += (nd[2] * d);
+        q[9] += (area * d * d);
+      }
+    }
+  }
+}
+
+/*
+ *	Lock the vertices of every edge only one triangle has; with the
+ *	seams welded these are the real edges of the surface.
+ */
+static void
+lod_lock_edges(struct lod_mesh_t* mesh)
+{
+  struct lod_vertex_t* v = NULL;
+  md3_triangle_t* tri = NULL;
+  int u, i, j, k, w, count;
+
+  for (u = 0; u < mesh->sptr->num_verts; ++u)
+  {
+    v = &mesh->verts[u];
+    for (i = 0; (i < v->num_tris) && !v->locked; ++i)
+    {
+      tri = &mesh->tris[v->tris[i]];
+      for (j = 0; j < 3; ++j)
+      {
+        w = mesh->weld[tri->index[j]];
+        if (w == u)
+          continue;
+
+        /* the triangles around u with the edge to w too */
+        for (k = 0, count = 0; k < v->num_tris; ++k)
+        {
+          if (lod_has(mesh, &mesh->tris[v->tris[k]], w))
+            ++count;
+        }
+        if (count == 1)
+        {
+          v->locked = 1;
+          mesh->verts[w].locked = 1;
+        }
+      }
+    }
+  }
+}
+
+/*
+ *	Add a triangle to those using a vertex.
+ */
+static void
+lod_add_tri(struct lod_vertex_t* v, int t)
+{
+  if (v->num_tris == v->max_tris)
+  {
+    v->max_tris = (v->max_tris ? (v->max_tris * 2) : 8);
+    v->tris = (int*)realloc(v->tris, (sizeof(int) * v->max_tris));
+  }
+  v->tris[v->num_tris++] = t;
+}
+
+/*
+ *	Find the neighbour a vertex collapses onto for the least error,
+ *	and what it costs.
+ */
+static void
+lod_update(struct lod_mesh_t* mesh, int u)
+{
+  struct lod_vertex_t* vu = &mesh->verts[u];
+  struct lod_vertex_t* vv = NULL;
+  md3_triangle_t* tri = NULL;
+  double cost;
+  int i, j, f, v;
+
+  vu->target = -1;
+  if (vu->locked || vu->gone || (mesh->weld[u] != u))
+    return;
+
+  for (i = 0; i < vu->num_tris; ++i)
+  {
+    if (mesh->tri_gone[vu->tris[i]])
+      continue;
+
+    tri = &mesh->tris[vu->tris[i]];
+    for (j = 0; j < 3; ++j)
+    {
+      v = mesh->weld[tri->index[j]];
+      if ((v == u) || (v == vu->target))
+        continue;
+
+      vv = &mesh->verts[v];
+      for (f = 0, cost = 0; f < mesh->frames; ++f)
+        cost += lod_error(vu->q[f], vv->q[f], mesh->pos[(f * mesh->sptr->num_verts) + v]);
+
+      if (((vu->target < 0) || (cost < vu->cost)) && lod_partners(mesh, u, v) && !lod_turns(mesh, u, v))
+      {
+        vu->target = v;
+        vu->cost = cost;
+      }
+    }
+  }
+}
+
+/*
+ *	Find where each vertex at u goes if u collapses onto v: the
+ *	vertex at v it has an edge to, so the texture coordinates on
+ *	either side of a seam carry on as they were.
+ *
+ *	Returns 0 if a vertex at u that is still used has none.
+ */
+static int
+lod_partners(struct lod_mesh_t* mesh, int u, int v)
+{
+  struct lod_vertex_t* vu = &mesh->verts[u];
+  md3_triangle_t* tri = NULL;
+  int i, j, k;
+
+  for (i = u; i >= 0; i = mesh->next_weld[i])
+    mesh->partner[i] = -1;
+
+  for (i = 0; i < vu->num_tris; ++i)
+  {
+    if (mesh->tri_gone[vu->tris[i]])
+      continue;
+
+    tri = &mesh->tris[vu->tris[i]];
+    for (j = 0; j < 3; ++j)
+    {
+      if (mesh->weld[tri->index[j]] != v)
+        continue;
+      for (k = 0; k < 3; ++k)
+      {
+        if (mesh->weld[tri->index[k]] == u)
+          mesh->partner[tri->index[k]] = tri->index[j];
+      }
+    }
+  }
+
+  for (i = 0; i < vu->num_tris; ++i)
+  {
+    if (mesh->tri_gone[vu->tris[i]])
+      continue;
+
+    tri = &mesh->tris[vu->tris[i]];
+    for (j = 0; j < 3; ++j)
+    {
+      if ((mesh->weld[tri->index[j]] == u) && (mesh->partner[tri->index[j]] < 0))
+        return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ *	Check if moving u onto v would turn any of the triangles
+ *	it leaves standing too far in any sample frame.
+ */
+static int
+lod_turns(struct lod_mesh_t* mesh, int u, int v)
+{
+  struct lod_vertex_t* vu = &mesh->verts[u];
+  md3_triangle_t* tri = NULL;
+  float* p[3];
+  float* moved[3];
+  float n1[3], n2[3];
+  float dot, len;
+  int i, j, f;
+
+  for (i = 0; i < vu->num_tris; ++i)
+  {
+    if (mesh->tri_gone[vu->tris[i]])
+      continue;
+
+    /* collapses away */
+    tri = &mesh->tris[vu->tris[i]];
+    if (lod_has(mesh, tri, v))
+      continue;
+
+    for (f = 0; f < mesh->frames; ++f)
+    {
+      for (j = 0; j < 3; ++j)
+      {
+        p[j] = mesh->pos[(f * mesh->sptr->num_verts) + tri->index[j]];
+        moved[j] = ((mesh->weld[tri->index[j]] == u) ? mesh->pos[(f * mesh->sptr->num_verts) + v] : p[j]);
+      }
+
+      lod_normal(p[0], p[1], p[2], n1);
+      lod_normal(moved[0], moved[1], moved[2], n2);
+      dot = ((n1[0] * n2[0]) + (n1[1] * n2[1]) + (n1[2] * n2[2]));
+      len = sqrtf(((n1[0] * n1[0]) + (n1[1] * n1[1]) + (n1[2] * n1[2])) * ((n2[0] * n2[0]) + (n2[1] * n2[1]) + (n2[2] * n2[2])));
+      if (dot <= (LOD_MAX_TURN * len))
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ *	Move the vertices at u onto their partners at v: the triangles
+ *	with both are gone, the rest of u's are now v's.  Then find new
+ *	targets around v.
+ */
+static void
+lod_collapse(struct lod_mesh_t* mesh, int u, int v)
+{
+  struct lod_vertex_t* vu = &mesh->verts[u];
+  struct lod_vertex_t* vv = &mesh->verts[v];
+  md3_triangle_t* tri = NULL;
+  int i, j, f, t;
+
+  lod_partners(mesh, u, v);
+
+  for (i = 0; i < vu->num_tris; ++i)
+  {
+    t = vu->tris[i];
+    if (mesh->tri_gone[t])
+      continue;
+
+    tri = &mesh->tris[t];
+    if (lod_has(mesh, tri, v))
+    {
+      mesh->tri_gone[t] = 1;
+      --mesh->live;
+      continue;
+    }
+
+    for (j = 0; j < 3; ++j)
+    {
+      if (mesh->weld[tri->index[j]] == u)
+        tri->index[j] = mesh->partner[tri->index[j]];
+    }
+    lod_add_tri(vv, t);
+  }
+
+  for (f = 0; f < mesh->frames; ++f)
+  {
+    for (j = 0; j < 10; ++j)
+      vv->q[f][j] += vu->q[f][j];
+  }
+  vu->gone = 1;
+  vu->target = -1;
+
+  /* drop the triangles v lost from its list */
+  for (i = 0, j = 0; i < vv->num_tris; ++i)
+  {
+    if (!mesh->tri_gone[vv->tris[i]])
+      vv->tris[j++] = vv->tris[i];
+  }
+  vv->num_tris = j;
+
+  /* everything around v may collapse differently now */
+  lod_update(mesh, v);
+  for (i = 0; i < vv->num_tris; ++i)
+  {
+    tri = &mesh->tris[vv->tris[i]];
+    for (j = 0; j < 3; ++j)
+    {
+      if (mesh->weld[tri->index[j]] != v)
+        lod_update(mesh, mesh->weld[tri->index[j]]);
+    }
+  }
+}
+
+/*
+ *	Check if a triangle has a corner at v.
+ */
+static int
+lod_has(struct lod_mesh_t* mesh, md3_triangle_t* tri, int v)
+{
+  return ((mesh->weld[tri->index[0]] == v) || (mesh->weld[tri->index[1]] == v) || (mesh->weld[tri->index[2]] == v));
+}
+
+/*
+ *	The error of the quadric q1 + q2 at p.
+ */
+static double
+lod_error(double* q1, double* q2, float* p)
+{
+  double q[10];
+  double x = p[0];
+  double y = p[1];
+  double z = p[2];
+  int i = 0;
+
+  for (; i < 10; ++i)
+    q[i] = (q1[i] + q2[i]);
+
+  return ((q[0] * x * x) + (2 * q[1] * x * y) + (2 * q[2] * x * z) + (2 * q[3] * x) +
+          (q[4] * y * y) + (2 * q[5] * y * z) + (2 * q[6] * y) +
+          (q[7] * z * z) + (2 * q[8] * z) +
+          q[9]);
+}
+
+/*
+ *	Twice the area along the normal of a triangle.
+ */
+static void
+lod_normal(float* a, float* b, float* c, float* n)
+{
+  float e1[3], e2[3];
+  int i = 0;
+
+  for (; i < 3; ++i)
+  {
+    e1[i] = (b[i] - a[i]);
+    e2[i] = (c[i] - a[i]);
+  }
+
+  n[0] = ((e1[1] * e2[2]) - (e1[2] * e2[1]));
+  n[1] = ((e1[2] * e2[0]) - (e1[0] * e2[2]));
+  n[2] = ((e1[0] * e2[1]) - (e1[1] * e2[0]));
+}
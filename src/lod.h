@@ -0,0 +1,68 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _LOD_H
+#define _LOD_H
+
+#include "md3_parse.h"
+
+/*
+ *	Levels of detail.
+ *
+ *	lod_build() simplifies a surface into up to MD3_MAX_LODS coarser
+ *	triangle lists, each about half the one before, by collapsing
+ *	edges in the order of least quadric error (Garland and Heckbert)
+ *	summed over LOD_SAMPLE_FRAMES of its key frames.  A vertex only
+ *	ever collapses onto another vertex, so every level indexes the
+ *	same vertices and the vertex animation plays on all of them.
+ *	Vertices on an open edge, as at texture seams, never move, so
+ *	the levels do not crack apart.
+ *
+ *	lod_pick() chooses the level for a part by the radius of its
+ *	bounds on the screen, from lod_screen_radius(): level i once it
+ *	is under lod_pixels[i], with LOD_HYSTERESIS either side so a
+ *	part on a threshold does not flicker between two.
+ *
+ *	Level 0 is always the surface's own triangles.
+ */
+
+#define LOD_SAMPLE_FRAMES 4
+#define LOD_HYSTERESIS 0.1f
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  extern const float lod_pixels[MD3_MAX_LODS + 1];
+
+  int lod_build(md3_surface_t* sptr);
+  void lod_free(md3_surface_t* sptr);
+
+  md3_triangle_t* lod_triangles(md3_surface_t* sptr, int lod, int* num);
+  int lod_first_triangle(md3_surface_t* sptr, int lod);
+
+  float lod_screen_radius(md3_model_t* model, md3_anim_state_t* state, float* clip, int viewport_height);
+  int lod_pick(float pixels, int current);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LOD_H */
@@ -25,46 +25,595 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "definitions.h"
 #include "util.h"
 #include "md3_parse.h"
 #include "world.h"
+#include "sim.h"
+#include "prof.h"
+#include "trace.h"
+#include "render.h"
+#include "headless.h"
+#include "batch.h"
+#include "bench.h"
+#include "load_bench.h"
+#include "quat_bench.h"
+#include "check.h"
+#include "thread.h"
 #include "gui.h"
 
 void
-a(md3_model_t* m)
+a(md3_instance_t* m)
 {
   int i = 0;
-  for (; i < m->num_tags; ++i)
+  for (; i < m->num_links; ++i)
   {
     printf("[%s] -> [%s]\n",
-           m->surface_ptr->name,
-           m->links[i] ? m->links[i]->surface_ptr->name : "none");
+           m->model->surface_ptr->name,
+           m->links[i] ? m->links[i]->model->surface_ptr->name : "none");
     if (m->links[i])
       a(m->links[i]);
   }
 }
 
+/*
+ *	--clock-script: read the frame times, in milliseconds, one per line.
+ *
+ *	Returns the number of times read; times must be freed.
+ */
+static int
+read_clock_script(char* file, double** times)
+{
+  FILE* fptr = fopen(file, "r");
+  double t;
+  int n = 0;
+
+  *times = NULL;
+  if (!fptr)
+  {
+    printf("Error: Could not open %s.\n", file);
+    return 0;
+  }
+
+  while (fscanf(fptr, "%lf", &t) == 1)
+  {
+    *times = (double*)realloc(*times, (sizeof(double) * (n + 1)));
+    (*times)[n++] = t;
+  }
+
+  fclose(fptr);
+  return n;
+}
+
+/*
+ *	Load the model and weapon named on the command line
+ *	and start its animations.
+ *
+ *	Returns 0 if the model could not be loaded.
+ */
+static int
+load_scene(struct world_t* w, char* model, char* weapon, char** anims, int num_anims)
+{
+  md3_anim_names_t* anim = NULL;
+  char* prefix = NULL;
+  int i = 0;
+
+  if (!load_model(w, model))
+  {
+    printf("Error: Could not load %s.\n", model);
+    return 0;
+  }
+
+  if (weapon)
+  {
+    prefix = get_models_root(weapon);
+    if (!load_weapon(w, weapon, prefix))
+      printf("Error: Could not load %s.\n", weapon);
+    free(prefix);
+  }
+
+  if (!num_anims)
+  {
+    set_model_animation(w, LEGS_IDLE);
+    set_model_animation(w, TORSO_STAND);
+  }
+  for (; i < num_anims; ++i)
+  {
+    anim = get_animation_by_name(anims[i]);
+    if (anim)
+      set_model_animation(w, (md3_animations_e)anim->id);
+    else
+      printf("Error: No animation called %s.\n", anims[i]);
+  }
+
+  return 1;
+}
+
+/*
+ *	The body part a name on the command line is, as in the .skin
+ *	files: head, upper, lower or weapon.
+ *
+ *	Returns 0 if it is none of them.
+ */
+static int
+part_by_name(char* name)
+{
+  if (!strcmp(name, "head"))
+    return MD3_HEAD;
+  if (!strcmp(name, "upper"))
+    return MD3_TORSO;
+  if (!strcmp(name, "lower"))
+    return MD3_LEGS;
+  if (!strcmp(name, "weapon"))
+    return MD3_WEAPON;
+
+  printf("Error: No body part called %s.\n", name);
+  return 0;
+}
+
+/*
+ *	--render: draw one image without a window and write it.
+ *
+ *	Returns the exit code.
+ */
+static int
+render_image(int argc, char** argv)
+{
+  struct world_link_instances_t* li = NULL;
+  struct world_t* w = NULL;
+  struct headless_t* h = NULL;
+  md3_instance_t* m = NULL;
+  char* out = NULL;
+  char* model = NULL;
+  char* weapon = NULL;
+  char* anims[8];
+  int num_anims = 0;
+  int width = 512;
+  int height = 512;
+  float frame = 0.0f;
+  float msec = -1.0f;
+  int options = 0;
+  int cleared = 0;
+  int lod_level = -1;
+  int i = 1;
+
+  for (; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--render") && ((i + 1) < argc))
+      out = argv[++i];
+    else if (!strcmp(argv[i], "--model") && ((i + 1) < argc))
+      model = argv[++i];
+    else if (!strcmp(argv[i], "--weapon") && ((i + 1) < argc))
+      weapon = argv[++i];
+    else if (!strcmp(argv[i], "--anim") && ((i + 1) < argc) && (num_anims < 8))
+      anims[num_anims++] = argv[++i];
+    else if (!strcmp(argv[i], "--frame") && ((i + 1) < argc))
+      frame = (float)atof(argv[++i]);
+    else if (!strcmp(argv[i], "--time") && ((i + 1) < argc))
+      msec = (float)atof(argv[++i]);
+    else if (!strcmp(argv[i], "--size") && ((i + 1) < argc))
+      sscanf(argv[++i], "%ix%i", &width, &height);
+    else if (!strcmp(argv[i], "--fast-slerp"))
+      options |= ENGINE_FAST_SLERP;
+    else if (!strcmp(argv[i], "--optimize-triangles"))
+      options |= ENGINE_OPTIMIZE_TRIANGLES;
+    else if (!strcmp(argv[i], "--optimize-overdraw"))
+      options |= (ENGINE_OPTIMIZE_TRIANGLES | ENGINE_OPTIMIZE_OVERDRAW);
+    else if (!strcmp(argv[i], "--no-cull"))
+      cleared |= ENGINE_FRUSTUM_CULL;
+    else if (!strcmp(argv[i], "--lod"))
+      options |= ENGINE_LOD;
+    else if (!strcmp(argv[i], "--lod-level") && ((i + 1) < argc))
+    {
+      options |= ENGINE_LOD;
+      lod_level = atoi(argv[++i]);
+    }
+  }
+
+  if (!model)
+  {
+    printf("Error: --render needs a --model.\n");
+    return 1;
+  }
+
+  h = headless_new(width, height);
+  if (!h)
+    return 1;
+
+  w = world_init(NULL);
+  world_clock_fixed(w, 0.0, 0.0);
+  render_setup(w);
+  render_viewport(w, width, height);
+  world_set_options(w, options, cleared);
+  w->lod_level = lod_level;
+
+  if (!load_scene(w, model, weapon, anims, num_anims))
+  {
+    world_free(w);
+    headless_free(h);
+    return 1;
+  }
+
+  if (msec >= 0.0f)
+    /* the animations were set at 0, draw the frame msec later */
+    world_clock_fixed(w, msec, 0.0);
+  else
+  {
+    /* hold every part at the same moment */
+    for (li = w->instances; li; li = li->next)
+    {
+      m = li->instance;
+      if (m->anim_state.animated)
+        world_hold_instance_animation(w, m, frame);
+    }
+  }
+
+  render_view(w);
+  render_c(w);
+  glFinish();
+
+  i = !headless_save(h, out);
+
+  world_free(w);
+  headless_free(h);
+  return i;
+}
+
+/*
+ *	--batch: draw preview images of every file on a list.
+ *
+ *	Returns the exit code.
+ */
+static int
+render_batch(int argc, char** argv)
+{
+  struct batch_t* b = NULL;
+  int workers = thread_cpu_count();
+  int bench = 0;
+  int images = 0;
+  double msec = 0;
+  int n = 0;
+  int i = 1;
+
+  for (; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--batch") && ((i + 1) < argc))
+      b = batch_new(argv[++i]);
+  }
+  if (!b)
+    return 1;
+
+  for (i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--out") && ((i + 1) < argc))
+      b->out_dir = argv[++i];
+    else if (!strcmp(argv[i], "--workers") && ((i + 1) < argc))
+      workers = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--turntable") && ((i + 1) < argc))
+      b->turntable = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--contact-sheet"))
+      b->contact_sheet = 1;
+    else if (!strcmp(argv[i], "--batch-bench"))
+      bench = 1;
+    else if (!strcmp(argv[i], "--size") && ((i + 1) < argc))
+      sscanf(argv[++i], "%ix%i", &b->width, &b->height);
+  }
+
+  if (!b->turntable && !b->contact_sheet)
+    b->turntable = 8;
+  if (workers < 1)
+    workers = 1;
+
+  batch_preload(b);
+
+  /* with --batch-bench 1, 2, 4, ... workers up to the number asked for */
+  n = (bench ? 1 : workers);
+  for (;;)
+  {
+    images = batch_run(b, n, &msec);
+    printf("%3i workers: %5i images in %9.1f ms, %8.2f images per second\n",
+           n, images, msec, ((msec > 0) ? ((images * 1000.0) / msec) : 0.0));
+
+    if (n == workers)
+      break;
+    n = (((n * 2) < workers) ? (n * 2) : workers);
+  }
+
+  batch_free(b);
+  return (images ? 0 : 1);
+}
+
+/*
+ *	--bench: time the model along a camera path with each
+ *	set of render options and write the results.
+ *
+ *	Returns the exit code; 1 if there was a regression.
+ */
+static int
+render_bench(int argc, char** argv)
+{
+  struct bench_t* b = NULL;
+  char* out = NULL;
+  char* model = NULL;
+  char* weapon = NULL;
+  char* baseline = NULL;
+  char* anims[8];
+  int num_anims = 0;
+  int width = 512;
+  int height = 512;
+  int frames = 300;
+  float tolerance = 10.0f;
+  int cull = 1;
+  int lod = 0;
+  int anim_lod = 0;
+  float anim_budget = -1.0f;
+  int parts[4];
+  float part_budgets[4];
+  int num_parts = 0;
+  int crowd = 0;
+  int ret = 0;
+  int i = 1;
+
+  for (; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--bench") && ((i + 1) < argc))
+      out = argv[++i];
+    else if (!strcmp(argv[i], "--model") && ((i + 1) < argc))
+      model = argv[++i];
+    else if (!strcmp(argv[i], "--weapon") && ((i + 1) < argc))
+      weapon = argv[++i];
+    else if (!strcmp(argv[i], "--anim") && ((i + 1) < argc) && (num_anims < 8))
+      anims[num_anims++] = argv[++i];
+    else if (!strcmp(argv[i], "--frames") && ((i + 1) < argc))
+      frames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--baseline") && ((i + 1) < argc))
+      baseline = argv[++i];
+    else if (!strcmp(argv[i], "--tolerance") && ((i + 1) < argc))
+      tolerance = (float)atof(argv[++i]);
+    else if (!strcmp(argv[i], "--size") && ((i + 1) < argc))
+      sscanf(argv[++i], "%ix%i", &width, &height);
+    else if (!strcmp(argv[i], "--generic-surfaces"))
+      /* without the surface kernels, as a baseline for them */
+      render_surface_kernels(0);
+    else if (!strcmp(argv[i], "--no-cull"))
+      cull = 0;
+    else if (!strcmp(argv[i], "--lod"))
+      lod = 1;
+    else if (!strcmp(argv[i], "--anim-lod"))
+      anim_lod = 1;
+    else if (!strcmp(argv[i], "--anim-budget") && ((i + 1) < argc))
+    {
+      anim_lod = 1;
+      anim_budget = (float)atof(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--part-budget") && ((i + 2) < argc) && (num_parts < 4))
+    {
+      anim_lod = 1;
+      parts[num_parts] = part_by_name(argv[++i]);
+      part_budgets[num_parts] = (float)atof(argv[++i]);
+      if (parts[num_parts])
+        ++num_parts;
+    }
+    else if (!strcmp(argv[i], "--crowd") && ((i + 1) < argc))
+      crowd = atoi(argv[++i]);
+  }
+
+  if (!model)
+  {
+    printf("Error: --bench needs a --model.\n");
+    return 1;
+  }
+
+  b = bench_new(width, height, frames);
+  if (!b)
+    return 1;
+  if (!cull)
+    world_set_options(b->world, 0, ENGINE_FRUSTUM_CULL);
+  if (lod)
+    world_set_options(b->world, ENGINE_LOD, 0);
+  if (anim_lod)
+  {
+    world_set_options(b->world, ENGINE_ANIM_LOD, 0);
+    if (anim_budget >= 0.0f)
+      b->world->anim_budget = anim_budget;
+  }
+
+  if (!load_scene(b->world, model, weapon, anims, num_anims))
+  {
+    bench_free(b);
+    return 1;
+  }
+  for (i = 0; i < num_parts; ++i)
+    world_set_instance_anim_budget(b->world, (md3_body_parts_e)parts[i], part_budgets[i]);
+
+  bench_run(b);
+  if (crowd > 0)
+  {
+    bench_crowd(b, crowd);
+    bench_interp(b, crowd);
+  }
+
+  /* compare before writing, the baseline may be the same file */
+  if (baseline && bench_compare(b, baseline, tolerance))
+    ret = 1;
+  if (!bench_write(b, out))
+    ret = 1;
+
+  bench_free(b);
+  return ret;
+}
+
+/*
+ *	--load-bench: load every model in a models directory over and
+ *	over, from the disk and from the page cache.
+ *
+ *	Returns the exit code.
+ */
+static int
+load_benchmark(int argc, char** argv)
+{
+  struct load_bench_t* lb = NULL;
+  int threads = 0;
+  int loads = 0;
+  int i = 1;
+
+  for (; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--load-bench") && ((i + 1) < argc))
+      lb = load_bench_new(argv[++i]);
+  }
+  if (!lb)
+    return 1;
+
+  for (i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--iterations") && ((i + 1) < argc))
+      lb->iterations = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--load-threads") && ((i + 1) < argc))
+      threads = atoi(argv[++i]);
+  }
+  if (lb->iterations < 1)
+    lb->iterations = 1;
+
+  loads += load_bench_run(lb, 1);
+  loads += load_bench_run(lb, 0);
+
+  /* with --load-threads 1, 2, 4, ... threads loading at once */
+  if (threads > 0)
+    load_bench_scale(lb, threads);
+
+  load_bench_free(lb);
+  return (loads ? 0 : 1);
+}
+
 int
 main(int argc, char** argv)
 {
+  double* times = NULL;
+  int num_times = 0;
+  int i = 1;
+
+  trace_thread_name("main");
+
+  /* draw images and exit, without a window */
+  for (; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--render") && ((i + 1) < argc))
+      return render_image(argc, argv);
+    if (!strcmp(argv[i], "--batch") && ((i + 1) < argc))
+      return render_batch(argc, argv);
+    if (!strcmp(argv[i], "--bench") && ((i + 1) < argc))
+      return render_bench(argc, argv);
+    if (!strcmp(argv[i], "--load-bench") && ((i + 1) < argc))
+      return load_benchmark(argc, argv);
+    if (!strcmp(argv[i], "--quat-bench"))
+      return (quat_bench_run() ? 1 : 0);
+    if (!strcmp(argv[i], "--slerp-check") && ((i + 1) < argc))
+      return (quat_bench_slerp_check(argv[i + 1]) ? 1 : 0);
+    if (!strcmp(argv[i], "--vcache-report") && ((i + 1) < argc))
+      return (check_vcache(argv[i + 1]) ? 1 : 0);
+    if (!strcmp(argv[i], "--lod-report") && ((i + 1) < argc))
+      return (check_lod(argv[i + 1]) ? 1 : 0);
+    if (!strcmp(argv[i], "--order-check") && ((i + 1) < argc))
+      return (check_order(argv[i + 1]) ? 1 : 0);
+    if (!strcmp(argv[i], "--sched-bench") && ((i + 1) < argc))
+      return (check_sched(argv[i + 1]) ? 1 : 0);
+  }
+
   /* initialize the world */
-  g_world = world_init();
+  g_world = world_init(NULL);
+
+  /* tick the animations on their own thread */
+  g_world->sim = sim_new(g_world);
+
+  /* command line options */
+  for (i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--compact-frames"))
+      /* drop key frames not used by any animation when loading */
+      world_set_options(g_world, ENGINE_COMPACT_FRAMES, 0);
+    else if (!strcmp(argv[i], "--fast-slerp"))
+      /* approximate the slerp of the tags between key frames */
+      world_set_options(g_world, ENGINE_FAST_SLERP, 0);
+    else if (!strcmp(argv[i], "--optimize-triangles"))
+      /* reorder the triangles for the vertex cache when loading */
+      world_set_options(g_world, ENGINE_OPTIMIZE_TRIANGLES, 0);
+    else if (!strcmp(argv[i], "--no-cull"))
+      /* draw every part, even off the screen */
+      world_set_options(g_world, 0, ENGINE_FRUSTUM_CULL);
+    else if (!strcmp(argv[i], "--lod"))
+      /* coarser parts the smaller they are on the screen */
+      world_set_options(g_world, ENGINE_LOD, 0);
+    else if (!strcmp(argv[i], "--anim-lod"))
+      /* animate parts less often the smaller they are on the screen */
+      world_set_options(g_world, ENGINE_ANIM_LOD, 0);
+    else if (!strcmp(argv[i], "--anim-budget") && ((i + 1) < argc))
+    {
+      /* and how often that is */
+      world_set_options(g_world, ENGINE_ANIM_LOD, 0);
+      g_world->anim_budget = (float)atof(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--optimize-overdraw"))
+      /* and for overdraw too */
+      world_set_options(g_world, (ENGINE_OPTIMIZE_TRIANGLES | ENGINE_OPTIMIZE_OVERDRAW), 0);
+    else if (!strcmp(argv[i], "--crowd") && ((i + 1) < argc))
+      /* draw copies of the model on a grid */
+      crowd_set_size(&g_world->crowd, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--crowd-cpu") && ((i + 1) < argc))
+      /* blend the crowd key frames on a thread pool */
+      crowd_set_cpu_interpolation(&g_world->crowd, 1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--profile-out") && ((i + 1) < argc))
+      /* write the time of every frame stage to a file */
+      prof_open(argv[++i]);
+    else if (!strcmp(argv[i], "--gpu-timers"))
+      /* time the render passes on the GPU too */
+      prof_gpu_enable();
+    else if (!strcmp(argv[i], "--trace") && ((i + 1) < argc))
+      /* record a timeline of loading and drawing, written at exit */
+      trace_start(argv[++i]);
+    else if (!strcmp(argv[i], "--no-sim-thread"))
+    {
+      /* animate on the GUI thread */
+      sim_free(g_world->sim);
+      g_world->sim = NULL;
+    }
+    else if (!strcmp(argv[i], "--fixed-clock") && ((i + 1) < argc))
+    {
+      /* animate by a virtual clock stepping once per frame drawn, on the GUI thread */
+      sim_free(g_world->sim);
+      g_world->sim = NULL;
+      world_clock_fixed(g_world, 0.0, atof(argv[++i]));
+    }
+    else if (!strcmp(argv[i], "--clock-script") && ((i + 1) < argc))
+    {
+      /* animate by a list of frame times, on the GUI thread */
+      sim_free(g_world->sim);
+      g_world->sim = NULL;
+      num_times = read_clock_script(argv[++i], &times);
+      world_clock_script(g_world, times, num_times);
+      free(times);
+    }
+  }
 
   /* load the full model */
-  // load_model("../models/sarge.mod");
-  // load_weapon("../models/weapons2/rocketl/rocketl.md3", "../");
-  /*md3_model_t* m = world_get_model_by_type(MD3_WEAPON);
-  unload_weapon(m);*/
+  // load_model(g_world, "../models/sarge.mod");
+  // load_weapon(g_world, "../models/weapons2/rocketl/rocketl.md3", "../");
+  /*md3_instance_t* m = world_get_instance_by_type(g_world, MD3_WEAPON);
+  unload_weapon(g_world, m);*/
 
   // world_set_options(g_world, 0, RENDER_TEXTURES);
 
-  set_model_animation(LEGS_IDLE);
-  set_model_animation(TORSO_STAND);
+  set_model_animation(g_world, LEGS_IDLE);
+  set_model_animation(g_world, TORSO_STAND);
 
   /* start the GUI */
   gui_start(argc, argv);
 
+  prof_close();
+  trace_stop();
+
   /* free the world */
   world_free(g_world);
 
@@ -7,18 +7,35 @@ QT += openglwidgets widgets
 QMAKE_CFLAGS += -Wall -Wextra -Wpedantic -Wshadow -Wstrict-aliasing=2 -Wdouble-promotion
 QMAKE_CXXFLAGS += -fpermissive -Wall -Wextra -Wpedantic -Wshadow -Wstrict-aliasing=2 -Wdouble-promotion
 
-LIBS += -lGL -lGLU -lX11 -lm -L/usr/X11R6/lib
+LIBS += -lGL -lGLU -lEGL -lX11 -lm -lpthread -L/usr/X11R6/lib
 
-SOURCES += main.cpp accum.c gl_widget.cpp gui.cpp md3_parse.c quaternion.c render.c tga.c util.c world.c 
+SOURCES += main.cpp accum.c anim_sched.c batch.c bench.c check.c crowd.c gl_ext.c gl_state.c gl_widget.cpp gui.cpp headless.c load_bench.c lod.c md3_parse.c pool.c prof.c quat_bench.c quaternion.c render.c sim.c tga.c thread.c trace.c util.c vcache.c world.c 
 
 HEADERS += accum.h \
+	   anim_sched.h \
+	   batch.h \
+	   bench.h \
+	   check.h \
+	   crowd.h \
 	   definitions.h \
+	   gl_ext.h \
+	   gl_state.h \
 	   gl_widget.h \
 	   gui.h \
+	   headless.h \
 	   jitter.h \
+	   load_bench.h \
+	   lod.h \
 	   md3_parse.h \
+	   pool.h \
+	   prof.h \
+	   quat_bench.h \
 	   quaternion.h \
 	   render.h \
+	   sim.h \
 	   tga.h \
+	   thread.h \
+	   trace.h \
 	   util.h \
+	   vcache.h \
 	   world.h
@@ -27,6 +27,12 @@
 #include "tga.h"
 #include "world.h"
 #include "md3_parse.h"
+#include "thread.h"
+#include "prof.h"
+#include "trace.h"
+#include "vcache.h"
+#include "lod.h"
+#include "anim_sched.h"
 
 /*
  *	Valid animations.
@@ -59,12 +65,46 @@ static md3_anim_names_t anim_structs[] = {
   {LEGS_IDLECR, "LEGS_IDLECR", ANIM_LEGS},
   {LEGS_TURN, "LEGS_TURN", ANIM_LEGS}};
 
-static void md3_load_surfaces(md3_model_t* model, char* texture_path_prefix);
+/*
+ *	Load statistics, added to from any thread.
+ */
+static int md3_stats_on;
+static int md3_stats_us[MD3_LOAD_STAGES]; /* microseconds in each stage	*/
+static int md3_stats_files;
+static int md3_stats_bytes;
+static int md3_stats_allocs;
+
+/* instances made, from any thread; staggers their animation updates */
+static int md3_instances;
+
+static const char* md3_load_stage_names[MD3_LOAD_STAGES] = {
+  "header",
+  "surfaces",
+  "vertices",
+  "normals",
+  "optimize",
+  "lod",
+  "textures",
+  "anims"};
+
+static double md3_stats_begin();
+static double md3_stats_stage(md3_load_stage_e stage, double start);
+static void md3_stats_count(int files, long bytes, int allocs);
+static struct tga_t* md3_load_tga(char* file);
+
+static void md3_load_surfaces(struct world_t* wptr, md3_model_t* model, char* texture_path_prefix);
 static void md3_make_normal(md3_vertex_t* vertex);
+static void md3_optimize_surfaces(struct world_t* wptr, md3_model_t* model, char* file);
+static void md3_build_lods(md3_model_t* model, char* file);
 
-static void load_texture_for_model(md3_model_t* model, char* texture, char* surface);
+static void load_texture_for_model(struct world_t* wptr, md3_model_t* model, char* texture, char* surface);
 static int load_anim_file(char* file, md3_anim_t* aptr);
 
+static int mark_used_frames(md3_model_t* model, int* remap);
+static void compact_model_frames(md3_model_t* model, int* remap);
+
+static md3_model_t* load_cached_model(struct world_t* wptr, char* file, char* key, char* texture_path_prefix, int* loaded);
+
 /*
  *	Load an MD3 model.
  *	Returns a pointer to the MD3 model structure, NULL on failure.
@@ -73,9 +113,11 @@ static int load_anim_file(char* file, md3_anim_t* aptr);
  *	and not the skin stuff.  Otherwise pass NULL.
  */
 md3_model_t*
-md3_load_model(char* file, char* texture_path_prefix)
+md3_load_model(struct world_t* wptr, char* file, char* texture_path_prefix)
 {
   md3_model_t* model = (md3_model_t*)malloc(sizeof(md3_model_t));
+  double start = trace_begin();
+  double stage = md3_stats_begin();
 
 #ifdef MD3_DEBUG
   int i = 0;
@@ -91,6 +133,7 @@ md3_load_model(char* file, char* texture_path_prefix)
   {
     printf("ERROR: Failed to open model file \"%s\".\n", file);
     free(model);
+    trace_end("md3_load_model", start);
     return NULL;
   }
 
@@ -136,9 +179,8 @@ md3_load_model(char* file, char* texture_path_prefix)
   /* TAGS */
   LOAD_ARRAY(model->tags, md3_tag_t, (model->num_tags * model->num_frames), 0, model->ofs_tags, model->fptr);
 
-  /* links - depend on number of tags (actual links are made later) */
-  model->links = (md3_model_t**)malloc(sizeof(md3_model_t*) * model->num_tags);
-  memset(model->links, 0, (sizeof(md3_model_t*) * model->num_tags));
+  md3_stats_stage(MD3_LOAD_HEADER, stage);
+  md3_stats_count(1, model->file_len, 3);
 
 #ifdef MD3_DEBUG
   printf("Tags loaded: %i\n", i);
@@ -148,7 +190,11 @@ md3_load_model(char* file, char* texture_path_prefix)
 #endif
 
   /* SURFACES */
-  md3_load_surfaces(model, texture_path_prefix);
+  md3_load_surfaces(wptr, model, texture_path_prefix);
+  if (WORLD_IS_SET(wptr, ENGINE_OPTIMIZE_TRIANGLES))
+    md3_optimize_surfaces(wptr, model, file);
+  if (WORLD_IS_SET(wptr, ENGINE_LOD))
+    md3_build_lods(model, file);
 
 #ifdef MD3_DEBUG
   printf("Surfaces loaded: %i\n", model->num_surfaces);
@@ -177,27 +223,14 @@ md3_load_model(char* file, char* texture_path_prefix)
 
   /* close the file */
   fclose(model->fptr);
+  model->fptr = NULL;
 
-  /* initialize the animation state */
-  model->anim_state.anim_info = NULL;
-  model->anim_state.id = 0;
-  model->anim_state.frame = 0;
-  model->anim_state.next_frame = 0;
-  model->anim_state.t = 0;
-  model->anim_state.last_time = 0.0;
-  model->anim_state.animated = 0;
-
-  /* initialize custom rotation */
-  model->rot[0] = 0.0f;
-  model->rot[1] = 0.0f;
-  model->rot[2] = 0.0f;
-  model->scale_factor = 1.0f;
-
+  trace_end("md3_load_model", start);
   return model;
 }
 
 static void
-md3_load_surfaces(md3_model_t* model, char* texture_path_prefix)
+md3_load_surfaces(struct world_t* wptr, md3_model_t* model, char* texture_path_prefix)
 {
   md3_surface_t* sptr = NULL;
   int surface_base = 0;
@@ -207,6 +240,8 @@ md3_load_surfaces(md3_model_t* model, char* texture_path_prefix)
   int surface = 0;
   int i = 0;
   char text_file[1024];
+  double start = trace_begin();
+  double stage = md3_stats_begin();
 
   /* assume there is at least 1 surface */
   model->surface_ptr = (md3_surface_t*)malloc(sizeof(md3_surface_t));
@@ -223,6 +258,7 @@ md3_load_surfaces(md3_model_t* model, char* texture_path_prefix)
     /* load in surface data */
     fseek(model->fptr, surface_start, SEEK_SET);
     fread(&sptr->ident, ((sizeof(int) * 11) + (sizeof(char) * MAX_QPATH)), 1, model->fptr);
+    sptr->gl_slot = -1;
 
     /* load shaders */
     sptr->shader = (md3_shader_t*)malloc(sizeof(md3_shader_t) * sptr->num_shaders);
@@ -239,8 +275,9 @@ md3_load_surfaces(md3_model_t* model, char* texture_path_prefix)
       if (sptr->shader[i].name[0] == '\0')
         sptr->shader[i].name[0] = 'm';
 
-      sptr->shader[i].gl_text_id = NULL;
-      sptr->shader[i].gl_text_bound = NULL;
+      sptr->shader[i].gl_slot = -1;
+
+      stage = md3_stats_stage(MD3_LOAD_SURFACES, stage);
 
       /* load the texture */
       if (!texture_path_prefix)
@@ -254,16 +291,16 @@ md3_load_surfaces(md3_model_t* model, char* texture_path_prefix)
         str_to_lower(sptr->shader[i].name);
         sprintf(text_file, "%s%s", (texture_path_prefix ? texture_path_prefix : ""), sptr->shader[i].name);
         format_path_for_os(text_file);
-        sptr->shader[i].texture = world_texture_cached(g_world, text_file, &sptr->shader[i]);
+        sptr->shader[i].texture = world_texture_cached(wptr, text_file, &sptr->shader[i]);
         if (!sptr->shader[i].texture)
         {
           /* if texture not already cached, load it */
-          sptr->shader[i].texture = load_tga(text_file);
+          sptr->shader[i].texture = md3_load_tga(text_file);
 
           if (sptr->shader[i].texture)
           {
             /* register it with the world */
-            world_add_texture(g_world, sptr->shader[i].texture, text_file, &sptr->shader[i]);
+            world_add_texture(wptr, sptr->shader[i].texture, text_file, &sptr->shader[i]);
 
 #ifdef MD3_DEBUG
             printf("Texture \"%s\" loaded.\n", text_file);
@@ -272,8 +309,7 @@ md3_load_surfaces(md3_model_t* model, char* texture_path_prefix)
         }
         else
         {
-          /* tell the world we need to use this texture */
-          world_using_texture(g_world, sptr->shader[i].texture);
+          /* the world counted us as using the texture already */
 
           /* if the texture id is not -1 then it has already been bound in GL */
 
@@ -285,6 +321,8 @@ md3_load_surfaces(md3_model_t* model, char* texture_path_prefix)
         if (!sptr->shader[i].texture)
           printf("Error: Unable to load texture \"%s\".\n", text_file);
       }
+
+      stage = md3_stats_begin();
     }
 
     /* load triangles */
@@ -294,6 +332,10 @@ md3_load_surfaces(md3_model_t* model, char* texture_path_prefix)
     /* load texture coordinates */
     LOAD_ARRAY(sptr->st, md3_texcoord_t, sptr->num_verts, surface_start, sptr->ofs_st, model->fptr);
 
+    /* the surface, its shaders, triangles, texture coordinates and verticies */
+    md3_stats_count(0, 0, 5);
+    stage = md3_stats_stage(MD3_LOAD_SURFACES, stage);
+
     /* load verticies */
     sptr->vertex = (md3_vertex_t*)malloc(sizeof(md3_vertex_t) * (sptr->num_verts * sptr->num_frames));
     vert_base = (surface_start + sptr->ofs_xyznormal);
@@ -301,10 +343,13 @@ md3_load_surfaces(md3_model_t* model, char* texture_path_prefix)
     {
       fseek(model->fptr, (vert_base + (i * MD3_SIZEOF_VERTEX)), SEEK_SET);
       fread(sptr->vertex + i, MD3_SIZEOF_VERTEX, 1, model->fptr);
+    }
+    stage = md3_stats_stage(MD3_LOAD_VERTICES, stage);
 
-      /* Calculate xyz normal */
+    /* Calculate xyz normals */
+    for (i = 0; i < (sptr->num_frames * sptr->num_verts); ++i)
       md3_make_normal(sptr->vertex + i);
-    }
+    stage = md3_stats_stage(MD3_LOAD_NORMALS, stage);
 
     /* go to start of next surface */
     if ((surface + 1) < model->num_surfaces)
@@ -315,13 +360,90 @@ md3_load_surfaces(md3_model_t* model, char* texture_path_prefix)
       sptr = sptr->next;
     }
   }
+
+  md3_stats_stage(MD3_LOAD_SURFACES, stage);
+  trace_end("md3_load_surfaces", start);
+}
+
+/*
+ *	Reorder the triangles of every surface for the vertex cache,
+ *	and for overdraw too if the world says so.
+ */
+static void
+md3_optimize_surfaces(struct world_t* wptr, md3_model_t* model, char* file)
+{
+  struct vcache_stats_t before, after;
+  md3_surface_t* sptr = model->surface_ptr;
+  double start = trace_begin();
+  double stage = md3_stats_begin();
+
+  memset(&before, 0, sizeof(before));
+  memset(&after, 0, sizeof(after));
+
+  for (; sptr; sptr = sptr->next)
+  {
+    vcache_measure(sptr, &before);
+    if (!vcache_optimize(sptr, WORLD_IS_SET(wptr, ENGINE_OPTIMIZE_OVERDRAW)))
+      printf("Error: Surface \"%s\" of \"%s\" has triangles out of range, not optimized.\n", sptr->name, file);
+    vcache_measure(sptr, &after);
+  }
+
+  /* the allocations for the reordered triangles, texture coordinates and vertices */
+  md3_stats_count(0, 0, (model->num_surfaces * 3));
+  md3_stats_stage(MD3_LOAD_OPTIMIZE, stage);
+
+  printf("Model %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f.\n", file, (double)VCACHE_ACMR(&before), (double)VCACHE_ACMR(&after),
+         (double)VCACHE_ATVR(&before), (double)VCACHE_ATVR(&after));
+
+  trace_end("md3_optimize_surfaces", start);
+}
+
+/*
+ *	Build the levels of detail of every surface.
+ */
+static void
+md3_build_lods(md3_model_t* model, char* file)
+{
+  md3_surface_t* sptr = model->surface_ptr;
+  double start = trace_begin();
+  double stage = md3_stats_begin();
+  int triangles[MD3_MAX_LODS + 1];
+  int num = 0;
+  int allocs = 0;
+  int i;
+
+  memset(triangles, 0, sizeof(triangles));
+
+  for (; sptr; sptr = sptr->next)
+  {
+    allocs += lod_build(sptr);
+    for (i = 0; i <= MD3_MAX_LODS; ++i)
+    {
+      lod_triangles(sptr, i, &num);
+      triangles[i] += num;
+    }
+  }
+
+  /* the allocations for the triangles of each level */
+  md3_stats_count(0, 0, allocs);
+  md3_stats_stage(MD3_LOAD_LOD, stage);
+
+  printf("Model %s: levels of detail of %i", file, triangles[0]);
+  for (i = 1; i <= MD3_MAX_LODS; ++i)
+    printf(", %i", triangles[i]);
+  printf(" triangles.\n");
+
+  trace_end("md3_build_lods", start);
 }
 
 /*
- *	Unload a model and deallocate memory used by the structures.
+ *	Unload model data and deallocate memory used by the structures.
+ *
+ *	Model data is shared, this should only be called once no
+ *	instance uses it anymore (see world_not_using_model()).
  */
 void
-md3_unload_model(md3_model_t* model)
+md3_unload_model(struct world_t* wptr, md3_model_t* model)
 {
   md3_surface_t* next_surface = NULL;
   int i = 0;
@@ -329,9 +451,6 @@ md3_unload_model(md3_model_t* model)
   if (!model)
     return;
 
-  /* tell the world */
-  world_del_model(g_world, model);
-
   /* free frames */
   free(model->frames);
 
@@ -345,7 +464,13 @@ md3_unload_model(md3_model_t* model)
 
     /* unload textures - tell the world we no longer need them */
     for (i = 0; i < model->surface_ptr->num_shaders; ++i)
-      world_not_using_texture(g_world, model->surface_ptr->shader[i].texture);
+      world_not_using_texture(wptr, model->surface_ptr->shader[i].texture);
+
+    /* free this world's GL buffers if the surface was drawn instanced */
+    crowd_free_surface(wptr, model->surface_ptr);
+
+    /* free the levels of detail */
+    lod_free(model->surface_ptr);
 
     /* free shaders */
     free(model->surface_ptr->shader);
@@ -353,6 +478,9 @@ md3_unload_model(md3_model_t* model)
     /* free triangles */
     free(model->surface_ptr->triangle);
 
+    /* free texture coordinates */
+    free(model->surface_ptr->st);
+
     /* free vertexes */
     free(model->surface_ptr->vertex);
 
@@ -362,14 +490,138 @@ md3_unload_model(md3_model_t* model)
     model->surface_ptr = next_surface;
   }
 
+  /* free animations */
+  free(model->anims);
+
+  /* free model */
+  free(model);
+}
+
+/*
+ *	Create a new instance of the model data.
+ *
+ *	The instance takes over the caller's reference to the model data,
+ *	it is released again by md3_free_instance().
+ */
+md3_instance_t*
+md3_new_instance(md3_model_t* model)
+{
+  md3_instance_t* inst = (md3_instance_t*)malloc(sizeof(md3_instance_t));
+  memset(inst, 0, sizeof(md3_instance_t));
+
+  inst->model = model;
+
+  /* links - depend on number of tags (actual links are made later) */
+  inst->num_links = model->num_tags;
+  inst->links = (md3_instance_t**)malloc(sizeof(md3_instance_t*) * model->num_tags);
+  memset(inst->links, 0, (sizeof(md3_instance_t*) * model->num_tags));
+
+  /* initialize the animation state */
+  inst->anim_state.anim_info = NULL;
+  inst->anim_state.id = 0;
+  inst->anim_state.frame = 0;
+  inst->anim_state.next_frame = 0;
+  inst->anim_state.t = 0;
+  inst->anim_state.last_time = 0.0;
+  inst->anim_state.animated = 0;
+
+  /* initialize custom rotation */
+  inst->rot[0] = 0.0f;
+  inst->rot[1] = 0.0f;
+  inst->rot[2] = 0.0f;
+  inst->scale_factor = 1.0f;
+
+  /* spread the animation updates of small instances over the frames */
+  inst->anim_phase = (float)fmod((ATOMIC_ADD(&md3_instances, 1) * ANIM_LOD_STAGGER), 1.0);
+
+  /* no period yet; the first is -1 for a phase past the clock's start */
+  inst->anim_slot = -HUGE_VAL;
+
+  return inst;
+}
+
+/*
+ *	Make a copy of an instance and everything linked to it.
+ *
+ *	The copies share the model data and are not added to the world.
+ */
+md3_instance_t*
+md3_clone_instance(struct world_t* wptr, md3_instance_t* inst)
+{
+  md3_instance_t* clone = NULL;
+  int link = 0;
+
+  if (!inst)
+    return NULL;
+
+  clone = md3_new_instance(inst->model);
+  world_using_model(wptr, inst->model);
+
+  clone->num_links = inst->num_links;
+  clone->model_name = (inst->model_name ? strdup(inst->model_name) : NULL);
+  clone->body_part = inst->body_part;
+  clone->anim_state = inst->anim_state;
+  memcpy(clone->rot, inst->rot, sizeof(clone->rot));
+  clone->scale_factor = inst->scale_factor;
+  clone->anim_budget = inst->anim_budget;
+
+  for (; link < inst->num_links; ++link)
+    clone->links[link] = md3_clone_instance(wptr, inst->links[link]);
+
+  return clone;
+}
+
+/*
+ *	Free an instance and release its model data.
+ */
+void
+md3_free_instance(struct world_t* wptr, md3_instance_t* inst)
+{
+  if (!inst)
+    return;
+
+  /* tell the world, and its scheduler */
+  anim_sched_remove(inst);
+  world_del_instance(wptr, inst);
+  world_not_using_model(wptr, inst->model);
+
   /* free the model name */
-  free(model->model_name);
+  free(inst->model_name);
 
   /* free array of links */
-  free(model->links);
+  free(inst->links);
 
-  /* free model */
-  free(model);
+  /* free instance */
+  free(inst);
+}
+
+/*
+ *	Get the model data for file from the world's cache,
+ *	or load it and add it to the cache under key.
+ *
+ *	loaded is set to 1 if the model data was freshly loaded.
+ *	Returns NULL on failure.
+ */
+static md3_model_t*
+load_cached_model(struct world_t* wptr, char* file, char* key, char* texture_path_prefix, int* loaded)
+{
+  md3_model_t* model = world_model_cached(wptr, key);
+
+  *loaded = 0;
+
+  /* the world counted us as using it already */
+  if (model)
+    return model;
+
+  model = md3_load_model(wptr, file, texture_path_prefix);
+  if (!model)
+    return NULL;
+
+  /* register it with the world */
+  world_add_model(wptr, model, key);
+  *loaded = 1;
+
+  return model;
 }
 
 /*
@@ -408,22 +660,34 @@ md3_make_normal(md3_vertex_t* vertex)
  *	Where "name" is the body part name and "file" is a relative
  *	path from this file to the md3 file.
  *
- *	Returns root model loaded.
+ *	The model data of each body part is shared with any other
+ *	instance already loaded from the same file.
+ *
+ *	Returns root instance loaded.
  */
-md3_model_t*
-load_model(char* file)
+md3_instance_t*
+load_model(struct world_t* wptr, char* file)
 {
   FILE* fptr = NULL;
   char* path = NULL;
   char buf[1024];
+  char key[1024];
   char name[64];
   char mfile[1024];
   char line_type;
   md3_model_t* model = NULL;
+  md3_instance_t* inst = NULL;
   char* text_path = NULL;
   int root_model = 1;
 
-  md3_model_t* models[10] = {0};
+  md3_anim_t anims[MD3_MAX_ANIMS];
+  int num_anims = 0;
+  int flags = 0;
+  long bytes = 0;
+  int id = 0;
+
+  md3_instance_t* insts[10] = {0};
+  int fresh[10] = {0};
   int loaded = 0;
   int i = 0;
 
@@ -459,33 +723,41 @@ load_model(char* file)
       /* make the relative path from this binary */
       sprintf(buf, "%s%s", (path ? path : ""), mfile);
 
+      /*
+       *	The textures and animations of a body part come from this file,
+       *	so the model data is only shared between instances of this file.
+       */
+      snprintf(key, sizeof(key), "%s:%s", file, name);
+
       /* load the model */
-      model = md3_load_model(buf, NULL);
+      model = load_cached_model(wptr, buf, key, NULL, &fresh[loaded]);
 
       if (!model)
         continue;
 
+      inst = md3_new_instance(model);
+
       /* assign our custom name to this model */
-      model->model_name = strdup(name);
+      inst->model_name = strdup(name);
       if (!strcmp(name, "upper"))
-        model->body_part = MD3_TORSO;
+        inst->body_part = MD3_TORSO;
       else if (!strcmp(name, "lower"))
-        model->body_part = MD3_LEGS;
+        inst->body_part = MD3_LEGS;
       else if (!strcmp(name, "head"))
-        model->body_part = MD3_HEAD;
+        inst->body_part = MD3_HEAD;
 
-      /* add the model to the world */
-      world_add_model(g_world, model, root_model);
+      /* add the instance to the world */
+      world_add_instance(wptr, inst, root_model);
 
       /* link this model to the others */
       for (i = 0; i < loaded; ++i)
       {
-        if (models[i])
-          md3_link_models(models[i], model);
+        if (insts[i])
+          md3_link_instances(insts[i], inst);
       }
 
       /* keep track of this model */
-      models[loaded] = model;
+      insts[loaded] = inst;
       ++loaded;
 
       /* only the first model in the file is considered the root model */
@@ -499,7 +771,7 @@ load_model(char* file)
       strcpy(name, buf);
       sprintf(buf, "%s%s", (path ? path : ""), name);
 
-      load_anim_file(buf, g_world->anims);
+      num_anims = load_anim_file(buf, anims);
     }
     else if (line_type == 't')
     {
@@ -522,16 +794,48 @@ load_model(char* file)
       /* Get the model this texture belongs to */
       for (; m < loaded; ++m)
       {
-        if (models[m]->body_part == model_type)
+        if (insts[m]->body_part == model_type)
         {
-          /* this is the model - find the surface */
-          load_texture_for_model(models[m], mfile, surface);
+          /* this is the model - find the surface (shared models already have it) */
+          if (fresh[m])
+            load_texture_for_model(wptr, insts[m]->model, mfile, surface);
           break;
         }
       }
     }
   }
 
+  /* give each freshly loaded body part the animations it can play */
+  for (i = 0; i < loaded; ++i)
+  {
+    if (insts[i]->body_part == MD3_TORSO)
+      flags = ANIM_BODY;
+    else if (insts[i]->body_part == MD3_LEGS)
+      flags = ANIM_LEGS;
+    else
+      continue;
+
+    if (!fresh[i] || !num_anims)
+      continue;
+
+    model = insts[i]->model;
+    model->anims = (md3_anim_t*)malloc(sizeof(md3_anim_t) * MD3_MAX_ANIMS);
+    md3_stats_count(0, 0, 1);
+    memset(model->anims, 0, (sizeof(md3_anim_t) * MD3_MAX_ANIMS));
+
+    for (id = 0; id < MD3_MAX_ANIMS; ++id)
+      if (get_animation_by_id(id)->flags & flags)
+        model->anims[id] = anims[id];
+
+    /* drop the key frames no animation will ever reach */
+    if (WORLD_IS_SET(wptr, ENGINE_COMPACT_FRAMES))
+    {
+      bytes = md3_compact_frames(model);
+      if (bytes)
+        printf("Model %s: compacted to %i frames, %ld bytes reclaimed.\n", insts[i]->model_name, model->num_frames, bytes);
+    }
+  }
+
   if (path)
     free(path);
   if (text_path)
@@ -539,7 +843,161 @@ load_model(char* file)
 
   fclose(fptr);
 
-  return *models;
+  return *insts;
+}
+
+/*
+ *	Remove the key frames of the model that are not part of any of
+ *	its animations, then renumber the animations to match.
+ *
+ *	The model data must not be in use by an animated instance yet.
+ *
+ *	Returns the number of bytes reclaimed.
+ */
+long
+md3_compact_frames(md3_model_t* model)
+{
+  md3_surface_t* sptr = NULL;
+  long frame_size = 0;
+  int old_frames = model->num_frames;
+  int* remap = NULL;
+  int used = 0;
+  int id = 0;
+
+  if (!model->anims)
+    /* not animated */
+    return 0;
+
+  remap = (int*)malloc(sizeof(int) * old_frames);
+  used = mark_used_frames(model, remap);
+
+  if (used < 0)
+    printf("*** ERROR: Animations of model \"%s\" do not fit its %i frames, not compacting.\n", model->name, old_frames);
+
+  if ((used <= 0) || (used == old_frames))
+  {
+    /* nothing to drop */
+    free(remap);
+    return 0;
+  }
+
+  frame_size = (sizeof(md3_frame_t) + (sizeof(md3_tag_t) * model->num_tags));
+  for (sptr = model->surface_ptr; sptr; sptr = sptr->next)
+    frame_size += (sizeof(md3_vertex_t) * sptr->num_verts);
+
+  compact_model_frames(model, remap);
+
+  /* renumber the animations */
+  for (; id < MD3_MAX_ANIMS; ++id)
+  {
+    if (!model->anims[id].fps)
+      continue;
+
+    model->anims[id].first_frame = remap[model->anims[id].first_frame];
+    model->anims[id].last_frame = remap[model->anims[id].last_frame];
+    model->anims[id].loop = remap[model->anims[id].loop % old_frames];
+  }
+
+  free(remap);
+
+  return ((old_frames - used) * frame_size);
+}
+
+/*
+ *	Fill remap with the new frame number of every frame in the model
+ *	that is referenced by its animations, and -1 for every other frame.
+ *
+ *	Returns the number of frames referenced, 0 if the model has
+ *	no animations, or -1 if the animations do not fit the model.
+ */
+static int
+mark_used_frames(md3_model_t* model, int* remap)
+{
+  md3_surface_t* sptr = model->surface_ptr;
+  md3_anim_t* anim = NULL;
+  int loaded = 0;
+  int used = 0;
+  int id;
+  int f;
+
+  /* every surface must have one set of verticies per frame */
+  for (; sptr; sptr = sptr->next)
+    if (sptr->num_frames != model->num_frames)
+      return -1;
+
+  for (f = 0; f < model->num_frames; ++f)
+    remap[f] = -1;
+
+  /* the first frame is shown whenever the model is not animated */
+  remap[0] = 0;
+
+  for (id = 0; id < MD3_MAX_ANIMS; ++id)
+  {
+    anim = &model->anims[id];
+    if (!anim->fps)
+      /* not in the animation file */
+      continue;
+
+    if ((anim->first_frame < 0) || (anim->last_frame >= model->num_frames) || (anim->loop < 0))
+      return -1;
+
+    for (f = anim->first_frame; f <= anim->last_frame; ++f)
+      remap[f] = 0;
+
+    /* the renderer wraps frames past the end around */
+    remap[anim->loop % model->num_frames] = 0;
+    ++loaded;
+  }
+
+  if (!loaded)
+    /* without animations every frame is as good as any other */
+    return 0;
+
+  /* give the referenced frames their new numbers */
+  for (f = 0; f < model->num_frames; ++f)
+    if (remap[f] >= 0)
+      remap[f] = used++;
+
+  return used;
+}
+
+/*
+ *	Move every referenced frame of the model down to its new number
+ *	and release the memory of the frames that were dropped.
+ */
+static void
+compact_model_frames(md3_model_t* model, int* remap)
+{
+  md3_surface_t* sptr = NULL;
+  int old_frames = model->num_frames;
+  int frames = 0;
+  int f;
+
+  /* frames only ever move down so copying them in order is safe */
+  for (f = 0; f < old_frames; ++f)
+  {
+    if (remap[f] < 0)
+      continue;
+
+    model->frames[remap[f]] = model->frames[f];
+    memmove(model->tags + (remap[f] * model->num_tags), model->tags + (f * model->num_tags), (sizeof(md3_tag_t) * model->num_tags));
+
+    for (sptr = model->surface_ptr; sptr; sptr = sptr->next)
+      memmove(sptr->vertex + (remap[f] * sptr->num_verts), sptr->vertex + (f * sptr->num_verts), (sizeof(md3_vertex_t) * sptr->num_verts));
+
+    ++frames;
+  }
+
+  model->num_frames = frames;
+  model->frames = (md3_frame_t*)realloc(model->frames, (sizeof(md3_frame_t) * frames));
+  if (model->num_tags)
+    model->tags = (md3_tag_t*)realloc(model->tags, (sizeof(md3_tag_t) * model->num_tags * frames));
+
+  for (sptr = model->surface_ptr; sptr; sptr = sptr->next)
+  {
+    sptr->num_frames = frames;
+    sptr->vertex = (md3_vertex_t*)realloc(sptr->vertex, (sizeof(md3_vertex_t) * sptr->num_verts * frames));
+  }
 }
 
 /*
@@ -548,38 +1006,44 @@ load_model(char* file)
  *	If unload_weapon_link is 0 the weapon link will not be unloaded.
  */
 void
-unload_model(md3_model_t* model, int unload_weapon_link)
+unload_model(struct world_t* wptr, md3_instance_t* inst, int unload_weapon_link)
 {
   int link = 0;
 
-  if (!model)
+  if (!inst)
     return;
 
-  if ((!unload_weapon_link) && (model->body_part == MD3_WEAPON))
+  if ((!unload_weapon_link) && (inst->body_part == MD3_WEAPON))
     /* we do not want to unload the weapon, just skip it */
     return;
 
   /* First unload all the links to this model */
-  for (; link < model->num_tags; ++link)
-    unload_model(model->links[link], unload_weapon_link);
+  for (; link < inst->num_links; ++link)
+    unload_model(wptr, inst->links[link], unload_weapon_link);
 
-  /* Unload the model - md3_unload_model() will tell the world for us */
-  md3_unload_model(model);
+  /* Free the instance - md3_free_instance() will tell the world for us */
+  md3_free_instance(wptr, inst);
 }
 
 /*
  *	Load a weapon and add to the world.
  */
-md3_model_t*
-load_weapon(char* path, char* texture_path_prefix)
+md3_instance_t*
+load_weapon(struct world_t* wptr, char* path, char* texture_path_prefix)
 {
-  md3_model_t* w = md3_load_model(path, texture_path_prefix);
-  if (!w)
+  md3_model_t* model = NULL;
+  md3_instance_t* w = NULL;
+  int loaded = 0;
+
+  model = load_cached_model(wptr, path, path, texture_path_prefix, &loaded);
+  if (!model)
     return NULL;
+
+  w = md3_new_instance(model);
   w->model_name = strdup("weapon");
   w->body_part = MD3_WEAPON;
-  world_link_model(g_world, w);
-  world_add_model(g_world, w, 0);
+  world_link_instance(wptr, w);
+  world_add_instance(wptr, w, 0);
   return w;
 }
 
@@ -587,11 +1051,10 @@ load_weapon(char* path, char* texture_path_prefix)
  *	Unload a weapon and delete from the world.
  */
 void
-unload_weapon(md3_model_t* w)
+unload_weapon(struct world_t* wptr, md3_instance_t* w)
 {
-  world_delink_model(g_world, w);
-  world_del_model(g_world, w);
-  md3_unload_model(w);
+  world_delink_instance(wptr, w);
+  md3_free_instance(wptr, w);
 }
 
 /*
@@ -600,7 +1063,7 @@ unload_weapon(md3_model_t* w)
  *	Return number of links made.
  */
 int
-md3_link_models(md3_model_t* parent, md3_model_t* child)
+md3_link_instances(md3_instance_t* parent, md3_instance_t* child)
 {
   int ctag;
   int ptag;
@@ -611,12 +1074,12 @@ md3_link_models(md3_model_t* parent, md3_model_t* child)
     return 0;
 
   /* iterate through each tag in the child */
-  for (ctag = 0; ctag < child->num_tags; ++ctag)
+  for (ctag = 0; ctag < child->num_links; ++ctag)
   {
     /* find this tag in parent */
-    for (ptag = 0; ptag < parent->num_tags; ++ptag)
+    for (ptag = 0; ptag < parent->num_links; ++ptag)
     {
-      if (!strcmp(parent->tags[ptag].name, child->tags[ctag].name))
+      if (!strcmp(parent->model->tags[ptag].name, child->model->tags[ctag].name))
       {
         parent->links[ptag] = child;
         ++links;
@@ -634,7 +1097,7 @@ md3_link_models(md3_model_t* parent, md3_model_t* child)
  *	Return 1 if the link was broken.
  */
 int
-md3_unlink_models(md3_model_t* parent, md3_model_t* child)
+md3_unlink_instances(md3_instance_t* parent, md3_instance_t* child)
 {
   int link = 0;
 
@@ -642,7 +1105,7 @@ md3_unlink_models(md3_model_t* parent, md3_model_t* child)
     /* a node can not be linked to itself */
     return 0;
 
-  for (; link < parent->num_tags; ++link)
+  for (; link < parent->num_links; ++link)
   {
     if (parent->links[link] == child)
     {
@@ -670,11 +1133,15 @@ load_anim_file(char* file, md3_anim_t* aptr)
   int loaded = 0;
   int id = 0;
   int legs_offset = 0;
+  double start, stage;
 
   fptr = fopen(file, "r");
   if (!fptr)
     return 0;
 
+  start = trace_begin();
+  stage = md3_stats_begin();
+
   memset(aptr, 0, (sizeof(md3_anim_t) * MD3_MAX_ANIMS));
 
   while (!feof(fptr))
@@ -743,8 +1210,11 @@ load_anim_file(char* file, md3_anim_t* aptr)
     ++loaded;
   }
 
+  md3_stats_count(1, ftell(fptr), 0);
   fclose(fptr);
 
+  md3_stats_stage(MD3_LOAD_ANIMS, stage);
+  trace_end("load_anim_file", start);
   return loaded;
 }
 
@@ -752,7 +1222,7 @@ load_anim_file(char* file, md3_anim_t* aptr)
  *	Load a texture for a specific surface for the given model.
  */
 static void
-load_texture_for_model(md3_model_t* model, char* texture, char* surface)
+load_texture_for_model(struct world_t* wptr, md3_model_t* model, char* texture, char* surface)
 {
   md3_surface_t* sptr = model->surface_ptr;
   while (sptr)
@@ -760,18 +1230,18 @@ load_texture_for_model(md3_model_t* model, char* texture, char* surface)
     if (!strcmp(sptr->name, surface))
     {
       /* this is the surface - load the texture here */
-      sptr->shader[0].texture = world_texture_cached(g_world, texture, &sptr->shader[0]);
+      sptr->shader[0].texture = world_texture_cached(wptr, texture, &sptr->shader[0]);
 
       if (!sptr->shader[0].texture)
       {
         /* if texture not already cached, load it */
         format_path_for_os(texture);
-        sptr->shader[0].texture = load_tga(texture);
+        sptr->shader[0].texture = md3_load_tga(texture);
 
         if (sptr->shader[0].texture)
         {
           /* register it with the world */
-          world_add_texture(g_world, sptr->shader[0].texture, texture, &sptr->shader[0]);
+          world_add_texture(wptr, sptr->shader[0].texture, texture, &sptr->shader[0]);
 
 #ifdef MD3_DEBUG
           printf("Texture \"%s\" loaded.\n", texture);
@@ -782,8 +1252,7 @@ load_texture_for_model(md3_model_t* model, char* texture, char* surface)
       }
       else
       {
-        /* tell the world we need to use this texture */
-        world_using_texture(g_world, sptr->shader[0].texture);
+        /* the world counted us as using the texture already */
 
         /* if the texture id is not -1 then it has already been bound in GL */
 
@@ -799,7 +1268,7 @@ load_texture_for_model(md3_model_t* model, char* texture, char* surface)
     }
     sptr = sptr->next;
   }
-  printf("Error: Failed to load texture \"%s\" to model %s surface %s.\n", texture, model->model_name, surface);
+  printf("Error: Failed to load texture \"%s\" to model %s surface %s.\n", texture, model->name, surface);
 }
 
 /*
@@ -832,25 +1301,123 @@ get_animation_by_name(char* name)
  *	Load a light model.
  */
 void
-load_light_model(char* file, int light_num)
+load_light_model(struct world_t* wptr, char* file, int light_num)
 {
-  md3_model_t* m = NULL;
+  md3_model_t* model = NULL;
+  md3_instance_t* m = NULL;
   char buf[64] = {0};
+  int loaded = 0;
 
-  m = md3_load_model(file, "../");
+  model = load_cached_model(wptr, file, file, "../", &loaded);
 
-  if (!m)
+  if (!model)
     return;
 
+  m = md3_new_instance(model);
   m->body_part = MD3_LIGHT;
 
   sprintf(buf, "Light %i", light_num);
   m->model_name = strdup(buf);
 
-  /* manually kill tags so no links are possible */
-  m->num_tags = 0;
+  /* manually kill links so no links are possible */
+  m->num_links = 0;
+
+  world_add_instance(wptr, m, 0);
+
+  wptr->light[light_num].model = m;
+}
+
+/*
+ *	Turn the load statistics on or off.
+ *
+ *	While on, every stage of loading a model is timed and the files,
+ *	bytes and allocations are counted, from every thread.
+ */
+void
+md3_load_stats_enable(int enable)
+{
+  md3_stats_on = enable;
+}
+
+/*
+ *	Get the load statistics since they were last taken, and reset them.
+ */
+void
+md3_load_stats_take(struct md3_load_stats_t* stats)
+{
+  int i = 0;
+
+  for (; i < MD3_LOAD_STAGES; ++i)
+    stats->ms[i] = (ATOMIC_EXCHANGE(&md3_stats_us[i], 0) / 1000.0f);
+  stats->files = ATOMIC_EXCHANGE(&md3_stats_files, 0);
+  stats->bytes = ATOMIC_EXCHANGE(&md3_stats_bytes, 0);
+  stats->allocs = ATOMIC_EXCHANGE(&md3_stats_allocs, 0);
+}
+
+/*
+ *	Get the name of a load stage.
+ */
+const char*
+md3_load_stage_name(md3_load_stage_e stage)
+{
+  return md3_load_stage_names[stage];
+}
+
+/*
+ *	Start timing a load stage.
+ *	Returns the time, or 0 if the statistics are off.
+ */
+static double
+md3_stats_begin()
+{
+  return (md3_stats_on ? prof_begin() : 0.0);
+}
+
+/*
+ *	Add the time since start to a load stage.
+ *	Returns the time, the start of the next stage.
+ */
+static double
+md3_stats_stage(md3_load_stage_e stage, double start)
+{
+  double now;
+
+  if (!md3_stats_on)
+    return 0.0;
+
+  now = prof_begin();
+  ATOMIC_ADD(&md3_stats_us[stage], (int)((now - start) * 1000.0));
+  return now;
+}
+
+/*
+ *	Count files read, the bytes read from them and allocations made.
+ */
+static void
+md3_stats_count(int files, long bytes, int allocs)
+{
+  if (!md3_stats_on)
+    return;
+
+  ATOMIC_ADD(&md3_stats_files, files);
+  ATOMIC_ADD(&md3_stats_bytes, (int)bytes);
+  ATOMIC_ADD(&md3_stats_allocs, allocs);
+}
+
+/*
+ *	Load a tga file, as a texture stage of the load statistics.
+ */
+static struct tga_t*
+md3_load_tga(char* file)
+{
+  double start = md3_stats_begin();
+  struct tga_t* tga = load_tga(file);
+
+  md3_stats_stage(MD3_LOAD_TEXTURES, start);
 
-  world_add_model(g_world, m, 0);
+  /* the header, the image and the two allocations for them */
+  if (tga)
+    md3_stats_count(1, (18 + (tga->header.width * tga->header.height * tga->header.depth)), 2);
 
-  g_world->light[light_num].model = m;
+  return tga;
 }
@@ -38,6 +38,7 @@ extern "C"
   typedef struct md3_anim_state_t md3_anim_state_t;
   typedef struct md3_anim_t md3_anim_t;
   typedef struct md3_frame_t md3_frame_t;
+  typedef struct md3_instance_t md3_instance_t;
   typedef struct md3_model_t md3_model_t;
   typedef struct md3_shader_t md3_shader_t;
   typedef struct md3_surface_t md3_surface_t;
@@ -47,12 +48,15 @@ extern "C"
   typedef struct md3_vertex_t md3_vertex_t;
   typedef struct vec3_t vec3_t;
 
+  struct anim_sched_t;
+
   //	Various MD3 constants.
 #define MD3_MAGIC_NUMBER_LITTLE_ENDIAN 0x33504449
 #define MAX_QPATH 64
 #define MD3_MAX_FRAMES 1024
 #define MD3_MAX_TAGS 16
 #define MD3_MAX_SURFACES 32
+#define MD3_MAX_LODS 3
 #define MD3_XYZ_SCALE (1.0f / 64.0f)
 
   //	The size of various structures in the file -
@@ -128,9 +132,8 @@ extern "C"
     char name[MAX_QPATH]; // name of shader
     int shader_index;     // shader index number
 
-    struct tga_t* texture;    // targa loaded texture
-    unsigned int* gl_text_id; // openGL texture id; points to world_texture_t.gl_text_id
-    int* gl_text_bound;       // has the texture been bound?; points to world_texture_t.dl_text_bound
+    struct tga_t* texture; // targa loaded texture
+    int gl_slot;           // of the texture's GL name in each world (world_texture_name()); -1 if none
   } NO_ALIGN;
 
   struct md3_triangle_t
@@ -172,6 +175,12 @@ extern "C"
     md3_triangle_t* triangle; // array of triangles
     md3_texcoord_t* st;       // array of surface textures
     md3_vertex_t* vertex;     // array of vertexes
+
+    int num_lods;                               // coarser levels of detail built (lod.h)
+    int lod_num_triangles[MD3_MAX_LODS];        // number of triangles in each
+    md3_triangle_t* lod_triangle[MD3_MAX_LODS]; // their triangles, on the same vertexes
+
+    int gl_slot; // of its GL buffers in each world (world_surface_buffers()); -1 until cached
   } NO_ALIGN;
 
 #pragma pack(8)
@@ -245,6 +254,9 @@ extern "C"
     int animated; // set to 1 if the model is in a state of animation
   };
 
+  //	Model data loaded from an MD3 file.
+  //	This is shared by every instance of the model and
+  //	is not changed once the model has been loaded.
   struct md3_model_t
   {
     FILE* fptr;          // file pointer
@@ -270,7 +282,18 @@ extern "C"
     md3_surface_t* surface_ptr; // list of surfaces
 
     // custom stuff
-    md3_model_t** links; // child model links
+    md3_anim_t* anims; // animations for this model (MD3_MAX_ANIMS), NULL if not animated
+
+    int total_triangles; // total number of triangles for model
+  };
+
+  //	An instance of a model placed in the world.
+  //	Many instances can share the same model data.
+  struct md3_instance_t
+  {
+    md3_model_t* model;     // shared model data
+    md3_instance_t** links; // child instance links (one per tag)
+    int num_links;          // number of usable links
 
     char* model_name;            // custom model name
     md3_body_parts_e body_part;  // the type of body part this model is
@@ -278,26 +301,71 @@ extern "C"
     float rot[3];                // user defined rotation on x/y/z
     float scale_factor;          // scaling factor (after MD3_XYZ_SCALE)
     int draw_bounding_box;       // should bounding box be rendered?
+    int lod;                     // level of detail drawn in the last frame
+    int screen_pixels;           // radius on the screen when last drawn, rounded up; 0 if never
+    float anim_budget;           // animation updates per second when small on the screen; 0 is the world's, negative is full rate
+    float anim_phase;            // where in each period of the budget it updates, 0 to 1
+    double anim_slot;            // the period it last updated in
+    double anim_due;             // when it next needs more than its blend moved
+    struct anim_sched_t* sched;  // the animation scheduler it is in, if any
+    int sched_id;                // its id in the scheduler
+  };
 
-    int total_triangles; // total number of triangles for model
+  //	Stages of loading a model, timed while load statistics are on.
+  //	They do not nest; texture loads are not part of surfaces.
+  enum MD3_LOAD_STAGES
+  {
+    MD3_LOAD_HEADER,   // header, frames and tags
+    MD3_LOAD_SURFACES, // surface headers, shaders, triangles, texture coordinates
+    MD3_LOAD_VERTICES, // reading the vertices
+    MD3_LOAD_NORMALS,  // decoding the vertex normals
+    MD3_LOAD_OPTIMIZE, // reordering the triangles for the vertex cache
+    MD3_LOAD_LOD,      // simplifying the surfaces into levels of detail
+    MD3_LOAD_TEXTURES, // reading tga files
+    MD3_LOAD_ANIMS,    // reading animation.cfg
+    MD3_LOAD_STAGES
+  };
+  typedef enum MD3_LOAD_STAGES md3_load_stage_e;
+
+  //	What the loaders did since the statistics were last taken,
+  //	summed over every thread.
+  struct md3_load_stats_t
+  {
+    float ms[MD3_LOAD_STAGES]; // time spent in each stage
+    int files;                 // md3, tga and animation.cfg files read
+    long bytes;                // bytes read from them
+    int allocs;                // allocations of model and texture data
   };
 
-  md3_model_t* md3_load_model(char* file, char* texture_path_prefix);
-  void md3_unload_model(md3_model_t* model);
+  //	The world the models are loaded into (world.h).
+  struct world_t;
 
-  md3_model_t* load_model(char* file);
-  void unload_model(md3_model_t* model, int unload_weapon_link);
+  md3_model_t* md3_load_model(struct world_t* wptr, char* file, char* texture_path_prefix);
+  void md3_unload_model(struct world_t* wptr, md3_model_t* model);
 
-  md3_model_t* load_weapon(char* path, char* texture_path_prefix);
-  void unload_weapon(md3_model_t* w);
+  md3_instance_t* md3_new_instance(md3_model_t* model);
+  md3_instance_t* md3_clone_instance(struct world_t* wptr, md3_instance_t* inst);
+  void md3_free_instance(struct world_t* wptr, md3_instance_t* inst);
 
-  int md3_link_models(md3_model_t* parent, md3_model_t* child);
-  int md3_unlink_models(md3_model_t* parent, md3_model_t* child);
+  md3_instance_t* load_model(struct world_t* wptr, char* file);
+  void unload_model(struct world_t* wptr, md3_instance_t* inst, int unload_weapon_link);
+
+  md3_instance_t* load_weapon(struct world_t* wptr, char* path, char* texture_path_prefix);
+  void unload_weapon(struct world_t* wptr, md3_instance_t* w);
+
+  long md3_compact_frames(md3_model_t* model);
+
+  int md3_link_instances(md3_instance_t* parent, md3_instance_t* child);
+  int md3_unlink_instances(md3_instance_t* parent, md3_instance_t* child);
 
   md3_anim_names_t* get_animation_by_id(md3_animations_e id);
   md3_anim_names_t* get_animation_by_name(char* name);
 
-  void load_light_model(char* file, int light_num);
+  void load_light_model(struct world_t* wptr, char* file, int light_num);
+
+  void md3_load_stats_enable(int enable);
+  void md3_load_stats_take(struct md3_load_stats_t* stats);
+  const char* md3_load_stage_name(md3_load_stage_e stage);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,311 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ *	Work stealing thread pool.
+ *
+ *	Each slot owns a range of task numbers.  A slot takes tasks from
+ *	the front of its own range; when it runs dry it steals the back
+ *	half of another slot's range.  Tasks are only ever integers so a
+ *	range [begin, end) is the whole deque.
+ *
+ *	Slot 0 is the thread calling pool_run(), it works too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "thread.h"
+#include "pool.h"
+#include "trace.h"
+
+struct pool_slot_t
+{
+  mutex_t lock;
+  int begin; /* next task to run					*/
+  int end;   /* one past the last task owned		*/
+
+  struct pool_t* pool;
+  int id;
+
+  char pad[CACHE_LINE];
+};
+
+struct pool_t
+{
+  int num_slots; /* worker threads + the caller	*/
+  struct pool_slot_t* slots;
+  thread_t* threads;
+
+  /* the job being run */
+  pool_func_t func;
+  void* data;
+
+  /* wake up and completion */
+  mutex_t lock;
+  cond_t start;
+  cond_t done;
+  int generation; /* bumped for every job		*/
+  int active;     /* workers still on the job	*/
+  int quit;
+};
+
+static void pool_worker(void* arg);
+static void pool_work(struct pool_t* p, struct pool_slot_t* self);
+static int pool_steal(struct pool_t* p, struct pool_slot_t* self);
+
+/*
+ *	Create a pool with the given number of threads, including
+ *	the caller.  0 uses one thread per processor.
+ */
+struct pool_t*
+pool_new(int threads)
+{
+  struct pool_t* p = (struct pool_t*)malloc(sizeof(struct pool_t));
+  int i = 0;
+
+  memset(p, 0, sizeof(struct pool_t));
+
+  if (threads <= 0)
+    threads = thread_cpu_count();
+
+  p->num_slots = threads;
+  p->slots = (struct pool_slot_t*)malloc(sizeof(struct pool_slot_t) * threads);
+  memset(p->slots, 0, (sizeof(struct pool_slot_t) * threads));
+  p->threads = (thread_t*)malloc(sizeof(thread_t) * threads);
+
+  mutex_init(&p->lock);
+  cond_init(&p->start);
+  cond_init(&p->done);
+
+  for (i = 0; i < threads; ++i)
+  {
+    mutex_init(&p->slots[i].lock);
+    p->slots[i].pool = p;
+    p->slots[i].id = i;
+  }
+
+  /* slot 0 is the caller */
+  for (i = 1; i < threads; ++i)
+  {
+    if (!thread_create(&p->threads[i], pool_worker, &p->slots[i]))
+    {
+      /* run with what we have */
+      p->num_slots = i;
+      break;
+    }
+  }
+
+  return p;
+}
+
+/*
+ *	Stop the threads and free the pool.
+ */
+void
+pool_free(struct pool_t* p)
+{
+  int i = 0;
+
+  if (!p)
+    return;
+
+  mutex_lock(&p->lock);
+  p->quit = 1;
+  cond_broadcast(&p->start);
+  mutex_unlock(&p->lock);
+
+  for (i = 1; i < p->num_slots; ++i)
+    thread_join(p->threads[i]);
+
+  for (i = 0; i < p->num_slots; ++i)
+    mutex_destroy(&p->slots[i].lock);
+
+  cond_destroy(&p->done);
+  cond_destroy(&p->start);
+  mutex_destroy(&p->lock);
+
+  free(p->threads);
+  free(p->slots);
+  free(p);
+}
+
+/*
+ *	Get the number of threads working on jobs, including the caller.
+ */
+int
+pool_threads(struct pool_t* p)
+{
+  return p->num_slots;
+}
+
+/*
+ *	Run func(data, task) for every task and wait for them all to finish.
+ */
+void
+pool_run(struct pool_t* p, pool_func_t func, void* data, int num_tasks)
+{
+  int per_slot = 0;
+  int i = 0;
+
+  if (num_tasks <= 0)
+    return;
+
+  if (p->num_slots == 1)
+  {
+    /* nobody to share with */
+    for (i = 0; i < num_tasks; ++i)
+      func(data, i);
+    return;
+  }
+
+  /* hand each slot an even share to start with */
+  per_slot = ((num_tasks + p->num_slots - 1) / p->num_slots);
+
+  mutex_lock(&p->lock);
+  p->func = func;
+  p->data = data;
+
+  for (i = 0; i < p->num_slots; ++i)
+  {
+    mutex_lock(&p->slots[i].lock);
+    p->slots[i].begin = (i * per_slot);
+    p->slots[i].end = ((i + 1) * per_slot);
+    if (p->slots[i].begin > num_tasks)
+      p->slots[i].begin = num_tasks;
+    if (p->slots[i].end > num_tasks)
+      p->slots[i].end = num_tasks;
+    mutex_unlock(&p->slots[i].lock);
+  }
+
+  p->active = (p->num_slots - 1);
+  p->generation++;
+  cond_broadcast(&p->start);
+  mutex_unlock(&p->lock);
+
+  /* work along with the threads */
+  pool_work(p, &p->slots[0]);
+
+  /* wait for the stragglers */
+  mutex_lock(&p->lock);
+  while (p->active)
+    cond_wait(&p->done, &p->lock);
+  mutex_unlock(&p->lock);
+}
+
+/*
+ *	Worker thread main loop.
+ */
+static void
+pool_worker(void* arg)
+{
+  struct pool_slot_t* self = (struct pool_slot_t*)arg;
+  struct pool_t* p = self->pool;
+  char name[32];
+  double start;
+  int seen = 0;
+
+  sprintf(name, "pool %i", self->id);
+  trace_thread_name(name);
+
+  mutex_lock(&p->lock);
+  for (;;)
+  {
+    while ((p->generation == seen) && !p->quit)
+      cond_wait(&p->start, &p->lock);
+
+    if (p->quit)
+      break;
+
+    seen = p->generation;
+    mutex_unlock(&p->lock);
+
+    start = trace_begin();
+    pool_work(p, self);
+    trace_end("pool_work", start);
+
+    mutex_lock(&p->lock);
+    if (!--p->active)
+      cond_signal(&p->done);
+  }
+  mutex_unlock(&p->lock);
+}
+
+/*
+ *	Run tasks until there are none left anywhere.
+ */
+static void
+pool_work(struct pool_t* p, struct pool_slot_t* self)
+{
+  int task = 0;
+
+  for (;;)
+  {
+    mutex_lock(&self->lock);
+    task = ((self->begin < self->end) ? self->begin++ : -1);
+    mutex_unlock(&self->lock);
+
+    if (task < 0)
+    {
+      if (!pool_steal(p, self))
+        return;
+      continue;
+    }
+
+    p->func(p->data, task);
+  }
+}
+
+/*
+ *	Take the back half of another slot's tasks.
+ *
+ *	Returns 0 if every slot is empty.
+ */
+static int
+pool_steal(struct pool_t* p, struct pool_slot_t* self)
+{
+  struct pool_slot_t* victim = NULL;
+  int begin = 0;
+  int end = 0;
+  int i = 1;
+
+  for (; i < p->num_slots; ++i)
+  {
+    victim = &p->slots[(self->id + i) % p->num_slots];
+
+    mutex_lock(&victim->lock);
+    if (victim->begin < victim->end)
+    {
+      end = victim->end;
+      begin = (victim->end - ((victim->end - victim->begin + 1) / 2));
+      victim->end = begin;
+    }
+    mutex_unlock(&victim->lock);
+
+    if (begin < end)
+    {
+      mutex_lock(&self->lock);
+      self->begin = begin;
+      self->end = end;
+      mutex_unlock(&self->lock);
+      return 1;
+    }
+  }
+
+  return 0;
+}
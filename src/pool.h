@@ -0,0 +1,46 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _POOL_H
+#define _POOL_H
+
+/*
+ *	Work stealing thread pool.
+ *
+ *	pool_run() calls func(data, task) once for every task in
+ *	[0, num_tasks) spread over the pool and returns when all are done.
+ */
+
+typedef void (*pool_func_t)(void* data, int task);
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct pool_t* pool_new(int threads);
+  void pool_free(struct pool_t* p);
+
+  int pool_threads(struct pool_t* p);
+  void pool_run(struct pool_t* p, pool_func_t func, void* data, int num_tasks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _POOL_H */
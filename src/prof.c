@@ -0,0 +1,414 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gl_ext.h"
+#include "thread.h"
+#include "prof.h"
+#include "trace.h"
+
+static const char* prof_names[PROF_STAGES] = {
+  "frame",
+  "tick",
+  "pose",
+  "interp",
+  "texture",
+  "draw",
+  "mirror",
+  "swap",
+  "gpu_model",
+  "gpu_flashlight",
+  "gpu_mirror_stencil",
+  "gpu_mirror_reflection",
+  "gpu_mirror_plane",
+  "gpu_box"};
+
+/* nanoseconds spent in each stage so far this frame, from any thread */
+static long long prof_current[PROF_STAGES];
+
+static double prof_frame_start;
+static int prof_in_frame;
+
+/* the last frames; only the drawing thread touches these */
+static struct prof_sample_t prof_ring[PROF_RING_SIZE];
+static unsigned int prof_head; /* frames ever written			*/
+static float prof_sorted[PROF_RING_SIZE];
+
+/* frames at the head of the ring still waiting for GPU times */
+static unsigned int prof_lag;
+
+/* --profile-out */
+static FILE* prof_out;
+static int prof_json;
+
+/*
+ *	GPU timestamp queries of one frame.
+ */
+struct prof_gpu_frame_t
+{
+  unsigned int frame; /* the frame that issued them				*/
+  int pending;        /* results not read back yet				*/
+  int num_spans;
+  prof_stage_e stages[PROF_GPU_SPANS];
+  GLuint queries[PROF_GPU_SPANS * 2]; /* begin and end of each span	*/
+};
+
+enum
+{
+  PROF_GPU_OFF,
+  PROF_GPU_ASKED, /* started on the first frame, with a GL context	*/
+  PROF_GPU_ON
+};
+
+static int prof_gpu_state;
+static struct prof_gpu_frame_t prof_gpu[PROF_GPU_FRAMES];
+static struct prof_gpu_frame_t* prof_gpu_current;
+
+static void prof_gpu_init();
+static void prof_gpu_collect();
+static void prof_write(unsigned int frame);
+static int prof_cmp(const void* a, const void* b);
+
+/*
+ *	Write every frame to a file as well, JSON if the name ends
+ *	in ".json" and CSV otherwise.
+ *
+ *	Returns 0 if the file could not be opened.
+ */
+int
+prof_open(char* file)
+{
+  size_t len = strlen(file);
+  int i = 0;
+
+  prof_out = fopen(file, "w");
+  if (!prof_out)
+  {
+    printf("Error: Could not open %s for the profile.\n", file);
+    return 0;
+  }
+
+  prof_json = ((len > 5) && !strcmp(&file[len - 5], ".json"));
+
+  if (prof_json)
+  {
+    fprintf(prof_out, "{\"stages\": [");
+    for (; i < PROF_STAGES; ++i)
+      fprintf(prof_out, "%s\"%s_ms\"", (i ? ", " : ""), prof_names[i]);
+    fprintf(prof_out, "],\n\"frames\": [");
+  }
+  else
+  {
+    fprintf(prof_out, "frame");
+    for (; i < PROF_STAGES; ++i)
+      fprintf(prof_out, ",%s_ms", prof_names[i]);
+    fprintf(prof_out, "\n");
+  }
+
+  return 1;
+}
+
+/*
+ *	Finish and close the profile file.
+ *
+ *	The last frames are written without the GPU times they
+ *	were still waiting for.
+ */
+void
+prof_close()
+{
+  unsigned int frame = ((prof_head > prof_lag) ? (prof_head - prof_lag) : 0);
+
+  if (!prof_out)
+    return;
+
+  for (; frame < prof_head; ++frame)
+    prof_write(frame);
+
+  if (prof_json)
+    fprintf(prof_out, "\n]}\n");
+
+  fclose(prof_out);
+  prof_out = NULL;
+}
+
+/*
+ *	Start timing a stage.
+ *	Returns the time on a monotonic clock in milliseconds.
+ */
+double
+prof_begin()
+{
+#ifdef _WIN32
+  LARGE_INTEGER freq, now;
+
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return ((now.QuadPart * 1000.0) / freq.QuadPart);
+#else
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((now.tv_sec * 1000.0) + (now.tv_nsec / 1000000.0));
+#endif
+}
+
+/*
+ *	Add the time since start to a stage of the frame in progress,
+ *	and to the trace if one is recorded.
+ *
+ *	The simulation thread steps between frames too; with no frame
+ *	in progress, as while the window is hidden, its time is dropped
+ *	rather than piled onto the next frame.
+ */
+void
+prof_end(prof_stage_e stage, double start)
+{
+  if (ATOMIC_LOAD(&prof_in_frame))
+    ATOMIC_ADD64(&prof_current[stage], (long long)((prof_begin() - start) * 1000000.0));
+  trace_end(prof_names[stage], start);
+}
+
+/*
+ *	Start a frame; closes the last one if it was never ended.
+ *
+ *	With GPU timing on a GL context must be current.
+ */
+void
+prof_frame_begin()
+{
+  if (prof_in_frame)
+    prof_frame_end();
+
+  if (prof_gpu_state == PROF_GPU_ASKED)
+    prof_gpu_init();
+
+  if (prof_gpu_state == PROF_GPU_ON)
+  {
+    prof_gpu_collect();
+
+    /* the oldest queries; if the GPU is that far behind they are dropped */
+    prof_gpu_current = &prof_gpu[prof_head % PROF_GPU_FRAMES];
+    prof_gpu_current->frame = prof_head;
+    prof_gpu_current->pending = 1;
+    prof_gpu_current->num_spans = 0;
+  }
+
+  prof_frame_start = prof_begin();
+  ATOMIC_STORE(&prof_in_frame, 1);
+}
+
+/*
+ *	End the frame and record it.
+ */
+void
+prof_frame_end()
+{
+  struct prof_sample_t* sample = NULL;
+  int i = 1;
+
+  if (!prof_in_frame)
+    return;
+  ATOMIC_STORE(&prof_in_frame, 0);
+
+  sample = &prof_ring[prof_head & (PROF_RING_SIZE - 1)];
+  sample->ms[PROF_FRAME] = (float)(prof_begin() - prof_frame_start);
+  trace_end(prof_names[PROF_FRAME], prof_frame_start);
+  for (; i < PROF_STAGES; ++i)
+    sample->ms[i] = (float)(ATOMIC_EXCHANGE64(&prof_current[i], 0) / 1000000.0);
+  ATOMIC_STORE(&prof_head, (prof_head + 1));
+
+  /* the oldest frame whose GPU times are all in */
+  if (prof_out && (prof_head > prof_lag))
+    prof_write(prof_head - prof_lag - 1);
+}
+
+/*
+ *	Time the render passes on the GPU as well.
+ */
+void
+prof_gpu_enable()
+{
+  prof_gpu_state = PROF_GPU_ASKED;
+  prof_lag = PROF_GPU_FRAMES;
+}
+
+/*
+ *	Start timing a render pass on the GPU.
+ *	Returns the span to end, or -1 if it is not timed.
+ */
+int
+prof_gpu_begin(prof_stage_e stage)
+{
+  struct prof_gpu_frame_t* f = prof_gpu_current;
+  int span;
+
+  if ((prof_gpu_state != PROF_GPU_ON) || !prof_in_frame || (f->num_spans == PROF_GPU_SPANS))
+    return -1;
+
+  span = f->num_spans++;
+  f->stages[span] = stage;
+  glQueryCounter(f->queries[span * 2], GL_TIMESTAMP);
+  return span;
+}
+
+/*
+ *	End timing a render pass on the GPU.
+ */
+void
+prof_gpu_end(int span)
+{
+  if (span < 0)
+    return;
+
+  glQueryCounter(prof_gpu_current->queries[(span * 2) + 1], GL_TIMESTAMP);
+}
+
+/*
+ *	Create the queries; the first frame has a GL context.
+ */
+static void
+prof_gpu_init()
+{
+  int i = 0;
+
+  gl_ext_init();
+  if (!gl_ext_version(3, 3))
+  {
+    printf("Error: GPU timing needs OpenGL 3.3.\n");
+    prof_gpu_state = PROF_GPU_OFF;
+    prof_lag = 0;
+    return;
+  }
+
+  /* they go with the context */
+  for (; i < PROF_GPU_FRAMES; ++i)
+    glGenQueries((PROF_GPU_SPANS * 2), prof_gpu[i].queries);
+
+  prof_gpu_state = PROF_GPU_ON;
+}
+
+/*
+ *	Read back the GPU times of the frames the GPU has finished,
+ *	without waiting for the ones it has not.
+ */
+static void
+prof_gpu_collect()
+{
+  struct prof_gpu_frame_t* f = NULL;
+  struct prof_sample_t* sample = NULL;
+  GLuint64 begin, end;
+  GLint available;
+  int i, j;
+
+  for (i = 0; i < PROF_GPU_FRAMES; ++i)
+  {
+    f = &prof_gpu[i];
+    if (!f->pending || (f->frame == prof_head))
+      continue;
+
+    if (f->num_spans)
+    {
+      /* timestamps land in order; if the last is in so are the rest */
+      glGetQueryObjectiv(f->queries[(f->num_spans * 2) - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+        continue;
+
+      sample = &prof_ring[f->frame & (PROF_RING_SIZE - 1)];
+      for (j = 0; j < f->num_spans; ++j)
+      {
+        glGetQueryObjectui64v(f->queries[j * 2], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(f->queries[(j * 2) + 1], GL_QUERY_RESULT, &end);
+        sample->ms[f->stages[j]] += ((end - begin) / 1000000.0f);
+      }
+    }
+
+    f->pending = 0;
+  }
+}
+
+/*
+ *	Write a frame to the profile file.
+ */
+static void
+prof_write(unsigned int frame)
+{
+  struct prof_sample_t* sample = &prof_ring[frame & (PROF_RING_SIZE - 1)];
+  int i = 0;
+
+  if (prof_json)
+    fprintf(prof_out, "%s\n[", (frame ? "," : ""));
+  else
+    fprintf(prof_out, "%u,", frame);
+
+  for (; i < PROF_STAGES; ++i)
+    fprintf(prof_out, "%s%.4f", (i ? "," : ""), (double)sample->ms[i]);
+
+  fprintf(prof_out, (prof_json ? "]" : "\n"));
+}
+
+/*
+ *	Get the median, 95th and 99th percentile of a stage over
+ *	the recorded frames.
+ *
+ *	Returns the number of frames they were taken from.
+ */
+int
+prof_percentiles(prof_stage_e stage, float* p50, float* p95, float* p99)
+{
+  unsigned int end = ((prof_head > prof_lag) ? (prof_head - prof_lag) : 0);
+  int n = ((end < (PROF_RING_SIZE - prof_lag)) ? (int)end : (int)(PROF_RING_SIZE - prof_lag));
+  int i = 0;
+
+  *p50 = *p95 = *p99 = 0.0f;
+  if (!n)
+    return 0;
+
+  for (; i < n; ++i)
+    prof_sorted[i] = prof_ring[(end - n + i) & (PROF_RING_SIZE - 1)].ms[stage];
+  qsort(prof_sorted, n, sizeof(float), prof_cmp);
+
+  *p50 = prof_sorted[(int)((n - 1) * 0.50f + 0.5f)];
+  *p95 = prof_sorted[(int)((n - 1) * 0.95f + 0.5f)];
+  *p99 = prof_sorted[(int)((n - 1) * 0.99f + 0.5f)];
+  return n;
+}
+
+/*
+ *	Get the name of a stage.
+ */
+const char*
+prof_stage_name(prof_stage_e stage)
+{
+  return prof_names[stage];
+}
+
+/*
+ *	qsort() callback for floats.
+ */
+static int
+prof_cmp(const void* a, const void* b)
+{
+  float fa = *(const float*)a;
+  float fb = *(const float*)b;
+
+  return ((fa > fb) - (fa < fb));
+}
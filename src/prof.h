@@ -0,0 +1,118 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _PROF_H
+#define _PROF_H
+
+/*
+ *	Frame time profiler.
+ *
+ *	Code is timed in stages with a monotonic clock:
+ *
+ *		double start = prof_begin();
+ *		...
+ *		prof_end(PROF_DRAW, start);
+ *
+ *	prof_end() may be called from any thread; the time is added to the
+ *	frame in progress.  Stages nest, so a stage includes the stages run
+ *	inside it (tick is part of pose, draw is part of mirror).  While a
+ *	trace is recorded every stage is a span in it too (see trace.h).
+ *
+ *	prof_frame_end() closes the frame and puts it on a ring buffer of
+ *	the last PROF_RING_SIZE frames that prof_percentiles() reads.
+ *	It is only called from one thread, the one drawing the frames.
+ *
+ *	With prof_gpu_enable() the GPU time of the render passes is
+ *	measured too, with timestamp queries so passes can nest:
+ *
+ *		int span = prof_gpu_begin(PROF_GPU_MODEL);
+ *		...
+ *		prof_gpu_end(span);
+ *
+ *	The results are read back PROF_GPU_FRAMES frames later, when the GPU
+ *	is surely done, and added to the frame that issued them.  Frames
+ *	are written to the profile file and counted in the percentiles
+ *	only once their GPU times are in.
+ */
+
+/*
+ *	Frames kept for the percentiles; a power of two.
+ */
+#define PROF_RING_SIZE 1024
+
+/*
+ *	Frames of GPU queries in flight, and the most spans in a frame.
+ */
+#define PROF_GPU_FRAMES 4
+#define PROF_GPU_SPANS 64
+
+typedef enum
+{
+  PROF_FRAME,   /* start of the frame to the swap				*/
+  PROF_TICK,    /* advancing animations							*/
+  PROF_POSE,    /* walking the tag tree for part transforms		*/
+  PROF_INTERP,  /* blending key frames on the CPU				*/
+  PROF_TEXTURE, /* binding textures								*/
+  PROF_DRAW,    /* submitting geometry							*/
+  PROF_MIRROR,  /* the mirror passes								*/
+  PROF_SWAP,    /* glFlush() and waiting for the swap			*/
+
+  /* GPU time */
+  PROF_GPU_MODEL,      /* the model or crowd					*/
+  PROF_GPU_FLASHLIGHT, /* the flashlight model					*/
+  PROF_GPU_STENCIL,    /* marking the mirrors in the stencil	*/
+  PROF_GPU_REFLECTION, /* the scene seen in the mirrors		*/
+  PROF_GPU_PLANE,      /* blending the mirror planes on top		*/
+  PROF_GPU_BOX,        /* bounding boxes						*/
+  PROF_STAGES
+} prof_stage_e;
+
+/*
+ *	One frame; milliseconds spent in each stage.
+ */
+struct prof_sample_t
+{
+  float ms[PROF_STAGES];
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  int prof_open(char* file);
+  void prof_close();
+
+  double prof_begin();
+  void prof_end(prof_stage_e stage, double start);
+
+  void prof_frame_begin();
+  void prof_frame_end();
+
+  void prof_gpu_enable();
+  int prof_gpu_begin(prof_stage_e stage);
+  void prof_gpu_end(int span);
+
+  int prof_percentiles(prof_stage_e stage, float* p50, float* p95, float* p99);
+  const char* prof_stage_name(prof_stage_e stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PROF_H */
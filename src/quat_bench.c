@@ -0,0 +1,901 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "definitions.h"
+#include "md3_parse.h"
+#include "quaternion.h"
+#include "world.h"
+#include "render.h"
+#include "thread.h"
+#include "prof.h"
+#include "load_bench.h"
+#include "check.h"
+#include "quat_bench.h"
+
+#define N QUAT_BENCH_INPUTS
+
+/*
+ *	The largest errors quat_bench_slerp_check() found, in degrees.
+ */
+struct quat_bench_slerp_t
+{
+  long pairs;   /* of key frames slerped	*/
+  double fast;  /* quat_slerp_fast()		*/
+  double slerp; /* quat_slerp()			*/
+};
+
+/*
+ *	A kernel: run() calls it once for every input, check() does
+ *	the same and returns the largest error against the reference.
+ */
+struct quat_bench_kernel_t
+{
+  const char* name;
+  void (*run)();
+  double (*check)();
+  double tolerance;
+};
+
+/*
+ *	The inputs and outputs of the kernels; the double
+ *	precision quaternions the float inputs were made from.
+ */
+static struct
+{
+  double qa[N][4];
+  double qb[N][4];
+
+  quat_t a[N];
+  quat_t b[N]; /* a turned up to 90 degrees		*/
+  float t[N];
+  struct vec3_t origin[N];
+  float ma[N][16]; /* a and b as 4x4 matrices		*/
+  float mb[N][16];
+  float m3a[N][9]; /* and as tags' 3x3 matrices	*/
+  float m3b[N][9];
+  md3_vertex_t v1[N];
+  md3_vertex_t v2[N];
+
+  quat_t q[N];
+  float m[N][16];
+  md3_vertex_t v[N];
+} qb;
+
+static unsigned int quat_bench_seed = 1;
+
+static void quat_bench_inputs();
+static double quat_bench_time(struct quat_bench_kernel_t* k, double* mad);
+static int quat_bench_cmp(const void* a, const void* b);
+
+static double quat_bench_random();
+static void quat_bench_random_quat(double* q);
+static double quat_bench_error(double x, double ref);
+static double quat_bench_quat_error(quat_t* q, double* ref);
+static void quat_bench_to_double(quat_t* q, double* d);
+static void quat_bench_slerp_inst(md3_instance_t* inst, struct quat_bench_slerp_t* s);
+static void quat_bench_tag_quat(md3_tag_t* tag, quat_t* q);
+static double quat_bench_angle(quat_t* q, double* ref);
+static void ref_mult(double* a, double* b, double* c);
+static void ref_slerp(double* a, double* b, double t, double* c);
+static void ref_to_matrix(double* q, struct vec3_t* origin, double* m);
+
+static void run_mult();
+static double check_mult();
+static void run_slerp();
+static double check_slerp();
+static void run_slerp_fast();
+static double check_slerp_fast();
+static void run_to_matrix();
+static double check_to_matrix();
+static void run_from_matrix_4x4();
+static double check_from_matrix_4x4();
+static void run_from_matrix_3x3();
+static double check_from_matrix_3x3();
+static void run_matrix_mult();
+static double check_matrix_mult();
+static void run_tag_blend();
+static double check_tag_blend();
+static void run_lerp_vertex();
+static double check_lerp_vertex();
+static void run_lerp_normal();
+static double check_lerp_normal();
+
+/*
+ *	The kernels and how far off they may be.
+ *
+ *	Errors are relative, or absolute below 1.  quat_slerp() blends
+ *	linearly without normalizing below about 26 degrees, so it is
+ *	off by up to 2.5%, and the tag matrices made from its result
+ *	by up to 10%.  The vertex blend truncates to shorts and may
+ *	land a unit apart from the reference.
+ */
+static struct quat_bench_kernel_t quat_bench_kernels[] = {
+  {"quat_mult", run_mult, check_mult, 1e-6},
+  {"quat_slerp", run_slerp, check_slerp, 0.03},
+  {"quat_slerp_fast", run_slerp_fast, check_slerp_fast, 1e-4},
+  {"quat_to_matrix_4x4", run_to_matrix, check_to_matrix, 1e-6},
+  {"quat_from_matrix_4x4", run_from_matrix_4x4, check_from_matrix_4x4, 1e-5},
+  {"quat_from_matrix_3x3", run_from_matrix_3x3, check_from_matrix_3x3, 1e-5},
+  {"matrix_mult_4x4", run_matrix_mult, check_matrix_mult, 1e-5},
+  {"tag blend", run_tag_blend, check_tag_blend, 0.1},
+  {"LERP_VERTEX", run_lerp_vertex, check_lerp_vertex, 1.0},
+  {"LERP_NORMAL", run_lerp_normal, check_lerp_normal, 1e-6}};
+
+/*
+ *	Time and check every kernel and print the results.
+ *
+ *	Returns the number of kernels that failed their check.
+ */
+int
+quat_bench_run()
+{
+  struct quat_bench_kernel_t* k = NULL;
+  int num = (sizeof(quat_bench_kernels) / sizeof(quat_bench_kernels[0]));
+  int pinned = thread_pin_cpu(0);
+  double median, mad, error;
+  int failed = 0;
+  int i = 0;
+
+  printf("Quaternion benchmark: %i inputs, %i repetitions after %i warmup, %s\n",
+         N, QUAT_BENCH_REPS, QUAT_BENCH_WARMUP, (pinned ? "pinned to processor 0" : "not pinned"));
+  printf("  %-22s %10s %10s %10s %10s %10s\n", "kernel", "median ns", "MAD ns", "Mcalls/s", "error", "tolerance");
+
+  quat_bench_inputs();
+
+  for (; i < num; ++i)
+  {
+    k = &quat_bench_kernels[i];
+
+    median = quat_bench_time(k, &mad);
+    error = k->check();
+    if (error > k->tolerance)
+      ++failed;
+
+    printf("  %-22s %10.2f %10.2f %10.1f %10.2e %10.2e %s\n",
+           k->name, median, mad, ((median > 0) ? (1000.0 / median) : 0.0), error, k->tolerance,
+           ((error > k->tolerance) ? "FAIL" : "ok"));
+  }
+
+  return failed;
+}
+
+/*
+ *	Slerp every tag of every model check_new() finds in dir
+ *	from each key frame to the next, with quat_slerp_fast() and with
+ *	quat_slerp(), and print how far each turns from an exact slerp.
+ *
+ *	Returns the number of files on which quat_slerp_fast() is off
+ *	by more than QUAT_SLERP_FAST_ERROR, or failed to load.
+ */
+int
+quat_bench_slerp_check(char* dir)
+{
+  struct check_t* c = check_new(dir, 0);
+  struct quat_bench_slerp_t total, file;
+  md3_instance_t* inst = NULL;
+  int i = 0;
+
+  if (!c)
+    return 1;
+
+  memset(&total, 0, sizeof(total));
+
+  printf("Slerp check: %i files, %i steps between key frames, largest error in degrees\n", c->lb->num_files, QUAT_BENCH_STEPS);
+  printf("  %-48s %8s %12s %12s\n", "file", "pairs", "fast", "quat_slerp");
+
+  for (; i < c->lb->num_files; ++i)
+  {
+    inst = check_load(c, c->lb->files[i].file);
+    if (!inst)
+      continue;
+
+    memset(&file, 0, sizeof(file));
+    quat_bench_slerp_inst(inst, &file);
+    check_unload(c, inst);
+
+    if (file.fast > (double)QUAT_SLERP_FAST_ERROR)
+      ++c->failed;
+    printf("  %-48s %8li %12.6f %12.6f %s\n", c->lb->files[i].file, file.pairs, file.fast, file.slerp,
+           ((file.fast > (double)QUAT_SLERP_FAST_ERROR) ? "FAIL" : "ok"));
+
+    total.pairs += file.pairs;
+    if (file.fast > total.fast)
+      total.fast = file.fast;
+    if (file.slerp > total.slerp)
+      total.slerp = file.slerp;
+  }
+
+  printf("  %-48s %8li %12.6f %12.6f (fast may be off by %.2f)\n", "all", total.pairs, total.fast, total.slerp, (double)QUAT_SLERP_FAST_ERROR);
+
+  return check_free(c);
+}
+
+/*
+ *	Slerp the tags of a part and everything linked to it.
+ */
+static void
+quat_bench_slerp_inst(md3_instance_t* inst, struct quat_bench_slerp_t* s)
+{
+  md3_model_t* model = inst->model;
+  md3_tag_t* tag = NULL;
+  md3_tag_t* next_tag = NULL;
+  quat_t q1, q2, q;
+  double d1[4], d2[4], ref[4];
+  double t;
+  int i, f, step;
+
+  for (i = 0; i < inst->num_links; ++i)
+  {
+    if (inst->links[i])
+      quat_bench_slerp_inst(inst->links[i], s);
+  }
+
+  if (!model || (model->num_frames < 2))
+    return;
+
+  for (i = 0; i < model->num_tags; ++i)
+  {
+    for (f = 0; f < model->num_frames; ++f)
+    {
+      tag = &model->tags[(f * model->num_tags) + i];
+      next_tag = &model->tags[(((f + 1) % model->num_frames) * model->num_tags) + i];
+
+      quat_bench_tag_quat(tag, &q1);
+      quat_bench_tag_quat(next_tag, &q2);
+      quat_bench_to_double(&q1, d1);
+      quat_bench_to_double(&q2, d2);
+      ++s->pairs;
+
+      for (step = 1; step < QUAT_BENCH_STEPS; ++step)
+      {
+        t = ((double)step / QUAT_BENCH_STEPS);
+        ref_slerp(d1, d2, t, ref);
+
+        quat_slerp_fast(&q1, &q2, (float)t, &q);
+        if (quat_bench_angle(&q, ref) > s->fast)
+          s->fast = quat_bench_angle(&q, ref);
+
+        quat_slerp(&q1, &q2, (float)t, &q);
+        if (quat_bench_angle(&q, ref) > s->slerp)
+          s->slerp = quat_bench_angle(&q, ref);
+      }
+    }
+  }
+}
+
+/*
+ *	The unit quaternion of a tag's orientation.
+ */
+static void
+quat_bench_tag_quat(md3_tag_t* tag, quat_t* q)
+{
+  float m[9];
+  int i = 0;
+
+  for (; i < 3; ++i)
+  {
+    m[(i * 3)] = tag->axis[i].x;
+    m[(i * 3) + 1] = tag->axis[i].y;
+    m[(i * 3) + 2] = tag->axis[i].z;
+  }
+
+  quat_from_matrix_3x3(q, m);
+  quat_normalize(q);
+}
+
+/*
+ *	Degrees of rotation between q and a unit quaternion;
+ *	q need not be of unit length.
+ */
+static double
+quat_bench_angle(quat_t* q, double* ref)
+{
+  double d[4];
+  double dp = 0, len = 0;
+  int i = 0;
+
+  quat_bench_to_double(q, d);
+  for (; i < 4; ++i)
+  {
+    dp += (d[i] * ref[i]);
+    len += (d[i] * d[i]);
+  }
+
+  dp = (fabs(dp) / sqrt(len));
+  return ((dp < 1.0) ? ((2.0 * acos(dp)) * (180.0 / PI)) : 0.0);
+}
+
+/*
+ *	Make the inputs, the same every run.
+ */
+static void
+quat_bench_inputs()
+{
+  double turn[4];
+  double m[16];
+  double angle;
+  int i, j;
+
+  quat_bench_seed = 1;
+
+  for (i = 0; i < N; ++i)
+  {
+    quat_bench_random_quat(qb.qa[i]);
+
+    /* the next key frame; a small turn of a random axis */
+    quat_bench_random_quat(turn);
+    angle = (quat_bench_random() * (PI / 4.0));
+    for (j = 0; j < 3; ++j)
+      turn[j] *= (sin(angle) / sqrt(1.0 - (turn[3] * turn[3])));
+    turn[3] = cos(angle);
+    ref_mult(qb.qa[i], turn, qb.qb[i]);
+
+    /* the other way round the sphere, sometimes */
+    if (!(i & 3))
+    {
+      for (j = 0; j < 4; ++j)
+        qb.qb[i][j] = -qb.qb[i][j];
+    }
+
+    qb.a[i].x = (float)qb.qa[i][0];
+    qb.a[i].y = (float)qb.qa[i][1];
+    qb.a[i].z = (float)qb.qa[i][2];
+    qb.a[i].w = (float)qb.qa[i][3];
+    qb.b[i].x = (float)qb.qb[i][0];
+    qb.b[i].y = (float)qb.qb[i][1];
+    qb.b[i].z = (float)qb.qb[i][2];
+    qb.b[i].w = (float)qb.qb[i][3];
+
+    qb.t[i] = (float)quat_bench_random();
+    qb.origin[i].x = (float)((quat_bench_random() * 60.0) - 30.0);
+    qb.origin[i].y = (float)((quat_bench_random() * 60.0) - 30.0);
+    qb.origin[i].z = (float)((quat_bench_random() * 60.0) - 30.0);
+
+    ref_to_matrix(qb.qa[i], &qb.origin[i], m);
+    for (j = 0; j < 16; ++j)
+      qb.ma[i][j] = (float)m[j];
+    for (j = 0; j < 9; ++j)
+      qb.m3a[i][j] = (float)m[((j / 3) * 4) + (j % 3)];
+
+    ref_to_matrix(qb.qb[i], &qb.origin[i], m);
+    for (j = 0; j < 16; ++j)
+      qb.mb[i][j] = (float)m[j];
+    for (j = 0; j < 9; ++j)
+      qb.m3b[i][j] = (float)m[((j / 3) * 4) + (j % 3)];
+
+    qb.v1[i].x = (short)((quat_bench_random() * 4000.0) - 2000.0);
+    qb.v1[i].y = (short)((quat_bench_random() * 4000.0) - 2000.0);
+    qb.v1[i].z = (short)((quat_bench_random() * 4000.0) - 2000.0);
+    qb.v2[i].x = (short)((quat_bench_random() * 4000.0) - 2000.0);
+    qb.v2[i].y = (short)((quat_bench_random() * 4000.0) - 2000.0);
+    qb.v2[i].z = (short)((quat_bench_random() * 4000.0) - 2000.0);
+    for (j = 0; j < 3; ++j)
+    {
+      qb.v1[i].normalxyz[j] = (float)qb.qa[i][j];
+      qb.v2[i].normalxyz[j] = (float)qb.qb[i][j];
+    }
+  }
+}
+
+/*
+ *	Time a kernel.
+ *	Returns the median nanoseconds per call; mad is set to the
+ *	median absolute deviation from it.
+ */
+static double
+quat_bench_time(struct quat_bench_kernel_t* k, double* mad)
+{
+  double ns[QUAT_BENCH_REPS];
+  double start, median;
+  int i = 0;
+
+  for (; i < QUAT_BENCH_WARMUP; ++i)
+    k->run();
+
+  for (i = 0; i < QUAT_BENCH_REPS; ++i)
+  {
+    start = prof_begin();
+    k->run();
+    ns[i] = (((prof_begin() - start) * 1000000.0) / N);
+  }
+
+  qsort(ns, QUAT_BENCH_REPS, sizeof(double), quat_bench_cmp);
+  median = ns[QUAT_BENCH_REPS / 2];
+
+  for (i = 0; i < QUAT_BENCH_REPS; ++i)
+    ns[i] = fabs(ns[i] - median);
+  qsort(ns, QUAT_BENCH_REPS, sizeof(double), quat_bench_cmp);
+  *mad = ns[QUAT_BENCH_REPS / 2];
+
+  return median;
+}
+
+/*
+ *	qsort() callback for doubles.
+ */
+static int
+quat_bench_cmp(const void* a, const void* b)
+{
+  double da = *(const double*)a;
+  double db = *(const double*)b;
+
+  return ((da > db) - (da < db));
+}
+
+/*
+ *	A number in [0, 1); the same ones every run.
+ */
+static double
+quat_bench_random()
+{
+  quat_bench_seed = ((quat_bench_seed * 1103515245) + 12345);
+  return ((quat_bench_seed >> 8) / 16777216.0);
+}
+
+/*
+ *	A random unit quaternion.
+ */
+static void
+quat_bench_random_quat(double* q)
+{
+  double len;
+  int i;
+
+  do
+  {
+    for (i = 0, len = 0; i < 4; ++i)
+    {
+      q[i] = ((quat_bench_random() * 2.0) - 1.0);
+      len += (q[i] * q[i]);
+    }
+  } while ((len < 0.01) || (len > 1.0) || ((q[3] * q[3]) > (0.99 * len)));
+
+  len = sqrt(len);
+  for (i = 0; i < 4; ++i)
+    q[i] /= len;
+}
+
+/*
+ *	How far x is off; relative to the reference, or absolute below 1.
+ */
+static double
+quat_bench_error(double x, double ref)
+{
+  return (fabs(x - ref) / ((fabs(ref) > 1.0) ? fabs(ref) : 1.0));
+}
+
+/*
+ *	How far a quaternion is off; q and -q are the same rotation.
+ */
+static double
+quat_bench_quat_error(quat_t* q, double* ref)
+{
+  double d[4];
+  double pos = 0, neg = 0;
+  int i = 0;
+
+  quat_bench_to_double(q, d);
+  for (; i < 4; ++i)
+  {
+    if (quat_bench_error(d[i], ref[i]) > pos)
+      pos = quat_bench_error(d[i], ref[i]);
+    if (quat_bench_error(d[i], -ref[i]) > neg)
+      neg = quat_bench_error(d[i], -ref[i]);
+  }
+
+  return ((pos < neg) ? pos : neg);
+}
+
+static void
+quat_bench_to_double(quat_t* q, double* d)
+{
+  d[0] = q->x;
+  d[1] = q->y;
+  d[2] = q->z;
+  d[3] = q->w;
+}
+
+/*
+ *	The reference math, in double precision.
+ */
+static void
+ref_mult(double* a, double* b, double* c)
+{
+  double r[4];
+
+  r[0] = ((a[3] * b[0]) + (a[0] * b[3]) + (a[1] * b[2]) - (a[2] * b[1]));
+  r[1] = ((a[3] * b[1]) - (a[0] * b[2]) + (a[1] * b[3]) + (a[2] * b[0]));
+  r[2] = ((a[3] * b[2]) + (a[0] * b[1]) - (a[1] * b[0]) + (a[2] * b[3]));
+  r[3] = ((a[3] * b[3]) - (a[0] * b[0]) - (a[1] * b[1]) - (a[2] * b[2]));
+  memcpy(c, r, sizeof(r));
+}
+
+static void
+ref_slerp(double* a, double* b, double t, double* c)
+{
+  double dp = ((a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]) + (a[3] * b[3]));
+  double sign = ((dp < 0) ? -1.0 : 1.0);
+  double theta, s0, s1, len;
+  int i;
+
+  dp *= sign;
+  if (dp > 0.9999999)
+  {
+    s0 = (1.0 - t);
+    s1 = t;
+  }
+  else
+  {
+    theta = acos(dp);
+    s0 = (sin((1.0 - t) * theta) / sin(theta));
+    s1 = (sin(t * theta) / sin(theta));
+  }
+
+  for (i = 0, len = 0; i < 4; ++i)
+  {
+    c[i] = ((s0 * a[i]) + (s1 * sign * b[i]));
+    len += (c[i] * c[i]);
+  }
+
+  len = sqrt(len);
+  for (i = 0; i < 4; ++i)
+    c[i] /= len;
+}
+
+/* the same layout as quat_to_matrix_4x4() */
+static void
+ref_to_matrix(double* q, struct vec3_t* origin, double* m)
+{
+  double x = q[0], y = q[1], z = q[2], w = q[3];
+
+  m[0] = 1 - 2 * (y * y + z * z);
+  m[1] = 2 * (x * y - z * w);
+  m[2] = 2 * (x * z + y * w);
+  m[3] = 0;
+  m[4] = 2 * (x * y + z * w);
+  m[5] = 1 - 2 * (x * x + z * z);
+  m[6] = 2 * (y * z - x * w);
+  m[7] = 0;
+  m[8] = 2 * (x * z - y * w);
+  m[9] = 2 * (y * z + x * w);
+  m[10] = 1 - 2 * (x * x + y * y);
+  m[11] = 0;
+  m[12] = origin->x;
+  m[13] = origin->y;
+  m[14] = origin->z;
+  m[15] = 1;
+}
+
+/*
+ *	The kernels.
+ */
+static void
+run_mult()
+{
+  int i = 0;
+
+  for (; i < N; ++i)
+    quat_mult(&qb.a[i], &qb.b[i], &qb.q[i]);
+}
+
+static double
+check_mult()
+{
+  double a[4], b[4], ref[4];
+  double error = 0;
+  int i = 0;
+
+  run_mult();
+  for (; i < N; ++i)
+  {
+    quat_bench_to_double(&qb.a[i], a);
+    quat_bench_to_double(&qb.b[i], b);
+    ref_mult(a, b, ref);
+    if (quat_bench_quat_error(&qb.q[i], ref) > error)
+      error = quat_bench_quat_error(&qb.q[i], ref);
+  }
+
+  return error;
+}
+
+static void
+run_slerp()
+{
+  int i = 0;
+
+  for (; i < N; ++i)
+    quat_slerp(&qb.a[i], &qb.b[i], qb.t[i], &qb.q[i]);
+}
+
+static double
+check_slerp()
+{
+  double ref[4];
+  double error = 0;
+  int i = 0;
+
+  run_slerp();
+  for (; i < N; ++i)
+  {
+    ref_slerp(qb.qa[i], qb.qb[i], qb.t[i], ref);
+    if (quat_bench_quat_error(&qb.q[i], ref) > error)
+      error = quat_bench_quat_error(&qb.q[i], ref);
+  }
+
+  return error;
+}
+
+static void
+run_slerp_fast()
+{
+  int i = 0;
+
+  for (; i < N; ++i)
+    quat_slerp_fast(&qb.a[i], &qb.b[i], qb.t[i], &qb.q[i]);
+}
+
+static double
+check_slerp_fast()
+{
+  double ref[4];
+  double error = 0;
+  int i = 0;
+
+  run_slerp_fast();
+  for (; i < N; ++i)
+  {
+    ref_slerp(qb.qa[i], qb.qb[i], qb.t[i], ref);
+    if (quat_bench_quat_error(&qb.q[i], ref) > error)
+      error = quat_bench_quat_error(&qb.q[i], ref);
+  }
+
+  return error;
+}
+
+static void
+run_to_matrix()
+{
+  int i = 0;
+
+  for (; i < N; ++i)
+    quat_to_matrix_4x4(&qb.a[i], &qb.origin[i], qb.m[i]);
+}
+
+static double
+check_to_matrix()
+{
+  double q[4], ref[16];
+  double error = 0;
+  int i, j;
+
+  run_to_matrix();
+  for (i = 0; i < N; ++i)
+  {
+    quat_bench_to_double(&qb.a[i], q);
+    ref_to_matrix(q, &qb.origin[i], ref);
+    for (j = 0; j < 16; ++j)
+    {
+      if (quat_bench_error(qb.m[i][j], ref[j]) > error)
+        error = quat_bench_error(qb.m[i][j], ref[j]);
+    }
+  }
+
+  return error;
+}
+
+static void
+run_from_matrix_4x4()
+{
+  int i = 0;
+
+  for (; i < N; ++i)
+    quat_from_matrix_4x4(&qb.q[i], qb.ma[i]);
+}
+
+static double
+check_from_matrix_4x4()
+{
+  double error = 0;
+  int i = 0;
+
+  run_from_matrix_4x4();
+  for (; i < N; ++i)
+  {
+    if (quat_bench_quat_error(&qb.q[i], qb.qa[i]) > error)
+      error = quat_bench_quat_error(&qb.q[i], qb.qa[i]);
+  }
+
+  return error;
+}
+
+static void
+run_from_matrix_3x3()
+{
+  int i = 0;
+
+  for (; i < N; ++i)
+    quat_from_matrix_3x3(&qb.q[i], qb.m3a[i]);
+}
+
+static double
+check_from_matrix_3x3()
+{
+  double error = 0;
+  int i = 0;
+
+  run_from_matrix_3x3();
+  for (; i < N; ++i)
+  {
+    if (quat_bench_quat_error(&qb.q[i], qb.qa[i]) > error)
+      error = quat_bench_quat_error(&qb.q[i], qb.qa[i]);
+  }
+
+  return error;
+}
+
+static void
+run_matrix_mult()
+{
+  int i = 0;
+
+  for (; i < N; ++i)
+    matrix_mult_4x4(qb.ma[i], qb.mb[i], qb.m[i]);
+}
+
+static double
+check_matrix_mult()
+{
+  double ref;
+  double error = 0;
+  int i, row, col, k;
+
+  run_matrix_mult();
+  for (i = 0; i < N; ++i)
+  {
+    for (col = 0; col < 4; ++col)
+    {
+      for (row = 0; row < 4; ++row)
+      {
+        for (k = 0, ref = 0; k < 4; ++k)
+          ref += ((double)qb.ma[i][(k * 4) + row] * (double)qb.mb[i][(col * 4) + k]);
+        if (quat_bench_error(qb.m[i][(col * 4) + row], ref) > error)
+          error = quat_bench_error(qb.m[i][(col * 4) + row], ref);
+      }
+    }
+  }
+
+  return error;
+}
+
+/* what md3_link_matrix() does for a tag between two key frames */
+static void
+run_tag_blend()
+{
+  quat_t q1, q2;
+  int i = 0;
+
+  for (; i < N; ++i)
+  {
+    quat_from_matrix_3x3(&q1, qb.m3a[i]);
+    quat_from_matrix_3x3(&q2, qb.m3b[i]);
+    quat_slerp(&q1, &q2, qb.t[i], &qb.q[i]);
+    quat_to_matrix_4x4(&qb.q[i], &qb.origin[i], qb.m[i]);
+  }
+}
+
+static double
+check_tag_blend()
+{
+  double q[4], ref[16];
+  double error = 0;
+  int i, j;
+
+  run_tag_blend();
+  for (i = 0; i < N; ++i)
+  {
+    ref_slerp(qb.qa[i], qb.qb[i], qb.t[i], q);
+    ref_to_matrix(q, &qb.origin[i], ref);
+    for (j = 0; j < 16; ++j)
+    {
+      if (quat_bench_error(qb.m[i][j], ref[j]) > error)
+        error = quat_bench_error(qb.m[i][j], ref[j]);
+    }
+  }
+
+  return error;
+}
+
+static void
+run_lerp_vertex()
+{
+  md3_vertex_t* v1 = NULL;
+  md3_vertex_t* v2 = NULL;
+  md3_vertex_t* v = NULL;
+  int i = 0;
+
+  for (; i < N; ++i)
+  {
+    v1 = &qb.v1[i];
+    v2 = &qb.v2[i];
+    v = &qb.v[i];
+    LERP_VERTEX(v1, v2, qb.t[i], v);
+  }
+}
+
+static double
+check_lerp_vertex()
+{
+  double t, error = 0;
+  int i = 0;
+
+  run_lerp_vertex();
+  for (; i < N; ++i)
+  {
+    t = qb.t[i];
+    if (abs(qb.v[i].x - (short)(qb.v1[i].x + (t * (qb.v2[i].x - qb.v1[i].x)))) > error)
+      error = abs(qb.v[i].x - (short)(qb.v1[i].x + (t * (qb.v2[i].x - qb.v1[i].x))));
+    if (abs(qb.v[i].y - (short)(qb.v1[i].y + (t * (qb.v2[i].y - qb.v1[i].y)))) > error)
+      error = abs(qb.v[i].y - (short)(qb.v1[i].y + (t * (qb.v2[i].y - qb.v1[i].y))));
+    if (abs(qb.v[i].z - (short)(qb.v1[i].z + (t * (qb.v2[i].z - qb.v1[i].z)))) > error)
+      error = abs(qb.v[i].z - (short)(qb.v1[i].z + (t * (qb.v2[i].z - qb.v1[i].z))));
+  }
+
+  return error;
+}
+
+static void
+run_lerp_normal()
+{
+  md3_vertex_t* v1 = NULL;
+  md3_vertex_t* v2 = NULL;
+  md3_vertex_t* v = NULL;
+  int i = 0;
+
+  for (; i < N; ++i)
+  {
+    v1 = &qb.v1[i];
+    v2 = &qb.v2[i];
+    v = &qb.v[i];
+    LERP_NORMAL(v1, v2, qb.t[i], v);
+  }
+}
+
+static double
+check_lerp_normal()
+{
+  double t, ref, error = 0;
+  int i, j;
+
+  run_lerp_normal();
+  for (i = 0; i < N; ++i)
+  {
+    t = qb.t[i];
+    for (j = 0; j < 3; ++j)
+    {
+      ref = ((double)qb.v1[i].normalxyz[j] + (t * ((double)qb.v2[i].normalxyz[j] - (double)qb.v1[i].normalxyz[j])));
+      if (quat_bench_error(qb.v[i].normalxyz[j], ref) > error)
+        error = quat_bench_error(qb.v[i].normalxyz[j], ref);
+    }
+  }
+
+  return error;
+}
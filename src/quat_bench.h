@@ -0,0 +1,61 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _QUAT_BENCH_H
+#define _QUAT_BENCH_H
+
+/*
+ *	Micro-benchmark of the quaternion, matrix and key frame blending
+ *	kernels the pose and draw passes run every frame.
+ *
+ *	Each kernel runs over QUAT_BENCH_INPUTS inputs QUAT_BENCH_WARMUP
+ *	times untimed, then QUAT_BENCH_REPS times timed, on one pinned
+ *	processor.  The median time per call and its median absolute
+ *	deviation are printed.
+ *
+ *	Each kernel's results are also checked against the same math
+ *	done in double precision, and fail if off by more than the
+ *	tolerance given for the kernel.  A faster kernel is added to
+ *	the table in quat_bench.c with the tolerance it must meet.
+ *
+ *	quat_bench_slerp_check() checks quat_slerp_fast() against an
+ *	exact slerp on the tags of real models instead.
+ */
+
+#define QUAT_BENCH_INPUTS 4096
+#define QUAT_BENCH_WARMUP 10
+#define QUAT_BENCH_REPS 51
+
+/*
+ *	Points quat_bench_slerp_check() slerps between each two key frames.
+ */
+#define QUAT_BENCH_STEPS 16
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  int quat_bench_run();
+  int quat_bench_slerp_check(char* dir);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QUAT_BENCH_H */
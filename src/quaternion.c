@@ -51,7 +51,7 @@ void
 quat_normalize(quat_t* q)
 {
   float r = ((q->x * q->x) + (q->y * q->y) + (q->z * q->z) + (q->w * q->w));
-  if (abs(1.0f - r) <= 0.0000001)
+  if (fabsf(1.0f - r) <= 0.0000001f)
     /* already nomalized */
     return;
   r = sqrt(r);
@@ -76,7 +76,7 @@ quat_mult(quat_t* a, quat_t* b, quat_t* c)
 {
   quat_t r;
   r.x = ((a->w * b->x) + (a->x * b->w) + (a->y * b->z) - (a->z * b->y));
-  r.y = ((a->w * b->y) - (a->z * b->z) + (a->y * b->w) + (a->z * b->x));
+  r.y = ((a->w * b->y) - (a->x * b->z) + (a->y * b->w) + (a->z * b->x));
   r.z = ((a->w * b->z) + (a->x * b->y) - (a->y * b->x) + (a->z * b->w));
   r.w = ((a->w * b->w) - (a->x * b->x) - (a->y * b->y) - (a->z * b->z));
   *c = r;
@@ -149,55 +149,93 @@ quat_to_matrix_4x4(quat_t* q, struct vec3_t* origin, float* m)
 }
 
 /*
- *	Generate a quaternion from a 4x4 matrix.
+ *	Generate a quaternion from the rotation of a column major matrix
+ *	whose columns are stride floats apart; 4 for a 4x4 matrix and
+ *	3 for a 3x3 one.
  */
-void
-quat_from_matrix_4x4(quat_t* q, float* m)
+static void
+quat_from_rotation(quat_t* q, float* m, int stride)
 {
   float trace = 0;
   float scale = 0;
+  float* c0 = m;
+  float* c1 = (m + stride);
+  float* c2 = (m + (2 * stride));
 
   /* calculate the sum of the diagonal + 1 */
-  trace = (m[0] + m[5] + m[10] + 1);
+  trace = (c0[0] + c1[1] + c2[2] + 1);
 
-  /* if trace > 0 then we can calculate quat now */
-  if (trace > 0.00000001)
+  /*
+   *	if trace > 1 then w is at least 0.5 and we can calculate quat now;
+   *	a smaller trace loses too much precision to the rounding of the sum
+   */
+  if (trace > 1.0f)
   {
     scale = (2 * sqrt(trace));
-    q->x = ((m[9] - m[6]) / scale);
-    q->y = ((m[2] - m[8]) / scale);
-    q->z = ((m[4] - m[1]) / scale);
+    q->x = ((c2[1] - c1[2]) / scale);
+    q->y = ((c0[2] - c2[0]) / scale);
+    q->z = ((c1[0] - c0[1]) / scale);
     q->w = (0.25f * scale);
     return;
   }
 
   /* calculation depends on which diagonal has greatest value */
-  if ((m[0] > m[5]) && (m[0] > m[10]))
+  if ((c0[0] > c1[1]) && (c0[0] > c2[2]))
   {
     /* column 0 */
-    scale = (sqrt(1.0f + m[0] - m[5] - m[10]) * 2);
+    scale = (sqrt(1.0f + c0[0] - c1[1] - c2[2]) * 2);
     q->x = (0.25f * scale);
-    q->y = ((m[4] + m[1]) / scale);
-    q->z = ((m[2] + m[8]) / scale);
-    q->w = ((m[9] + m[6]) / scale);
+    q->y = ((c1[0] + c0[1]) / scale);
+    q->z = ((c0[2] + c2[0]) / scale);
+    q->w = ((c2[1] - c1[2]) / scale);
   }
-  else if (m[5] > m[10])
+  else if (c1[1] > c2[2])
   {
     /* column 1 */
-    scale = (sqrt(1.0f + m[5] - m[0] - m[10]) * 2);
-    q->x = ((m[4] + m[1]) / scale);
+    scale = (sqrt(1.0f + c1[1] - c0[0] - c2[2]) * 2);
+    q->x = ((c1[0] + c0[1]) / scale);
     q->y = (0.25f * scale);
-    q->z = ((m[9] + m[6]) / scale);
-    q->w = ((m[2] + m[8]) / scale);
+    q->z = ((c2[1] + c1[2]) / scale);
+    q->w = ((c0[2] - c2[0]) / scale);
   }
   else
   {
     /* column 2 */
-    scale = (sqrt(1.0f + m[10] - m[0] - m[5]) * 2);
-    q->x = ((m[2] + m[8]) / scale);
-    q->y = ((m[9] + m[6]) / scale);
+    scale = (sqrt(1.0f + c2[2] - c0[0] - c1[1]) * 2);
+    q->x = ((c0[2] + c2[0]) / scale);
+    q->y = ((c2[1] + c1[2]) / scale);
     q->z = (0.25f * scale);
-    q->w = ((m[4] + m[1]) / scale);
+    q->w = ((c1[0] - c0[1]) / scale);
+  }
+}
+
+/*
+ *	Generate a quaternion from a 4x4 matrix.
+ */
+void
+quat_from_matrix_4x4(quat_t* q, float* m)
+{
+  quat_from_rotation(q, m, 4);
+}
+
+/*
+ *	c = a * b for column major 4x4 matrices.
+ */
+void
+matrix_mult_4x4(float* a, float* b, float* c)
+{
+  int row = 0;
+  int col = 0;
+
+  for (col = 0; col < 4; ++col)
+  {
+    for (row = 0; row < 4; ++row)
+    {
+      c[(col * 4) + row] = ((a[row] * b[(col * 4)]) +
+                            (a[4 + row] * b[(col * 4) + 1]) +
+                            (a[8 + row] * b[(col * 4) + 2]) +
+                            (a[12 + row] * b[(col * 4) + 3]));
+    }
   }
 }
 
@@ -251,14 +289,12 @@ matrix_3x3_to_4x4(float* m3, float* m4, struct vec3_t* origin)
 void
 quat_from_matrix_3x3(quat_t* q, float* m)
 {
-  float m4[16];
-  matrix_3x3_to_4x4(m, m4, NULL);
-  quat_from_matrix_4x4(q, m4);
+  quat_from_rotation(q, m, 3);
 }
 
 /*
  *	Spherical linear interpolation of quaternions q1 and q2 by time factor t.
- *	The result is stored in q3.
+ *	The result is stored in q3; q1 and q2 are left as they are.
  *
  *	q = (((q1.q0)^-1)^t) * q1
  *
@@ -268,6 +304,7 @@ void
 quat_slerp(quat_t* q1, quat_t* q2, float t, quat_t* q3)
 {
   float dp = 0;
+  float sign = 1;
   float front_slerp;
   float back_slerp;
 
@@ -284,13 +321,13 @@ quat_slerp(quat_t* q1, quat_t* q2, float t, quat_t* q3)
   /* q1.q0 is a dot product */
   dp = ((q1->x * q2->x) + (q1->y * q2->y) + (q1->z * q2->z) + (q1->w * q2->w));
 
-  /* the dot product can be negative, in which case the rotation is >90 degrees */
+  /*
+   *	the dot product can be negative, in which case the rotation is >90 degrees;
+   *	go the short way round with -q2, which is the same rotation
+   */
   if (dp < 0.0f)
   {
-    q2->x *= -1;
-    q2->y *= -1;
-    q2->z *= -1;
-    q2->w *= -1;
+    sign = -1;
     dp *= -1;
   }
 
@@ -316,9 +353,53 @@ quat_slerp(quat_t* q1, quat_t* q2, float t, quat_t* q3)
     front_slerp = t;
     back_slerp = (1 - t);
   }
+  front_slerp *= sign;
 
   q3->x = ((back_slerp * q1->x) + (front_slerp * q2->x));
   q3->y = ((back_slerp * q1->y) + (front_slerp * q2->y));
   q3->z = ((back_slerp * q1->z) + (front_slerp * q2->z));
   q3->w = ((back_slerp * q1->w) + (front_slerp * q2->w));
 }
+
+/*
+ *	Approximate quat_slerp() without acos() or sin().
+ *
+ *	A normalized lerp turns faster in the middle than at the ends;
+ *	t is first bent by a polynomial in t and the dot product that
+ *	makes it turn at a near constant speed again.  The fit is off
+ *	an exact slerp by at most QUAT_SLERP_FAST_ERROR degrees, at
+ *	half turns; much less for the small turns between key frames.
+ *
+ *	http://zeux.io/2015/07/23/approximating-slerp/
+ */
+void
+quat_slerp_fast(quat_t* q1, quat_t* q2, float t, quat_t* q3)
+{
+  float dp = ((q1->x * q2->x) + (q1->y * q2->y) + (q1->z * q2->z) + (q1->w * q2->w));
+  float sign = 1;
+  float a, b, k, r;
+  quat_t q;
+
+  /* the short way round, as quat_slerp() */
+  if (dp < 0.0f)
+  {
+    sign = -1;
+    dp *= -1;
+  }
+
+  a = (1.0904f + (dp * (-3.2452f + (dp * (3.55645f - (dp * 1.43519f))))));
+  b = (0.848013f + (dp * (-1.06021f + (dp * 0.215638f))));
+  k = ((a * (t - 0.5f) * (t - 0.5f)) + b);
+  t = (t + (t * (t - 0.5f) * (t - 1.0f) * k));
+
+  q.x = (((1.0f - t) * q1->x) + (t * sign * q2->x));
+  q.y = (((1.0f - t) * q1->y) + (t * sign * q2->y));
+  q.z = (((1.0f - t) * q1->z) + (t * sign * q2->z));
+  q.w = (((1.0f - t) * q1->w) + (t * sign * q2->w));
+
+  r = (1.0f / sqrtf((q.x * q.x) + (q.y * q.y) + (q.z * q.z) + (q.w * q.w)));
+  q3->x = (q.x * r);
+  q3->y = (q.y * r);
+  q3->z = (q.z * r);
+  q3->w = (q.w * r);
+}
@@ -34,6 +34,12 @@ struct quat_t
   float w;
 };
 
+/*
+ *	The most quat_slerp_fast() is off an exact slerp,
+ *	in degrees of rotation.
+ */
+#define QUAT_SLERP_FAST_ERROR 0.05f
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -48,8 +54,10 @@ extern "C"
   void quat_from_matrix_3x3(quat_t* q, float* m);
 
   void matrix_3x3_to_4x4(float* m3, float* m4, struct vec3_t* origin);
+  void matrix_mult_4x4(float* a, float* b, float* c);
 
   void quat_slerp(quat_t* q1, quat_t* q2, float t, quat_t* q3);
+  void quat_slerp_fast(quat_t* q1, quat_t* q2, float t, quat_t* q3);
 
 #ifdef __cplusplus
 }
@@ -16,7 +16,7 @@
  *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
-// #include <GL/glu.h>
+#include <GL/glu.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
@@ -28,6 +28,12 @@
 #include "util.h"
 #include "jitter.h"
 #include "accum.h"
+#include "sim.h"
+#include "prof.h"
+#include "trace.h"
+#include "lod.h"
+#include "anim_sched.h"
+#include "thread.h"
 #include "render.h"
 
 /* bright white material */
@@ -57,32 +63,302 @@ md3_tag_t pseudo_tag = {
    {0, 1, 0},
    {0, 0, 1}}};
 
-static void render_scene();
-static void apply_custom_rotation(md3_model_t* model, md3_tag_t* tag, quat_t* quat);
+static void render_scene(struct world_t* wptr);
+static int md3_frustum_cull(md3_model_t* model, md3_anim_state_t* state, float* clip);
+static void md3_surface_generic(struct world_t* wptr, md3_surface_t* sptr, md3_triangle_t* tri, int num_tris, struct tga_t* texture, int frame_offset, int next_frame_offset, float t);
+
+/*
+ *	What a surface kernel draws with; they index md3_surface_kernels.
+ */
+#define MD3_SURFACE_TEXTURED 0x1
+#define MD3_SURFACE_WIREFRAME 0x2
+#define MD3_SURFACE_INTERPOLATE 0x4
+#define MD3_SURFACE_LIT 0x8
+#define MD3_SURFACE_KERNELS 16
+
+/*
+ *	Define a function drawing triangles of a surface, those of one of
+ *	its levels of detail, with the options given as constants, so the
+ *	loops test none of them.
+ *
+ *	flip holds the texture coordinates' offset and scale, s then t,
+ *	which turn them around for a flipped texture.  A solid surface is
+ *	one glBegin(); a wireframe one a line strip per triangle.
+ */
+#define MD3_SURFACE_KERNEL(_name, _textured, _wireframe, _interpolate, _lit)                          \
+  static void                                                                                         \
+  _name(md3_surface_t* sptr, md3_triangle_t* tri, int num_tris, int frame_offset,                     \
+        int next_frame_offset, float t, float* flip)                                                  \
+  {                                                                                                   \
+    md3_triangle_t* end = (tri + num_tris);                                                           \
+    md3_vertex_t* frame = (sptr->vertex + frame_offset);                                              \
+    md3_vertex_t* next = (sptr->vertex + next_frame_offset);                                          \
+    md3_vertex_t* vptr1 = NULL;                                                                       \
+    md3_vertex_t* vptr2 = NULL;                                                                       \
+    md3_vertex_t vptr;                                                                                \
+    md3_texcoord_t* tptr = NULL;                                                                      \
+    int vertex;                                                                                       \
+                                                                                                      \
+    (void)next;                                                                                       \
+    (void)vptr2;                                                                                      \
+    (void)vptr;                                                                                       \
+    (void)tptr;                                                                                       \
+    (void)t;                                                                                          \
+    (void)flip;                                                                                       \
+                                                                                                      \
+    if (!_wireframe)                                                                                  \
+      glBegin(GL_TRIANGLES);                                                                          \
+    for (; tri < end; ++tri)                                                                          \
+    {                                                                                                 \
+      if (_wireframe)                                                                                 \
+        glBegin(GL_LINE_STRIP);                                                                       \
+                                                                                                      \
+      for (vertex = 0; vertex < 3; ++vertex)                                                          \
+      {                                                                                               \
+        vptr1 = &frame[tri->index[vertex]];                                                           \
+        if (_interpolate)                                                                             \
+        {                                                                                             \
+          vptr2 = &next[tri->index[vertex]];                                                          \
+          LERP_VERTEX(vptr1, vptr2, t, (&vptr));                                                      \
+          if (_lit)                                                                                   \
+            LERP_NORMAL(vptr1, vptr2, t, (&vptr));                                                    \
+          vptr1 = &vptr;                                                                              \
+        }                                                                                             \
+                                                                                                      \
+        if (_lit)                                                                                     \
+          glNormal3f(vptr1->normalxyz[0], vptr1->normalxyz[1], vptr1->normalxyz[2]);                  \
+        if (_textured)                                                                                \
+        {                                                                                             \
+          tptr = &sptr->st[tri->index[vertex]];                                                       \
+          glTexCoord2f((flip[0] + (flip[1] * tptr->st[0])), (flip[2] + (flip[3] * tptr->st[1])));     \
+        }                                                                                             \
+        glVertex3f((float)(vptr1->x * MD3_XYZ_SCALE), (float)(vptr1->y * MD3_XYZ_SCALE),              \
+                   (float)(vptr1->z * MD3_XYZ_SCALE));                                                \
+      }                                                                                               \
+                                                                                                      \
+      if (_wireframe)                                                                                 \
+        glEnd();                                                                                      \
+    }                                                                                                 \
+    if (!_wireframe)                                                                                  \
+      glEnd();                                                                                        \
+  }
+
+MD3_SURFACE_KERNEL(md3_surface_plain, 0, 0, 0, 0)
+MD3_SURFACE_KERNEL(md3_surface_tex, 1, 0, 0, 0)
+MD3_SURFACE_KERNEL(md3_surface_wire, 0, 1, 0, 0)
+MD3_SURFACE_KERNEL(md3_surface_tex_wire, 1, 1, 0, 0)
+MD3_SURFACE_KERNEL(md3_surface_lerp, 0, 0, 1, 0)
+MD3_SURFACE_KERNEL(md3_surface_tex_lerp, 1, 0, 1, 0)
+MD3_SURFACE_KERNEL(md3_surface_wire_lerp, 0, 1, 1, 0)
+MD3_SURFACE_KERNEL(md3_surface_tex_wire_lerp, 1, 1, 1, 0)
+MD3_SURFACE_KERNEL(md3_surface_lit, 0, 0, 0, 1)
+MD3_SURFACE_KERNEL(md3_surface_tex_lit, 1, 0, 0, 1)
+MD3_SURFACE_KERNEL(md3_surface_wire_lit, 0, 1, 0, 1)
+MD3_SURFACE_KERNEL(md3_surface_tex_wire_lit, 1, 1, 0, 1)
+MD3_SURFACE_KERNEL(md3_surface_lerp_lit, 0, 0, 1, 1)
+MD3_SURFACE_KERNEL(md3_surface_tex_lerp_lit, 1, 0, 1, 1)
+MD3_SURFACE_KERNEL(md3_surface_wire_lerp_lit, 0, 1, 1, 1)
+MD3_SURFACE_KERNEL(md3_surface_tex_wire_lerp_lit, 1, 1, 1, 1)
+
+static void (*md3_surface_kernels[MD3_SURFACE_KERNELS])(md3_surface_t*, md3_triangle_t*, int, int, int, float, float*) = {
+  md3_surface_plain,
+  md3_surface_tex,
+  md3_surface_wire,
+  md3_surface_tex_wire,
+  md3_surface_lerp,
+  md3_surface_tex_lerp,
+  md3_surface_wire_lerp,
+  md3_surface_tex_wire_lerp,
+  md3_surface_lit,
+  md3_surface_tex_lit,
+  md3_surface_wire_lit,
+  md3_surface_tex_wire_lit,
+  md3_surface_lerp_lit,
+  md3_surface_tex_lerp_lit,
+  md3_surface_wire_lerp_lit,
+  md3_surface_tex_wire_lerp_lit};
+
+/* draw every surface with md3_surface_generic() instead, to compare */
+static int render_generic_surfaces;
+
+/*
+ *	Set up a new GL context for drawing the world.
+ */
+void
+render_setup(struct world_t* wptr)
+{
+  /* enable gl options */
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_NORMALIZE);
+  glEnable(GL_TEXTURE_2D);
+  glEnable(GL_BLEND);
+  glEnable(GL_CULL_FACE);
+
+  /* clear the stencil buffer */
+  glClearStencil(0);
+
+  if (WORLD_IS_SET(wptr, ENGINE_LIGHTING))
+    glEnable(GL_LIGHTING);
+
+  /*
+   *	Optimization.
+   *	We want every optimization possible,
+   *	so we don't draw the back faces.
+   */
+  glCullFace(GL_FRONT);
+
+  glShadeModel(GL_SMOOTH);
+
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  /* set background color */
+  glClearColor(wptr->env.bg_rgba[0], wptr->env.bg_rgba[1], wptr->env.bg_rgba[2], wptr->env.bg_rgba[3]);
+
+  /* make the bounding box */
+  wptr->gl_box_id = make_bounding_box();
+  wptr->gl_plane_id = make_tes_plane();
+
+  /* register the mirror walls */
+  {
+    /* floor */
+    double clip[] = {0.0, -1.0, 0.0, 0.0};
+    float origin[] = {-50.0f, -25.0f, -50.0f};
+    float axis[] = {0.0f, 0.0f, 0.0f};
+    float normal[] = {0.0f, -1.0f, 0.0f};
+    float angle = 0.0f;
+    world_register_mirror(wptr, clip, origin, normal, axis, angle);
+  }
+  {
+    /* right wall */
+    double clip[] = {0.0, -1.0, 0.0, 0.0};
+    float origin[] = {-50.0f, -50.0f, -75.0f};
+    float axis[] = {1.0f, 0.0f, 0.0f};
+    float normal[] = {0.0f, 0.0f, -1.0f};
+    float angle = 90.0f;
+    world_register_mirror(wptr, clip, origin, normal, axis, angle);
+  }
+  {
+    /* back wall */
+    double clip[] = {0.0, -1.0, 0.0, 0.0};
+    float origin[] = {-75.0f, -50.0f, -50.0f};
+    float axis[] = {0.0f, 0.0f, 1.0f};
+    float normal[] = {-1.0f, 0.0f, 0.0f};
+    float angle = -90.0f;
+    world_register_mirror(wptr, clip, origin, normal, axis, angle);
+  }
+}
+
+/*
+ *	Set the viewport and projection for a w x h view.
+ */
+void
+render_viewport(struct world_t* wptr, int w, int h)
+{
+  /* setup viewport */
+  glViewport(0, 0, w, h);
+  wptr->viewport_height = h;
+
+  /* setup the projection matrix */
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  gluPerspective(wptr->env.fov, ((float)w / (float)h), wptr->env.vnear, wptr->env.vfar);
+
+  /* switch back and initialize the model view matrix */
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+}
+
+/*
+ *	Clear the view and set up the camera and lights for a frame.
+ *	render_c() draws the frame after this.
+ */
+void
+render_view(struct world_t* wptr)
+{
+  /* nothing set yet this frame */
+  gl_state_reset(&wptr->gl);
+
+  /* clear color and depth buffers */
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+  /* set matrix mode to model view */
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+
+  /* initialize names buffer */
+  glInitNames();
+  glPushName(0);
+  glLoadName(ETHER);
+
+  /* setup camera */
+  gluLookAt(wptr->camera.r * cos(wptr->camera.prot * deg) * cos(wptr->camera.trot * deg),
+            wptr->camera.r * sin(wptr->camera.prot * deg),
+            wptr->camera.r * cos(wptr->camera.prot * deg) * sin(wptr->camera.trot * deg),
+            wptr->camera.center_xyz[0],
+            wptr->camera.center_xyz[1],
+            wptr->camera.center_xyz[2],
+            0,
+            1,
+            0);
+
+  /* apply the light sources */
+  if (WORLD_IS_SET(wptr, ENGINE_LIGHTING))
+  {
+    gl_state_enable(&wptr->gl, GL_STATE_LIGHTING, 1);
+    glEnable(GL_LIGHT0);
+    apply_light(GL_LIGHT0, &wptr->light[0]);
+  }
+  else
+    gl_state_enable(&wptr->gl, GL_STATE_LIGHTING, 0);
+
+  /* apply textures */
+  gl_state_enable(&wptr->gl, GL_STATE_TEXTURE_2D, WORLD_IS_SET(wptr, RENDER_TEXTURES));
+}
 
 /*
  *	Render the scene for the current engine setup.
+ *
+ *	The frame is drawn at the time of the simulation's snapshot,
+ *	or else at the next time of the world's clock.
  */
 void
-render_c()
+render_c(struct world_t* wptr)
 {
-  render_scene();
+  struct sim_snapshot_t* snap = sim_snapshot(wptr->sim);
+  double start;
+
+  wptr->time = (snap ? snap->time : world_clock_next(wptr));
+  memset(&wptr->cull, 0, sizeof(wptr->cull));
+
+  /* without a simulation thread the animations are ticked here */
+  if (!snap)
+    anim_sched_tick(&wptr->sched, wptr, wptr->time);
+
+  render_scene(wptr);
 
   /* Flush the GL pipeline */
+  start = prof_begin();
   glFlush();
+  prof_end(PROF_SWAP, start);
 }
 
 /*
  *	Render the scene.
  */
 static void
-render_scene()
+render_scene(struct world_t* wptr)
 {
-  render_primitives(1);
+  double start;
+
+  render_primitives(wptr, 1);
 
   /* render the mirror images if enabled */
-  if (WORLD_IS_SET(RENDER_MIRRORS))
-    draw_mirrors(g_world->mirrors);
+  if (WORLD_IS_SET(wptr, RENDER_MIRRORS))
+  {
+    start = prof_begin();
+    draw_mirrors(wptr, wptr->mirrors);
+    prof_end(PROF_MIRROR, start);
+  }
 }
 
 /*
@@ -94,53 +370,86 @@ render_scene()
  *		A model is primitive, but a mirror is not.
  */
 void
-render_primitives(int apply_names)
+render_primitives(struct world_t* wptr, int apply_names)
 {
+  double start = trace_begin();
+  int span;
+
+  span = prof_gpu_begin(PROF_GPU_MODEL);
   glPushMatrix();
   glRotatef(-90, 1, 0, 0);
-  md3_render(g_world->root_model, apply_names, NULL);
+  if (wptr->crowd.size > 1)
+    crowd_render(&wptr->crowd, apply_names);
+  else
+    render_model(wptr, apply_names);
   glPopMatrix();
+  prof_gpu_end(span);
+  trace_end("render_model", start);
 
   /* draw the flashlight */
-  if (WORLD_IS_SET(RENDER_FLASHLIGHT))
-    render_flashlight();
+  if (WORLD_IS_SET(wptr, RENDER_FLASHLIGHT))
+  {
+    start = trace_begin();
+    span = prof_gpu_begin(PROF_GPU_FLASHLIGHT);
+    render_flashlight(wptr);
+    prof_gpu_end(span);
+    trace_end("render_flashlight", start);
+  }
+}
+
+/*
+ *	Render the root model and everything linked to it.
+ *
+ *	With the simulation thread running the pose comes from its
+ *	snapshot, otherwise the model is ticked and posed here.
+ */
+void
+render_model(struct world_t* wptr, int apply_names)
+{
+  struct sim_snapshot_t* snap = sim_snapshot(wptr->sim);
+
+  if (snap)
+    md3_render_poses(wptr, snap->poses, snap->num_root_poses, apply_names);
+  else
+    md3_render(wptr, wptr->root_instance, wptr->time, apply_names, NULL);
 }
 
 /*
  *	Draw the flashlight.
  */
 void
-render_flashlight()
+render_flashlight(struct world_t* wptr)
 {
-  int lighting_enabled = WORLD_IS_SET(ENGINE_LIGHTING);
-  md3_model_t* light_model = world_get_model_by_type(MD3_LIGHT);
+  md3_instance_t* light_model = world_get_instance_by_type(wptr, MD3_LIGHT);
+  struct sim_snapshot_t* snap = sim_snapshot(wptr->sim);
 
-  /* disable lighting */
-  world_set_options(g_world, 0, ENGINE_LIGHTING);
-  glDisable(GL_LIGHTING);
+  /* disable lighting; the options stay as they are, as changing them asks for another frame */
+  wptr->unlit_pass = 1;
+  gl_state_enable(&wptr->gl, GL_STATE_LIGHTING, 0);
 
   glPushMatrix();
   /* translate to the flashlight origin */
-  glTranslatef(g_world->light[0].position[0], g_world->light[0].position[1], g_world->light[0].position[2]);
+  glTranslatef(wptr->light[0].position[0], wptr->light[0].position[1], wptr->light[0].position[2]);
 
   /* rotate up/down */
-  glRotatef(g_world->light[0].dir_prot, 0, 0, 1);
+  glRotatef(wptr->light[0].dir_prot, 0, 0, 1);
 
   /*	rotate right/left */
-  glRotatef(g_world->light[0].dir_trot, 0, 1, 0);
+  glRotatef(wptr->light[0].dir_trot, 0, 1, 0);
 
   glRotatef(-90, 0, 1, 0);
   glScalef(0.8, 0.8, 0.8);
 
-  md3_render(light_model, 1, NULL);
+  if (snap)
+    md3_render_poses(wptr, &snap->poses[snap->num_root_poses], (snap->num_poses - snap->num_root_poses), 1);
+  else
+    md3_render(wptr, light_model, wptr->time, 1, NULL);
   glPopMatrix();
 
   /* reenable lighting if it was previously set */
-  if (lighting_enabled)
-  {
-    world_set_options(g_world, ENGINE_LIGHTING, 0);
-    glEnable(GL_LIGHTING);
-  }
+  wptr->unlit_pass = 0;
+  if (WORLD_IS_SET(wptr, ENGINE_LIGHTING))
+    gl_state_enable(&wptr->gl, GL_STATE_LIGHTING, 1);
 }
 
 /*
@@ -149,33 +458,20 @@ render_flashlight()
  *	Link tag is the tag in the parent model where this model links for this frame.
  *	This is needed for custom rotation of the current model part.
  *	If the base model is passed, give link_tag as NULL.
+ *
+ *	The animations are ticked to now on the world's clock.
  */
 void
-md3_render(md3_model_t* model, int apply_names, md3_tag_t* link_tag)
+md3_render(struct world_t* wptr, md3_instance_t* inst, double now, int apply_names, md3_tag_t* link_tag)
 {
   int i = 0;
-  int frame;
-  int next_frame;
-
   md3_tag_t* tag = NULL;
-  md3_tag_t* next_tag = NULL;
-  int itag = 0;
-  float* rot1 = NULL;
-  float* rot2 = NULL;
   float rot[16];
   quat_t q1;
-  quat_t q2;
-  quat_t q3;
-  struct vec3_t* origin1 = NULL;
-  struct vec3_t* origin2 = NULL;
-  struct vec3_t origin;
 
-  if (!model)
+  if (!inst)
     return;
 
-  frame = model->anim_state.frame;
-  next_frame = model->anim_state.frame;
-
   /*
    *	Instantly apply custom rotation.
    *	No interpolation since there is no time duration.
@@ -190,77 +486,176 @@ md3_render(md3_model_t* model, int apply_names, md3_tag_t* link_tag)
     link_tag = &pseudo_tag;
 
   quat_init(&q1);
-  apply_custom_rotation(model, link_tag, &q1);
+  apply_custom_rotation(inst, link_tag, &q1);
   quat_to_matrix_4x4(&q1, NULL, rot);
   glMultMatrixf(rot);
 
   /* Apply custom scale for this model only (no children) */
-  if (model->scale_factor)
+  if (inst->scale_factor)
   {
     glPushMatrix();
-    glScalef(model->scale_factor, model->scale_factor, model->scale_factor);
+    glScalef(inst->scale_factor, inst->scale_factor, inst->scale_factor);
   }
 
   /*	Render this model	*/
-  md3_render_single(model, apply_names);
+  md3_render_single(wptr, inst, now, apply_names);
 
-  if (model->scale_factor)
+  if (inst->scale_factor)
     glPopMatrix();
 
   /*	Render each link	*/
-  for (i = 0; i < model->num_tags; ++i)
+  for (i = 0; i < inst->num_links; ++i)
   {
     /* if no model link here (possible load error) then skip */
-    if (!model->links[i])
+    if (!inst->links[i])
       continue;
 
-    /*
-     *	Get the tag index for this frame.
-     *
-     *	For saftey modulate the frame by the total number of frames.
-     *	The multiply by the number of tags since each frame has
-     *	X continuous entries (where X is the number of tags)
-     *	in the tag array.
-     *	Then offset to the current tag by adding the current tag number.
-     */
     glPushMatrix();
 
-    /* SLERP the rotation */
-    itag = (((model->anim_state.frame % model->num_frames) * model->num_tags) + i);
-    tag = &(model->tags[itag]);
+    tag = md3_link_matrix(wptr, inst, i, rot);
+    glMultMatrixf(rot);
 
-    itag = (((model->anim_state.next_frame % model->num_frames) * model->num_tags) + i);
-    next_tag = &(model->tags[itag]);
+    /* Render child */
+    md3_render(wptr, inst->links[i], now, apply_names, tag);
 
-    /* LERP the origin translation - needed? */
-    origin1 = &tag->origin;
-    origin2 = &next_tag->origin;
-    LERP_VERTEX(origin1, origin2, model->anim_state.t, (&origin));
+    glPopMatrix();
+  }
+}
 
-    /*
-     *	If there was a custom scale set, it must also be
-     *	applied to the origin so that the body parts align.
-     */
-    if (model->scale_factor)
-      SCALE_VERTEX((&origin), model->scale_factor);
+/*
+ *	Build the transform from the instance to the child on link i
+ *	for the current animation state and store it in m.
+ *	With ENGINE_FAST_SLERP the rotation is slerped approximately.
+ *
+ *	Returns the tag of the link for the current frame.
+ */
+md3_tag_t*
+md3_link_matrix(struct world_t* wptr, md3_instance_t* inst, int i, float* m)
+{
+  md3_model_t* model = inst->model;
+  md3_tag_t* tag = NULL;
+  md3_tag_t* next_tag = NULL;
+  int itag = 0;
+  float* rot1 = NULL;
+  float* rot2 = NULL;
+  quat_t q1;
+  quat_t q2;
+  quat_t q3;
+  struct vec3_t* origin1 = NULL;
+  struct vec3_t* origin2 = NULL;
+  struct vec3_t origin;
 
-    rot1 = (float*)tag->axis;
-    rot2 = (float*)next_tag->axis;
+  /*
+   *	Get the tag index for this frame.
+   *
+   *	For saftey modulate the frame by the total number of frames.
+   *	The multiply by the number of tags since each frame has
+   *	X continuous entries (where X is the number of tags)
+   *	in the tag array.
+   *	Then offset to the current tag by adding the current tag number.
+   */
 
-    /* convert the 3x3 matricies to quaternions */
-    quat_from_matrix_3x3(&q1, rot1);
-    quat_from_matrix_3x3(&q2, rot2);
+  /* SLERP the rotation */
+  itag = (((inst->anim_state.frame % model->num_frames) * model->num_tags) + i);
+  tag = &(model->tags[itag]);
 
-    /* slerp the quaternions */
-    quat_slerp(&q1, &q2, model->anim_state.t, &q3);
+  itag = (((inst->anim_state.next_frame % model->num_frames) * model->num_tags) + i);
+  next_tag = &(model->tags[itag]);
 
-    /* convert the quaternion to 4x4 matrix and apply */
-    quat_to_matrix_4x4(&q3, &origin, rot);
-    glMultMatrixf(rot);
+  /* LERP the origin translation - needed? */
+  origin1 = &tag->origin;
+  origin2 = &next_tag->origin;
+  LERP_VERTEX(origin1, origin2, inst->anim_state.t, (&origin));
 
-    /* Render child */
-    md3_render(model->links[i], apply_names, tag);
+  /*
+   *	If there was a custom scale set, it must also be
+   *	applied to the origin so that the body parts align.
+   */
+  if (inst->scale_factor)
+    SCALE_VERTEX((&origin), inst->scale_factor);
 
+  rot1 = (float*)tag->axis;
+  rot2 = (float*)next_tag->axis;
+
+  /* convert the 3x3 matricies to quaternions */
+  quat_from_matrix_3x3(&q1, rot1);
+  quat_from_matrix_3x3(&q2, rot2);
+
+  /* slerp the quaternions */
+  if (WORLD_ANIM_IS_SET(wptr, ENGINE_FAST_SLERP))
+    quat_slerp_fast(&q1, &q2, inst->anim_state.t, &q3);
+  else
+    quat_slerp(&q1, &q2, inst->anim_state.t, &q3);
+
+  /* convert the quaternion to 4x4 matrix */
+  quat_to_matrix_4x4(&q3, &origin, m);
+
+  return tag;
+}
+
+/*
+ *	Tick and pose a part and everything linked to it on the CPU.
+ *
+ *	This is md3_render() with the GL matrix stack done by hand.
+ *	m is the transform the part hangs from; func is called for every
+ *	part with its transform, custom scale included.
+ */
+void
+md3_pose(struct world_t* wptr, md3_instance_t* inst, double now, md3_tag_t* link_tag, float* m, md3_pose_func_t func, void* data)
+{
+  md3_tag_t* tag = NULL;
+  float node[16];
+  float part[16];
+  float link[16];
+  float child[16];
+  quat_t q;
+  int i = 0;
+
+  if (!inst)
+    return;
+
+  world_tick_model(wptr, inst, now);
+
+  /* custom rotation; applies to the children too */
+  quat_init(&q);
+  apply_custom_rotation(inst, (link_tag ? link_tag : &pseudo_tag), &q);
+  quat_to_matrix_4x4(&q, NULL, link);
+  matrix_mult_4x4(m, link, node);
+
+  /* custom scale for this part only (no children) */
+  memcpy(part, node, sizeof(node));
+  if (inst->scale_factor)
+  {
+    for (i = 0; i < 12; ++i)
+      part[i] *= inst->scale_factor;
+  }
+
+  func(data, inst, part);
+
+  for (i = 0; i < inst->num_links; ++i)
+  {
+    if (!inst->links[i])
+      continue;
+
+    tag = md3_link_matrix(wptr, inst, i, link);
+    matrix_mult_4x4(node, link, child);
+    md3_pose(wptr, inst->links[i], now, tag, child, func, data);
+  }
+}
+
+/*
+ *	Render parts posed by the simulation thread.
+ */
+void
+md3_render_poses(struct world_t* wptr, struct sim_pose_t* poses, int num_poses, int apply_names)
+{
+  int i = 0;
+
+  for (; i < num_poses; ++i)
+  {
+    glPushMatrix();
+    glMultMatrixf(poses[i].matrix);
+    md3_render_frame(wptr, poses[i].inst, &poses[i].state, apply_names);
     glPopMatrix();
   }
 }
@@ -270,125 +665,360 @@ md3_render(md3_model_t* model, int apply_names, md3_tag_t* link_tag)
  *	There is no SLERP here.
  */
 void
-md3_render_single(md3_model_t* model, int apply_names)
+md3_render_single(struct world_t* wptr, md3_instance_t* inst, double now, int apply_names)
+{
+  /* tick the model to update animation information */
+  world_tick_model(wptr, inst, now);
+
+  md3_render_frame(wptr, inst, &inst->anim_state, apply_names);
+}
+
+/*
+ *	Render a single model link at the given animation state.
+ *	The state does not have to be the live one of the instance.
+ */
+void
+md3_render_frame(struct world_t* wptr, md3_instance_t* inst, md3_anim_state_t* state, int apply_names)
 {
+  md3_model_t* model = inst->model;
   md3_surface_t* sptr = model->surface_ptr;
-  md3_vertex_t* vptr1 = NULL;
-  md3_vertex_t* vptr2 = NULL;
-  md3_vertex_t vptr;
-  md3_texcoord_t* tptr = NULL;
+  md3_surface_t* order[MD3_MAX_SURFACES];
   struct tga_t* texture = NULL;
+  float flip[4] = {0.0f, 1.0f, 0.0f, 1.0f};
+  md3_triangle_t* tris = NULL;
+  float modelview[16];
+  float projection[16];
+  float clip[16];
+  int num_tris;
   int frame_offset;
   int next_frame_offset;
-  int vertex;
-  int i = 0;
+  int kernel;
+  int lod = 0;
+  int sized;
+  int ordered;
+  int i;
+  float pixels = 0.0f;
+  double start;
+
+  /* the part's own space to clip space, for culling and the levels of detail */
+  sized = ((WORLD_IS_SET(wptr, ENGINE_LOD) || WORLD_IS_SET(wptr, ENGINE_ANIM_LOD)) && !wptr->mirror_pass);
+  if (WORLD_IS_SET(wptr, ENGINE_FRUSTUM_CULL) || sized)
+  {
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    matrix_mult_4x4(projection, modelview, clip);
+  }
+
+  /* skip the part if it is off the screen, or out of the mirror */
+  if (WORLD_IS_SET(wptr, ENGINE_FRUSTUM_CULL))
+  {
+    ++wptr->cull.parts;
+    wptr->cull.surfaces += model->num_surfaces;
+    if (md3_frustum_cull(model, state, clip))
+    {
+      ++wptr->cull.parts_culled;
+      wptr->cull.surfaces_culled += model->num_surfaces;
+      wptr->cull.triangles_culled += model->total_triangles;
+      /* out of sight; its animation need not keep up */
+      if (sized)
+        ATOMIC_STORE(&inst->screen_pixels, 1);
+      return;
+    }
+  }
+
+  /* its size on the screen, for the levels of detail and the animation's rate */
+  if (sized)
+  {
+    pixels = lod_screen_radius(model, state, clip, wptr->viewport_height);
+    ATOMIC_STORE(&inst->screen_pixels, ((pixels < 1.0f) ? 1 : (int)ceilf(pixels)));
+  }
+
+  /* coarser the smaller it is on the screen; a mirror keeps the view's */
+  if (WORLD_IS_SET(wptr, ENGINE_LOD))
+  {
+    if (wptr->lod_level >= 0)
+      lod = wptr->lod_level;
+    else if (wptr->mirror_pass)
+      lod = inst->lod;
+    else
+      lod = inst->lod = lod_pick(pixels, inst->lod);
+  }
 
   /* white material used for textures */
-  apply_material(&white_material);
+  gl_state_material(&wptr->gl, &white_material);
 
   /* set the name for this body part */
   if (apply_names)
-    glLoadName(model->body_part);
+    glLoadName(inst->body_part);
 
-  /* tick the model to update animation information */
-  world_tick_model(model);
+  /* the surfaces by texture, if there is more than one to order */
+  ordered = md3_surface_order(wptr, model, order);
+  if (ordered)
+    sptr = order[0];
 
-  while (sptr)
+  for (i = 0; sptr; ++i)
   {
     /* Get texture */
-    if (WORLD_IS_SET(RENDER_TEXTURES))
+    texture = NULL;
+    if (WORLD_IS_SET(wptr, RENDER_TEXTURES))
     {
+      start = prof_begin();
       texture = sptr->shader[0].texture;
-      apply_texture(&(sptr->shader[0]));
+      apply_texture(wptr, &(sptr->shader[0]));
+      prof_end(PROF_TEXTURE, start);
     }
     else
-      glDisable(GL_TEXTURE_2D);
-    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+      gl_state_enable(&wptr->gl, GL_STATE_TEXTURE_2D, 0);
+    gl_state_color(&wptr->gl, 1.0f, 1.0f, 1.0f, 1.0f);
 
     /* get correct frame information */
-    frame_offset = ((model->anim_state.frame % sptr->num_frames) * sptr->num_verts);
-    next_frame_offset = ((model->anim_state.next_frame % sptr->num_frames) * sptr->num_verts);
+    frame_offset = ((state->frame % sptr->num_frames) * sptr->num_verts);
+    next_frame_offset = ((state->next_frame % sptr->num_frames) * sptr->num_verts);
 
-    for (i = 0; i < sptr->num_triangles; ++i)
-    {
-      if (WORLD_IS_SET(RENDER_WIREFRAME))
-        glBegin(GL_LINE_STRIP);
-      else
-        glBegin(GL_TRIANGLES);
+    tris = lod_triangles(sptr, lod, &num_tris);
+    wptr->cull.triangles_lod += (sptr->num_triangles - num_tris);
 
-      /* draw the three verticies for the triangle */
-      for (vertex = 0; vertex < 3; ++vertex)
+    /* the key frames are blended as they are sent, so this is draw time */
+    start = prof_begin();
+    if (render_generic_surfaces)
+      md3_surface_generic(wptr, sptr, tris, num_tris, texture, frame_offset, next_frame_offset, state->t);
+    else
+    {
+      /* the kernel for these options, and the texture coordinates flipped as the texture is */
+      kernel = 0;
+      if (texture && (sptr->shader[0].gl_slot >= 0))
       {
-        /* get texture data */
-        tptr = &(sptr->st[sptr->triangle[i].index[vertex]]);
-
-        /* get vertex data for this frame and next frame */
-        vptr1 = &(sptr->vertex[sptr->triangle[i].index[vertex] + frame_offset]);
-        vptr2 = &(sptr->vertex[sptr->triangle[i].index[vertex] + next_frame_offset]);
-
-        /* LERP the verticies */
-        LERP_VERTEX(vptr1, vptr2, model->anim_state.t, (&vptr));
-
-        /* LERP the normal */
-        LERP_NORMAL(vptr1, vptr2, model->anim_state.t, (&vptr));
-
-        /* set the normal and texture data */
-        glNormal3f(vptr.normalxyz[0], vptr.normalxyz[1], vptr.normalxyz[2]);
-
-        if (WORLD_IS_SET(RENDER_TEXTURES) && sptr->shader[0].gl_text_bound && tptr)
-          glTexCoord2f((texture->hflip ? (1 - tptr->st[0]) : tptr->st[0]), (texture->vflip ? (1 - tptr->st[1]) : tptr->st[1]));
-
-        /* draw it */
-        glVertex3f((float)(vptr.x * MD3_XYZ_SCALE), (float)(vptr.y * MD3_XYZ_SCALE), (float)(vptr.z * MD3_XYZ_SCALE));
+        kernel |= MD3_SURFACE_TEXTURED;
+        flip[0] = (texture->hflip ? 1.0f : 0.0f);
+        flip[1] = (texture->hflip ? -1.0f : 1.0f);
+        flip[2] = (texture->vflip ? 1.0f : 0.0f);
+        flip[3] = (texture->vflip ? -1.0f : 1.0f);
       }
-
-      glEnd();
+      if (WORLD_IS_SET(wptr, RENDER_WIREFRAME))
+        kernel |= MD3_SURFACE_WIREFRAME;
+      if ((state->t != 0.0f) && (frame_offset != next_frame_offset))
+        kernel |= MD3_SURFACE_INTERPOLATE;
+      if (WORLD_IS_SET(wptr, ENGINE_LIGHTING) && !wptr->unlit_pass)
+        kernel |= MD3_SURFACE_LIT;
+
+      md3_surface_kernels[kernel](sptr, tris, num_tris, frame_offset, next_frame_offset, state->t, flip);
     }
+    prof_end(PROF_DRAW, start);
 
     /*
      *	Draw the bounding box if this model has the flag
      *	set and this is also the first surface for the model.
      */
-    if (model->draw_bounding_box && (sptr == model->surface_ptr))
+    if (inst->draw_bounding_box && (sptr == model->surface_ptr))
     {
       md3_frame_t* f = &model->frames[0];
       float r = (f->radius / 2.5f);
+      int span = prof_gpu_begin(PROF_GPU_BOX);
 
-      glDisable(GL_LIGHTING);
-      glDisable(GL_TEXTURE_2D);
+      gl_state_enable(&wptr->gl, (GL_STATE_LIGHTING | GL_STATE_TEXTURE_2D), 0);
 
       glPushMatrix();
       glTranslatef(f->local_origin.x, f->local_origin.y, f->local_origin.z);
       glScalef(r, r, r);
-      glCallList(g_world->gl_box_id);
+      glCallList(wptr->gl_box_id);
       glPopMatrix();
 
-      if (WORLD_IS_SET(ENGINE_LIGHTING))
-        glEnable(GL_LIGHTING);
-      if (WORLD_IS_SET(RENDER_TEXTURES))
-        glEnable(GL_TEXTURE_2D);
+      /* the box's list sets the colour */
+      gl_state_forget(&wptr->gl, GL_STATE_COLOR);
+
+      gl_state_enable(&wptr->gl, GL_STATE_LIGHTING, (WORLD_IS_SET(wptr, ENGINE_LIGHTING) && !wptr->unlit_pass));
+      gl_state_enable(&wptr->gl, GL_STATE_TEXTURE_2D, WORLD_IS_SET(wptr, RENDER_TEXTURES));
+
+      prof_gpu_end(span);
     }
 
-    sptr = sptr->next;
+    if (ordered)
+      sptr = (((i + 1) < ordered) ? order[i + 1] : NULL);
+    else
+      sptr = sptr->next;
+  }
+}
+
+/*
+ *	Order the surfaces of a part to bind each texture once, when
+ *	some of them share one: by texture, each in the order it first
+ *	appears, and the surfaces of a texture in the file's order.
+ *
+ *	Returns how many surfaces are in order, or 0 to draw them in
+ *	the file's order: when there is nothing to bind, or the file has
+ *	each texture's surfaces together already, as when every texture
+ *	is a different one.  The order only depends on the part, so a
+ *	translucent part blends the same in every frame.
+ */
+int
+md3_surface_order(struct world_t* wptr, md3_model_t* model, md3_surface_t** order)
+{
+  md3_surface_t* surfaces[MD3_MAX_SURFACES];
+  md3_surface_t* sptr;
+  struct tga_t* texture;
+  int taken[MD3_MAX_SURFACES] = {0};
+  int moved = 0;
+  int num = 0;
+  int ordered = 0;
+  int i, j;
+
+  if (!WORLD_IS_SET(wptr, RENDER_TEXTURES) || (model->num_surfaces < 2) || (model->num_surfaces > MD3_MAX_SURFACES))
+    return 0;
+
+  for (sptr = model->surface_ptr; sptr && (num < MD3_MAX_SURFACES); sptr = sptr->next)
+    surfaces[num++] = sptr;
+
+  for (i = 0; i < num; ++i)
+  {
+    if (taken[i])
+      continue;
+
+    order[ordered++] = surfaces[i];
+    texture = surfaces[i]->shader[0].texture;
+    for (j = (i + 1); texture && (j < num); ++j)
+    {
+      if (!taken[j] && (surfaces[j]->shader[0].texture == texture))
+      {
+        order[ordered++] = surfaces[j];
+        taken[j] = 1;
+        moved |= (j != (ordered - 1));
+      }
+    }
+  }
+
+  /* the same order as the file's */
+  if (!moved)
+    return 0;
+
+  return ordered;
+}
+
+/*
+ *	Check if a part at the given animation state is outside the
+ *	view frustum; clip is the projection and modelview it is drawn
+ *	with, multiplied.
+ *
+ *	The bounds of the two key frames are blended as the vertices
+ *	are, so they hold every vertex drawn.  The frustum planes come
+ *	from clip, in the part's own space; in a mirror the modelview
+ *	holds the reflection, so the reflected frustum is tested.
+ *
+ *	Returns 1 if no part of it can be seen.
+ */
+static int
+md3_frustum_cull(md3_model_t* model, md3_anim_state_t* state, float* clip)
+{
+  md3_frame_t* f1 = &model->frames[state->frame % model->num_frames];
+  md3_frame_t* f2 = &model->frames[state->next_frame % model->num_frames];
+  struct vec3_t* min1 = &f1->min_bounds;
+  struct vec3_t* min2 = &f2->min_bounds;
+  struct vec3_t* max1 = &f1->max_bounds;
+  struct vec3_t* max2 = &f2->max_bounds;
+  struct vec3_t min, max;
+  float plane[4];
+  int i, j;
+
+  LERP_VERTEX(min1, min2, state->t, (&min));
+  LERP_VERTEX(max1, max2, state->t, (&max));
+
+  /* the planes are the last row of the clip matrix plus or minus each other row */
+  for (i = 0; i < 6; ++i)
+  {
+    for (j = 0; j < 4; ++j)
+      plane[j] = ((i & 1) ? (clip[(j * 4) + 3] - clip[(j * 4) + (i >> 1)]) : (clip[(j * 4) + 3] + clip[(j * 4) + (i >> 1)]));
+
+    /* the corner of the box furthest inside the plane */
+    if (((plane[0] * ((plane[0] > 0.0f) ? max.x : min.x)) +
+         (plane[1] * ((plane[1] > 0.0f) ? max.y : min.y)) +
+         (plane[2] * ((plane[2] > 0.0f) ? max.z : min.z)) +
+         plane[3]) < 0.0f)
+      return 1;
   }
+
+  return 0;
 }
 
+/*
+ *	Draw the triangles of a surface testing the options for every
+ *	vertex, as before there were kernels; for the benchmark.
+ */
 static void
-apply_custom_rotation(md3_model_t* model, md3_tag_t* tag, quat_t* quat)
+md3_surface_generic(struct world_t* wptr, md3_surface_t* sptr, md3_triangle_t* tri, int num_tris, struct tga_t* texture, int frame_offset, int next_frame_offset, float t)
+{
+  md3_vertex_t* vptr1 = NULL;
+  md3_vertex_t* vptr2 = NULL;
+  md3_vertex_t vptr;
+  md3_texcoord_t* tptr = NULL;
+  int vertex;
+  int i = 0;
+
+  for (; i < num_tris; ++i)
+  {
+    if (WORLD_IS_SET(wptr, RENDER_WIREFRAME))
+      glBegin(GL_LINE_STRIP);
+    else
+      glBegin(GL_TRIANGLES);
+
+    /* draw the three verticies for the triangle */
+    for (vertex = 0; vertex < 3; ++vertex)
+    {
+      /* get texture data */
+      tptr = &(sptr->st[tri[i].index[vertex]]);
+
+      /* get vertex data for this frame and next frame */
+      vptr1 = &(sptr->vertex[tri[i].index[vertex] + frame_offset]);
+      vptr2 = &(sptr->vertex[tri[i].index[vertex] + next_frame_offset]);
+
+      /* LERP the verticies */
+      LERP_VERTEX(vptr1, vptr2, t, (&vptr));
+
+      /* LERP the normal */
+      LERP_NORMAL(vptr1, vptr2, t, (&vptr));
+
+      /* set the normal and texture data */
+      glNormal3f(vptr.normalxyz[0], vptr.normalxyz[1], vptr.normalxyz[2]);
+
+      if (WORLD_IS_SET(wptr, RENDER_TEXTURES) && (sptr->shader[0].gl_slot >= 0) && tptr)
+        glTexCoord2f((texture->hflip ? (1 - tptr->st[0]) : tptr->st[0]), (texture->vflip ? (1 - tptr->st[1]) : tptr->st[1]));
+
+      /* draw it */
+      glVertex3f((float)(vptr.x * MD3_XYZ_SCALE), (float)(vptr.y * MD3_XYZ_SCALE), (float)(vptr.z * MD3_XYZ_SCALE));
+    }
+
+    glEnd();
+  }
+}
+
+/*
+ *	Draw surfaces with the kernel specialized for the options
+ *	(the default), or with the generic loop testing them all as
+ *	it goes, to measure what the kernels save.
+ */
+void
+render_surface_kernels(int enable)
+{
+  render_generic_surfaces = !enable;
+}
+
+/*
+ *	Apply the user defined rotation of the instance about the axes of the tag it hangs from.
+ */
+void
+apply_custom_rotation(md3_instance_t* inst, md3_tag_t* tag, quat_t* quat)
 {
   quat_t c_local;
   quat_init(&c_local);
 
   /* rotation x-axis */
-  quat_rotate(&c_local, model->rot[0], tag->axis[1].x, tag->axis[1].y, tag->axis[1].z);
+  quat_rotate(&c_local, inst->rot[0], tag->axis[1].x, tag->axis[1].y, tag->axis[1].z);
   quat_mult(quat, &c_local, quat);
 
   /* rotation y-axis */
-  quat_rotate(&c_local, model->rot[1], tag->axis[0].x, tag->axis[0].y, tag->axis[0].z);
+  quat_rotate(&c_local, inst->rot[1], tag->axis[0].x, tag->axis[0].y, tag->axis[0].z);
   quat_mult(quat, &c_local, quat);
 
   /* rotation z-axis */
-  quat_rotate(&c_local, model->rot[2], tag->axis[2].x, tag->axis[2].y, tag->axis[2].z);
+  quat_rotate(&c_local, inst->rot[2], tag->axis[2].x, tag->axis[2].y, tag->axis[2].z);
   quat_mult(quat, &c_local, quat);
 }
 
@@ -499,10 +1129,13 @@ make_tes_plane()
  *		- render the mirror
  */
 void
-draw_mirrors(struct mirror_t* m)
+draw_mirrors(struct world_t* wptr, struct mirror_t* m)
 {
+  int span;
+
   while (m)
   {
+    span = prof_gpu_begin(PROF_GPU_STENCIL);
     glClear(GL_STENCIL_BUFFER_BIT);
 
     /* setup the stencil buffer */
@@ -522,12 +1155,14 @@ draw_mirrors(struct mirror_t* m)
     glTranslatef(m->origin[0], m->origin[1], m->origin[2]);
 
     glScalef(100.0, 1.0, 100.0);
-    glCallList(g_world->gl_plane_id);
+    glCallList(wptr->gl_plane_id);
+    gl_state_forget(&wptr->gl, (GL_STATE_MATERIAL | GL_STATE_TEXTURE_2D));
 
     /* the clipping plane rests on this plane */
     glEnable(GL_CLIP_PLANE0);
     glClipPlane(GL_CLIP_PLANE0, m->clip);
     glPopMatrix();
+    prof_gpu_end(span);
 
     glEnable(GL_DEPTH_TEST);
 
@@ -536,6 +1171,7 @@ draw_mirrors(struct mirror_t* m)
     glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
 
     /* now draw the actual reflections */
+    span = prof_gpu_begin(PROF_GPU_REFLECTION);
     glCullFace(GL_BACK); /* the inversion seems to flip the faces */
 
     glPushMatrix();
@@ -549,8 +1185,10 @@ draw_mirrors(struct mirror_t* m)
       m->normal[1] ? m->normal[1] : 1,
       m->normal[2] ? m->normal[2] : 1);
 
-    /* draw the scene */
-    render_primitives(0);
+    /* draw the scene; the levels of detail picked for the view stay */
+    wptr->mirror_pass = 1;
+    render_primitives(wptr, 0);
+    wptr->mirror_pass = 0;
     glPopMatrix();
 
     /* diable the clipping plane */
@@ -560,8 +1198,10 @@ draw_mirrors(struct mirror_t* m)
     glCullFace(GL_FRONT);
 
     glDisable(GL_STENCIL_TEST);
+    prof_gpu_end(span);
 
     /* draw the mirror */
+    span = prof_gpu_begin(PROF_GPU_PLANE);
     glPushMatrix();
     /* rotate so plane is on z=0 */
     glRotatef(m->angle, m->axis[0], m->axis[1], m->axis[2]);
@@ -570,8 +1210,10 @@ draw_mirrors(struct mirror_t* m)
     glTranslatef(m->origin[0], m->origin[1], m->origin[2]);
 
     glScalef(100.0, 1.0, 100.0);
-    glCallList(g_world->gl_plane_id);
+    glCallList(wptr->gl_plane_id);
+    gl_state_forget(&wptr->gl, (GL_STATE_MATERIAL | GL_STATE_TEXTURE_2D));
     glPopMatrix();
+    prof_gpu_end(span);
 
     m = m->next;
   }
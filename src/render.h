@@ -20,6 +20,7 @@
 #define _MD3_RENDER_H
 
 #include "md3_parse.h"
+#include "quaternion.h"
 
 /*
  *	Linearly interpolate a vertex.
@@ -35,12 +36,12 @@
     v3->z = (v1->z + (t * (v2->z - v1->z))); \
   } while (0)
 
-#define LERP_NORMAL(v1, v2, t, v3)                                                             \
-  do                                                                                           \
-  {                                                                                            \
-    v3->normalxyz[0] = (v1->normalxyz[0] + (t * (vptr2->normalxyz[0] - vptr1->normalxyz[0]))); \
-    v3->normalxyz[1] = (v1->normalxyz[1] + (t * (vptr2->normalxyz[1] - vptr1->normalxyz[1]))); \
-    v3->normalxyz[2] = (v1->normalxyz[2] + (t * (vptr2->normalxyz[2] - vptr1->normalxyz[2]))); \
+#define LERP_NORMAL(v1, v2, t, v3)                                                       \
+  do                                                                                     \
+  {                                                                                      \
+    v3->normalxyz[0] = (v1->normalxyz[0] + (t * (v2->normalxyz[0] - v1->normalxyz[0]))); \
+    v3->normalxyz[1] = (v1->normalxyz[1] + (t * (v2->normalxyz[1] - v1->normalxyz[1]))); \
+    v3->normalxyz[2] = (v1->normalxyz[2] + (t * (v2->normalxyz[2] - v1->normalxyz[2]))); \
   } while (0)
 
 #define SCALE_VERTEX(v, factor) \
@@ -56,23 +57,45 @@
  */
 #define JITTER_SCALE 2.0
 
+/*
+ *	Called by md3_pose() for every part with its transform.
+ */
+typedef void (*md3_pose_func_t)(void* data, md3_instance_t* inst, float* m);
+
+struct sim_pose_t;
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
-  void render_c();
-  void render_primitives(int apply_names);
+  extern md3_tag_t pseudo_tag;
+  extern struct material_t white_material;
+
+  void render_setup(struct world_t* wptr);
+  void render_viewport(struct world_t* wptr, int w, int h);
+  void render_view(struct world_t* wptr);
+  void render_c(struct world_t* wptr);
+  void render_primitives(struct world_t* wptr, int apply_names);
+  void render_model(struct world_t* wptr, int apply_names);
+  void render_surface_kernels(int enable);
 
-  void render_flashlight();
+  void render_flashlight(struct world_t* wptr);
 
-  void md3_render(md3_model_t* model, int apply_names, md3_tag_t* link_tag);
-  void md3_render_single(md3_model_t* model, int apply_names);
+  void md3_render(struct world_t* wptr, md3_instance_t* inst, double now, int apply_names, md3_tag_t* link_tag);
+  void md3_render_single(struct world_t* wptr, md3_instance_t* inst, double now, int apply_names);
+  void md3_render_frame(struct world_t* wptr, md3_instance_t* inst, md3_anim_state_t* state, int apply_names);
+  void md3_render_poses(struct world_t* wptr, struct sim_pose_t* poses, int num_poses, int apply_names);
+  void md3_pose(struct world_t* wptr, md3_instance_t* inst, double now, md3_tag_t* link_tag, float* m, md3_pose_func_t func, void* data);
+  md3_tag_t* md3_link_matrix(struct world_t* wptr, md3_instance_t* inst, int i, float* m);
+  int md3_surface_order(struct world_t* wptr, md3_model_t* model, md3_surface_t** order);
+  void apply_custom_rotation(md3_instance_t* inst, md3_tag_t* tag, quat_t* quat);
 
   unsigned int make_bounding_box();
   unsigned int make_tes_plane();
 
-  void draw_mirrors(struct mirror_t* m);
+  void draw_mirrors(struct world_t* wptr, struct mirror_t* m);
+
 
 #ifdef __cplusplus
 }
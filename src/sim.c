@@ -0,0 +1,432 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "md3_parse.h"
+#include "world.h"
+#include "render.h"
+#include "util.h"
+#include "anim_sched.h"
+#include "sim.h"
+#include "prof.h"
+#include "trace.h"
+
+/* set in sim_t.middle when it holds a snapshot the renderer has not seen */
+#define SIM_FRESH 4
+
+static void sim_thread(void* arg);
+static void sim_wake(struct sim_t* s);
+static int sim_queued(struct sim_t* s);
+static int sim_step(struct sim_t* s);
+static void sim_apply(struct world_t* wptr, struct sim_command_t* cmd);
+static int sim_pop(struct sim_t* s, struct sim_command_t* cmd);
+static void sim_add_pose(void* data, md3_instance_t* inst, float* m);
+
+/*
+ *	Create a simulation of a world; it does not run until sim_start().
+ */
+struct sim_t*
+sim_new(struct world_t* wptr)
+{
+  struct sim_t* s = (struct sim_t*)malloc(sizeof(struct sim_t));
+  memset(s, 0, sizeof(struct sim_t));
+
+  s->world = wptr;
+
+  mutex_init(&s->lock);
+  cond_init(&s->wake);
+
+  s->back = 0;
+  s->middle = 1;
+  s->front = 2;
+
+  return s;
+}
+
+/*
+ *	Stop the simulation and free it.
+ */
+void
+sim_free(struct sim_t* s)
+{
+  int i = 0;
+
+  if (!s)
+    return;
+
+  sim_stop(s);
+
+  for (; i < 3; ++i)
+    free(s->snapshots[i].poses);
+
+  cond_destroy(&s->wake);
+  mutex_destroy(&s->lock);
+  free(s);
+}
+
+/*
+ *	Start the simulation thread.
+ *
+ *	From here on the GUI thread must not touch the animation state,
+ *	rotation or scale of the instances other than through the world
+ *	functions, and must hold sim_lock() to load or unload models.
+ */
+void
+sim_start(struct sim_t* s)
+{
+  if (!s || s->running)
+    return;
+
+  /* have a pose ready before the first frame is drawn */
+  mutex_lock(&s->lock);
+  sim_step(s);
+
+  s->quit = 0;
+  s->running = 1;
+  if (!thread_create(&s->thread, sim_thread, s))
+  {
+    printf("Error: Could not start the simulation thread, animating on the GUI thread.\n");
+    s->running = 0;
+  }
+
+  /* the thread waits for this so it sees s->thread set */
+  mutex_unlock(&s->lock);
+}
+
+/*
+ *	Stop the simulation thread; the world belongs to the caller again.
+ */
+void
+sim_stop(struct sim_t* s)
+{
+  if (!s || !s->running)
+    return;
+
+  ATOMIC_STORE(&s->quit, 1);
+  sim_wake(s);
+  thread_join(s->thread);
+  s->running = 0;
+
+  /* apply what is still queued */
+  sim_step(s);
+}
+
+/*
+ *	Take the world away from the simulation, to change its structure.
+ *
+ *	World functions called while it is held apply right away.
+ */
+void
+sim_lock(struct sim_t* s)
+{
+  if (!s)
+    return;
+
+  mutex_lock(&s->lock);
+  s->locked = 1;
+}
+
+/*
+ *	Give the world back to the simulation.
+ *
+ *	A step is taken right away so the next snapshot the renderer
+ *	gets matches the new structure.
+ */
+void
+sim_unlock(struct sim_t* s)
+{
+  if (!s)
+    return;
+
+  sim_step(s);
+
+  /* the new models may be animated */
+  ATOMIC_STORE(&s->idle, 0);
+  cond_signal(&s->wake);
+
+  s->locked = 0;
+  mutex_unlock(&s->lock);
+}
+
+/*
+ *	Queue a command for the simulation thread.
+ *
+ *	Returns 0 if the caller should apply the edit itself; that is if
+ *	the simulation is not running, the caller is the simulation, or
+ *	the caller holds sim_lock().
+ */
+int
+sim_post(struct sim_t* s, sim_command_e type, int part, int axis, float value)
+{
+  struct sim_command_t* cmd = NULL;
+  unsigned int tail = 0;
+
+  if (!s || !s->running || sim_is_current(s) || s->locked)
+    return 0;
+
+  /* full; the simulation empties the queue every step */
+  tail = s->tail;
+  while ((tail - ATOMIC_LOAD(&s->head)) == SIM_QUEUE_SIZE)
+    thread_sleep(1);
+
+  cmd = &s->queue[tail & (SIM_QUEUE_SIZE - 1)];
+  cmd->type = type;
+  cmd->part = part;
+  cmd->axis = axis;
+  cmd->value = value;
+
+  ATOMIC_STORE(&s->tail, (tail + 1));
+
+  sim_wake(s);
+  return 1;
+}
+
+/*
+ *	Check if the caller is the simulation thread.
+ */
+int
+sim_is_current(struct sim_t* s)
+{
+  return (s && s->running && thread_is_current(s->thread));
+}
+
+/*
+ *	Get the newest snapshot for a frame.
+ *
+ *	The snapshot stays valid until the next call; call once per frame.
+ *	Returns NULL if the simulation is not running.
+ */
+struct sim_snapshot_t*
+sim_acquire(struct sim_t* s)
+{
+  if (!s || !s->running)
+    return NULL;
+
+  if (ATOMIC_LOAD(&s->middle) & SIM_FRESH)
+    s->front = (ATOMIC_EXCHANGE(&s->middle, s->front) & ~SIM_FRESH);
+
+  return &s->snapshots[s->front];
+}
+
+/*
+ *	Get the snapshot of the current frame.
+ *	Returns NULL if the simulation is not running.
+ */
+struct sim_snapshot_t*
+sim_snapshot(struct sim_t* s)
+{
+  if (!s || !s->running)
+    return NULL;
+
+  return &s->snapshots[s->front];
+}
+
+/*
+ *	Simulation thread main loop.
+ */
+static void
+sim_thread(void* arg)
+{
+  struct sim_t* s = (struct sim_t*)arg;
+  double start = 0;
+  int animating = 1;
+  int wait = 0;
+
+  trace_thread_name("simulation");
+
+  while (!ATOMIC_LOAD(&s->quit))
+  {
+    start = get_time_in_ms();
+
+    mutex_lock(&s->lock);
+
+    /* posing is wasted while nobody draws, as when the window is hidden */
+    if (sim_queued(s) || !(ATOMIC_LOAD(&s->middle) & SIM_FRESH))
+      animating = sim_step(s);
+
+    if (!animating && !sim_queued(s))
+    {
+      /*
+       *	Nothing moves until a command comes in, sleep until then.
+       *	Whoever clears idle signals wake under the lock, so
+       *	a command queued after the check is not missed.
+       */
+      ATOMIC_EXCHANGE(&s->idle, 1);
+      if (!sim_queued(s) && !ATOMIC_LOAD(&s->quit))
+      {
+        while (ATOMIC_LOAD(&s->idle))
+          cond_wait(&s->wake, &s->lock);
+      }
+      ATOMIC_STORE(&s->idle, 0);
+
+      /* look again at the next step */
+      animating = 1;
+    }
+
+    mutex_unlock(&s->lock);
+
+    wait = (SIM_STEP_MS - (int)(get_time_in_ms() - start));
+    thread_sleep((wait > 0) ? wait : 0);
+  }
+}
+
+/*
+ *	Wake the simulation thread if it is idle.
+ */
+static void
+sim_wake(struct sim_t* s)
+{
+  if (!ATOMIC_EXCHANGE(&s->idle, 0))
+    return;
+
+  mutex_lock(&s->lock);
+  cond_signal(&s->wake);
+  mutex_unlock(&s->lock);
+}
+
+/*
+ *	Check if there are commands waiting.
+ */
+static int
+sim_queued(struct sim_t* s)
+{
+  return (s->head != ATOMIC_LOAD(&s->tail));
+}
+
+/*
+ *	Apply the queued commands, tick and pose the model and publish it.
+ *	Returns the snapshot's animating flag.
+ *
+ *	The caller holds s->lock.
+ */
+static int
+sim_step(struct sim_t* s)
+{
+  struct sim_snapshot_t* snap = &s->snapshots[s->back];
+  struct sim_command_t cmd;
+  int applied = 0;
+  double start, now;
+  float m[16];
+
+  while (sim_pop(s, &cmd))
+  {
+    sim_apply(s->world, &cmd);
+    applied = 1;
+  }
+
+  memset(m, 0, sizeof(m));
+  m[0] = m[5] = m[10] = m[15] = 1.0f;
+
+  now = world_clock_next(s->world);
+  start = prof_begin();
+  anim_sched_tick(&s->world->sched, s->world, now);
+  snap->num_poses = 0;
+  md3_pose(s->world, s->world->root_instance, now, NULL, m, sim_add_pose, snap);
+  snap->num_root_poses = snap->num_poses;
+  md3_pose(s->world, world_get_instance_by_type(s->world, MD3_LIGHT), now, NULL, m, sim_add_pose, snap);
+  prof_end(PROF_POSE, start);
+  snap->animating = world_is_animating(s->world->root_instance);
+  snap->time = now;
+
+  /* publish */
+  s->back = (ATOMIC_EXCHANGE(&s->middle, (s->back | SIM_FRESH)) & ~SIM_FRESH);
+
+  /* the edits are in the snapshot now, show them */
+  if (applied && s->world->redraw)
+    s->world->redraw(s->world->redraw_data);
+
+  return snap->animating;
+}
+
+/*
+ *	Apply a command from the GUI thread.
+ */
+static void
+sim_apply(struct world_t* wptr, struct sim_command_t* cmd)
+{
+  switch (cmd->type)
+  {
+    case SIM_ROTATE:
+      rotate_model(wptr, (md3_body_parts_e)cmd->part, cmd->axis, cmd->value);
+      break;
+    case SIM_ROTATE_ABSOLUTE:
+      rotate_model_absolute(wptr, (md3_body_parts_e)cmd->part, cmd->axis, cmd->value);
+      break;
+    case SIM_ROTATE_ALL_ABSOLUTE:
+      rotate_all_models_absolute(wptr, cmd->axis, cmd->value, cmd->part);
+      break;
+    case SIM_SCALE:
+      scale_model(wptr, (md3_body_parts_e)cmd->part, cmd->value);
+      break;
+    case SIM_SCALE_ALL:
+      scale_all_models(wptr, cmd->value, cmd->part);
+      break;
+    case SIM_ANIMATION:
+      set_model_animation(wptr, (md3_animations_e)cmd->part);
+      break;
+    case SIM_STOP_ANIMATION:
+      world_stop_model_animation(wptr, cmd->part);
+      break;
+    case SIM_ANIM_BUDGET:
+      world_set_instance_anim_budget(wptr, (md3_body_parts_e)cmd->part, cmd->value);
+      break;
+    case SIM_OPTIONS:
+      ATOMIC_STORE(&wptr->anim_flags, cmd->part);
+      break;
+  }
+}
+
+/*
+ *	Take the oldest command off the queue.
+ *	Returns 0 if it is empty.
+ */
+static int
+sim_pop(struct sim_t* s, struct sim_command_t* cmd)
+{
+  unsigned int head = s->head;
+
+  if (head == ATOMIC_LOAD(&s->tail))
+    return 0;
+
+  *cmd = s->queue[head & (SIM_QUEUE_SIZE - 1)];
+  ATOMIC_STORE(&s->head, (head + 1));
+  return 1;
+}
+
+/*
+ *	md3_pose() callback: add a posed part to a snapshot.
+ */
+static void
+sim_add_pose(void* data, md3_instance_t* inst, float* m)
+{
+  struct sim_snapshot_t* snap = (struct sim_snapshot_t*)data;
+  struct sim_pose_t* pose = NULL;
+
+  if (snap->num_poses == snap->max_poses)
+  {
+    snap->max_poses = (snap->max_poses ? (snap->max_poses * 2) : 8);
+    snap->poses = (struct sim_pose_t*)realloc(snap->poses, (sizeof(struct sim_pose_t) * snap->max_poses));
+  }
+
+  pose = &snap->poses[snap->num_poses++];
+  pose->inst = inst;
+  pose->state = inst->anim_state;
+  memcpy(pose->matrix, m, sizeof(pose->matrix));
+}
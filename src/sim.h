@@ -0,0 +1,163 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+/*
+ *	Simulation thread.
+ *
+ *	While it runs the simulation thread owns the animation state,
+ *	custom rotation and scale of the world's instances.  It ticks the
+ *	animations and poses the model on its own, and publishes the
+ *	result as a snapshot through a triple buffer so the renderer
+ *	always has a complete pose to draw without waiting.
+ *
+ *	Edits from the GUI thread (rotate_model(), scale_model(),
+ *	set_model_animation(), ...) are queued as commands on a single
+ *	producer, single consumer lock free queue and applied by the
+ *	simulation thread at its next step.
+ *
+ *	When nothing is animating and no commands are queued the thread
+ *	sleeps until sim_post() wakes it; while the renderer has not taken
+ *	the last snapshot (the window is hidden) it skips posing.
+ */
+
+#include "md3_parse.h"
+#include "thread.h"
+
+/*
+ *	Time between simulation steps in milliseconds.
+ */
+#define SIM_STEP_MS 4
+
+/*
+ *	Number of commands the queue holds; a power of two.
+ */
+#define SIM_QUEUE_SIZE 256
+
+/*
+ *	Commands from the GUI thread.
+ */
+typedef enum
+{
+  SIM_ROTATE,              /* rotate_model(part, axis, value)					*/
+  SIM_ROTATE_ABSOLUTE,     /* rotate_model_absolute(part, axis, value)			*/
+  SIM_ROTATE_ALL_ABSOLUTE, /* rotate_all_models_absolute(axis, value, part)	*/
+  SIM_SCALE,               /* scale_model(part, value)							*/
+  SIM_SCALE_ALL,           /* scale_all_models(value, part)					*/
+  SIM_ANIMATION,           /* set_model_animation(part)						*/
+  SIM_STOP_ANIMATION,      /* world_stop_model_animation(part)					*/
+  SIM_ANIM_BUDGET,         /* world_set_instance_anim_budget(part, value)		*/
+  SIM_OPTIONS              /* part is the new WORLD_ANIM_FLAGS					*/
+} sim_command_e;
+
+struct sim_command_t
+{
+  sim_command_e type;
+  int part;
+  int axis;
+  float value;
+};
+
+/*
+ *	A part of the model posed by the simulation.
+ */
+struct sim_pose_t
+{
+  md3_instance_t* inst;
+  md3_anim_state_t state; /* key frames and blend at this step				*/
+  float matrix[16];       /* part to model space, custom scale included	*/
+};
+
+/*
+ *	Everything the renderer needs from one simulation step.
+ *	Never changed once published.
+ */
+struct sim_snapshot_t
+{
+  struct sim_pose_t* poses; /* the root model, then the flashlight model	*/
+  int num_poses;
+  int max_poses;
+  int num_root_poses; /* poses[0, num_root_poses) are the root model	*/
+  int animating;      /* the model will move at the next step			*/
+  double time;        /* when the step was taken						*/
+};
+
+struct sim_t
+{
+  struct world_t* world; /* the world it animates	*/
+  thread_t thread;
+  int running;
+  int quit;
+  int locked; /* the GUI thread holds the lock; only it reads this	*/
+
+  /*
+   *	Held by the simulation thread for each step, and by the
+   *	GUI thread to change the world's structure (loading models).
+   *	The renderer never takes it.
+   */
+  mutex_t lock;
+  cond_t wake; /* signalled to wake an idle simulation		*/
+  int idle;    /* waiting on wake; cleared by whoever wakes it	*/
+
+  /* command queue; the GUI thread writes tail, the simulation head */
+  struct sim_command_t queue[SIM_QUEUE_SIZE];
+  unsigned int head;
+  char pad0[CACHE_LINE];
+  unsigned int tail;
+  char pad1[CACHE_LINE];
+
+  /*
+   *	Triple buffer.  The simulation fills snapshots[back], then swaps
+   *	it with the middle; the renderer swaps the middle with its front
+   *	when a new one is there.  SIM_FRESH in middle flags a new one.
+   */
+  struct sim_snapshot_t snapshots[3];
+  int back;
+  char pad2[CACHE_LINE];
+  int middle;
+  char pad3[CACHE_LINE];
+  int front;
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct sim_t* sim_new(struct world_t* wptr);
+  void sim_free(struct sim_t* s);
+
+  void sim_start(struct sim_t* s);
+  void sim_stop(struct sim_t* s);
+
+  void sim_lock(struct sim_t* s);
+  void sim_unlock(struct sim_t* s);
+
+  int sim_post(struct sim_t* s, sim_command_e type, int part, int axis, float value);
+  int sim_is_current(struct sim_t* s);
+
+  struct sim_snapshot_t* sim_acquire(struct sim_t* s);
+  struct sim_snapshot_t* sim_snapshot(struct sim_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SIM_H */
@@ -22,6 +22,7 @@
 #include "definitions.h"
 #include "world.h"
 #include "tga.h"
+#include "trace.h"
 
 /*
  *	Load a tga file.
@@ -32,11 +33,14 @@ load_tga(char* file)
   struct tga_t* tga = NULL;
   FILE* fptr = NULL;
   int size = 0;
+  double start;
 
   fptr = fopen(file, "rb");
   if (!fptr)
     return NULL;
 
+  start = trace_begin();
+
   tga = (struct tga_t*)malloc(sizeof(struct tga_t));
   memset(tga, 0, sizeof(struct tga_t));
 
@@ -81,6 +85,7 @@ load_tga(char* file)
   };
   tga->gl_compontents = tga->header.depth;
 
+  trace_end("load_tga", start);
   return tga;
 };
 
@@ -95,3 +100,34 @@ free_tga(struct tga_t* tga)
   free(tga->img);
   free(tga);
 }
+
+/*
+ *	Save an uncompressed 32 bit tga file.
+ *	Rows go bottom to top, as glReadPixels() returns them.
+ *
+ *	Returns 0 on failure.
+ */
+int
+save_tga(char* file, int width, int height, unsigned char* bgra)
+{
+  struct tga_header_t header;
+  FILE* fptr = NULL;
+  int ok = 0;
+
+  fptr = fopen(file, "wb");
+  if (!fptr)
+    return 0;
+
+  memset(&header, 0, sizeof(struct tga_header_t));
+  header.image_type = 2;
+  header.width = (short)width;
+  header.height = (short)height;
+  header.depth = 32;
+  header.desc = 8; /* alpha bits, lower left origin */
+
+  ok = (fwrite(&header, 18, 1, fptr) == 1);
+  ok = (ok && (fwrite(bgra, (width * height * 4), 1, fptr) == 1));
+
+  fclose(fptr);
+  return ok;
+}
@@ -70,6 +70,7 @@ extern "C"
 
   struct tga_t* load_tga(char* file);
   void free_tga(struct tga_t* tga);
+  int save_tga(char* file, int width, int height, unsigned char* bgra);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,292 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE /* pthread_setaffinity_np() */
+#endif
+#include <stdlib.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <time.h>
+#endif
+#include "thread.h"
+
+#ifdef _WIN32
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* this thread's number from thread_id(), and the last one given out */
+static THREAD_LOCAL int thread_number;
+static int thread_numbers;
+
+/*
+ *	The thread function and its argument.
+ *	Both thread APIs want a different function signature,
+ *	so threads start in thread_start() which calls this.
+ */
+struct thread_start_t
+{
+  void (*func)(void* arg);
+  void* arg;
+};
+
+#ifdef _WIN32
+static DWORD WINAPI
+thread_start(LPVOID p)
+{
+  struct thread_start_t s = *(struct thread_start_t*)p;
+  free(p);
+  s.func(s.arg);
+  return 0;
+}
+#else
+static void*
+thread_start(void* p)
+{
+  struct thread_start_t s = *(struct thread_start_t*)p;
+  free(p);
+  s.func(s.arg);
+  return NULL;
+}
+#endif
+
+/*
+ *	Start a thread running func(arg).
+ *
+ *	Returns 0 on failure.
+ */
+int
+thread_create(thread_t* t, void (*func)(void* arg), void* arg)
+{
+  struct thread_start_t* s = (struct thread_start_t*)malloc(sizeof(struct thread_start_t));
+  s->func = func;
+  s->arg = arg;
+
+#ifdef _WIN32
+  *t = CreateThread(NULL, 0, thread_start, s, 0, NULL);
+  if (*t)
+    return 1;
+#else
+  if (!pthread_create(t, NULL, thread_start, s))
+    return 1;
+#endif
+
+  free(s);
+  return 0;
+}
+
+/*
+ *	Wait for a thread to finish.
+ */
+void
+thread_join(thread_t t)
+{
+#ifdef _WIN32
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+#else
+  pthread_join(t, NULL);
+#endif
+}
+
+/*
+ *	Check if t is the calling thread.
+ */
+int
+thread_is_current(thread_t t)
+{
+#ifdef _WIN32
+  return (GetThreadId(t) == GetCurrentThreadId());
+#else
+  return pthread_equal(t, pthread_self());
+#endif
+}
+
+/*
+ *	Get a small number for the calling thread, counting from 1
+ *	in the order threads first ask.
+ */
+int
+thread_id()
+{
+  if (!thread_number)
+    thread_number = ATOMIC_ADD(&thread_numbers, 1);
+  return thread_number;
+}
+
+/*
+ *	Sleep for the given number of milliseconds.
+ */
+void
+thread_sleep(int msec)
+{
+#ifdef _WIN32
+  Sleep(msec);
+#else
+  struct timespec ts;
+  ts.tv_sec = (msec / 1000);
+  ts.tv_nsec = ((msec % 1000) * 1000000L);
+  nanosleep(&ts, NULL);
+#endif
+}
+
+/*
+ *	Get the number of processors available.
+ */
+int
+thread_cpu_count()
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return ((n > 0) ? (int)n : 1);
+#endif
+}
+
+/*
+ *	Keep the calling thread on one processor.
+ *
+ *	Returns 0 if the system would not, or cannot.
+ */
+int
+thread_pin_cpu(int cpu)
+{
+#if defined(_WIN32)
+  return (SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR)1 << cpu)) != 0);
+#elif defined(__linux__)
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return !pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+#else
+  (void)cpu;
+  return 0;
+#endif
+}
+
+void
+mutex_init(mutex_t* m)
+{
+#ifdef _WIN32
+  InitializeCriticalSection(m);
+#else
+  pthread_mutex_init(m, NULL);
+#endif
+}
+
+void
+mutex_destroy(mutex_t* m)
+{
+#ifdef _WIN32
+  DeleteCriticalSection(m);
+#else
+  pthread_mutex_destroy(m);
+#endif
+}
+
+void
+mutex_lock(mutex_t* m)
+{
+#ifdef _WIN32
+  EnterCriticalSection(m);
+#else
+  pthread_mutex_lock(m);
+#endif
+}
+
+/*
+ *	Lock m if no other thread holds it.
+ *
+ *	Returns 0 if one does, without waiting.
+ */
+int
+mutex_trylock(mutex_t* m)
+{
+#ifdef _WIN32
+  return (TryEnterCriticalSection(m) != 0);
+#else
+  return !pthread_mutex_trylock(m);
+#endif
+}
+
+void
+mutex_unlock(mutex_t* m)
+{
+#ifdef _WIN32
+  LeaveCriticalSection(m);
+#else
+  pthread_mutex_unlock(m);
+#endif
+}
+
+void
+cond_init(cond_t* c)
+{
+#ifdef _WIN32
+  InitializeConditionVariable(c);
+#else
+  pthread_cond_init(c, NULL);
+#endif
+}
+
+void
+cond_destroy(cond_t* c)
+{
+#ifdef _WIN32
+  /* nothing to free */
+  (void)c;
+#else
+  pthread_cond_destroy(c);
+#endif
+}
+
+void
+cond_wait(cond_t* c, mutex_t* m)
+{
+#ifdef _WIN32
+  SleepConditionVariableCS(c, m, INFINITE);
+#else
+  pthread_cond_wait(c, m);
+#endif
+}
+
+void
+cond_signal(cond_t* c)
+{
+#ifdef _WIN32
+  WakeConditionVariable(c);
+#else
+  pthread_cond_signal(c);
+#endif
+}
+
+void
+cond_broadcast(cond_t* c)
+{
+#ifdef _WIN32
+  WakeAllConditionVariable(c);
+#else
+  pthread_cond_broadcast(c);
+#endif
+}
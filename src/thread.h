@@ -0,0 +1,91 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _THREAD_H
+#define _THREAD_H
+
+/*
+ *	Threads, locks and atomics for Windows and pthreads.
+ */
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+
+#define ATOMIC_LOAD(p) InterlockedCompareExchange((volatile LONG*)(p), 0, 0)
+#define ATOMIC_STORE(p, v) InterlockedExchange((volatile LONG*)(p), (v))
+#define ATOMIC_ADD(p, v) (InterlockedExchangeAdd((volatile LONG*)(p), (v)) + (v))
+#define ATOMIC_EXCHANGE(p, v) InterlockedExchange((volatile LONG*)(p), (v))
+#define ATOMIC_ADD64(p, v) (InterlockedExchangeAdd64((volatile LONGLONG*)(p), (v)) + (v))
+#define ATOMIC_EXCHANGE64(p, v) InterlockedExchange64((volatile LONGLONG*)(p), (v))
+#else
+#include <pthread.h>
+
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+
+#define ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_ADD(p, v) __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define ATOMIC_EXCHANGE(p, v) __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define ATOMIC_ADD64(p, v) ATOMIC_ADD((p), (v))
+#define ATOMIC_EXCHANGE64(p, v) ATOMIC_EXCHANGE((p), (v))
+#endif
+
+/*
+ *	Keep data touched by different threads on different cache lines.
+ */
+#define CACHE_LINE 64
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  int thread_create(thread_t* t, void (*func)(void* arg), void* arg);
+  void thread_join(thread_t t);
+  int thread_is_current(thread_t t);
+  int thread_id();
+  void thread_sleep(int msec);
+  int thread_cpu_count();
+  int thread_pin_cpu(int cpu);
+
+  void mutex_init(mutex_t* m);
+  void mutex_destroy(mutex_t* m);
+  void mutex_lock(mutex_t* m);
+  int mutex_trylock(mutex_t* m);
+  void mutex_unlock(mutex_t* m);
+
+  void cond_init(cond_t* c);
+  void cond_destroy(cond_t* c);
+  void cond_wait(cond_t* c, mutex_t* m);
+  void cond_signal(cond_t* c);
+  void cond_broadcast(cond_t* c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _THREAD_H */
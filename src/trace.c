@@ -0,0 +1,222 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "thread.h"
+#include "prof.h"
+#include "trace.h"
+
+/*
+ *	A finished span.
+ */
+struct trace_event_t
+{
+  const char* name;
+  double start; /* on the prof_begin() clock, in ms		*/
+  float dur;    /* ms										*/
+  int tid;      /* thread_id() of the thread it ran on		*/
+  int done;     /* set last, once the rest is filled in	*/
+};
+
+static int trace_on;
+static double trace_t0;
+static FILE* trace_out;
+
+/*
+ *	Events are appended by any thread through trace_count.
+ *	The array is kept once allocated, a thread may still be
+ *	finishing an event after tracing stops.
+ */
+static struct trace_event_t* trace_events;
+static int trace_count;
+static int trace_dropped;
+
+/* thread names by thread_id() */
+static char trace_threads[TRACE_MAX_THREADS][32];
+
+static void trace_write();
+
+/*
+ *	Start tracing; the trace is written to file by trace_stop().
+ *
+ *	Returns 0 if the file could not be opened.
+ */
+int
+trace_start(char* file)
+{
+  int n = ATOMIC_LOAD(&trace_count);
+
+  if (trace_on)
+    trace_stop();
+
+  trace_out = fopen(file, "w");
+  if (!trace_out)
+  {
+    printf("Error: Could not open %s for the trace.\n", file);
+    return 0;
+  }
+
+  if (!trace_events)
+    trace_events = (struct trace_event_t*)calloc(TRACE_MAX_EVENTS, sizeof(struct trace_event_t));
+  else
+    memset(trace_events, 0, (sizeof(struct trace_event_t) * ((n < TRACE_MAX_EVENTS) ? n : TRACE_MAX_EVENTS)));
+
+  ATOMIC_STORE(&trace_count, 0);
+  ATOMIC_STORE(&trace_dropped, 0);
+  trace_t0 = prof_begin();
+  ATOMIC_STORE(&trace_on, 1);
+
+  return 1;
+}
+
+/*
+ *	Stop tracing and write the trace.
+ */
+void
+trace_stop()
+{
+  if (!trace_on)
+    return;
+
+  ATOMIC_STORE(&trace_on, 0);
+  trace_write();
+  fclose(trace_out);
+  trace_out = NULL;
+
+  if (trace_dropped)
+    printf("Error: The trace was full, %i events were dropped.\n", trace_dropped);
+}
+
+/*
+ *	Check if a trace is being recorded.
+ */
+int
+trace_enabled()
+{
+  return ATOMIC_LOAD(&trace_on);
+}
+
+/*
+ *	Start a span.
+ *	Returns its start time, or 0 if tracing is off.
+ */
+double
+trace_begin()
+{
+  if (!ATOMIC_LOAD(&trace_on))
+    return 0;
+
+  return prof_begin();
+}
+
+/*
+ *	End a span and record it.
+ */
+void
+trace_end(const char* name, double start)
+{
+  struct trace_event_t* e = NULL;
+  double end;
+  int i;
+
+  /* begun before tracing started */
+  if (!ATOMIC_LOAD(&trace_on) || (start < trace_t0))
+    return;
+
+  end = prof_begin();
+
+  if (ATOMIC_LOAD(&trace_count) >= TRACE_MAX_EVENTS)
+  {
+    ATOMIC_ADD(&trace_dropped, 1);
+    return;
+  }
+
+  i = (ATOMIC_ADD(&trace_count, 1) - 1);
+  if (i >= TRACE_MAX_EVENTS)
+  {
+    ATOMIC_ADD(&trace_dropped, 1);
+    return;
+  }
+
+  e = &trace_events[i];
+  e->name = name;
+  e->start = start;
+  e->dur = (float)(end - start);
+  e->tid = thread_id();
+  ATOMIC_STORE(&e->done, 1);
+}
+
+/*
+ *	Name the calling thread's track.
+ *	Threads should name themselves as they start, traced or not.
+ */
+void
+trace_thread_name(const char* name)
+{
+  int tid = thread_id();
+
+  if (tid >= TRACE_MAX_THREADS)
+    return;
+
+  strncpy(trace_threads[tid], name, (sizeof(trace_threads[tid]) - 1));
+}
+
+/*
+ *	Write the events recorded so far as Chrome trace events,
+ *	in microseconds from the start of the trace.
+ */
+static void
+trace_write()
+{
+  struct trace_event_t* e = NULL;
+  int n = ATOMIC_LOAD(&trace_count);
+  int first = 1;
+  int i = 0;
+
+  if (n > TRACE_MAX_EVENTS)
+    n = TRACE_MAX_EVENTS;
+
+  fprintf(trace_out, "{\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [");
+
+  for (; i < TRACE_MAX_THREADS; ++i)
+  {
+    if (!trace_threads[i][0])
+      continue;
+
+    fprintf(trace_out, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %i, \"args\": {\"name\": \"%s\"}}",
+            (first ? "" : ","), i, trace_threads[i]);
+    first = 0;
+  }
+
+  for (i = 0; i < n; ++i)
+  {
+    e = &trace_events[i];
+
+    /* still being filled in when tracing stopped */
+    if (!ATOMIC_LOAD(&e->done))
+      continue;
+
+    fprintf(trace_out, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %i, \"ts\": %.3f, \"dur\": %.3f}",
+            (first ? "" : ","), e->name, e->tid, ((e->start - trace_t0) * 1000.0), ((double)e->dur * 1000.0));
+    first = 0;
+  }
+
+  fprintf(trace_out, "\n]}\n");
+}
@@ -0,0 +1,69 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+/*
+ *	Timeline tracing.
+ *
+ *	Spans of code are recorded with the thread they ran on and
+ *	written as Chrome trace events, which chrome://tracing and
+ *	Perfetto open:
+ *
+ *		double start = trace_begin();
+ *		...
+ *		trace_end("load_tga", start);
+ *
+ *	The name must be a string constant; only the pointer is kept.
+ *	Spans may be recorded from any thread and nest.  While tracing is
+ *	off trace_begin() returns 0 and trace_end() does nothing with it.
+ *
+ *	The profiler stages (see prof.h) are traced under their own names
+ *	as well, so frames show up without extra spans.
+ */
+
+/*
+ *	The most events in one trace; later ones are dropped.
+ */
+#define TRACE_MAX_EVENTS (1 << 20)
+
+/*
+ *	Threads that can be given a name for their track.
+ */
+#define TRACE_MAX_THREADS 64
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  int trace_start(char* file);
+  void trace_stop();
+  int trace_enabled();
+
+  double trace_begin();
+  void trace_end(const char* name, double start);
+
+  void trace_thread_name(const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TRACE_H */
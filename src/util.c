@@ -70,6 +70,27 @@ get_path(char* file, int alloc)
   return buf;
 }
 
+/*
+ *	Get the directory holding the models/ directory a file is in.
+ *	Texture names inside md3 files start from there, so
+ *	"../models/weapons2/rocketl/rocketl.md3" gives "../".
+ *
+ *	Returns an allocated string, empty if the file is not under models/.
+ */
+char*
+get_models_root(char* file)
+{
+  char* buf = strdup(file);
+  char* s = strstr(buf, "models");
+
+  if (s && ((s == buf) || (s[-1] == '/') || (s[-1] == '\\')))
+    *s = '\0';
+  else
+    *buf = '\0';
+
+  return buf;
+}
+
 /*
  *	Remove a \r\n from the given string.
  *	Return the same pointerr.
@@ -54,6 +54,7 @@ extern "C"
 #endif
 
   char* get_path(char* file, int alloc);
+  char* get_models_root(char* file);
   char* strip_lf(char* s);
 
   void get_time(struct timeval* t);
@@ -0,0 +1,540 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ *	References used for the research of this code include:
+ *
+ *	http://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+ *	"Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+ *	by Sander, Nehab and Barczak
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "md3_parse.h"
+#include "world.h"
+#include "vcache.h"
+
+/*
+ *	A vertex while the triangles are being ordered.
+ */
+struct vcache_vertex_t
+{
+  int first;     /* its triangles in vcache_t.adjacent			*/
+  int num;       /* how many									*/
+  int remaining; /* of them not yet ordered						*/
+  int cache_pos; /* in the simulated LRU cache, -1 if not in it	*/
+  float score;
+};
+
+/*
+ *	A run of triangles for the overdraw order.
+ */
+struct vcache_cluster_t
+{
+  int first; /* triangle in the cache order		*/
+  int num;
+  float area; /* twice the area of its triangles	*/
+  float key;  /* how much it faces out			*/
+};
+
+static int vcache_order(md3_surface_t* sptr, int* order);
+static float vcache_score(struct vcache_vertex_t* v);
+static void vcache_overdraw(md3_surface_t* sptr, int* order);
+static void vcache_renumber(md3_surface_t* sptr, int* order);
+static int vcache_fifo_miss(int* fifo, int* head, int* size, int v);
+static int vcache_cluster_cmp(const void* a, const void* b);
+
+/*
+ *	Reorder the triangles of a surface for the vertex cache and
+ *	renumber its vertices in the order they are first used.
+ *
+ *	If overdraw is set the triangles are then also split into runs
+ *	at the points where the cache starts over anyway, and the runs
+ *	most facing out from the middle of the surface in its first
+ *	frame are drawn first, so they hide more of those drawn after.
+ *
+ *	The surface must not have been uploaded to GL yet.
+ *
+ *	Returns 0 if the triangles refer to vertices the surface does
+ *	not have; the surface is then left as it was.
+ */
+int
+vcache_optimize(md3_surface_t* sptr, int overdraw)
+{
+  int* order = NULL;
+
+  if (sptr->num_triangles < 2)
+    return 1;
+
+  order = (int*)malloc(sizeof(int) * sptr->num_triangles);
+  if (!vcache_order(sptr, order))
+  {
+    free(order);
+    return 0;
+  }
+
+  if (overdraw)
+    vcache_overdraw(sptr, order);
+
+  vcache_renumber(sptr, order);
+  free(order);
+
+  return 1;
+}
+
+/*
+ *	Count the vertex transforms the triangles of a surface take with
+ *	a FIFO cache, and add them to stats.
+ */
+void
+vcache_measure(md3_surface_t* sptr, struct vcache_stats_t* stats)
+{
+  int fifo[VCACHE_FIFO_SIZE];
+  int head = 0;
+  int size = 0;
+  char* used = (char*)malloc(sptr->num_verts ? sptr->num_verts : 1);
+  int i, j, v;
+
+  memset(used, 0, (sptr->num_verts ? sptr->num_verts : 1));
+
+  for (i = 0; i < sptr->num_triangles; ++i)
+  {
+    for (j = 0; j < 3; ++j)
+    {
+      v = sptr->triangle[i].index[j];
+      if ((v < 0) || (v >= sptr->num_verts))
+        continue;
+
+      if (!used[v])
+      {
+        used[v] = 1;
+        ++stats->vertices;
+      }
+      stats->transforms += vcache_fifo_miss(fifo, &head, &size, v);
+    }
+  }
+
+  stats->triangles += sptr->num_triangles;
+  free(used);
+}
+
+/*
+ *	Fill order with the triangles in the order to draw them.
+ *
+ *	Each step draws the triangle whose vertices score highest: those
+ *	recently used, and those with few triangles left to draw so no
+ *	lone triangles are left behind.  Only the triangles of vertices
+ *	in the cache are rescored, and searched for the next best.
+ *
+ *	Returns 0 if a triangle has a vertex out of range.
+ */
+static int
+vcache_order(md3_surface_t* sptr, int* order)
+{
+  int num_verts = sptr->num_verts;
+  int num_tris = sptr->num_triangles;
+  struct vcache_vertex_t* verts = NULL;
+  struct vcache_vertex_t* v = NULL;
+  int* adjacent = NULL;
+  float* tri_score = NULL;
+  char* drawn = NULL;
+  int cache[VCACHE_SIZE + 3];
+  int new_cache[VCACHE_SIZE + 3];
+  int cache_size = 0;
+  int new_size = 0;
+  int scan = 0;
+  int best = 0;
+  float best_score;
+  int i, j, k, n, t;
+
+  if ((num_tris < 1) || (num_verts < 1))
+    return 0;
+
+  for (i = 0; i < num_tris; ++i)
+  {
+    for (j = 0; j < 3; ++j)
+    {
+      if ((sptr->triangle[i].index[j] < 0) || (sptr->triangle[i].index[j] >= num_verts))
+        return 0;
+    }
+  }
+
+  verts = (struct vcache_vertex_t*)malloc(sizeof(struct vcache_vertex_t) * num_verts);
+  memset(verts, 0, (sizeof(struct vcache_vertex_t) * num_verts));
+  adjacent = (int*)malloc(sizeof(int) * num_tris * 3);
+  tri_score = (float*)malloc(sizeof(float) * num_tris);
+  drawn = (char*)malloc(sizeof(char) * num_tris);
+  memset(drawn, 0, (sizeof(char) * num_tris));
+
+  /* the triangles of every vertex */
+  for (i = 0; i < num_tris; ++i)
+  {
+    for (j = 0; j < 3; ++j)
+      ++verts[sptr->triangle[i].index[j]].num;
+  }
+  for (i = 0, n = 0; i < num_verts; ++i)
+  {
+    verts[i].first = n;
+    n += verts[i].num;
+    verts[i].remaining = 0;
+    verts[i].cache_pos = -1;
+  }
+  for (i = 0; i < num_tris; ++i)
+  {
+    for (j = 0; j < 3; ++j)
+    {
+      v = &verts[sptr->triangle[i].index[j]];
+      adjacent[v->first + v->remaining++] = i;
+    }
+  }
+
+  for (i = 0; i < num_verts; ++i)
+    verts[i].score = vcache_score(&verts[i]);
+  for (i = 0; i < num_tris; ++i)
+  {
+    tri_score[i] = 0;
+    for (j = 0; j < 3; ++j)
+      tri_score[i] += verts[sptr->triangle[i].index[j]].score;
+  }
+
+  for (n = 0; n < num_tris; ++n)
+  {
+    /* nothing in the cache to go on; start with the best of the rest */
+    if (best < 0)
+    {
+      best_score = -1.0f;
+      for (; scan < num_tris; ++scan)
+      {
+        if (!drawn[scan])
+          break;
+      }
+      for (i = scan; i < num_tris; ++i)
+      {
+        if (!drawn[i] && (tri_score[i] > best_score))
+        {
+          best_score = tri_score[i];
+          best = i;
+        }
+      }
+    }
+
+    order[n] = best;
+    drawn[best] = 1;
+
+    /* its vertices go to the front of the cache, with one less triangle to draw */
+    new_size = 0;
+    for (j = 0; j < 3; ++j)
+    {
+      v = &verts[sptr->triangle[best].index[j]];
+      new_cache[new_size++] = sptr->triangle[best].index[j];
+
+      for (k = v->first; k < (v->first + v->remaining); ++k)
+      {
+        if (adjacent[k] == best)
+        {
+          adjacent[k] = adjacent[v->first + v->remaining - 1];
+          adjacent[v->first + v->remaining - 1] = best;
+          --v->remaining;
+          break;
+        }
+      }
+    }
+    for (i = 0; i < cache_size; ++i)
+    {
+      if ((cache[i] != new_cache[0]) && (cache[i] != new_cache[1]) && (cache[i] != new_cache[2]))
+        new_cache[new_size++] = cache[i];
+    }
+
+    /* those pushed out of the cache score again too */
+    for (i = VCACHE_SIZE; i < new_size; ++i)
+    {
+      v = &verts[new_cache[i]];
+      v->cache_pos = -1;
+      v->score = vcache_score(v);
+    }
+    cache_size = ((new_size < VCACHE_SIZE) ? new_size : VCACHE_SIZE);
+    for (i = 0; i < cache_size; ++i)
+    {
+      cache[i] = new_cache[i];
+      v = &verts[cache[i]];
+      v->cache_pos = i;
+      v->score = vcache_score(v);
+    }
+
+    /* rescore the triangles left in the cache and take the best */
+    best = -1;
+    best_score = -1.0f;
+    for (i = 0; i < cache_size; ++i)
+    {
+      v = &verts[cache[i]];
+      for (k = v->first; k < (v->first + v->remaining); ++k)
+      {
+        t = adjacent[k];
+        tri_score[t] = (verts[sptr->triangle[t].index[0]].score +
+                        verts[sptr->triangle[t].index[1]].score +
+                        verts[sptr->triangle[t].index[2]].score);
+        if (tri_score[t] > best_score)
+        {
+          best_score = tri_score[t];
+          best = t;
+        }
+      }
+    }
+  }
+
+  free(verts);
+  free(adjacent);
+  free(tri_score);
+  free(drawn);
+
+  return 1;
+}
+
+/*
+ *	How much drawing a vertex next is worth.
+ */
+static float
+vcache_score(struct vcache_vertex_t* v)
+{
+  float score = 0.0f;
+
+  if (!v->remaining)
+    /* nothing left to draw with it */
+    return -1.0f;
+
+  if (v->cache_pos >= 0)
+  {
+    if (v->cache_pos < 3)
+      /* used by the last triangle; a little less, so it is not drawn right back */
+      score = 0.75f;
+    else
+      score = powf((1.0f - ((float)(v->cache_pos - 3) / (VCACHE_SIZE - 3))), 1.5f);
+  }
+
+  /* the fewer triangles left, the sooner they should be drawn */
+  return (score + (2.0f / sqrtf((float)v->remaining)));
+}
+
+/*
+ *	Split the order into runs where every vertex of a triangle
+ *	misses the cache, and sort the runs by how much they face out.
+ */
+static void
+vcache_overdraw(md3_surface_t* sptr, int* order)
+{
+  struct vcache_cluster_t* clusters = (struct vcache_cluster_t*)malloc(sizeof(struct vcache_cluster_t) * sptr->num_triangles);
+  float (*centroid)[3] = (float (*)[3])malloc(sizeof(float) * 3 * sptr->num_triangles);
+  float (*normal)[3] = (float (*)[3])malloc(sizeof(float) * 3 * sptr->num_triangles);
+  int* sorted = (int*)malloc(sizeof(int) * sptr->num_triangles);
+  md3_vertex_t* vptr = NULL;
+  float p[3][3];
+  float mid[3] = {0, 0, 0};
+  float e1[3], e2[3], n[3];
+  float area = 0;
+  float total = 0;
+  float len;
+  int fifo[VCACHE_FIFO_SIZE];
+  int head = 0;
+  int size = 0;
+  int num = 0;
+  int misses, i, j, c;
+
+  memset(centroid, 0, (sizeof(float) * 3 * sptr->num_triangles));
+  memset(normal, 0, (sizeof(float) * 3 * sptr->num_triangles));
+
+  for (i = 0; i < sptr->num_triangles; ++i)
+  {
+    for (j = 0, misses = 0; j < 3; ++j)
+    {
+      vptr = &sptr->vertex[sptr->triangle[order[i]].index[j]];
+      p[j][0] = (float)vptr->x;
+      p[j][1] = (float)vptr->y;
+      p[j][2] = (float)vptr->z;
+      misses += vcache_fifo_miss(fifo, &head, &size, sptr->triangle[order[i]].index[j]);
+    }
+
+    if (!i || (misses == 3))
+    {
+      clusters[num].first = i;
+      clusters[num].num = 0;
+      clusters[num].area = 0.0f;
+      ++num;
+    }
+    c = (num - 1);
+    ++clusters[c].num;
+
+    /* md3 triangles wind clockwise seen from the front */
+    for (j = 0; j < 3; ++j)
+    {
+      e1[j] = (p[1][j] - p[0][j]);
+      e2[j] = (p[2][j] - p[0][j]);
+    }
+    n[0] = ((e2[1] * e1[2]) - (e2[2] * e1[1]));
+    n[1] = ((e2[2] * e1[0]) - (e2[0] * e1[2]));
+    n[2] = ((e2[0] * e1[1]) - (e2[1] * e1[0]));
+    area = sqrtf((n[0] * n[0]) + (n[1] * n[1]) + (n[2] * n[2]));
+
+    /* sums of the normals and area weighted centres */
+    for (j = 0; j < 3; ++j)
+    {
+      normal[c][j] += n[j];
+      centroid[c][j] += ((area * (p[0][j] + p[1][j] + p[2][j])) / 3.0f);
+      mid[j] += ((area * (p[0][j] + p[1][j] + p[2][j])) / 3.0f);
+    }
+    clusters[c].area += area;
+    total += area;
+  }
+
+  if ((num < 2) || (total <= 0.0f))
+  {
+    free(clusters);
+    free(centroid);
+    free(normal);
+    free(sorted);
+    return;
+  }
+
+  for (j = 0; j < 3; ++j)
+    mid[j] /= total;
+
+  /* how far out from the middle the run is, along the way it faces */
+  for (c = 0; c < num; ++c)
+  {
+    for (j = 0, area = 0, len = 0; j < 3; ++j)
+    {
+      area += (normal[c][j] * normal[c][j]);
+      len += (normal[c][j] * centroid[c][j]);
+    }
+    area = sqrtf(area);
+
+    clusters[c].key = 0.0f;
+    if ((area > 0.0f) && (clusters[c].area > 0.0f))
+    {
+      clusters[c].key = (len / (clusters[c].area * area));
+      for (j = 0; j < 3; ++j)
+        clusters[c].key -= ((normal[c][j] * mid[j]) / area);
+    }
+  }
+
+  qsort(clusters, num, sizeof(struct vcache_cluster_t), vcache_cluster_cmp);
+
+  for (c = 0, i = 0; c < num; ++c)
+  {
+    for (j = 0; j < clusters[c].num; ++j)
+      sorted[i++] = order[clusters[c].first + j];
+  }
+  memcpy(order, sorted, (sizeof(int) * sptr->num_triangles));
+
+  free(clusters);
+  free(centroid);
+  free(normal);
+  free(sorted);
+}
+
+/*
+ *	Put the triangles in order and number the vertices in the order
+ *	they are first used, moving their data in every frame to match.
+ *	Vertices no triangle uses go last.
+ */
+static void
+vcache_renumber(md3_surface_t* sptr, int* order)
+{
+  int num_verts = sptr->num_verts;
+  int* remap = (int*)malloc(sizeof(int) * num_verts);
+  md3_triangle_t* tris = (md3_triangle_t*)malloc(sizeof(md3_triangle_t) * sptr->num_triangles);
+  md3_texcoord_t* st = (md3_texcoord_t*)malloc(sizeof(md3_texcoord_t) * num_verts);
+  md3_vertex_t* vertex = (md3_vertex_t*)malloc(sizeof(md3_vertex_t) * num_verts * sptr->num_frames);
+  int next = 0;
+  int i, j, f, v;
+
+  for (i = 0; i < num_verts; ++i)
+    remap[i] = -1;
+
+  for (i = 0; i < sptr->num_triangles; ++i)
+  {
+    for (j = 0; j < 3; ++j)
+    {
+      v = sptr->triangle[order[i]].index[j];
+      if (remap[v] < 0)
+        remap[v] = next++;
+      tris[i].index[j] = remap[v];
+    }
+  }
+  for (i = 0; i < num_verts; ++i)
+  {
+    if (remap[i] < 0)
+      remap[i] = next++;
+  }
+
+  for (i = 0; i < num_verts; ++i)
+  {
+    st[remap[i]] = sptr->st[i];
+    for (f = 0; f < sptr->num_frames; ++f)
+      vertex[(f * num_verts) + remap[i]] = sptr->vertex[(f * num_verts) + i];
+  }
+
+  free(sptr->triangle);
+  free(sptr->st);
+  free(sptr->vertex);
+  sptr->triangle = tris;
+  sptr->st = st;
+  sptr->vertex = vertex;
+
+  free(remap);
+}
+
+/*
+ *	Use a vertex through a FIFO cache.
+ *	Returns 1 if it had to be transformed.
+ */
+static int
+vcache_fifo_miss(int* fifo, int* head, int* size, int v)
+{
+  int i = 0;
+
+  for (; i < *size; ++i)
+  {
+    if (fifo[i] == v)
+      return 0;
+  }
+
+  fifo[*head] = v;
+  *head = ((*head + 1) % VCACHE_FIFO_SIZE);
+  if (*size < VCACHE_FIFO_SIZE)
+    ++*size;
+
+  return 1;
+}
+
+/*
+ *	qsort() callback; the runs facing out most first, then in
+ *	their cache order.
+ */
+static int
+vcache_cluster_cmp(const void* a, const void* b)
+{
+  const struct vcache_cluster_t* ca = (const struct vcache_cluster_t*)a;
+  const struct vcache_cluster_t* cb = (const struct vcache_cluster_t*)b;
+
+  if (ca->key != cb->key)
+    return ((ca->key < cb->key) - (ca->key > cb->key));
+  return (ca->first - cb->first);
+}
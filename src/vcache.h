@@ -0,0 +1,73 @@
+/*
+ *	This file is part of MenderD3
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _VCACHE_H
+#define _VCACHE_H
+
+#include "md3_parse.h"
+
+/*
+ *	Triangle order for the post-transform vertex cache.
+ *
+ *	vcache_optimize() reorders the triangles of a surface so each
+ *	vertex is reused while still in the cache, with Tom Forsyth's
+ *	"Linear-Speed Vertex Cache Optimisation", scored for an LRU cache
+ *	of VCACHE_SIZE vertices.  The vertices are then renumbered in the
+ *	order the triangles first use them, in every frame, so they are
+ *	fetched in order too.
+ *
+ *	vcache_measure() simulates a FIFO cache of VCACHE_FIFO_SIZE
+ *	vertices, as GPUs have, to count how often vertices are
+ *	transformed:
+ *
+ *		ACMR	transforms per triangle; 0.5 at best, 3 at worst
+ *		ATVR	transforms per vertex; 1 at best
+ *
+ *	check_vcache() prints both for every bundled model, before and
+ *	after.
+ */
+
+#define VCACHE_SIZE 32
+#define VCACHE_FIFO_SIZE 16
+
+/*
+ *	What vcache_measure() counted.
+ */
+struct vcache_stats_t
+{
+  int triangles;
+  int vertices;   /* used by the triangles	*/
+  int transforms; /* cache misses			*/
+};
+
+#define VCACHE_ACMR(s) ((s)->triangles ? ((float)(s)->transforms / (s)->triangles) : 0.0f)
+#define VCACHE_ATVR(s) ((s)->vertices ? ((float)(s)->transforms / (s)->vertices) : 0.0f)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  int vcache_optimize(md3_surface_t* sptr, int overdraw);
+  void vcache_measure(md3_surface_t* sptr, struct vcache_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _VCACHE_H */
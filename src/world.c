@@ -30,35 +30,90 @@
  *		unloaded as it is no longer referenced by anything in the world.
  *
  *	MODELS
- *		All models are given to the world.
+ *		Model data is shared the same way as textures.  Each model file is only
+ *		loaded once and every instance of it points to the same data.  The
+ *		number of instances using the data is kept track of by calling
+ *		world_using_model() and world_not_using_model(), and the data is
+ *		unloaded once the last instance is gone.
  *
- *	The world will deallocate everything it is given, including models and textures.
+ *	CACHE
+ *		Models and textures live in a cache that several worlds may share,
+ *		for example one per thread rendering on its own.  The cache has a
+ *		lock of its own; everything else in a world belongs to the thread
+ *		using it, and nothing in the engine reaches for a global world.
+ *		The GL textures and buffers are the world's, made in its own context
+ *		(see world_gl_t), and a model is only shared between loads with the
+ *		same WORLD_LOAD_FLAGS.
+ *
+ *	INSTANCES
+ *		All model instances are given to the world.
+ *		An instance holds the animation state, rotation, scale and links
+ *		of one body part.
+ *
+ *	SIMULATION
+ *		When the simulation thread runs it owns the animation state, rotation
+ *		and scale of the instances.  The functions changing those queue the
+ *		change for it instead when called from another thread; see sim.h.
+ *
+ *	The world will deallocate everything it is given, including instances, models and textures.
  */
 
 #include <stdio.h>
 #include <malloc.h>
 #include <string.h>
+#include <math.h>
 #include "md3_parse.h"
 #include "tga.h"
 #include "util.h"
+#include "thread.h"
+#include "prof.h"
+#include "trace.h"
+#include "sim.h"
+#include "anim_sched.h"
+#include "gl_ext.h"
 #include "world.h"
 
-/* global world object */
-struct world_t* g_world = NULL;
-
-static int get_next_frame(md3_anim_state_t* as);
-static void _rotate_model(md3_body_parts_e type, int axis, float degree, int absolute);
+static int get_next_frame(struct world_t* wptr, md3_instance_t* m);
+static int world_blend_model(struct world_t* wptr, md3_instance_t* m, double now);
+static void world_advance_model(struct world_t* wptr, md3_instance_t* m, double now);
+static float world_anim_budget(struct world_t* wptr, md3_instance_t* m);
+static int world_anim_level(struct world_t* wptr, md3_instance_t* m);
+static int world_anim_due(struct world_t* wptr, md3_instance_t* m, double now, int level, double* next);
+static void _rotate_model(struct world_t* wptr, md3_body_parts_e type, int axis, float degree, int absolute);
+static unsigned int* world_gl_slot(unsigned int** names, int* num, int slot, int per);
+static void world_cache_lock(struct world_cache_t* cache);
 
 /*
  *	Construct and return a new world object.
+ *
+ *	Worlds given the same cache share the model data and textures
+ *	they load; with NULL the world gets a cache of its own.
  */
 struct world_t*
-world_init()
+world_init(struct world_cache_t* cache)
 {
   struct world_t* w = (struct world_t*)malloc(sizeof(struct world_t));
   memset(w, 0, sizeof(struct world_t));
 
+  if (!cache)
+  {
+    cache = (struct world_cache_t*)malloc(sizeof(struct world_cache_t));
+    memset(cache, 0, sizeof(struct world_cache_t));
+    mutex_init(&cache->lock);
+  }
+
+  world_cache_lock(cache);
+  cache->worlds++;
+  mutex_unlock(&cache->lock);
+  w->cache = cache;
+
   w->flags = WORLD_DEFAULT_FLAGS;
+  w->anim_flags = (w->flags & WORLD_ANIM_FLAGS);
+  w->lod_level = -1;
+  w->anim_budget = ANIM_LOD_BUDGET;
+
+  /* the crowd draws with the world's options */
+  w->crowd.world = w;
 
   /* setup the camera */
   init_camera(&w->camera);
@@ -74,80 +129,140 @@ world_init()
 
 /*
  *	Deallocate the world...
+ *
+ *	The cache goes with the last world using it.
  */
 void
 world_free(struct world_t* wptr)
 {
-  struct world_link_models_t* mnext = NULL;
+  struct world_cache_t* cache = wptr->cache;
+  struct world_link_instances_t* inext = NULL;
+  struct world_model_t* mnext = NULL;
   struct world_texture_t* tnext = NULL;
+  struct mirror_t* mirror = NULL;
+  int worlds;
+
+  /* stop the simulation before freeing what it works on */
+  sim_free(wptr->sim);
+
+  free(wptr->clock.script);
+
+  /* free the crowd first, its members use the cached models */
+  crowd_free(&wptr->crowd);
+
+  /* free all the instances */
+  while (wptr->instances)
+  {
+    inext = wptr->instances->next;
+    md3_free_instance(wptr, wptr->instances->instance);
+    wptr->instances = inext;
+  }
+  anim_sched_free(&wptr->sched);
+
+  while (wptr->mirrors)
+  {
+    mirror = wptr->mirrors->next;
+    free(wptr->mirrors);
+    wptr->mirrors = mirror;
+  }
+
+  world_cache_lock(cache);
+  worlds = --cache->worlds;
+  mutex_unlock(&cache->lock);
 
-  /* free all the models */
-  while (wptr->models)
+  /* free any model data still cached */
+  while (!worlds && cache->models)
   {
-    mnext = wptr->models->next;
-    md3_unload_model(wptr->models->model);
-    wptr->models = mnext;
+    md3_unload_model(wptr, cache->models->model);
+    free(cache->models->name);
+
+    mnext = cache->models->next;
+    free(cache->models);
+    cache->models = mnext;
+  }
+
+  /* the GL objects this world made; its context must be current */
+  if (wptr->objects.num_texts)
+    glDeleteTextures(wptr->objects.num_texts, wptr->objects.texts);
+  if (wptr->objects.num_buffers)
+    glDeleteBuffers((wptr->objects.num_buffers * 3), wptr->objects.buffers);
+  free(wptr->objects.texts);
+  free(wptr->objects.buffers);
+
+  if (worlds)
+  {
+    free(wptr);
+    return;
   }
 
   /* free all the textures */
-  while (wptr->texts)
+  while (cache->texts)
   {
-    free_tga(wptr->texts->text);
-    free(wptr->texts->name);
+    free_tga(cache->texts->text);
+    free(cache->texts->name);
 
-    tnext = wptr->texts->next;
-    free(wptr->texts);
-    wptr->texts = tnext;
+    tnext = cache->texts->next;
+    free(cache->texts);
+    cache->texts = tnext;
   }
 
+  mutex_destroy(&cache->lock);
+  free(cache);
   free(wptr);
 }
 
 /*
- *	Add a model to the world.
+ *	Add a model instance to the world.
  */
 void
-world_add_model(struct world_t* wptr, md3_model_t* mptr, int root)
+world_add_instance(struct world_t* wptr, md3_instance_t* iptr, int root)
 {
-  struct world_link_models_t* add = (struct world_link_models_t*)malloc(sizeof(struct world_link_models_t));
-  memset(add, 0, sizeof(struct world_link_models_t));
+  struct world_link_instances_t* add = (struct world_link_instances_t*)malloc(sizeof(struct world_link_instances_t));
+  memset(add, 0, sizeof(struct world_link_instances_t));
 
-  add->model = mptr;
+  add->instance = iptr;
 
   /* add to front of list */
-  add->next = wptr->models;
-  wptr->models = add;
-  wptr->model_triangles += add->model->total_triangles;
+  add->next = wptr->instances;
+  wptr->instances = add;
+  wptr->model_triangles += add->instance->model->total_triangles;
 
-  /* set as root model if needed */
+  /* set as root instance if needed */
   if (root)
-    wptr->root_model = add->model;
+    wptr->root_instance = add->instance;
+
+  /* its animation is ticked with the world's */
+  anim_sched_add(&wptr->sched, iptr);
+
+  /* the crowd copies the root tree, it must be rebuilt */
+  wptr->crowd.stale = 1;
 }
 
 /*
- *	Delete the model from the world.
- *	Actual deallocate of the model is done my md3_unload_model()
+ *	Delete the model instance from the world.
+ *	Actual deallocate of the instance is done my md3_free_instance()
  */
 void
-world_del_model(struct world_t* wptr, md3_model_t* mptr)
+world_del_instance(struct world_t* wptr, md3_instance_t* iptr)
 {
-  struct world_link_models_t* del = wptr->models;
-  struct world_link_models_t* last = NULL;
+  struct world_link_instances_t* del = wptr->instances;
+  struct world_link_instances_t* last = NULL;
   while (del)
   {
-    if (del->model == mptr)
+    if (del->instance == iptr)
     {
       /* delink this one */
       if (last)
         last->next = del->next;
 
       /* if this thing was the root set the root to be the next */
-      if (wptr->root_model == mptr)
-        wptr->root_model = (del->next ? del->next->model : NULL);
-      if (wptr->models == del)
-        wptr->models = del->next;
+      if (wptr->root_instance == iptr)
+        wptr->root_instance = (del->next ? del->next->instance : NULL);
+      if (wptr->instances == del)
+        wptr->instances = del->next;
 
-      wptr->model_triangles -= del->model->total_triangles;
+      wptr->model_triangles -= del->instance->model->total_triangles;
+      wptr->crowd.stale = 1;
 
       free(del);
       return;
@@ -158,41 +273,174 @@ world_del_model(struct world_t* wptr, md3_model_t* mptr)
 }
 
 /*
- *	Link a model from the others.
+ *	Link a model instance from the others.
  */
 void
-world_link_model(struct world_t* wptr, md3_model_t* mptr)
+world_link_instance(struct world_t* wptr, md3_instance_t* iptr)
 {
-  struct world_link_models_t* lm = wptr->models;
-  if (!mptr)
+  struct world_link_instances_t* li = wptr->instances;
+  if (!iptr)
     return;
-  while (lm)
+  while (li)
   {
-    if (md3_link_models(lm->model, mptr))
+    if (md3_link_instances(li->instance, iptr))
       break;
-    lm = lm->next;
+    li = li->next;
   }
 }
 
 /*
- *	Delink a model from the others.
+ *	Delink a model instance from the others.
  */
 void
-world_delink_model(struct world_t* wptr, md3_model_t* mptr)
+world_delink_instance(struct world_t* wptr, md3_instance_t* iptr)
 {
-  struct world_link_models_t* lm = wptr->models;
-  if (!mptr)
+  struct world_link_instances_t* li = wptr->instances;
+  if (!iptr)
     return;
-  while (lm)
+  while (li)
+  {
+    if (md3_unlink_instances(li->instance, iptr))
+      break;
+    li = li->next;
+  }
+}
+
+/*
+ *	Cache model data.
+ *
+ *	name is the key the model is found by in world_model_cached(),
+ *	along with the world's WORLD_LOAD_FLAGS it was loaded with.
+ *	Two threads missing the cache at once may both load and add the
+ *	same file; each keeps its own copy, which is wasteful but safe.
+ */
+void
+world_add_model(struct world_t* wptr, md3_model_t* mptr, char* name)
+{
+  struct world_model_t* add = (struct world_model_t*)malloc(sizeof(struct world_model_t));
+  md3_surface_t* sptr = NULL;
+
+  add->model = mptr;
+  add->name = strdup(name);
+  add->options = (wptr->flags & WORLD_LOAD_FLAGS);
+  add->binds = 1;
+
+  /* add to front of list */
+  world_cache_lock(wptr->cache);
+  for (sptr = mptr->surface_ptr; sptr; sptr = sptr->next)
+    sptr->gl_slot = wptr->cache->surface_slots++;
+  add->next = wptr->cache->models;
+  wptr->cache->models = add;
+  mutex_unlock(&wptr->cache->lock);
+}
+
+/*
+ *	Tell the world another instance needs this model data.
+ */
+void
+world_using_model(struct world_t* wptr, md3_model_t* mptr)
+{
+  struct world_model_t* m = NULL;
+
+  world_cache_lock(wptr->cache);
+  for (m = wptr->cache->models; m; m = m->next)
+  {
+    if (m->model == mptr)
+    {
+      /* model found */
+      m->binds++;
+
+#ifdef _DEBUG
+      printf("Model \"%s\" now being used by %i instances.\n", m->name, m->binds);
+#endif
+
+      break;
+    }
+  }
+  mutex_unlock(&wptr->cache->lock);
+}
+
+/*
+ *	Tell the world some instance that was using this model data no longer needs it.
+ */
+void
+world_not_using_model(struct world_t* wptr, md3_model_t* mptr)
+{
+  struct world_model_t* m = NULL;
+  struct world_model_t* last = NULL;
+
+  world_cache_lock(wptr->cache);
+  for (m = wptr->cache->models; m; last = m, m = m->next)
+  {
+    if (m->model == mptr)
+    {
+      /* model found */
+      m->binds--;
+
+#ifdef _DEBUG
+      printf("Model \"%s\" now being used by %i instances.\n", m->name, m->binds);
+#endif
+
+      if (m->binds)
+        m = NULL;
+      else
+      {
+        /* no instances are using this model anymore, delink it */
+        if (last)
+          last->next = m->next;
+        if (wptr->cache->models == m)
+          wptr->cache->models = m->next;
+      }
+
+      break;
+    }
+  }
+  mutex_unlock(&wptr->cache->lock);
+
+  /* kill it; unloading releases its textures, which takes the lock again */
+  if (m)
+  {
+    md3_unload_model(wptr, m->model);
+    free(m->name);
+    free(m);
+  }
+}
+
+/*
+ *	Check to see if model data has already been
+ *	added to the world, loaded with the world's
+ *	WORLD_LOAD_FLAGS.
+ *
+ *	Returns pointer to md3_model_t structure if it exists,
+ *	and the caller then holds a reference to it as if it had
+ *	called world_using_model().
+ */
+md3_model_t*
+world_model_cached(struct world_t* wptr, char* name)
+{
+  struct world_model_t* m = NULL;
+  md3_model_t* model = NULL;
+
+  world_cache_lock(wptr->cache);
+  for (m = wptr->cache->models; m; m = m->next)
   {
-    if (md3_unlink_models(lm->model, mptr))
+    if (!strcmp(name, m->name) && (m->options == (wptr->flags & WORLD_LOAD_FLAGS)))
+    {
+      m->binds++;
+      model = m->model;
       break;
-    lm = lm->next;
+    }
   }
+  mutex_unlock(&wptr->cache->lock);
+
+  return model;
 }
 
 /*
  *	Cache a texture.
+ *
+ *	Like models a texture may be added twice when two threads
+ *	load it at once.
  */
 void
 world_add_texture(struct world_t* wptr, struct tga_t* tptr, char* name, md3_shader_t* sptr)
@@ -202,27 +450,28 @@ world_add_texture(struct world_t* wptr, struct tga_t* tptr, char* name, md3_shad
   add->text = tptr;
   add->name = strdup(name);
   add->binds = 1;
-  add->gl_text_id = 0;
-  add->gl_text_bound = 0;
-
-  if (sptr)
-  {
-    sptr->gl_text_id = &add->gl_text_id;
-    sptr->gl_text_bound = &add->gl_text_bound;
-  }
 
   /* add to front of list */
-  add->next = wptr->texts;
-  wptr->texts = add;
+  world_cache_lock(wptr->cache);
+  add->slot = wptr->cache->text_slots++;
+  if (sptr)
+    sptr->gl_slot = add->slot;
+  add->next = wptr->cache->texts;
+  wptr->cache->texts = add;
+  mutex_unlock(&wptr->cache->lock);
 }
 
 /*
  *	Delete the texture from the world.
+ *
+ *	The caller holds the cache lock.  Only the caller's world's GL
+ *	texture is deleted; other worlds sharing the cache delete theirs
+ *	when they are freed, as their contexts may not be current.
  */
-void
+static void
 world_del_texture(struct world_t* wptr, struct tga_t* text)
 {
-  struct world_texture_t* del = wptr->texts;
+  struct world_texture_t* del = wptr->cache->texts;
   struct world_texture_t* last = NULL;
   while (del)
   {
@@ -231,18 +480,24 @@ world_del_texture(struct world_t* wptr, struct tga_t* text)
       /* delink this one */
       if (last)
         last->next = del->next;
-      if (wptr->texts == del)
-        wptr->texts = del->next;
+      if (wptr->cache->texts == del)
+        wptr->cache->texts = del->next;
 
 #ifdef _DEBUG
-      printf("Texture \"%s\" deleted (GL unbind id %i).\n", del->name, del->gl_text_id);
+      printf("Texture \"%s\" deleted (slot %i).\n", del->name, del->slot);
 #endif
 
       /* tell GL to unbind the texture */
-      glDeleteTextures(1, &del->gl_text_id);
+      if ((del->slot < wptr->objects.num_texts) && wptr->objects.texts[del->slot])
+      {
+        glDeleteTextures(1, &wptr->objects.texts[del->slot]);
+        wptr->objects.texts[del->slot] = 0;
+        gl_state_forget(&wptr->gl, GL_STATE_TEXTURE);
+      }
 
       /* unload the texture */
       free_tga(del->text);
+      free(del->name);
       free(del);
 
       return;
@@ -258,9 +513,10 @@ world_del_texture(struct world_t* wptr, struct tga_t* text)
 void
 world_using_texture(struct world_t* wptr, struct tga_t* text)
 {
-  struct world_texture_t* t = wptr->texts;
+  struct world_texture_t* t = NULL;
 
-  while (t)
+  world_cache_lock(wptr->cache);
+  for (t = wptr->cache->texts; t; t = t->next)
   {
     if (t->text == text)
     {
@@ -271,10 +527,10 @@ world_using_texture(struct world_t* wptr, struct tga_t* text)
       printf("Texture \"%s\" now being used by %i models.\n", t->name, t->binds);
 #endif
 
-      return;
+      break;
     }
-    t = t->next;
   }
+  mutex_unlock(&wptr->cache->lock);
 }
 
 /*
@@ -283,9 +539,10 @@ world_using_texture(struct world_t* wptr, struct tga_t* text)
 void
 world_not_using_texture(struct world_t* wptr, struct tga_t* text)
 {
-  struct world_texture_t* t = wptr->texts;
+  struct world_texture_t* t = NULL;
 
-  while (t)
+  world_cache_lock(wptr->cache);
+  for (t = wptr->cache->texts; t; t = t->next)
   {
     if (t->text == text)
     {
@@ -300,75 +557,145 @@ world_not_using_texture(struct world_t* wptr, struct tga_t* text)
         /* no models are using this texture anymore, kill it */
         world_del_texture(wptr, text);
 
-      return;
+      break;
     }
-    t = t->next;
   }
+  mutex_unlock(&wptr->cache->lock);
 }
 
 /*
  *	Check to see if a texture has already been
  *	added to the world.
  *
- *	Returns pointer to tga_t structure if it exists.
+ *	Returns pointer to tga_t structure if it exists,
+ *	and the caller then holds a reference to it as if it had
+ *	called world_using_texture().
  */
 struct tga_t*
 world_texture_cached(struct world_t* wptr, char* name, md3_shader_t* sptr)
 {
-  struct world_texture_t* t = wptr->texts;
+  struct world_texture_t* t = NULL;
+  struct tga_t* text = NULL;
 
-  while (t)
+  world_cache_lock(wptr->cache);
+  for (t = wptr->cache->texts; t; t = t->next)
   {
     if (!strcmp(name, t->name))
     {
       /* texture found */
       if (sptr)
-      {
-        sptr->gl_text_id = &t->gl_text_id;
-        sptr->gl_text_bound = &t->gl_text_bound;
-      }
+        sptr->gl_slot = t->slot;
 
-      return t->text;
+      t->binds++;
+      text = t->text;
+      break;
     }
-    t = t->next;
   }
+  mutex_unlock(&wptr->cache->lock);
 
-  return NULL;
+  return text;
 }
 
 /*
- *	Return the model structure for the assoicated model name.
+ *	The GL name of a shader's texture in this world,
+ *	0 if it has none or apply_texture() has not made it yet.
  */
-md3_model_t*
-world_get_model_by_name(char* name)
+unsigned int
+world_texture_name(struct world_t* wptr, md3_shader_t* sptr)
+{
+  if (!sptr->texture || (sptr->gl_slot < 0) || (sptr->gl_slot >= wptr->objects.num_texts))
+    return 0;
+
+  return wptr->objects.texts[sptr->gl_slot];
+}
+
+/*
+ *	The vertex, texcoord and index buffers of a surface in this
+ *	world, 0 until made, for the caller to make; NULL if the surface
+ *	is not cached.  The pointer is good until the next call.
+ */
+unsigned int*
+world_surface_buffers(struct world_t* wptr, md3_surface_t* sptr)
+{
+  if (sptr->gl_slot < 0)
+    return NULL;
+
+  return world_gl_slot(&wptr->objects.buffers, &wptr->objects.num_buffers, sptr->gl_slot, 3);
+}
+
+/*
+ *	The per names of a slot in one of a world's tables of GL
+ *	names, growing the table to hold the slot; new names are 0.
+ */
+static unsigned int*
+world_gl_slot(unsigned int** names, int* num, int slot, int per)
+{
+  int size = *num;
+
+  if (slot >= size)
+  {
+    while (size <= slot)
+      size = (size ? (size * 2) : 16);
+
+    *names = (unsigned int*)realloc(*names, (sizeof(unsigned int) * per * size));
+    memset(&(*names)[*num * per], 0, (sizeof(unsigned int) * per * (size - *num)));
+    *num = size;
+  }
+
+  return &(*names)[slot * per];
+}
+
+/*
+ *	Take the lock of a cache, counting the times it was taken by
+ *	another thread and how long it was waited for.
+ */
+static void
+world_cache_lock(struct world_cache_t* cache)
+{
+  double start;
+
+  if (mutex_trylock(&cache->lock))
+    return;
+
+  start = get_time_in_ms();
+  mutex_lock(&cache->lock);
+  cache->lock_waits++;
+  cache->lock_wait_ms += (get_time_in_ms() - start);
+}
+
+/*
+ *	Return the instance for the assoicated model name.
+ */
+md3_instance_t*
+world_get_instance_by_name(struct world_t* wptr, char* name)
 {
-  struct world_link_models_t* wmodel = g_world->models;
-  while (wmodel)
+  struct world_link_instances_t* winst = wptr->instances;
+  while (winst)
   {
-    if (!strcmp(wmodel->model->model_name, name))
-      return wmodel->model;
-    wmodel = wmodel->next;
+    if (!strcmp(winst->instance->model_name, name))
+      return winst->instance;
+    winst = winst->next;
   }
   return NULL;
 }
 
 /*
- *	Return the model structure for the assoicated model type.
+ *	Return the instance for the assoicated model type.
  *	Type can be:
  *		MD3_HEAD
  *		MD3_TORSO
  *		MD3_LEGS
  *		MD3_WEAPON
  */
-md3_model_t*
-world_get_model_by_type(md3_body_parts_e type)
+md3_instance_t*
+world_get_instance_by_type(struct world_t* wptr, md3_body_parts_e type)
 {
-  struct world_link_models_t* wmodel = g_world->models;
-  while (wmodel)
+  struct world_link_instances_t* winst = wptr->instances;
+  while (winst)
   {
-    if (wmodel->model->body_part == type)
-      return wmodel->model;
-    wmodel = wmodel->next;
+    if (winst->instance->body_part == type)
+      return winst->instance;
+    winst = winst->next;
   }
   return NULL;
 }
@@ -377,10 +704,14 @@ world_get_model_by_type(md3_body_parts_e type)
  *	Set the animation for the model.
  */
 void
-set_model_animation(md3_animations_e id)
+set_model_animation(struct world_t* wptr, md3_animations_e id)
 {
   md3_anim_names_t* inf = NULL;
-  md3_model_t* m = NULL;
+  md3_instance_t* m = NULL;
+
+  if (sim_post(wptr->sim, SIM_ANIMATION, id, 0, 0.0f))
+    return;
+  world_redraw(wptr);
 
 #if 0
 	if (id == NO_ANIM) {
@@ -397,36 +728,83 @@ set_model_animation(md3_animations_e id)
   /* body */
   if ((inf->flags & ANIM_BODY) == ANIM_BODY)
   {
-    /* get the model pointer */
-    m = world_get_model_by_type(MD3_TORSO);
+    /* get the instance pointer */
+    m = world_get_instance_by_type(wptr, MD3_TORSO);
 
-    if (!m)
+    if (!m || !m->model->anims)
       return;
 
-    m->anim_state.animated = 1;
-    m->anim_state.id = inf->id;
-
-    /* set starting frame for the animation */
-    m->anim_state.frame = g_world->anims[m->anim_state.id].first_frame;
-    m->anim_state.next_frame = get_next_frame(&m->anim_state);
+    world_set_instance_animation(wptr, m, inf->id, 0.0f);
   }
 
   /* legs */
   if ((inf->flags & ANIM_LEGS) == ANIM_LEGS)
   {
-    /* get the model pointer */
-    m = world_get_model_by_type(MD3_LEGS);
+    /* get the instance pointer */
+    m = world_get_instance_by_type(wptr, MD3_LEGS);
 
-    if (!m)
+    if (!m || !m->model->anims)
       return;
 
-    m->anim_state.animated = 1;
-    m->anim_state.id = inf->id;
+    world_set_instance_animation(wptr, m, inf->id, 0.0f);
+  }
+}
 
-    /* set starting frame for the animation */
-    m->anim_state.frame = g_world->anims[m->anim_state.id].first_frame;
-    m->anim_state.next_frame = get_next_frame(&m->anim_state);
+/*
+ *	Start an animation on a single instance.
+ *
+ *	phase is how far into the animation to start, from 0 to 1.
+ */
+void
+world_set_instance_animation(struct world_t* wptr, md3_instance_t* m, md3_animations_e id, float phase)
+{
+  md3_anim_t* anim = NULL;
+
+  if (!m->model->anims)
+    return;
+
+  anim = &m->model->anims[id];
+
+  m->anim_state.animated = 1;
+  m->anim_state.id = id;
+  m->anim_state.last_time = world_clock_now(wptr);
+  m->anim_state.t = 0;
+  m->anim_due = 0.0;
+  anim_sched_update(m);
+
+  /* set starting frame for the animation */
+  m->anim_state.frame = (anim->first_frame + (int)(phase * anim->frames));
+  if (m->anim_state.frame > anim->last_frame)
+    m->anim_state.frame = anim->last_frame;
+  m->anim_state.next_frame = get_next_frame(wptr, m);
+}
+
+/*
+ *	Pose an instance the given number of key frames into its
+ *	animation from the first frame, and stop it there.
+ *
+ *	The fraction is the blend towards the next key frame.
+ */
+void
+world_hold_instance_animation(struct world_t* wptr, md3_instance_t* m, float frames)
+{
+  md3_anim_t* anim = NULL;
+
+  if (!m->model->anims || !m->anim_state.animated)
+    return;
+
+  anim = &m->model->anims[m->anim_state.id];
+
+  m->anim_state.frame = anim->first_frame;
+  m->anim_state.next_frame = get_next_frame(wptr, m);
+  for (; frames >= 1.0f; frames -= 1.0f)
+  {
+    m->anim_state.frame = m->anim_state.next_frame;
+    m->anim_state.next_frame = get_next_frame(wptr, m);
   }
+
+  m->anim_state.t = frames;
+  m->anim_state.animated = 0;
 }
 
 /*
@@ -438,68 +816,246 @@ set_model_animation(md3_animations_e id)
  *		MD3_WEAPON
  */
 void
-world_stop_model_animation(int model_types)
+world_stop_model_animation(struct world_t* wptr, int model_types)
 {
-  struct world_link_models_t* lm = NULL;
-  md3_model_t* m = NULL;
+  struct world_link_instances_t* li = NULL;
+  md3_instance_t* m = NULL;
+
+  if (sim_post(wptr->sim, SIM_STOP_ANIMATION, model_types, 0, 0.0f))
+    return;
+  world_redraw(wptr);
 
-  /* iterate through each model */
-  lm = g_world->models;
-  while (lm)
+  /* iterate through each instance */
+  li = wptr->instances;
+  while (li)
   {
-    m = lm->model;
+    m = li->instance;
 
     if ((model_types & m->body_part) == m->body_part)
       /* this was selected for termination */
       m->anim_state.animated = 0;
 
-    lm = lm->next;
+    li = li->next;
   }
 }
 
 /*
- *	Update the animation state for the given model.
+ *	Update the animation state for the given model to the time now,
+ *	in milliseconds on the world's clock.
+ *
+ *	The state only depends on the time since the animation was set,
+ *	not on how often it is ticked.  Before its anim_due only the
+ *	blend moves; its scheduler, if it is in one, is kept in order.
  */
 void
-world_tick_model(md3_model_t* m)
+world_tick_model(struct world_t* wptr, md3_instance_t* m, double now)
 {
-  double now, elapsed, frame_duration;
-
   if (!m->anim_state.animated)
     /* if we are not in a state of animation t should not change */
     return;
 
-  now = get_time_in_ms();
+  if ((now < m->anim_due) && world_blend_model(wptr, m, now))
+    return;
+
+  world_advance_model(wptr, m, now);
+  anim_sched_update(m);
+}
+
+/*
+ *	Move the blend towards the next key frame, from the one time of
+ *	the frame; nothing else changes before the instance is due.
+ *
+ *	Returns 0 if the key frame is past after all, as when its
+ *	animation level of detail changed.
+ */
+static int
+world_blend_model(struct world_t* wptr, md3_instance_t* m, double now)
+{
+  double t;
+
+  /* held until its next update */
+  if (WORLD_ANIM_IS_SET(wptr, ENGINE_ANIM_LOD) && world_anim_level(wptr, m))
+    return 1;
+
+  t = (((now - m->anim_state.last_time) * m->model->anims[m->anim_state.id].fps) / 1000.0);
+  if (t >= 1.0)
+    return 0;
+
+#ifdef USE_INTERPOLATION
+  if (WORLD_ANIM_IS_SET(wptr, ENGINE_INTERPOLATE))
+    m->anim_state.t = ((t > 0.0) ? t : 0.0);
+#endif
+
+  return 1;
+}
+
+/*
+ *	Advance the key frames to the time now, and work out when the
+ *	instance is next due.
+ */
+static void
+world_advance_model(struct world_t* wptr, md3_instance_t* m, double now)
+{
+  md3_anim_t* anim = NULL;
+  double elapsed, frame_duration;
+  double next_slot = 0.0;
+  double start;
+  int frames;
+  int level = 0;
+
+  /* small on the screen; it may hold its pose this frame */
+  if (WORLD_ANIM_IS_SET(wptr, ENGINE_ANIM_LOD))
+  {
+    level = world_anim_level(wptr, m);
+    if (level && !world_anim_due(wptr, m, now, level, &next_slot))
+    {
+      m->anim_due = next_slot;
+      return;
+    }
+  }
+
+  start = prof_begin();
+  anim = &m->model->anims[m->anim_state.id];
   elapsed = (now - m->anim_state.last_time);
-  frame_duration = (1000.0 / g_world->anims[m->anim_state.id].fps);
+  frame_duration = (1000.0 / anim->fps);
+
+  /* a frame from before the animation was set */
+  if (elapsed < 0.0)
+    elapsed = 0.0;
+
+  if (elapsed >= frame_duration)
+  {
+    /* tick to the key frame now is in, keeping the remainder */
+    frames = (int)(elapsed / frame_duration);
+    m->anim_state.last_time += (frames * frame_duration);
+    elapsed -= (frames * frame_duration);
+
+    /* further behind than the animation is long, as after the window was hidden */
+    if (frames > anim->frames)
+      frames = anim->frames;
+
+    for (; frames > 0; --frames)
+    {
+      m->anim_state.frame = m->anim_state.next_frame;
+      m->anim_state.next_frame = get_next_frame(wptr, m);
+    }
+    m->anim_state.t = 0;
+  }
 
 #ifdef USE_INTERPOLATION
-  if (WORLD_IS_SET(ENGINE_INTERPOLATE))
+  if (WORLD_ANIM_IS_SET(wptr, ENGINE_INTERPOLATE))
     m->anim_state.t = (elapsed / frame_duration);
 #endif
 
-  if (elapsed >= frame_duration)
+  /* the smallest snap to the nearest key frame and draw it unblended */
+  if ((level > 1) && (m->anim_state.t != 0.0f))
   {
-    /* tick the frame to the next key frame */
-    m->anim_state.frame++;
-    m->anim_state.frame = m->anim_state.next_frame;
-    m->anim_state.next_frame = get_next_frame(&m->anim_state);
-    m->anim_state.last_time = now;
+    if (m->anim_state.t >= 0.5f)
+    {
+      /* shown early; the ticks after wait for the clock to catch up */
+      m->anim_state.frame = m->anim_state.next_frame;
+      m->anim_state.next_frame = get_next_frame(wptr, m);
+      m->anim_state.last_time += frame_duration;
+    }
     m->anim_state.t = 0;
   }
+
+  /* the next key frame, or the next update it may have */
+  m->anim_due = (level ? next_slot : (m->anim_state.last_time + frame_duration));
+
+  prof_end(PROF_TICK, start);
+}
+
+/*
+ *	The animation updates a second an instance has when small on the
+ *	screen: its own budget, or the world's if it has none.  0 if it
+ *	runs at full rate.
+ */
+static float
+world_anim_budget(struct world_t* wptr, md3_instance_t* m)
+{
+  float budget = (m->anim_budget ? m->anim_budget : wptr->anim_budget);
+
+  return ((budget > 0.0f) ? budget : 0.0f);
+}
+
+/*
+ *	The animation level of detail of an instance by its size on the
+ *	screen when last drawn: 0 updates every frame, 1 at its budget,
+ *	2 at half its budget and snapped to key frames.
+ */
+static int
+world_anim_level(struct world_t* wptr, md3_instance_t* m)
+{
+  int pixels = ATOMIC_LOAD(&m->screen_pixels);
+
+  /* never drawn, or big enough */
+  if (!pixels || (pixels >= ANIM_LOD_PIXELS))
+    return 0;
+
+  /* no budget; it keeps to its key frames */
+  if (!world_anim_budget(wptr, m))
+    return 0;
+
+  return ((pixels >= (ANIM_LOD_PIXELS / 2)) ? 1 : 2);
 }
 
 /*
- *	Get the next frame for the animation state.
+ *	Check if a small instance is due an animation update: once in
+ *	each period of its budget, at its own phase of the period, so
+ *	the instances take turns.  next is set to when the next period
+ *	starts.
  */
 static int
-get_next_frame(md3_anim_state_t* as)
+world_anim_due(struct world_t* wptr, md3_instance_t* m, double now, int level, double* next)
 {
-  int next = (as->frame + 1);
+  double period, slot;
+
+  period = ((1000.0 / (double)world_anim_budget(wptr, m)) * level);
+  slot = floor((now / period) - (double)m->anim_phase);
+  *next = ((slot + 1.0 + (double)m->anim_phase) * period);
+  if (slot == m->anim_slot)
+    return 0;
+
+  m->anim_slot = slot;
+  return 1;
+}
 
-  if (next > g_world->anims[as->id].last_frame)
+/*
+ *	Check if an instance or any instance linked to it is animating.
+ */
+int
+world_is_animating(md3_instance_t* inst)
+{
+  int i = 0;
+
+  if (!inst)
+    return 0;
+
+  if (inst->anim_state.animated)
+    return 1;
+
+  for (; i < inst->num_links; ++i)
+  {
+    if (world_is_animating(inst->links[i]))
+      return 1;
+  }
+
+  return 0;
+}
+
+/*
+ *	Get the next frame for the animation state of the instance.
+ */
+static int
+get_next_frame(struct world_t* wptr, md3_instance_t* m)
+{
+  md3_anim_t* anim = &m->model->anims[m->anim_state.id];
+  int next = (m->anim_state.frame + 1);
+
+  if (next > anim->last_frame)
     /* when looping we start at loop, not at the first frame unless explicitly told to */
-    return (WORLD_IS_SET(RENDER_ANIM_LOOP) ? g_world->anims[as->id].first_frame : g_world->anims[as->id].loop);
+    return (WORLD_ANIM_IS_SET(wptr, RENDER_ANIM_LOOP) ? anim->first_frame : anim->loop);
   return next;
 }
 
@@ -512,9 +1068,12 @@ get_next_frame(md3_anim_state_t* as)
  *		Z_AXIS
  */
 void
-rotate_model(md3_body_parts_e type, int axis, float degree)
+rotate_model(struct world_t* wptr, md3_body_parts_e type, int axis, float degree)
 {
-  _rotate_model(type, axis, degree, 0);
+  if (sim_post(wptr->sim, SIM_ROTATE, type, axis, degree))
+    return;
+  world_redraw(wptr);
+  _rotate_model(wptr, type, axis, degree, 0);
 }
 
 /*
@@ -526,9 +1085,12 @@ rotate_model(md3_body_parts_e type, int axis, float degree)
  *		Z_AXIS
  */
 void
-rotate_model_absolute(md3_body_parts_e type, int axis, float degree)
+rotate_model_absolute(struct world_t* wptr, md3_body_parts_e type, int axis, float degree)
 {
-  _rotate_model(type, axis, degree, 1);
+  if (sim_post(wptr->sim, SIM_ROTATE_ABSOLUTE, type, axis, degree))
+    return;
+  world_redraw(wptr);
+  _rotate_model(wptr, type, axis, degree, 1);
 }
 
 /*
@@ -542,28 +1104,33 @@ rotate_model_absolute(md3_body_parts_e type, int axis, float degree)
  *	Exclude can be any MD3_BODY_PARTS OR'ed togther that will not be applied.
  */
 void
-rotate_all_models_absolute(int axis, float degree, unsigned int exclude)
+rotate_all_models_absolute(struct world_t* wptr, int axis, float degree, unsigned int exclude)
 {
-  struct world_link_models_t* ln = g_world->models;
+  struct world_link_instances_t* ln = wptr->instances;
+
+  if (sim_post(wptr->sim, SIM_ROTATE_ALL_ABSOLUTE, exclude, axis, degree))
+    return;
+  world_redraw(wptr);
+
   while (ln)
   {
-    if (!ln->model)
+    if (!ln->instance)
     {
       ln = ln->next;
       continue;
     }
 
-    if ((ln->model->body_part & exclude) == exclude)
+    if ((ln->instance->body_part & exclude) == exclude)
     {
       /* skip this one */
       ln = ln->next;
       continue;
     }
 
-    ln->model->rot[axis] = degree;
+    ln->instance->rot[axis] = degree;
 
     /* modulate axis rotation to be between 0 and 359 */
-    ln->model->rot[axis] = FLOAT_MOD(ln->model->rot[axis], 360);
+    ln->instance->rot[axis] = FLOAT_MOD(ln->instance->rot[axis], 360);
 
     ln = ln->next;
   }
@@ -575,15 +1142,15 @@ rotate_all_models_absolute(int axis, float degree, unsigned int exclude)
  *		rotate_model_absolute()
  */
 static void
-_rotate_model(md3_body_parts_e type, int axis, float degree, int absolute)
+_rotate_model(struct world_t* wptr, md3_body_parts_e type, int axis, float degree, int absolute)
 {
-  md3_model_t* m = NULL;
+  md3_instance_t* m = NULL;
 
   if ((axis != X_AXIS) && (axis != Y_AXIS) && (axis != Z_AXIS))
     /* not a valid axis */
     return;
 
-  m = world_get_model_by_type(type);
+  m = world_get_instance_by_type(wptr, type);
   if (!m)
     return;
 
@@ -600,10 +1167,15 @@ _rotate_model(md3_body_parts_e type, int axis, float degree, int absolute)
  *	Set the scale factor for a given body part.
  */
 void
-scale_model(md3_body_parts_e type, float factor)
+scale_model(struct world_t* wptr, md3_body_parts_e type, float factor)
 {
-  md3_model_t* m = NULL;
-  m = world_get_model_by_type(type);
+  md3_instance_t* m = NULL;
+
+  if (sim_post(wptr->sim, SIM_SCALE, type, 0, factor))
+    return;
+  world_redraw(wptr);
+
+  m = world_get_instance_by_type(wptr, type);
   if (!m)
     return;
   m->scale_factor = factor;
@@ -615,29 +1187,59 @@ scale_model(md3_body_parts_e type, float factor)
  *	Exclude can be any MD3_BODY_PARTS OR'ed togther that will not be applied.
  */
 void
-scale_all_models(float factor, unsigned int exclude)
+scale_all_models(struct world_t* wptr, float factor, unsigned int exclude)
 {
-  struct world_link_models_t* ln = g_world->models;
+  struct world_link_instances_t* ln = wptr->instances;
+
+  if (sim_post(wptr->sim, SIM_SCALE_ALL, exclude, 0, factor))
+    return;
+  world_redraw(wptr);
+
   while (ln)
   {
-    if (!ln->model)
+    if (!ln->instance)
     {
       ln = ln->next;
       continue;
     }
 
-    if ((ln->model->body_part & exclude) == exclude)
+    if ((ln->instance->body_part & exclude) == exclude)
     {
       /* skip this one */
       ln = ln->next;
       continue;
     }
 
-    ln->model->scale_factor = factor;
+    ln->instance->scale_factor = factor;
     ln = ln->next;
   }
 }
 
+/*
+ *	Set the animation updates a second of a body part while it is
+ *	small on the screen: 0 takes the world's budget, and a negative
+ *	budget keeps it at full rate.
+ */
+void
+world_set_instance_anim_budget(struct world_t* wptr, md3_body_parts_e type, float budget)
+{
+  md3_instance_t* m = NULL;
+
+  if (sim_post(wptr->sim, SIM_ANIM_BUDGET, type, 0, budget))
+    return;
+  world_redraw(wptr);
+
+  m = world_get_instance_by_type(wptr, type);
+  if (!m)
+    return;
+
+  m->anim_budget = budget;
+
+  /* its next update may come sooner */
+  m->anim_due = 0.0;
+  anim_sched_update(m);
+}
+
 /*
  *	Enable the rendering options specified by enable.
  *	Disable the rendering options specified by disable.
@@ -648,6 +1250,8 @@ scale_all_models(float factor, unsigned int exclude)
 void
 world_set_options(struct world_t* wptr, int enable, int disable)
 {
+  int old = wptr->flags;
+
   /* remove mutually exclusive bits */
   int tmp = enable;
   tmp &= ~disable;
@@ -656,6 +1260,16 @@ world_set_options(struct world_t* wptr, int enable, int disable)
 
   wptr->flags |= enable;
   wptr->flags &= ~disable;
+
+  /* let the animation tick know */
+  if ((old ^ wptr->flags) & WORLD_ANIM_FLAGS)
+  {
+    if (!sim_post(wptr->sim, SIM_OPTIONS, (wptr->flags & WORLD_ANIM_FLAGS), 0, 0.0f))
+      ATOMIC_STORE(&wptr->anim_flags, (wptr->flags & WORLD_ANIM_FLAGS));
+  }
+
+  if (old != wptr->flags)
+    world_redraw(wptr);
 }
 
 /*
@@ -667,6 +1281,109 @@ void
 world_set_camera_distance(struct world_t* wptr, float distance)
 {
   wptr->camera.r = distance;
+  world_redraw(wptr);
+}
+
+/*
+ *	Ask the view for a new frame after changing the world.
+ *
+ *	The view only draws when asked, or on its own while something
+ *	is animating.  The simulation thread asks once it has published
+ *	the change, so calls from it are ignored here.
+ */
+void
+world_redraw(struct world_t* wptr)
+{
+  if (!wptr->redraw || sim_is_current(wptr->sim))
+    return;
+
+  wptr->redraw(wptr->redraw_data);
+}
+
+/*
+ *	Tick the animations by the wall clock.  This is the default.
+ */
+void
+world_clock_real(struct world_t* wptr)
+{
+  sim_lock(wptr->sim);
+  free(wptr->clock.script);
+  memset(&wptr->clock, 0, sizeof(struct world_clock_t));
+  wptr->clock.mode = WORLD_CLOCK_REAL;
+  sim_unlock(wptr->sim);
+}
+
+/*
+ *	Tick the animations by a virtual clock, the first frame at start
+ *	and every frame after step milliseconds later.
+ */
+void
+world_clock_fixed(struct world_t* wptr, double start, double step)
+{
+  sim_lock(wptr->sim);
+  free(wptr->clock.script);
+  memset(&wptr->clock, 0, sizeof(struct world_clock_t));
+  wptr->clock.mode = WORLD_CLOCK_FIXED;
+  wptr->clock.now = start;
+  wptr->clock.step = step;
+  sim_unlock(wptr->sim);
+}
+
+/*
+ *	Tick the animations by a virtual clock giving each frame the
+ *	next of the times; after the last the clock stops there.
+ */
+void
+world_clock_script(struct world_t* wptr, double* times, int num_times)
+{
+  if (num_times < 1)
+  {
+    world_clock_fixed(wptr, 0.0, 0.0);
+    return;
+  }
+
+  sim_lock(wptr->sim);
+  free(wptr->clock.script);
+  memset(&wptr->clock, 0, sizeof(struct world_clock_t));
+  wptr->clock.mode = WORLD_CLOCK_SCRIPT;
+  wptr->clock.script = (double*)malloc(sizeof(double) * num_times);
+  memcpy(wptr->clock.script, times, (sizeof(double) * num_times));
+  wptr->clock.script_len = num_times;
+  wptr->clock.now = times[0];
+  sim_unlock(wptr->sim);
+}
+
+/*
+ *	Get the time of the next frame without moving the clock;
+ *	animations set now start from it.
+ */
+double
+world_clock_now(struct world_t* wptr)
+{
+  if (wptr->clock.mode == WORLD_CLOCK_REAL)
+    return get_time_in_ms();
+
+  return wptr->clock.now;
+}
+
+/*
+ *	Get the time of a new frame and move a virtual clock on to the next.
+ *
+ *	Only the thread ticking the world calls this, once per frame
+ *	or simulation step.
+ */
+double
+world_clock_next(struct world_t* wptr)
+{
+  struct world_clock_t* c = &wptr->clock;
+  double now = world_clock_now(wptr);
+
+  if (c->mode == WORLD_CLOCK_FIXED)
+    c->now += c->step;
+  else if ((c->mode == WORLD_CLOCK_SCRIPT) && (c->script_pos < (c->script_len - 1)))
+    c->now = c->script[++c->script_pos];
+
+  return now;
 }
 
 /*
@@ -702,22 +1419,31 @@ apply_material(struct material_t* material)
 
 /*
  *	Bind the texture within OpenGL.
+ *
+ *	Each world uploads the textures it draws to its own context,
+ *	the first time it draws each; the image is the cache's and is
+ *	kept as long as the model holding it.
  */
 void
-apply_texture(md3_shader_t* sptr)
+apply_texture(struct world_t* wptr, md3_shader_t* sptr)
 {
+  unsigned int* name;
+
   /* if no texture exists, it cannot be bound */
-  if (!sptr->texture)
+  if (!sptr->texture || (sptr->gl_slot < 0))
     return;
 
-  if (sptr->gl_text_bound && !*sptr->gl_text_bound)
+  name = world_gl_slot(&wptr->objects.texts, &wptr->objects.num_texts, sptr->gl_slot, 1);
+  if (!*name)
   {
+    double start = trace_begin();
+
     /*
      *	Bind the texture within OpenGL if it has not already been done.
      *	This speeds up rendering.
      */
-    glGenTextures(1, sptr->gl_text_id);
-    glBindTexture(GL_TEXTURE_2D, *sptr->gl_text_id);
+    glGenTextures(1, name);
+    glBindTexture(GL_TEXTURE_2D, *name);
     glTexImage2D(
       GL_TEXTURE_2D,
       0,
@@ -735,11 +1461,12 @@ apply_texture(md3_shader_t* sptr)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
-    *sptr->gl_text_bound = 1;
+    gl_state_forget(&wptr->gl, GL_STATE_TEXTURE);
+    trace_end("texture_upload", start);
   }
 
-  /* Apply the texture */
-  glBindTexture(GL_TEXTURE_2D, *sptr->gl_text_id);
+  /* Apply the texture; most surfaces share the last one's */
+  gl_state_bind_texture(&wptr->gl, *name);
 }
 
 /*
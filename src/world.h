@@ -21,6 +21,10 @@
 
 #include "md3_parse.h"
 #include "tga.h"
+#include "crowd.h"
+#include "anim_sched.h"
+#include "gl_state.h"
+#include "thread.h"
 
 #define X_AXIS 0
 #define Y_AXIS 1
@@ -38,10 +42,43 @@
 #define ENGINE_INTERPOLATE 0x040
 #define ENGINE_AA 0x080
 #define ENGINE_DEPTH_OF_FIELD 0x100
+#define ENGINE_COMPACT_FRAMES 0x200
+#define ENGINE_FAST_SLERP 0x400
+#define ENGINE_OPTIMIZE_TRIANGLES 0x800
+#define ENGINE_OPTIMIZE_OVERDRAW 0x1000
+#define ENGINE_FRUSTUM_CULL 0x2000
+#define ENGINE_LOD 0x4000
+#define ENGINE_ANIM_LOD 0x8000
 
-#define WORLD_DEFAULT_FLAGS (RENDER_TEXTURES | ENGINE_LIGHTING | ENGINE_INTERPOLATE)
+#define WORLD_DEFAULT_FLAGS (RENDER_TEXTURES | ENGINE_LIGHTING | ENGINE_INTERPOLATE | ENGINE_FRUSTUM_CULL)
 
-#define WORLD_IS_SET(flag) ((g_world->flags & flag) == flag)
+#define WORLD_IS_SET(wptr, flag) (((wptr)->flags & flag) == flag)
+
+/*
+ *	Flags read by the animation tick, which may run on the simulation thread.
+ */
+#define WORLD_ANIM_FLAGS (RENDER_ANIM_LOOP | ENGINE_INTERPOLATE | ENGINE_FAST_SLERP | ENGINE_ANIM_LOD)
+
+/*
+ *	Flags that change the model data as it is loaded; a cached model
+ *	is only shared with loads under the same ones.
+ */
+#define WORLD_LOAD_FLAGS (ENGINE_COMPACT_FRAMES | ENGINE_OPTIMIZE_TRIANGLES | ENGINE_OPTIMIZE_OVERDRAW | ENGINE_LOD)
+
+/* the animation flags, which the simulation thread may be changing */
+#define WORLD_ANIM_IS_SET(wptr, flag) ((ATOMIC_LOAD(&(wptr)->anim_flags) & flag) == flag)
+
+/*
+ *	Animation level of detail (ENGINE_ANIM_LOD).  A part under
+ *	ANIM_LOD_PIXELS on the screen updates its animation at most its
+ *	budget times a second; under half that, half as often again and
+ *	snapped to the nearest key frame.  Each instance updates at its
+ *	own phase of the period, ANIM_LOD_STAGGER apart, so the updates
+ *	spread evenly over the frames.
+ */
+#define ANIM_LOD_PIXELS 32
+#define ANIM_LOD_BUDGET 15.0f
+#define ANIM_LOD_STAGGER 0.6180339887
 
 #define DEFAULT_CAMERA_TROT 45
 #define DEFAULT_CAMERA_PROT 15
@@ -60,20 +97,32 @@
 #define DEFAULT_TORSO_ANIM TORSO_STAND
 #define DEFAULT_LEGS_ANIM LEGS_IDLE
 
-#define SET_DEFAULT_ANIMATIONS()      \
-  do                                  \
-  {                                   \
-    set_model_animation(LEGS_IDLE);   \
-    set_model_animation(TORSO_STAND); \
+#define SET_DEFAULT_ANIMATIONS(wptr)        \
+  do                                        \
+  {                                         \
+    set_model_animation(wptr, LEGS_IDLE);   \
+    set_model_animation(wptr, TORSO_STAND); \
   } while (0)
 
 /*
- *	Linked list of models.
+ *	Linked list of model instances.
+ */
+struct world_link_instances_t
+{
+  struct world_link_instances_t* next;
+  md3_instance_t* instance;
+};
+
+/*
+ *	Linked list of shared model data.
  */
-struct world_link_models_t
+struct world_model_t
 {
-  struct world_link_models_t* next;
+  struct world_model_t* next;
   md3_model_t* model;
+  char* name;
+  int options; /* the WORLD_LOAD_FLAGS it was loaded with */
+  int binds;   /* how many instances are using this model */
 };
 
 /*
@@ -84,9 +133,41 @@ struct world_texture_t
   struct world_texture_t* next;
   struct tga_t* text;
   char* name;
-  int binds;               /* how many models are using this texture								*/
-  unsigned int gl_text_id; /* the GL texture identifier; md3_surface_t.gl_text_id points to this	*/
-  int gl_text_bound;       /* is texture bound?; md3_surface_t.gl_text_bound points to this		*/
+  int binds; /* how many models are using this texture					*/
+  int slot;  /* of its GL name in each world; md3_shader_t.gl_slot is this	*/
+};
+
+/*
+ *	Model data and textures; may be shared by several worlds.
+ *
+ *	The cache holds no GL objects, as the worlds sharing it may draw
+ *	in contexts of their own.  It gives each texture and surface a
+ *	slot instead, never reused, and each world keeps the GL objects
+ *	it made for them by slot in its world_gl_t.
+ */
+struct world_cache_t
+{
+  mutex_t lock;                  /* guards the lists, the counts and the slots	*/
+  struct world_model_t* models;  /* shared model data								*/
+  struct world_texture_t* texts; /* textures										*/
+  int worlds;                    /* worlds using the cache						*/
+  int text_slots;                /* slots given to textures						*/
+  int surface_slots;             /* and to surfaces								*/
+  int lock_waits;                /* times a thread found the lock taken			*/
+  double lock_wait_ms;           /* and waited for it							*/
+};
+
+/*
+ *	The GL objects a world made in its context for the cache's
+ *	textures and surfaces, by their slots; 0 until made.  Only the
+ *	thread drawing the world touches them.
+ */
+struct world_gl_t
+{
+  unsigned int* texts;   /* texture names								*/
+  int num_texts;
+  unsigned int* buffers; /* vertex, texcoord and index buffers, three a slot	*/
+  int num_buffers;       /* slots										*/
 };
 
 /* camera stuff */
@@ -135,7 +216,7 @@ struct light_t
   double dir_trot;
   double dir_prot;
 
-  md3_model_t* model; /* model for this light - if needed */
+  md3_instance_t* model; /* model for this light - if needed */
 };
 
 /* material information */
@@ -148,6 +229,46 @@ struct material_t
   GLfloat shininess;
 };
 
+/*
+ *	Where the animation time comes from.
+ */
+typedef enum
+{
+  WORLD_CLOCK_REAL,  /* the wall clock								*/
+  WORLD_CLOCK_FIXED, /* a fixed step per frame from a start time		*/
+  WORLD_CLOCK_SCRIPT /* a list of times, one per frame; the last holds	*/
+} world_clock_e;
+
+/*
+ *	The clock the animations are ticked by.
+ *
+ *	Read with world_clock_next() once per frame, by the thread ticking
+ *	the world: the simulation thread while it runs, else the renderer.
+ */
+struct world_clock_t
+{
+  world_clock_e mode;
+  double now;     /* milliseconds; the next frame's for a virtual clock	*/
+  double step;    /* added after each frame (fixed)						*/
+  double* script; /* frame times (script)								*/
+  int script_len;
+  int script_pos; /* next entry of the script							*/
+};
+
+/*
+ *	What the frustum culling tested and skipped in the frame
+ *	being drawn; the mirror passes count again.
+ */
+struct world_cull_t
+{
+  int parts;
+  int parts_culled;
+  int surfaces;
+  int surfaces_culled;
+  int triangles_culled;
+  int triangles_lod; /* left out by drawing coarser levels of detail	*/
+};
+
 struct mirror_t
 {
   struct mirror_t* next;
@@ -165,11 +286,9 @@ struct mirror_t
  */
 struct world_t
 {
-  md3_model_t* root_model;            /* root model - start of render tree				*/
-  struct world_link_models_t* models; /* array of model parts	(not needed for rendering)	*/
-  struct world_texture_t* texts;      /* array of textures								*/
-
-  md3_anim_t anims[MD3_MAX_ANIMS]; /* animation data				*/
+  md3_instance_t* root_instance;            /* root instance - start of render tree			*/
+  struct world_link_instances_t* instances; /* array of model parts	(not needed for rendering)	*/
+  struct world_cache_t* cache;              /* shared model data and textures					*/
 
   struct camera_t camera;  /* camera position				*/
   struct env_t env;        /* environment settings			*/
@@ -182,6 +301,26 @@ struct world_t
   unsigned int gl_plane_id; /* call list id for tes plane		*/
   struct mirror_t* mirrors; /* list of mirrors					*/
   int model_triangles;      /* total triangles for a model		*/
+  struct world_cull_t cull; /* parts culled this frame			*/
+  int lod_level;            /* level of detail for every part; -1 picks by size	*/
+  int viewport_height;      /* in pixels, for picking the level of detail		*/
+  int mirror_pass;          /* drawing the reflections						*/
+  int unlit_pass;           /* drawing the flashlight, lighting off			*/
+  float anim_budget;        /* animation updates per second of small parts	*/
+  struct gl_state_t gl;     /* GL state set this frame, to skip setting it again	*/
+
+  struct crowd_t crowd;      /* crowd of root model copies		*/
+  struct anim_sched_t sched; /* animation scheduler of the instances	*/
+  struct world_gl_t objects; /* GL objects of the cached textures and surfaces	*/
+
+  struct sim_t* sim; /* simulation thread; NULL animates on the GUI thread	*/
+  int anim_flags;    /* WORLD_ANIM_FLAGS as the simulation sees them		*/
+
+  void (*redraw)(void* data); /* asks the view for a new frame; any thread	*/
+  void* redraw_data;
+
+  struct world_clock_t clock; /* animation time							*/
+  double time;                /* when the frame being drawn is, in clock time	*/
 };
 
 #ifdef __cplusplus
@@ -189,44 +328,64 @@ extern "C"
 {
 #endif
 
-  struct world_t* world_init();
+  struct world_t* world_init(struct world_cache_t* cache);
   void world_free(struct world_t* wptr);
 
-  void world_add_model(struct world_t* wptr, md3_model_t* mptr, int root);
-  void world_del_model(struct world_t* wptr, md3_model_t* mptr);
+  void world_add_instance(struct world_t* wptr, md3_instance_t* iptr, int root);
+  void world_del_instance(struct world_t* wptr, md3_instance_t* iptr);
+
+  void world_link_instance(struct world_t* wptr, md3_instance_t* iptr);
+  void world_delink_instance(struct world_t* wptr, md3_instance_t* iptr);
+
+  void world_add_model(struct world_t* wptr, md3_model_t* mptr, char* name);
+  void world_using_model(struct world_t* wptr, md3_model_t* mptr);
+  void world_not_using_model(struct world_t* wptr, md3_model_t* mptr);
 
-  void world_link_model(struct world_t* wptr, md3_model_t* mptr);
-  void world_delink_model(struct world_t* wptr, md3_model_t* mptr);
+  md3_model_t* world_model_cached(struct world_t* wptr, char* name);
 
   void world_add_texture(struct world_t* wptr, struct tga_t* tptr, char* name, md3_shader_t* sptr);
-  void world_del_texture(struct world_t* wptr, struct tga_t* text);
   void world_using_texture(struct world_t* wptr, struct tga_t* text);
   void world_not_using_texture(struct world_t* wptr, struct tga_t* text);
 
   struct tga_t* world_texture_cached(struct world_t* wptr, char* name, md3_shader_t* sptr);
 
-  md3_model_t* world_get_model_by_name(char* name);
-  md3_model_t* world_get_model_by_type(md3_body_parts_e type);
+  unsigned int world_texture_name(struct world_t* wptr, md3_shader_t* sptr);
+  unsigned int* world_surface_buffers(struct world_t* wptr, md3_surface_t* sptr);
 
-  void set_model_animation(md3_animations_e id);
-  void world_stop_model_animation(int model_types);
+  md3_instance_t* world_get_instance_by_name(struct world_t* wptr, char* name);
+  md3_instance_t* world_get_instance_by_type(struct world_t* wptr, md3_body_parts_e type);
 
-  void world_tick_model(md3_model_t* m);
+  void set_model_animation(struct world_t* wptr, md3_animations_e id);
+  void world_set_instance_animation(struct world_t* wptr, md3_instance_t* m, md3_animations_e id, float phase);
+  void world_hold_instance_animation(struct world_t* wptr, md3_instance_t* m, float frames);
+  void world_stop_model_animation(struct world_t* wptr, int model_types);
 
-  void rotate_model(md3_body_parts_e type, int axis, float degree);
-  void rotate_model_absolute(md3_body_parts_e type, int axis, float degree);
-  void rotate_all_models_absolute(int axis, float degree, unsigned int exclude);
+  void world_tick_model(struct world_t* wptr, md3_instance_t* m, double now);
+  int world_is_animating(md3_instance_t* inst);
 
-  void scale_model(md3_body_parts_e type, float factor);
-  void scale_all_models(float factor, unsigned int exclude);
+  void rotate_model(struct world_t* wptr, md3_body_parts_e type, int axis, float degree);
+  void rotate_model_absolute(struct world_t* wptr, md3_body_parts_e type, int axis, float degree);
+  void rotate_all_models_absolute(struct world_t* wptr, int axis, float degree, unsigned int exclude);
+
+  void scale_model(struct world_t* wptr, md3_body_parts_e type, float factor);
+  void scale_all_models(struct world_t* wptr, float factor, unsigned int exclude);
+
+  void world_set_instance_anim_budget(struct world_t* wptr, md3_body_parts_e type, float budget);
 
   void world_set_options(struct world_t* wptr, int enable, int disable);
 
   void world_set_camera_distance(struct world_t* wptr, float distance);
+  void world_redraw(struct world_t* wptr);
+
+  void world_clock_real(struct world_t* wptr);
+  void world_clock_fixed(struct world_t* wptr, double start, double step);
+  void world_clock_script(struct world_t* wptr, double* times, int num_times);
+  double world_clock_now(struct world_t* wptr);
+  double world_clock_next(struct world_t* wptr);
 
   void apply_light(GLenum gllight, struct light_t* light);
   void apply_material(struct material_t* material);
-  void apply_texture(md3_shader_t* sptr);
+  void apply_texture(struct world_t* wptr, md3_shader_t* sptr);
 
   void init_light(struct light_t* light);
   void init_camera(struct camera_t* camera);